@@ -0,0 +1,95 @@
+#include <benchmark/benchmark.h>
+#include <malloc.h>
+#include <string>
+#include <vector>
+
+#include "storage/shard.h"
+
+using namespace redis;
+
+// the entry shards stored before values were encoded: every value is a heap vector
+struct BytesEntry
+{
+    bytes value;
+    int64_t expire_at = NO_EXPIRY;
+    int64_t timer_at = NO_EXPIRY;
+};
+
+// large tables are mmapped by malloc, they are not part of uordblks. Shards map their arenas themselves, they are
+// not seen by malloc at all: BM_ShardAccounting reports them.
+size_t heap_in_use()
+{
+    const auto info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+// the value of the key i: a short string, or a counter for one key out of two
+std::string make_value(const int64_t i) { return i % 2 == 0 ? "v:" + std::to_string(i % 1'000'000) : std::to_string(i); }
+
+template<typename Fill>
+void measure(benchmark::State& state, Fill&& fill)
+{
+    const auto keys = state.range(0);
+    for (auto _: state)
+    {
+        const auto before = heap_in_use();
+        auto store = fill(keys);
+        const auto used = heap_in_use() - before;
+        state.counters["bytes_per_key"] = static_cast<double>(used) / static_cast<double>(keys);
+        state.counters["heap_mb"] = static_cast<double>(used) / (1 << 20);
+        benchmark::DoNotOptimize(store);
+    }
+}
+
+void BM_BytesValues(benchmark::State& state)
+{
+    measure(state,
+            [](const int64_t keys)
+            {
+                auto dict = std::make_unique<Dict<BytesEntry>>();
+                for (int64_t i = 0; i < keys; ++i)
+                {
+                    const auto value = make_value(i);
+                    dict->try_emplace("key:" + std::to_string(i)).first->value.assign(value.begin(), value.end());
+                }
+                return dict;
+            });
+}
+
+void BM_EncodedValues(benchmark::State& state)
+{
+    measure(state,
+            [](const int64_t keys)
+            {
+                auto shard = std::make_unique<Shard>();
+                for (int64_t i = 0; i < keys; ++i)
+                {
+                    shard->set("key:" + std::to_string(i), make_value(i));
+                }
+                return shard;
+            });
+}
+
+// the same keys, reported by the accounting of the shard instead of malloc
+void BM_ShardAccounting(benchmark::State& state)
+{
+    const auto keys = state.range(0);
+    for (auto _: state)
+    {
+        Shard shard;
+        for (int64_t i = 0; i < keys; ++i)
+        {
+            shard.set("key:" + std::to_string(i), make_value(i));
+        }
+        const auto memory = shard.stats().memory;
+        state.counters["used_per_key"] = static_cast<double>(memory.used) / static_cast<double>(keys);
+        state.counters["resident_per_key"] = static_cast<double>(memory.resident) / static_cast<double>(keys);
+        state.counters["fragmentation"] = static_cast<double>(memory.resident) / static_cast<double>(memory.used);
+    }
+}
+
+BENCHMARK(BM_BytesValues)->Arg(10'000'000)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_EncodedValues)->Arg(10'000'000)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ShardAccounting)->Arg(10'000'000)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
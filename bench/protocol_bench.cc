@@ -0,0 +1,224 @@
+#include <benchmark/benchmark.h>
+#include <photon/common/alog.h>
+#include <photon/common/utility.h>
+#include <photon/photon.h>
+#include <string>
+#include <vector>
+
+#include "framer/decoder.h"
+#include "framer/handler.h"
+#include "memory_stream/mstream.h"
+
+using namespace redis;
+
+// The request path, from the bytes of a connection to a command: Handler::decode over a MemoryStream, the encoding of
+// frames and the command lookup. Every benchmark reports bytes/s and items/s, compare runs against a baseline with
+//   protocol_bench --benchmark_out=baseline.json --benchmark_out_format=json
+// and the compare.py tool of Google Benchmark.
+
+// command returns the RESP encoding of a request, an array of bulk strings
+std::string command(const std::initializer_list<std::string_view> args)
+{
+    auto encoded = "*" + std::to_string(args.size()) + "\r\n";
+    for (const auto arg: args)
+    {
+        encoded += "$" + std::to_string(arg.size()) + "\r\n";
+        encoded += arg;
+        encoded += "\r\n";
+    }
+    return encoded;
+}
+
+// Corpus is what a client sends at once: frames requests, encoded back to back
+struct Corpus
+{
+    std::string bytes;
+    int64_t frames;
+};
+
+Corpus small_get_set() { return {command({"SET", "key:1", "value:1"}) + command({"GET", "key:1"}), 2}; }
+
+// a pipelining client, like redis-benchmark -P 64
+Corpus pipeline()
+{
+    Corpus corpus{{}, 64};
+    for (int i = 0; i < corpus.frames; i += 2)
+    {
+        const auto key = "key:" + std::to_string(i);
+        corpus.bytes += command({"SET", key, "value:" + std::to_string(i)});
+        corpus.bytes += command({"GET", key});
+    }
+    return corpus;
+}
+
+Corpus large_bulk() { return {command({"SET", "large", std::string(1 << 20, 'x')}), 1}; }
+
+// arrays nested as deep as MAX_RECURSION_DEPTH allows, each with a bulk string next to the nested one
+Corpus nested_arrays()
+{
+    Corpus corpus{{}, 1};
+    for (int depth = 0; depth < MAX_RECURSION_DEPTH - 1; ++depth)
+    {
+        corpus.bytes += "*2\r\n$4\r\nnode\r\n";
+    }
+    corpus.bytes += "*0\r\n";
+    return corpus;
+}
+
+// frames_of decodes the frames of corpus into owning copies
+std::vector<Frame> frames_of(const Corpus& corpus)
+{
+    Decoder decoder;
+    std::vector<Frame> frames;
+    size_t offset = 0;
+    while (offset < corpus.bytes.size())
+    {
+        size_t consumed = 0;
+        auto frame = decoder.decode(std::span(corpus.bytes).subspan(offset), consumed);
+        offset += consumed;
+        frames.push_back(std::move(frame.value()));
+    }
+    return frames;
+}
+
+void set_processed(benchmark::State& state, const Corpus& corpus)
+{
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(corpus.bytes.size()));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * corpus.frames);
+}
+
+// handler_decode sends corpus to a handler and decodes every frame of it, as an owning copy or a view
+template<bool View>
+void handler_decode(benchmark::State& state, const Corpus& corpus)
+{
+    auto [client, server] = MemoryStream::duplex(corpus.bytes.size());
+    Handler handler(std::move(server), 16 * 1024);
+    for (auto _: state)
+    {
+        client->write(corpus.bytes.data(), corpus.bytes.size());
+        for (int64_t i = 0; i < corpus.frames; ++i)
+        {
+            if constexpr (View)
+            {
+                auto frame = handler.decode_view(MAX_RECURSION_DEPTH);
+                if (frame.is_error())
+                {
+                    state.SkipWithError("the corpus could not be decoded");
+                    return;
+                }
+                benchmark::DoNotOptimize(frame);
+            }
+            else
+            {
+                auto frame = handler.decode(MAX_RECURSION_DEPTH);
+                if (frame.is_error())
+                {
+                    state.SkipWithError("the corpus could not be decoded");
+                    return;
+                }
+                benchmark::DoNotOptimize(frame);
+            }
+        }
+    }
+    set_processed(state, corpus);
+}
+
+void BM_HandlerDecode(benchmark::State& state, const Corpus& corpus) { handler_decode<false>(state, corpus); }
+void BM_HandlerDecodeView(benchmark::State& state, const Corpus& corpus) { handler_decode<true>(state, corpus); }
+
+BENCHMARK_CAPTURE(BM_HandlerDecode, small, small_get_set());
+BENCHMARK_CAPTURE(BM_HandlerDecode, pipeline, pipeline());
+BENCHMARK_CAPTURE(BM_HandlerDecode, large_bulk, large_bulk());
+BENCHMARK_CAPTURE(BM_HandlerDecode, nested, nested_arrays());
+BENCHMARK_CAPTURE(BM_HandlerDecodeView, small, small_get_set());
+BENCHMARK_CAPTURE(BM_HandlerDecodeView, pipeline, pipeline());
+BENCHMARK_CAPTURE(BM_HandlerDecodeView, large_bulk, large_bulk());
+BENCHMARK_CAPTURE(BM_HandlerDecodeView, nested, nested_arrays());
+
+// frame_encode encodes the frames of corpus back, with as_bytes or into a reused IOBuffer
+template<bool Buffer>
+void frame_encode(benchmark::State& state, const Corpus& corpus)
+{
+    const auto frames = frames_of(corpus);
+    IOBuffer out;
+    for (auto _: state)
+    {
+        for (const auto& frame: frames)
+        {
+            if constexpr (Buffer)
+            {
+                frame.encode_to(out);
+            }
+            else
+            {
+                auto bytes = frame.as_bytes();
+                benchmark::DoNotOptimize(bytes.data());
+            }
+        }
+        out.clear();
+    }
+    set_processed(state, corpus);
+}
+
+void BM_FrameAsBytes(benchmark::State& state, const Corpus& corpus) { frame_encode<false>(state, corpus); }
+void BM_FrameEncodeTo(benchmark::State& state, const Corpus& corpus) { frame_encode<true>(state, corpus); }
+
+BENCHMARK_CAPTURE(BM_FrameAsBytes, small, small_get_set());
+BENCHMARK_CAPTURE(BM_FrameAsBytes, pipeline, pipeline());
+BENCHMARK_CAPTURE(BM_FrameAsBytes, large_bulk, large_bulk());
+BENCHMARK_CAPTURE(BM_FrameAsBytes, nested, nested_arrays());
+BENCHMARK_CAPTURE(BM_FrameEncodeTo, small, small_get_set());
+BENCHMARK_CAPTURE(BM_FrameEncodeTo, pipeline, pipeline());
+BENCHMARK_CAPTURE(BM_FrameEncodeTo, large_bulk, large_bulk());
+BENCHMARK_CAPTURE(BM_FrameEncodeTo, nested, nested_arrays());
+
+// BM_CommandFromFrame looks up the commands of corpus, from views decoded once
+void BM_CommandFromFrame(benchmark::State& state, const Corpus& corpus)
+{
+    // a view is only valid until its decoder decodes another frame, every frame gets its own
+    std::vector<Decoder> decoders(corpus.frames);
+    std::vector<FrameView> views;
+    size_t offset = 0;
+    for (auto& decoder: decoders)
+    {
+        size_t consumed = 0;
+        views.push_back(decoder.decode_view(std::span(corpus.bytes).subspan(offset), consumed).value());
+        offset += consumed;
+    }
+    for (auto _: state)
+    {
+        for (const auto& view: views)
+        {
+            auto command = Command::command_from_frame(view);
+            benchmark::DoNotOptimize(command);
+        }
+    }
+    set_processed(state, corpus);
+}
+
+Corpus mixed_commands()
+{
+    return {command({"SET", "key", "value", "EX", "100"}) + command({"GET", "key"}) + command({"INCRBY", "n", "5"}) +
+                    command({"DEL", "a", "b", "c", "d", "e", "f", "g", "h"}) + command({"NOPE", "key"}) +
+                    command({"GET"}),
+            6};
+}
+
+BENCHMARK_CAPTURE(BM_CommandFromFrame, pipeline, pipeline());
+BENCHMARK_CAPTURE(BM_CommandFromFrame, mixed, mixed_commands());
+
+int main(int argc, char** argv)
+{
+    log_output_level = ALOG_WARN;
+    // the memory streams lock photon mutexes
+    photon::init(photon::INIT_EVENT_EPOLL, photon::INIT_IO_NONE);
+    DEFER(photon::fini());
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <string>
+
+#include "framer/scan.h"
+
+using namespace redis;
+
+// the line scanning the decoder did before: find the LF, then look for a stray CR in a second pass
+LineScan scan_line_find(const std::span<const char> input)
+{
+    const auto lf = std::ranges::find(input, '\n');
+    if (lf == input.end())
+    {
+        return {NO_LF, false};
+    }
+    const auto pos = static_cast<size_t>(lf - input.begin());
+    const auto line = input.first(pos > 0 ? pos - 1 : 0);
+    return {pos, std::ranges::find(line, '\r') != line.end()};
+}
+
+// a simple string line of the given length followed by more pipelined data
+std::string make_line(const size_t length) { return "+" + std::string(length, 'x') + "\r\n" + std::string(64, 'y'); }
+
+template<LineScan (*Scan)(std::span<const char>)>
+void BM_ScanLine(benchmark::State& state)
+{
+    const auto input = make_line(state.range(0));
+    const auto span = std::span(input.data(), input.size());
+    for (auto _: state)
+    {
+        benchmark::DoNotOptimize(Scan(span));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * (state.range(0) + 3));
+}
+
+LineScan scan_line_default(const std::span<const char> input) { return scan_line(input); }
+LineScan scan_line_reference(const std::span<const char> input) { return scan_line_scalar(input); }
+
+BENCHMARK(BM_ScanLine<scan_line_find>)->Arg(8)->Arg(64)->Arg(512)->Arg(4096);
+BENCHMARK(BM_ScanLine<scan_line_reference>)->Arg(8)->Arg(64)->Arg(512)->Arg(4096);
+BENCHMARK(BM_ScanLine<scan_line_default>)->Arg(8)->Arg(64)->Arg(512)->Arg(4096);
+
+BENCHMARK_MAIN();
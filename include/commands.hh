@@ -5,10 +5,12 @@
 #ifndef COMMAND_HH
 #define COMMAND_HH
 
-#include <framer/frame.h>
+#include <array>
+#include <cstdint>
+#include <framer/frame_view.h>
 #include <string>
-#include <unordered_map>
-#include <vector>
+#include <string_view>
+
 namespace redis
 {
     enum class CommandType
@@ -18,25 +20,129 @@ namespace redis
         SET,
         DEL,
         EXPIRE,
+        PEXPIRE,
+        TTL,
+        PTTL,
+        PERSIST,
+        INCR,
+        DECR,
+        INCRBY,
+        DECRBY,
+        SCAN,
+        INFO,
+        COMMAND,
+        SAVE,
+        BGSAVE,
+        BGREWRITEAOF,
         ERROR  // This isn't a command per se. But it is used to send erroneous responses back to the user.
     };
 
+    /// Command flags, reported by COMMAND INFO.
+    enum CommandFlag : uint32_t
+    {
+        CMD_WRITE = 1 << 0,
+        CMD_READONLY = 1 << 1,
+        CMD_FAST = 1 << 2,
+        CMD_LOADING = 1 << 3,
+        CMD_STALE = 1 << 4,
+        // the command can grow the dataset, it is refused when the memory limit is reached
+        CMD_DENYOOM = 1 << 5,
+        // an administrative command, like the persistence ones
+        CMD_ADMIN = 1 << 6,
+    };
+
+    /**
+     * CommandSpec describes a command like the Redis command table does. arity counts the command name, a negative
+     * arity -N means at least N arguments. Keys are the arguments from first_key to last_key with step, last_key -1
+     * meaning the last argument. first_key is 0 for commands without keys.
+     */
+    struct CommandSpec
+    {
+        std::string_view name;
+        CommandType type;
+        int arity;
+        uint32_t flags;
+        int first_key;
+        int last_key;
+        int step;
+    };
+
+    // clang-format off
+    inline constexpr std::array COMMAND_TABLE{
+            CommandSpec{"ping", CommandType::PING, -1, CMD_FAST | CMD_STALE | CMD_LOADING, 0, 0, 0},
+            CommandSpec{"get", CommandType::GET, 2, CMD_READONLY | CMD_FAST, 1, 1, 1},
+            CommandSpec{"set", CommandType::SET, -3, CMD_WRITE | CMD_DENYOOM, 1, 1, 1},
+            CommandSpec{"del", CommandType::DEL, -2, CMD_WRITE, 1, -1, 1},
+            CommandSpec{"expire", CommandType::EXPIRE, 3, CMD_WRITE | CMD_FAST, 1, 1, 1},
+            CommandSpec{"pexpire", CommandType::PEXPIRE, 3, CMD_WRITE | CMD_FAST, 1, 1, 1},
+            CommandSpec{"ttl", CommandType::TTL, 2, CMD_READONLY | CMD_FAST, 1, 1, 1},
+            CommandSpec{"pttl", CommandType::PTTL, 2, CMD_READONLY | CMD_FAST, 1, 1, 1},
+            CommandSpec{"persist", CommandType::PERSIST, 2, CMD_WRITE | CMD_FAST, 1, 1, 1},
+            CommandSpec{"incr", CommandType::INCR, 2, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+            CommandSpec{"decr", CommandType::DECR, 2, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+            CommandSpec{"incrby", CommandType::INCRBY, 3, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+            CommandSpec{"decrby", CommandType::DECRBY, 3, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+            CommandSpec{"scan", CommandType::SCAN, -2, CMD_READONLY, 0, 0, 0},
+            CommandSpec{"info", CommandType::INFO, -1, CMD_LOADING | CMD_STALE, 0, 0, 0},
+            CommandSpec{"command", CommandType::COMMAND, -1, CMD_LOADING | CMD_STALE, 0, 0, 0},
+            CommandSpec{"save", CommandType::SAVE, 1, CMD_ADMIN, 0, 0, 0},
+            CommandSpec{"bgsave", CommandType::BGSAVE, -1, CMD_ADMIN, 0, 0, 0},
+            CommandSpec{"bgrewriteaof", CommandType::BGREWRITEAOF, 1, CMD_ADMIN, 0, 0, 0},
+    };
+    // clang-format on
+
+    /**
+     * find_command looks a command name up, ignoring case, in a perfect hash table built at compile time. It does not
+     * allocate, the name is hashed and compared in place.
+     * @return the spec of the command, or nullptr if the command is unknown.
+     */
+    const CommandSpec* find_command(std::string_view name) noexcept;
+
     struct Command
     {
         CommandType type;
-        std::vector<std::string> args;
+        // The frame the command was parsed from. Its arguments are borrowed from the connection receive buffer, so a
+        // command must be executed before the next frame is decoded.
+        FrameView frame;
+        // Only set for CommandType::ERROR.
+        std::string error;
+        // Not set for CommandType::ERROR.
+        const CommandSpec* spec = nullptr;
 
-        Command(const CommandType t, std::vector<std::string> args) : type(t), args(std::move(args)) {}
+        Command(const CommandType t, const FrameView& frame, const CommandSpec* spec = nullptr) :
+            type(t), frame(frame), spec(spec)
+        {
+        }
 
-        static Command command_from_frame(const Frame& frame) noexcept;
-    };
+        Command(const CommandType t, std::string error) : type(t), error(std::move(error)) {}
 
-    static std::unordered_map<std::string, CommandType> redis_command_map = {
-            {"PING", CommandType::PING}, {"GET", CommandType::GET},       {"SET", CommandType::SET},
-            {"DEL", CommandType::DEL},   {"EXPIRE", CommandType::EXPIRE},
-    };
+        /// argc returns the number of arguments, the command name included.
+        [[nodiscard]] size_t argc() const noexcept { return frame.size(); }
+
+        /// arg returns the argument at index, the command name being at index 0.
+        [[nodiscard]] std::string_view arg(const size_t index) const noexcept { return frame[index].str(); }
 
+        /// for_each_key calls fn(index) with the index of each key argument, as described by the spec of the command.
+        template<typename F>
+        void for_each_key(F&& fn) const
+        {
+            if (spec == nullptr || spec->first_key == 0)
+            {
+                return;
+            }
+            const auto last = spec->last_key < 0 ? static_cast<int>(this->argc()) + spec->last_key : spec->last_key;
+            for (auto i = spec->first_key; i <= last; i += spec->step)
+            {
+                fn(static_cast<size_t>(i));
+            }
+        }
 
+        /**
+         * command_from_frame looks the command up and checks its arity, so that its key arguments are known to exist
+         * once it is dispatched. Nothing is allocated unless the command is invalid.
+         */
+        static Command command_from_frame(const FrameView& frame) noexcept;
+    };
 }  // namespace redis
 
 #endif  // COMMAND_HH
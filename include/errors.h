@@ -19,6 +19,16 @@ namespace redis
         not_enough_data,
         generic_network_error,
         max_recursion_depth,
+        not_integer,
+        integer_overflow,
+        out_of_memory,
+        rdb_corrupted,
+        rdb_unsupported,
+        io_error,
+        save_in_progress,
+        aof_corrupted,
+        query_buffer_limit,
+        invalid_bulk_length,
     };
 
     std::ostream &operator<<(std::ostream &o, RedisError err);
@@ -51,6 +61,26 @@ namespace redis
                     return "network error occurred";
                 case RedisError::max_recursion_depth:
                     return "reached frame nesting limit";
+                case RedisError::not_integer:
+                    return "value is not an integer or out of range";
+                case RedisError::integer_overflow:
+                    return "increment or decrement would overflow";
+                case RedisError::out_of_memory:
+                    return "command not allowed when used memory > 'maxmemory'";
+                case RedisError::rdb_corrupted:
+                    return "the RDB file is corrupted or truncated";
+                case RedisError::rdb_unsupported:
+                    return "the RDB file uses a version or an object type which is not supported";
+                case RedisError::io_error:
+                    return "a file cannot be read or written";
+                case RedisError::save_in_progress:
+                    return "Background save already in progress";
+                case RedisError::aof_corrupted:
+                    return "the AOF file is corrupted or holds unknown commands";
+                case RedisError::query_buffer_limit:
+                    return "the client reached the query buffer limit";
+                case RedisError::invalid_bulk_length:
+                    return "Protocol error: invalid bulk length";
             }
             return "redis::RedisError::unknown";
         }
@@ -0,0 +1,86 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+namespace redis
+{
+    /**
+     * @class Arena
+     * @brief A bump allocator for the scratch memory of a connection.
+     *
+     * Allocating is bumping a cursor and freeing does nothing, everything is released at once by reset. It is a
+     * std::pmr::memory_resource, so std::pmr containers can take their memory from it.
+     *
+     * When a batch needs more than the current block, more blocks are chained. On reset, they are replaced by a single
+     * block as large as all of them together, so that once the arena has seen the largest batch of the connection,
+     * every following one takes its scratch memory from one block without calling malloc. Only what is allocated from
+     * the arena is covered. Blocks larger than MAX_RETAINED are not kept across resets, a single huge reply does not
+     * pin its memory for the lifetime of the connection.
+     */
+    class Arena final : public std::pmr::memory_resource
+    {
+    public:
+        static constexpr size_t DEFAULT_BLOCK_SIZE = 4 * 1024;
+        static constexpr size_t MAX_RETAINED = 1024 * 1024;
+
+        explicit Arena(size_t block_size = DEFAULT_BLOCK_SIZE);
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+        Arena(Arena&& other) noexcept;
+        Arena& operator=(Arena&& other) noexcept;
+        ~Arena() override = default;
+
+        /// copy copies str in the arena. @return a view over the copy, valid until the next reset.
+        std::string_view copy(std::string_view str);
+
+        /// reset releases every allocation at once. Nothing allocated before can be used afterward.
+        void reset() noexcept;
+
+        /// release is reset, and frees every block too. The next allocation allocates a block again.
+        void release() noexcept;
+
+        /// used returns the amount of bytes allocated since the last reset, alignment padding included.
+        [[nodiscard]] size_t used() const noexcept { return used_ + static_cast<size_t>(cursor_ - begin_); }
+
+        /// capacity returns the size of all the blocks held.
+        [[nodiscard]] size_t capacity() const noexcept { return capacity_; }
+
+        /// blocks returns the number of blocks held.
+        [[nodiscard]] size_t blocks() const noexcept { return blocks_.size(); }
+
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void*, size_t, size_t) override {}
+        [[nodiscard]] bool do_is_equal(const memory_resource& other) const noexcept override { return this == &other; }
+
+        // add_block_ chains a new block of at least size bytes and makes it current
+        void add_block_(size_t size);
+
+        struct Block
+        {
+            std::unique_ptr<char[]> data;
+            size_t size;
+        };
+
+        std::vector<Block> blocks_;
+        size_t block_size_;
+        // bytes allocated in the blocks before the current one
+        size_t used_ = 0;
+        size_t capacity_ = 0;
+        char* begin_ = nullptr;
+        char* cursor_ = nullptr;
+        char* end_ = nullptr;
+    };
+}  // namespace redis
+
+#endif  // ARENA_H
@@ -0,0 +1,124 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace redis
+{
+    /**
+     * @class BufferPool
+     * @brief The storage released by the IOBuffers of a vCPU, kept to be reused by the next ones.
+     *
+     * An idle connection holds no buffer: its IOBuffers give their storage back here once drained, and take one back
+     * when data arrives. Only sizes which are powers of two between MIN_SIZE and MAX_SIZE are pooled, at most
+     * MAX_FREE_BYTES of each; the others are allocated and freed as usual. There is one pool per vCPU, see local,
+     * the photon threads of a vCPU never run in parallel so it takes no lock.
+     */
+    class BufferPool
+    {
+    public:
+        /// local returns the pool of the calling vCPU.
+        static BufferPool& local() noexcept;
+
+        /// acquire returns a storage of exactly size bytes, a released one if possible.
+        std::vector<char> acquire(size_t size);
+
+        /// release takes storage back, it is freed if it is not pooled.
+        void release(std::vector<char>&& storage) noexcept;
+
+        /// free_count returns the number of storages of size bytes ready to be reused.
+        [[nodiscard]] size_t free_count(size_t size) const noexcept;
+
+        static constexpr size_t MIN_SIZE = 1024;
+        static constexpr size_t MAX_SIZE = 64 * 1024;
+        static constexpr size_t MAX_FREE_BYTES = 4 * 1024 * 1024;
+
+    private:
+        // class_of returns the index of the free list of size, or CLASSES if it is not pooled
+        static size_t class_of(size_t size) noexcept;
+
+        static constexpr size_t CLASSES = 7;
+        std::array<std::vector<std::vector<char>>, CLASSES> free_;
+    };
+
+    /**
+     * @class IOBuffer
+     * @brief A contiguous byte buffer with independent read and write cursors.
+     *
+     * Bytes are appended at the write cursor (either by copying with append or by letting a producer such as recv
+     * write directly in the span returned by prepare, followed by commit) and consumed from the read cursor.
+     * Consuming never moves memory, it only advances the read cursor. The live region is moved back to the front of
+     * the storage only when prepare needs room and the already consumed prefix is at least as large as the live
+     * region, so the cost of compaction is amortized over the consumed bytes.
+     *
+     * The storage comes from the BufferPool of the vCPU. It is only taken when bytes are first written, and release
+     * gives it back while the buffer is empty: a buffer costs no memory between two uses.
+     */
+    class IOBuffer
+    {
+    public:
+        /// capacity is the size of the storage taken when bytes are first written, none is taken before.
+        explicit IOBuffer(size_t capacity = 0) noexcept : initial_capacity_(capacity) {}
+
+        /// Gives the storage back to the pool.
+        ~IOBuffer();
+
+        IOBuffer(const IOBuffer&) = delete;
+        IOBuffer& operator=(const IOBuffer&) = delete;
+        IOBuffer(IOBuffer&&) noexcept = default;
+        IOBuffer& operator=(IOBuffer&&) noexcept = default;
+
+        /// size returns the number of readable (not yet consumed) bytes.
+        [[nodiscard]] size_t size() const noexcept { return write_pos_ - read_pos_; }
+
+        [[nodiscard]] bool empty() const noexcept { return write_pos_ == read_pos_; }
+
+        [[nodiscard]] size_t capacity() const noexcept { return storage_.size(); }
+
+        /// data returns a pointer to the first readable byte.
+        [[nodiscard]] const char* data() const noexcept { return storage_.data() + read_pos_; }
+
+        [[nodiscard]] char* data_mut() noexcept { return storage_.data() + read_pos_; }
+
+        /// readable returns a view over the readable bytes. It is invalidated by prepare and append.
+        [[nodiscard]] std::span<const char> readable() const noexcept { return {data(), size()}; }
+
+        /**
+         * prepare makes sure at least n bytes can be written contiguously after the write cursor and returns the
+         * whole writable region. Written bytes only become readable after a call to commit.
+         */
+        std::span<char> prepare(size_t n);
+
+        /// commit makes n bytes previously written in the prepared region readable.
+        void commit(size_t n) noexcept;
+
+        /// consume drops n bytes from the front of the readable region.
+        void consume(size_t n) noexcept;
+
+        /// append copies bytes at the end of the readable region.
+        void append(std::span<const char> bytes);
+
+        void clear() noexcept { read_pos_ = write_pos_ = 0; }
+
+        /// erase drops n readable bytes from offset on, the bytes after them are moved back.
+        void erase(size_t offset, size_t n) noexcept;
+
+        /// release gives the storage back to the pool if the buffer is empty, the next prepare takes one again.
+        void release() noexcept;
+
+    private:
+        size_t initial_capacity_;
+        std::vector<char> storage_;
+        size_t read_pos_ = 0;
+        size_t write_pos_ = 0;
+    };
+}  // namespace redis
+
+#endif  // BUFFER_H
@@ -0,0 +1,125 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <algorithm>
+#include <errors.h>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "frame.h"
+#include "frame_view.h"
+#include "storage/value.h"
+
+namespace redis
+{
+    constexpr int MAX_RECURSION_DEPTH = 30;
+    /// DEFAULT_PROTO_MAX_BULK_LEN is the largest bulk string accepted by default, proto-max-bulk-len in Redis.
+    constexpr size_t DEFAULT_PROTO_MAX_BULK_LEN = 512 * 1024 * 1024;
+
+    /**
+     * @class Decoder
+     * @brief An incremental RESP decoder.
+     *
+     * The decoder is fed with whatever bytes are available and never reads from the network by itself. When the input
+     * does not hold a full frame, it remembers how far it went (open arrays, the header of a bulk string) and reports
+     * that more data is needed. The next call, with the same input plus the new bytes, resumes exactly where the
+     * previous one stopped, nothing is parsed twice.
+     *
+     * Decoded frames are not copied out of the input. The decoder records where each element lives relative to the
+     * beginning of the frame, and the bytes of a frame are only reported as consumed once the whole frame is decoded.
+     * Until then, the caller must keep the input as is, but is free to move it around (e.g. compact a buffer).
+     */
+    class Decoder
+    {
+    public:
+        /**
+         * A bulk string longer than max_bulk_len is a decoding error, RedisError::invalid_bulk_length. max_bulk_len is
+         * clamped to Value::MAX_SIZE, a longer string could not be stored.
+         */
+        explicit Decoder(const size_t max_bulk_len = DEFAULT_PROTO_MAX_BULK_LEN) noexcept :
+            max_bulk_len_(std::min(max_bulk_len, Value::MAX_SIZE))
+        {
+        }
+
+        /// PendingBulk is a bulk string whose header was decoded, waiting for its payload.
+        struct PendingBulk
+        {
+            // where the payload begins in the input
+            size_t offset;
+            size_t size;
+        };
+        /**
+         * decode_view attempts to decode one full frame from the beginning of input.
+         *
+         * @param input the bytes available. Bytes the decoder is done with are reported through consumed and must be
+         * dropped by the caller before the next call.
+         * @param consumed the number of bytes of input the decoder is done with. It is 0 while a frame is incomplete,
+         * the size of the frame once decoded, and the bytes up to the offending element after a decoding error.
+         * @param max_depth the maximum nesting of aggregate frames.
+         * @return a view over the frame, valid until the next call to the decoder and as long as the consumed bytes of
+         * input are kept. RedisError::incomplete_frame if a line is not complete yet, RedisError::not_enough_data if
+         * the payload of a bulk string is not complete yet, or a decoding error. After a decoding error, the partial
+         * state is dropped.
+         */
+        Result<FrameView> decode_view(std::span<const char> input, size_t& consumed,
+                                      uint8_t max_depth = MAX_RECURSION_DEPTH);
+
+        /// decode is like decode_view, but returns an owning copy of the frame.
+        Result<Frame> decode(std::span<const char> input, size_t& consumed, uint8_t max_depth = MAX_RECURSION_DEPTH);
+
+        /**
+         * pending_bulk returns the bulk string the last call to decode_view stopped at with
+         * RedisError::not_enough_data, if its payload is not already read elsewhere.
+         */
+        [[nodiscard]] std::optional<PendingBulk> pending_bulk() const noexcept;
+
+        /**
+         * set_bulk_payload tells that the payload of the pending bulk string was read by the caller, to data which must
+         * outlive the frame. It is dropped from the input: the next call expects the CRLF closing the bulk string where
+         * its payload began.
+         */
+        void set_bulk_payload(const char* data) noexcept;
+
+        /// idle is true when no partially decoded frame is pending.
+        [[nodiscard]] bool idle() const noexcept { return scan_ == 0; }
+
+        /// reset drops any partially decoded frame.
+        void reset() noexcept
+        {
+            nodes_.clear();
+            stack_.clear();
+            pending_bulk_.reset();
+            scan_ = 0;
+        }
+
+    private:
+        struct OpenArray
+        {
+            size_t node;
+            int64_t remaining;
+        };
+
+        Result<FrameView> fail_(const RedisError err, size_t& consumed, const size_t upto) noexcept
+        {
+            consumed = upto;
+            this->reset();
+            return {err};
+        }
+
+        // the flattened tree of the frame being decoded, reused from one frame to the other
+        std::vector<FrameNode> nodes_;
+        std::vector<OpenArray> stack_;
+        // index of the bulk node waiting for its payload
+        std::optional<size_t> pending_bulk_;
+        // how many bytes of the current frame were decoded already
+        size_t scan_ = 0;
+        size_t max_bulk_len_;
+    };
+}  // namespace redis
+
+#endif  // DECODER_H
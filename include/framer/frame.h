@@ -6,6 +6,7 @@
 #define FRAME_HH
 #include <cstdint>
 #include <string>
+#include <sys/uio.h>
 #include <variant>
 #include <vector>
 
@@ -34,11 +35,26 @@ namespace redis
         Null = kNull,  // '_'
         BigNumber = kBigNumber,  // '('
         Array = kArray,  // '*'
-        Undefined
+        // Undefined must not collide with any of the identifiers above.
+        Undefined = 0
     };
 
     FrameID frame_id_from_char(char from);
 
+    class IOBuffer;
+
+    /// MAX_HEADER_SIZE is the largest RESP line made of an identifier, a 64 bits integer and CRLF.
+    constexpr size_t MAX_HEADER_SIZE = 1 + 20 + 2;
+
+    /// header_size returns the size of the line made of an identifier, n and CRLF.
+    size_t header_size(int64_t n) noexcept;
+
+    /**
+     * encode_header writes an identifier followed by n and CRLF. out must have room for header_size(n) bytes.
+     * @return a pointer past the last written byte.
+     */
+    char* encode_header(char* out, char prefix, int64_t n) noexcept;
+
     inline bool is_aggregate_frame(const FrameID frame_id) noexcept { return frame_id == FrameID::Array; };
     inline bool is_bulk_frame(const FrameID frame_id) noexcept
     {
@@ -64,7 +80,33 @@ namespace redis
 
         [[nodiscard]] std::string to_string() const noexcept;
 
+        /// as_bytes returns the RESP encoding of the frame. Prefer encode_to, which does not allocate.
         [[nodiscard]] std::vector<char> as_bytes() const noexcept;
+
+        /// encoded_size returns the exact size of the RESP encoding of the frame.
+        [[nodiscard]] size_t encoded_size() const noexcept;
+
+        /**
+         * encode_to writes the RESP encoding of the frame at out, which must have room for encoded_size() bytes.
+         * @return a pointer past the last written byte.
+         */
+        char* encode_to(char* out) const noexcept;
+
+        /// encode_to appends the RESP encoding of the frame to out with a single reservation.
+        void encode_to(IOBuffer& out) const;
+
+        /**
+         * encode_to_iov describes the RESP encoding of the frame as a list of iovec, ready for writev. The payloads of
+         * bulk frames of at least by_ref_threshold bytes are referenced in place, everything else is written in the
+         * free space of scratch, which is committed. The iovecs are valid as long as the frame and scratch are left
+         * untouched.
+         */
+        void encode_to_iov(IOBuffer& scratch, std::vector<iovec>& iov, size_t by_ref_threshold) const;
+
+    private:
+        // copied_size returns the part of the encoding which is not referenced by encode_to_iov.
+        [[nodiscard]] size_t copied_size_(size_t by_ref_threshold) const noexcept;
+        char* encode_to_iov_(char* out, char*& segment, std::vector<iovec>& iov, size_t by_ref_threshold) const noexcept;
     };
 }  // namespace redis
 
@@ -0,0 +1,112 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef FRAME_VIEW_H
+#define FRAME_VIEW_H
+
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+#include "frame.h"
+
+namespace redis
+{
+    /**
+     * FrameNode is one element of a decoded frame tree. Trees are flattened in pre-order: the children of an array
+     * directly follow it, and span tells how many nodes the subtree rooted at a node is made of, so the next sibling
+     * of a node is always node + span.
+     */
+    struct FrameNode
+    {
+        FrameID frame_id;
+        // offset of the payload from the beginning of the frame, for simple and bulk frames
+        size_t offset;
+        // payload size for simple and bulk frames, number of children for arrays
+        size_t size;
+        // number of nodes in the subtree rooted at this node, this one included
+        uint32_t span;
+        // value of integer and boolean frames
+        int64_t integer;
+        // the payload of a bulk frame read out of the buffer of the frame, see Decoder::set_bulk_payload
+        const char* external = nullptr;
+    };
+
+    /**
+     * @class FrameView
+     * @brief A borrowed, read-only view over a decoded frame.
+     *
+     * The payloads of simple and bulk frames are not copied, they point into the buffer the frame was decoded from.
+     * A view is only valid as long as that buffer region and the decoder which produced it are left untouched, which
+     * for a Handler means until the next frame is decoded.
+     */
+    class FrameView
+    {
+    public:
+        class Iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = FrameView;
+            using difference_type = std::ptrdiff_t;
+
+            Iterator() = default;
+            Iterator(const FrameNode* node, const char* base) : node_(node), base_(base) {}
+
+            FrameView operator*() const noexcept { return {node_, base_}; }
+            Iterator& operator++() noexcept
+            {
+                node_ += node_->span;
+                return *this;
+            }
+            Iterator operator++(int) noexcept
+            {
+                auto tmp = *this;
+                ++*this;
+                return tmp;
+            }
+            bool operator==(const Iterator& other) const noexcept { return node_ == other.node_; }
+
+        private:
+            const FrameNode* node_ = nullptr;
+            const char* base_ = nullptr;
+        };
+
+        FrameView() = default;
+        FrameView(const FrameNode* node, const char* base) : node_(node), base_(base) {}
+
+        [[nodiscard]] FrameID frame_id() const noexcept { return node_->frame_id; }
+
+        /// str returns the payload of simple and bulk frames.
+        [[nodiscard]] std::string_view str() const noexcept
+        {
+            return {node_->external != nullptr ? node_->external : base_ + node_->offset, node_->size};
+        }
+
+        [[nodiscard]] int64_t integer() const noexcept { return node_->integer; }
+
+        [[nodiscard]] bool boolean() const noexcept { return node_->integer != 0; }
+
+        /// size returns the number of children of an array.
+        [[nodiscard]] size_t size() const noexcept { return is_aggregate_frame(frame_id()) ? node_->size : 0; }
+
+        [[nodiscard]] bool empty() const noexcept { return this->size() == 0; }
+
+        [[nodiscard]] Iterator begin() const noexcept { return {node_ + 1, base_}; }
+
+        [[nodiscard]] Iterator end() const noexcept { return {node_ + node_->span, base_}; }
+
+        /// operator[] returns the child at index. It walks the siblings, so it is linear in index when they are nested.
+        FrameView operator[](size_t index) const noexcept;
+
+        /// to_frame makes an owning copy of the view.
+        [[nodiscard]] Frame to_frame() const;
+
+    private:
+        const FrameNode* node_ = nullptr;
+        const char* base_ = nullptr;
+    };
+}  // namespace redis
+
+#endif  // FRAME_VIEW_H
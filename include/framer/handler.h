@@ -5,18 +5,57 @@
 #ifndef HANDLER_H
 #define HANDLER_H
 
+#include <commands.hh>
 #include <errors.h>
 #include <optional>
 #include <photon/net/socket.h>
 #include <span>
 #include <vector>
 
+#include "arena.h"
+#include "buffer.h"
+#include "decoder.h"
 #include "frame.h"
+#include "persistence/aof.h"
+#include "persistence/persistence.h"
+#include "storage/keyspace.h"
 
 namespace redis
 {
+    constexpr size_t DEFAULT_FLUSH_THRESHOLD = 16 * 1024;
+    constexpr size_t DEFAULT_REFERENCE_THRESHOLD = 64 * 1024;
+    /// Bulk strings of requests from this size on are received right into the storage of their value, not buffered.
+    constexpr size_t PROTO_MBULK_BIG_ARG = 32 * 1024;
 
-    constexpr int MAX_RECURSION_DEPTH = 30;
+    /**
+     * OutputBufferLimit is a class of the Redis client-output-buffer-limit option. A client is disconnected once its
+     * pending replies reach hard_bytes, or once they stayed above soft_bytes for soft_seconds. 0 disables a limit.
+     */
+    struct OutputBufferLimit
+    {
+        size_t hard_bytes = 0;
+        size_t soft_bytes = 0;
+        int64_t soft_seconds = 0;
+    };
+
+    /// ClientClass selects the output buffer limit of a client.
+    enum class ClientClass : uint8_t
+    {
+        Normal,
+        // subscribers get messages they did not ask for, their replies can pile up
+        PubSub,
+    };
+
+    /// ClientLimits are the buffer limits of every connection, with the defaults of Redis.
+    struct ClientLimits
+    {
+        OutputBufferLimit normal{};
+        OutputBufferLimit pubsub{32 << 20, 8 << 20, 60};
+        // client-query-buffer-limit, the input of a client not decoded yet
+        size_t query_buffer_bytes = 1 << 30;
+        // proto-max-bulk-len, the largest bulk string of a request, at most Value::MAX_SIZE
+        size_t proto_max_bulk_len = DEFAULT_PROTO_MAX_BULK_LEN;
+    };
 
     class Handler
     {
@@ -26,17 +65,34 @@ namespace redis
         Handler(Handler&&) = default;
         Handler& operator=(Handler&&) = default;
 
-        Handler(std::unique_ptr<photon::net::ISocketStream> stream, size_t chunk_size);
+        /**
+         * @param stream the connection to serve.
+         * @param chunk_size the amount of bytes requested from the stream on each read.
+         * @param flush_threshold the amount of buffered reply bytes above which replies are written right away
+         * instead of waiting for the end of the current input batch.
+         * @param keyspace the dataset commands are applied to, it must outlive the handler. Key commands are rejected
+         * when it is null.
+         * @param persistence saves the keyspace for SAVE and BGSAVE, which are rejected when it is null.
+         * @param aof the append only file writes are logged to, if any. BGREWRITEAOF is rejected without it.
+         * @param limits the buffer limits the connection is closed at.
+         * @param reference_threshold the size from which the values read by GET are not copied to the output buffer
+         * but written to the stream right from the keyspace, see Value::pin.
+         */
+        Handler(std::unique_ptr<photon::net::ISocketStream> stream, size_t chunk_size,
+                size_t flush_threshold = DEFAULT_FLUSH_THRESHOLD, Keyspace* keyspace = nullptr,
+                Persistence* persistence = nullptr, Aof* aof = nullptr, const ClientLimits& limits = {},
+                size_t reference_threshold = DEFAULT_REFERENCE_THRESHOLD);
 
         /**
-         * is_eof checks for real eof meaning the buffer is empty and the eof bit was seen on the upstream stream.
+         * seen_eof is true once the upstream stream returned 0 bytes, meaning the peer closed its end. The buffer can
+         * still hold data received before that.
          */
         [[nodiscard]] bool seen_eof() const noexcept { return eof_reached_; }
 
         [[nodiscard]] bool empty() const noexcept { return buffer_.empty(); }
 
-        // get buffer
-        [[nodiscard]] const std::vector<char>& get_buffer() const noexcept { return buffer_; }
+        // get a view over the bytes received but not consumed yet
+        [[nodiscard]] std::span<const char> get_buffer() const noexcept { return buffer_.readable(); }
 
         /**
          * read_until read from the handler buffer or/and the upstream stream until char c is reached.
@@ -54,16 +110,34 @@ namespace redis
         Result<bytes> read_exact(int64_t n);
 
         /**
-         * send_frame writes frames to the underlined stream of the handler.
-         * It is similar to calling the send method on the Photonlib socket stream.
+         * send_frame writes everything buffered, then the frame, to the underlined stream of the handler. Bulk payloads
+         * larger than the flush threshold are written from the frame itself with writev, they are not copied.
          * @param frame
-         * @return return the same output as send. The number of bytes written if success, a negative number if not.
+         * @return the number of bytes of frame written if success, a negative number if not.
          */
-        ssize_t send_frame(const Frame& frame) const
-        {
-            const auto data = frame.as_bytes();
-            return stream_->write(data.data(), data.size());
-        }
+        ssize_t send_frame(const Frame& frame);
+
+        /**
+         * write_frame appends a reply to the output buffer. Buffered replies are written to the stream once the
+         * buffered input is exhausted, right before blocking for more input, or as soon as the output buffer grows
+         * past the flush threshold. This turns a pipeline of N commands into a single write.
+         */
+        void write_frame(const Frame& frame);
+
+        /**
+         * flush writes the whole output buffer to the underlined stream.
+         * @return the number of bytes written, or a negative number on network errors.
+         */
+        ssize_t flush();
+
+        /// scratch returns the arena per command temporaries are allocated from. It is reset at the end of each batch.
+        [[nodiscard]] const Arena& scratch() const noexcept { return arena_; }
+
+        /// pending_output returns the amount of reply bytes not written to the stream yet.
+        [[nodiscard]] size_t pending_output() const noexcept { return out_buffer_.size() + referenced_bytes_; }
+
+        /// closed is true once a write failed or a buffer limit was reached, the connection is unusable from then on.
+        [[nodiscard]] bool closed() const noexcept { return write_failed_; }
         /**
          * data is used to get a non-mutable access to the data managed by the buffer.
          *
@@ -75,41 +149,120 @@ namespace redis
          *
          * @return a pointer to the first byte of the underlined buffer.
          */
-        [[nodiscard]] char* data_mut() { return buffer_.data(); }
+        [[nodiscard]] char* data_mut() { return buffer_.data_mut(); }
         [[nodiscard]] size_t buffer_size() const { return buffer_.size(); }
 
-        void add_more_data(std::span<char> bytes) noexcept
-        {
-            buffer_.insert(buffer_.end(), bytes.begin(), bytes.end());
-        }
+        void add_more_data(std::span<const char> bytes) { buffer_.append(bytes); }
+
+        /**
+         * decode returns the next frame sent by the peer. Frames already sitting in the buffer are decoded without
+         * touching the network, the upstream stream is only read when the buffer does not hold a full frame.
+         * @return a frame, RedisError::eof if the peer closed the stream between two frames, or a decoding error.
+         */
+        Result<Frame> decode(u_int8_t max_depth);
 
-        Result<Frame> decode(u_int8_t dept, u_int8_t max_depth);
+        /**
+         * decode_view is like decode but does not copy the frame out of the receive buffer. The view stays valid until
+         * the next call to decode, decode_view, read_until or read_exact, which is when the bytes it references are
+         * released.
+         */
+        Result<FrameView> decode_view(u_int8_t max_depth);
 
         // start session sart processing and responding to frames.
         void start_session();
 
-        /// handle_frame extracts a command from a frame and apply the command
-        void handle_frame(const Frame& frame);
+        /// handle_command applies a command and writes its reply to the output buffer.
+        void handle_command(const Command& command);
 
     private:
-        // parse a frame, extract command and its args as string
-        std::vector<std::string> parse_frame(const Frame& frame);
         Result<ssize_t> get_more_data_upstream_();
-        Result<bytes> get_simple_string_();
-        Result<bytes> get_bulk_string_();
-        Result<int64_t> get_integer_();
-        Result<FrameID> get_frame_id_();
-        Result<Frame> get_null_frame_();
-        Result<Frame> get_bool_frame_();
-        Result<Frame> decode_array_(u_int8_t dept, u_int8_t max_depth);
-
-        // Choose chunk size wisely. Initially, a buffer of 2 * chunk_size will be allocated for reading
-        // on the network stream.
+        // release_view_ drops the bytes of the last frame returned by decode_view from the receive buffer
+        void release_view_() noexcept
+        {
+            buffer_.consume(view_size_);
+            view_size_ = 0;
+            streamed_.clear();
+            streamed_bytes_ = 0;
+        }
+        // stream_bulk_ receives the payload of a large bulk string into a storage of its own, out of the buffer
+        Result<ssize_t> stream_bulk_(const Decoder::PendingBulk& bulk);
+        // streamed_payload_ returns the storage arg was streamed to, if it was
+        Value::Buffer* streamed_payload_(std::string_view arg) noexcept;
+        void maybe_flush_();
+        // check_output_limit_ closes the connection if pending reply bytes are past the limit of its class
+        bool check_output_limit_(size_t pending);
+        // writev_ writes iov_ to the stream, checking the output limit after partial writes when limited
+        ssize_t writev_(bool limited);
+        // send_some_ writes what the stream takes of iov, pending bytes being left to write. When limited, a peer
+        // which does not drain them is waited for until the output limit is reached, the connection is closed then.
+        ssize_t send_some_(const iovec* iov, int count, size_t pending, bool limited);
+        // flush_referenced_ is flush when some replies reference values, they are written along the output buffer
+        ssize_t flush_referenced_();
+        void clear_output_() noexcept;
+        // recv_idle_ reads from the socket without waiting, or waits for it to be readable holding no buffer
+        Result<ssize_t> recv_idle_();
+        // The write_ helpers only append to the output buffer, they never write to the stream. They can be called from
+        // any vCPU, while the thread runs on the owner of a shard.
+        void write_simple_(FrameID frame_id, std::string_view data);
+        void write_bulk_(std::string_view data);
+        void write_null_();
+        // write_value_ writes a bulk string reply, referencing the value rather than copying it when it is large
+        void write_value_(const Value& value);
+        void write_integer_(int64_t value);
+        void write_array_header_(size_t size);
+        // log_ appends a write to the AOF, from the vCPU owning key, right after the change
+        void log_(std::string_view key, std::initializer_list<std::string_view> args);
+        void execute_key_command_(const Command& command);
+        void execute_scan_(const Command& command);
+        void execute_info_(const Command& command);
+        void execute_save_(const Command& command);
+        void execute_command_(const Command& command);
+        void write_command_spec_(const CommandSpec& spec);
+
+        // Choose chunk size wisely. A buffer of 2 * chunk_size is taken from the pool for reading on the network
+        // stream. Each recv lands directly in the buffer and asks for chunk_size bytes of room.
         size_t chunk_size_ = 1024;
-        bytes buffer_;
+        IOBuffer buffer_;
+        Decoder decoder_;
+        // size of the frame lent by decode_view, still held in the receive buffer
+        size_t view_size_ = 0;
+        // the large bulk strings of that frame, received out of the buffer. SET stores them as they are.
+        std::vector<Value::Buffer> streamed_;
+        size_t streamed_bytes_ = 0;
+        IOBuffer out_buffer_;
+        // A value referenced by the replies, to be written at offset in the output buffer. It is pinned: it can be
+        // overwritten or deleted by another client before it is written.
+        struct Reference
+        {
+            size_t offset;
+            Value::Pin value;
+        };
+        std::vector<Reference> references_;
+        size_t referenced_bytes_ = 0;
+        size_t reference_threshold_ = DEFAULT_REFERENCE_THRESHOLD;
+        std::vector<iovec> iov_;
+        size_t flush_threshold_ = DEFAULT_FLUSH_THRESHOLD;
+        // set once a write failed or a limit was reached, the connection is unusable from then on
+        bool write_failed_ = false;
+        // set once an error is replied to the command being handled, it is then one of its failed calls
+        bool error_replied_ = false;
+        // set when the command being handled is refused, like a write over maxmemory: it is one of its rejected calls
+        bool rejected_ = false;
+        ClientLimits limits_;
+        ClientClass client_class_ = ClientClass::Normal;
+        // unix time in milliseconds the pending replies went past the soft limit, 0 when they are under it
+        int64_t soft_limit_since_ms_ = 0;
         std::unique_ptr<photon::net::ISocketStream> stream_;
         bool eof_reached_ = false;
-        size_t cursor_pos_ = 0;
+        Keyspace* keyspace_ = nullptr;
+        Persistence* persistence_ = nullptr;
+        Aof* aof_ = nullptr;
+        // epoch of the last write logged since the last flush, its reply waits until it is durable
+        uint64_t wait_epoch_ = 0;
+        // Scratch memory of the commands of the current batch: SCAN keys, INFO text, error messages. It is reset when
+        // the batch is over, right before blocking for more input, so building these replies does not call malloc once
+        // the arena is warm. Gathering what they report, like the stats of every shard for INFO, is not covered.
+        Arena arena_;
     };
 }  // namespace redis
 
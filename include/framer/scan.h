@@ -0,0 +1,41 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace redis
+{
+    /// LineScan is the outcome of scanning a RESP line.
+    struct LineScan
+    {
+        // position of the first LF, or NO_LF when the input does not hold one
+        size_t lf;
+        // a CR was found before the LF, somewhere else than right before it
+        bool stray_cr;
+    };
+
+    constexpr size_t NO_LF = SIZE_MAX;
+
+    /**
+     * scan_line finds the first LF of input and, in the same pass, checks that the only CR before it is the one
+     * terminating the line. The vectorized implementation is picked once at startup depending on the CPU, AVX2 or
+     * SSE2 on x86-64, with a scalar fallback elsewhere.
+     */
+    LineScan scan_line(std::span<const char> input) noexcept;
+
+    /// scan_line_scalar is the byte by byte implementation, used as fallback and reference.
+    LineScan scan_line_scalar(std::span<const char> input) noexcept;
+
+#if defined(__x86_64__)
+    LineScan scan_line_sse2(std::span<const char> input) noexcept;
+    LineScan scan_line_avx2(std::span<const char> input) noexcept;
+#endif
+}  // namespace redis
+
+#endif  // SCAN_H
@@ -0,0 +1,123 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <commands.hh>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace redis
+{
+    class Keyspace;
+
+    /// COMMAND_TYPE_COUNT is the number of command types, CommandType::ERROR included.
+    constexpr size_t COMMAND_TYPE_COUNT = static_cast<size_t>(CommandType::ERROR) + 1;
+
+    /**
+     * @class LatencyHistogram
+     * @brief A log-linear histogram of latencies in microseconds, like HdrHistogram.
+     *
+     * Latencies under SUB_BUCKETS microseconds have a bucket each. Above, every power of two is split in SUB_BUCKETS
+     * buckets of equal width, so a percentile is off by less than 1 / SUB_BUCKETS of its value. Latencies of
+     * MAX_VALUE microseconds and more, over 19 hours, all land in the last bucket. Recording is a few shifts and an
+     * increment, with no allocation.
+     */
+    class LatencyHistogram
+    {
+    public:
+        static constexpr unsigned SUB_BUCKET_BITS = 4;
+        static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static constexpr unsigned MAX_EXPONENT = 35;
+        static constexpr uint64_t MAX_VALUE = (uint64_t{1} << (MAX_EXPONENT + 1)) - 1;
+        static constexpr size_t BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+        void record(uint64_t usec) noexcept;
+
+        [[nodiscard]] uint64_t count() const noexcept { return count_; }
+        [[nodiscard]] uint64_t sum() const noexcept { return sum_; }
+        [[nodiscard]] uint64_t max() const noexcept { return max_; }
+
+        /// percentile returns the latency under which p percent of the recorded ones are, 0 if there is none.
+        [[nodiscard]] uint64_t percentile(double p) const noexcept;
+
+        LatencyHistogram& operator+=(const LatencyHistogram& other) noexcept;
+
+        /// bucket_of returns the index of the bucket of usec.
+        [[nodiscard]] static size_t bucket_of(uint64_t usec) noexcept;
+
+        /// upper_bound returns the largest latency of the bucket at index.
+        [[nodiscard]] static uint64_t upper_bound(size_t index) noexcept;
+
+    private:
+        std::array<uint64_t, BUCKETS> buckets_{};
+        uint64_t count_ = 0;
+        uint64_t sum_ = 0;
+        uint64_t max_ = 0;
+    };
+
+    /// CommandMetrics are the statistics of a command type, reported by INFO commandstats and latencystats.
+    struct CommandMetrics
+    {
+        uint64_t calls = 0;
+        // calls which replied with an error
+        uint64_t failed_calls = 0;
+        // calls refused before they ran, like the writes over maxmemory. They are not counted in calls.
+        uint64_t rejected_calls = 0;
+        LatencyHistogram latency;
+
+        CommandMetrics& operator+=(const CommandMetrics& other) noexcept;
+    };
+
+    /**
+     * @struct Metrics
+     * @brief The counters of a vCPU, reported by INFO and the Prometheus endpoint.
+     *
+     * Every vCPU has its own, see local: the photon threads of a vCPU never run in parallel, so they are updated with
+     * plain increments, no atomic and no cache line shared with another core. They are only read by collect_metrics,
+     * on their own vCPU too.
+     */
+    struct Metrics
+    {
+        uint64_t total_connections_received = 0;
+        uint64_t connected_clients = 0;
+        uint64_t total_commands_processed = 0;
+        uint64_t total_error_replies = 0;
+        // requests which could not be decoded
+        uint64_t protocol_errors = 0;
+        uint64_t net_input_bytes = 0;
+        uint64_t net_output_bytes = 0;
+        // connections refused past maxclients, shared by the vCPUs and only set by collect_metrics
+        uint64_t rejected_connections = 0;
+        std::array<CommandMetrics, COMMAND_TYPE_COUNT> commands{};
+
+        /// local returns the metrics of the calling vCPU.
+        static Metrics& local() noexcept;
+
+        /// record_command records a call of a command which took usec microseconds.
+        void record_command(CommandType type, uint64_t usec, bool failed) noexcept;
+
+        /// record_rejected records a call of a command which was refused.
+        void record_rejected(CommandType type) noexcept;
+
+        Metrics& operator+=(const Metrics& other) noexcept;
+    };
+
+    /**
+     * collect_metrics returns the sum of the metrics of the vCPUs of keyspace, the ones serving the sessions. Each of
+     * them is read from its own vCPU, like the statistics of the shards.
+     */
+    Metrics collect_metrics(Keyspace& keyspace);
+
+    /// count_rejected_connection counts a connection refused past maxclients, from any vCPU.
+    void count_rejected_connection() noexcept;
+
+    /// prometheus_text formats metrics in the text exposition format of Prometheus.
+    std::string prometheus_text(const Metrics& metrics);
+}  // namespace redis
+
+#endif  // METRICS_H
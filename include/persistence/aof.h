@@ -0,0 +1,191 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef AOF_H
+#define AOF_H
+
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <photon/fs/localfs.h>
+#include <photon/thread/thread.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "errors.h"
+
+namespace redis
+{
+    class Keyspace;
+
+    /// FsyncPolicy is the appendfsync option, when the AOF is made durable.
+    enum class FsyncPolicy : uint8_t
+    {
+        // after every batch of writes, before they are acknowledged
+        Always,
+        // once per second, a crash loses at most the last second of writes
+        EverySec,
+        // never, the kernel writes the file back when it wants to
+        No,
+    };
+
+    /// parse_fsync_policy returns the policy named like the Redis appendfsync option, if any.
+    std::optional<FsyncPolicy> parse_fsync_policy(std::string_view name) noexcept;
+
+    std::string_view to_string(FsyncPolicy policy) noexcept;
+
+    /**
+     * @class Aof
+     * @brief The append only file, a log of the write commands replayed at startup.
+     *
+     * Every shard appends the commands applied to it to a log buffer of its own, from the vCPU owning it: logging a
+     * command takes no lock. The commands are written as Redis does, RESP arrays, but in a canonical form which does
+     * not depend on the time: relative expiry times are turned into absolute ones.
+     *
+     * A flusher thread collects the buffers of all the shards and writes them at once with io_uring, a group commit.
+     * The keys of a shard are only ever changed by that shard, so the order of the commands of a shard is all that
+     * matters when the file is replayed. With FsyncPolicy::Always the batch is synced before the clients which sent it
+     * get their replies: durability costs one fdatasync per batch rather than one per command.
+     *
+     * The file is compacted by rewrite, which writes the dataset again in the background while the commands keep
+     * being logged to the current file.
+     */
+    class Aof
+    {
+    public:
+        /// Info are the statistics reported by INFO persistence.
+        struct Info
+        {
+            bool last_write_ok = true;
+            size_t size = 0;
+        };
+
+        Aof(Keyspace& keyspace, std::string path, FsyncPolicy policy);
+
+        /// Stops the flusher, if it was started, after a last flush.
+        ~Aof();
+
+        Aof(const Aof&) = delete;
+        Aof& operator=(const Aof&) = delete;
+
+        /**
+         * open opens the file for appending. A missing file is created with the commands rebuilding the keyspace, so
+         * that the file alone holds the whole dataset. The keys evicted by the shards are logged as DEL from then on.
+         * @return RedisError::io_error if the file cannot be opened or written, errno tells why.
+         */
+        Result<size_t> open();
+
+        /// start starts the flusher thread on the calling vCPU, which must not change before the Aof is destroyed.
+        void start();
+
+        /**
+         * append logs the write command args, which changed key. It must be called from the vCPU owning key, right
+         * after the change.
+         * @return the epoch of the command, to be given to wait_durable.
+         */
+        uint64_t append(std::string_view key, std::initializer_list<std::string_view> args);
+
+        /// wait_durable waits until the commands appended at epoch are on disk, with FsyncPolicy::Always only.
+        void wait_durable(uint64_t epoch);
+
+        /**
+         * flush writes the logs of all the shards to the file, and syncs it if the policy asks for it. It is run by the
+         * flusher, on demand and at least every FLUSH_INTERVAL_US.
+         * @return false if the file could not be written, the logs are written again by the next flush.
+         */
+        bool flush();
+
+        /**
+         * rewrite compacts the file: the dataset is written to a new file from a snapshot of each shard, one shard at a
+         * time, and the commands logged since the snapshot of a shard are kept in a delta buffer. Once the snapshots
+         * are written, the deltas are appended and the new file replaces the current one with a rename, under the
+         * flush lock: the file always holds every command flushed. The snapshot steps are throttled so that a shard
+         * spends at most half of its time on the rewrite. It must not run along with another snapshot of the shards.
+         * @return the size of the new file, RedisError::io_error if it could not be written, errno tells why.
+         */
+        Result<size_t> rewrite();
+
+        [[nodiscard]] FsyncPolicy policy() const noexcept { return policy_; }
+        [[nodiscard]] Info info() const noexcept { return Info{last_write_ok_, size_}; }
+
+        /// FLUSH_INTERVAL_US is the longest time logged commands wait for the flusher when it is not woken up.
+        static constexpr uint64_t FLUSH_INTERVAL_US = 100'000;
+        /// REWRITE_SLICE_US is how long a rewrite keeps a shard busy, in short steps, before pausing as long.
+        static constexpr int64_t REWRITE_SLICE_US = 1'000;
+
+    private:
+        // flush_ is flush with flush_mutex_ held, end_capture stops copying the commands to the deltas
+        bool flush_(bool end_capture);
+        void flush_loop_();
+        // write_ writes data at the end of the file
+        bool write_(std::string_view data);
+        // write_snapshot_ writes the commands rebuilding the keyspace to file, capturing the deltas when rewriting
+        bool write_snapshot_(photon::fs::IFile& file, size_t& size, bool rewriting);
+        // end_rewrite_ drops the deltas of a rewrite which failed
+        void end_rewrite_();
+        // log_evictions_ makes the shards append a DEL for every key they evict
+        void log_evictions_();
+
+        static constexpr size_t NO_CAPTURE = -1;
+
+        // the log of a shard, on its own cache line since every vCPU writes to its own
+        struct alignas(64) ShardLog
+        {
+            std::string buffer;
+            // the commands of buffer from this offset on are also copied to delta, while a rewrite runs
+            size_t capture = NO_CAPTURE;
+            // what was collected by the flusher but not written yet, and the offset it is captured from
+            std::string collected;
+            size_t collected_capture = NO_CAPTURE;
+            // the commands logged since the snapshot of the shard, written to the file being rewritten
+            std::string delta;
+        };
+
+        Keyspace& keyspace_;
+        std::string path_;
+        FsyncPolicy policy_;
+        std::unique_ptr<photon::fs::IFile> file_;
+        std::vector<ShardLog> logs_;
+        std::atomic<size_t> size_{0};
+        std::atomic<bool> last_write_ok_{true};
+        // flushes are serialized
+        photon::mutex flush_mutex_;
+        int64_t last_sync_ms_ = 0;
+        // Commands are appended at epoch_, a flush begins by incrementing it: the commands of an epoch are durable
+        // once durable_ reaches it.
+        std::atomic<uint64_t> epoch_{1};
+        std::atomic<uint64_t> durable_{0};
+        photon::mutex durable_mutex_;
+        photon::condition_variable durable_changed_;
+        // set when a log has commands the flusher was not woken up for
+        std::atomic<bool> dirty_{false};
+        photon::semaphore pending_{0};
+        std::atomic<bool> stopping_{false};
+        photon::join_handle* flusher_ = nullptr;
+    };
+
+    /// AofLoadStats sums up the replay of an AOF file.
+    struct AofLoadStats
+    {
+        uint64_t commands = 0;
+        size_t bytes = 0;
+        // bytes of an incomplete command at the end of the file, cut off
+        size_t truncated = 0;
+    };
+
+    /**
+     * load_aof replays the AOF file at path into keyspace. Like load_rdb, the commands are handed over to their shards
+     * in batches and applied in parallel, in the order of the file for each shard. An incomplete command at the end of
+     * the file, left by a crash in the middle of a write, is cut off the file so that appending goes on after the last
+     * complete one.
+     * @return the statistics of the replay, RedisError::eof if the file cannot be read (errno tells why) or
+     * RedisError::aof_corrupted.
+     */
+    Result<AofLoadStats> load_aof(const std::string& path, Keyspace& keyspace);
+}  // namespace redis
+
+#endif  // AOF_H
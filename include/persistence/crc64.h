@@ -0,0 +1,21 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef CRC64_H
+#define CRC64_H
+
+#include <cstdint>
+#include <span>
+
+namespace redis
+{
+    /**
+     * crc64 extends crc, the checksum of the bytes before data, with data. It is the CRC-64/Jones of Redis, which ends
+     * RDB files: reflected, with an initial value of 0 and no final xor. Bytes are processed 8 at a time with the
+     * slicing-by-8 tables, the checksum of a multi gigabytes snapshot is not the bottleneck of writing it.
+     */
+    uint64_t crc64(uint64_t crc, std::span<const char> data) noexcept;
+}  // namespace redis
+
+#endif  // CRC64_H
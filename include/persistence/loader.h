@@ -0,0 +1,75 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace redis
+{
+    class Keyspace;
+    class MappedFile;
+
+    /// LoadOp is a write replayed into a shard while a file is loaded.
+    enum class LoadOp : uint8_t
+    {
+        Set,
+        Del,
+        ExpireAt,
+        Persist,
+        IncrBy,
+    };
+
+    /**
+     * @class ShardLoader
+     * @brief Hands the writes parsed from a file over to their shards, in batches.
+     *
+     * The file is parsed by the calling thread, the writes are copied to a batch per shard which is posted to the
+     * vCPU of the shard once full. The shards apply their batches in parallel while the parsing goes on: loading scales
+     * with the amount of shards until the parsing is the bottleneck. The pages of the file already copied out are
+     * released on the way, so that a file much larger than the memory can be streamed. Used by load_rdb and load_aof.
+     */
+    class ShardLoader
+    {
+    public:
+        ShardLoader(Keyspace& keyspace, MappedFile& file);
+        /// Wait for the batches being applied, the ones being filled are dropped.
+        ~ShardLoader();
+
+        ShardLoader(const ShardLoader&) = delete;
+        ShardLoader& operator=(const ShardLoader&) = delete;
+
+        /**
+         * add copies a write to the batch of the shard owning key.
+         * @param number the expiry time of Set and ExpireAt, the increment of IncrBy
+         */
+        void add(LoadOp op, std::string_view key, std::string_view value, int64_t number);
+
+        /// parsed tells that the first size bytes of the file are copied out, they are not read again.
+        void parsed(size_t size) noexcept;
+
+        /// reserve sizes every shard for keys keys, once the batches being applied are done.
+        void reserve(size_t keys);
+
+        /// finish hands the batches being filled over and waits until all are applied. @return the writes applied.
+        uint64_t finish();
+
+    private:
+        struct ShardLoad;
+
+        // dispatch_ hands the batch being filled for a shard over to its owner, once the previous one is applied
+        void dispatch_(size_t index);
+
+        Keyspace& keyspace_;
+        MappedFile& file_;
+        std::vector<std::unique_ptr<ShardLoad>> loads_;
+        size_t released_ = 0;
+    };
+}  // namespace redis
+
+#endif  // LOADER_H
@@ -0,0 +1,118 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef PERSISTENCE_H
+#define PERSISTENCE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "aof.h"
+#include "errors.h"
+#include "rdb.h"
+
+namespace redis
+{
+    /**
+     * @class Persistence
+     * @brief Saves the keyspace to its RDB file, for SAVE and BGSAVE, rewrites the AOF for BGREWRITEAOF, and keeps the
+     * statistics of INFO persistence.
+     *
+     * A single save or rewrite runs at a time, they both snapshot the shards. Saves do not fork: see save_rdb, the
+     * commands keep being served while a snapshot is written, SAVE only blocks the connection which sent it. It can be
+     * used from any vCPU.
+     */
+    class Persistence
+    {
+    public:
+        /// BgSave is the outcome of a call to bgsave or bgrewriteaof.
+        enum class BgSave : uint8_t
+        {
+            Started,
+            // a save or a rewrite is running, this one starts once it is over
+            Scheduled,
+            AlreadyRunning,
+        };
+
+        /// Info are the statistics reported by INFO persistence.
+        struct Info
+        {
+            bool bgsave_in_progress = false;
+            uint64_t saves = 0;
+            // unix time in seconds of the last successful save
+            int64_t last_save_time = 0;
+            bool last_bgsave_ok = true;
+            // durations in seconds, -1 if there was none
+            int64_t last_bgsave_time_sec = -1;
+            int64_t current_bgsave_time_sec = -1;
+            uint64_t current_save_keys_processed = 0;
+            uint64_t current_save_keys_total = 0;
+            bool aof_rewrite_in_progress = false;
+            bool aof_rewrite_scheduled = false;
+            uint64_t aof_rewrites = 0;
+            bool aof_last_bgrewrite_ok = true;
+            int64_t aof_last_rewrite_time_sec = -1;
+            int64_t aof_current_rewrite_time_sec = -1;
+        };
+
+        /**
+         * @param path the RDB file snapshots are written to.
+         * @param aof the append only file, if it is enabled.
+         */
+        Persistence(Keyspace& keyspace, std::string path, Aof* aof = nullptr);
+
+        /// Waits for the background save still running, if any.
+        ~Persistence();
+
+        Persistence(const Persistence&) = delete;
+        Persistence& operator=(const Persistence&) = delete;
+
+        /**
+         * save writes a snapshot and returns once it is on disk.
+         * @return the statistics of the save, RedisError::io_error if it failed or RedisError::save_in_progress.
+         */
+        Result<RdbSaveStats> save();
+
+        /// bgsave starts a save in a new photon thread. With schedule, a save requested while one runs is not refused.
+        BgSave bgsave(bool schedule = false);
+
+        /// bgrewriteaof starts a rewrite of the AOF in a new photon thread, or once the running save is over.
+        BgSave bgrewriteaof();
+
+        [[nodiscard]] bool in_progress() const noexcept { return in_progress_; }
+        [[nodiscard]] bool rewriting() const noexcept { return rewriting_; }
+
+        [[nodiscard]] Info info() const noexcept;
+
+    private:
+        // run_ saves the snapshot, in_progress_ is set by the caller and cleared when it is over
+        Result<RdbSaveStats> run_(bool background);
+        void bgsave_main_();
+        void bgrewriteaof_main_();
+        // finish_ clears in_progress_ and starts what was scheduled meanwhile
+        void finish_();
+
+        Keyspace& keyspace_;
+        std::string path_;
+        Aof* aof_;
+        SaveProgress progress_;
+        std::atomic<bool> in_progress_{false};
+        std::atomic<bool> background_{false};
+        std::atomic<bool> scheduled_{false};
+        std::atomic<uint64_t> saves_{0};
+        std::atomic<int64_t> last_save_time_;
+        std::atomic<bool> last_bgsave_ok_{true};
+        std::atomic<int64_t> last_bgsave_time_sec_{-1};
+        // unix time in milliseconds the running save or rewrite began
+        std::atomic<int64_t> started_at_{0};
+        std::atomic<bool> rewriting_{false};
+        std::atomic<bool> rewrite_scheduled_{false};
+        std::atomic<uint64_t> rewrites_{0};
+        std::atomic<bool> last_rewrite_ok_{true};
+        std::atomic<int64_t> last_rewrite_time_sec_{-1};
+    };
+}  // namespace redis
+
+#endif  // PERSISTENCE_H
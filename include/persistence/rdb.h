@@ -0,0 +1,279 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef RDB_H
+#define RDB_H
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "errors.h"
+
+namespace redis
+{
+    class Keyspace;
+
+    /// The constants of the RDB format, named like in the rdb.h of Redis.
+    namespace rdb
+    {
+        constexpr std::string_view MAGIC = "REDIS";
+        // the version written by Redis 7.4, the latest one read
+        constexpr uint32_t VERSION = 12;
+
+        constexpr uint8_t TYPE_STRING = 0;
+        constexpr uint8_t TYPE_LIST = 1;
+        constexpr uint8_t TYPE_SET = 2;
+        constexpr uint8_t TYPE_ZSET = 3;
+        constexpr uint8_t TYPE_HASH = 4;
+        constexpr uint8_t TYPE_ZSET_2 = 5;
+        constexpr uint8_t TYPE_HASH_ZIPMAP = 9;
+        constexpr uint8_t TYPE_LIST_ZIPLIST = 10;
+        constexpr uint8_t TYPE_SET_INTSET = 11;
+        constexpr uint8_t TYPE_ZSET_ZIPLIST = 12;
+        constexpr uint8_t TYPE_HASH_ZIPLIST = 13;
+        constexpr uint8_t TYPE_LIST_QUICKLIST = 14;
+        constexpr uint8_t TYPE_HASH_LISTPACK = 16;
+        constexpr uint8_t TYPE_ZSET_LISTPACK = 17;
+        constexpr uint8_t TYPE_LIST_QUICKLIST_2 = 18;
+        constexpr uint8_t TYPE_SET_LISTPACK = 20;
+
+        constexpr uint8_t OPCODE_SLOT_INFO = 244;
+        constexpr uint8_t OPCODE_FUNCTION2 = 245;
+        constexpr uint8_t OPCODE_FUNCTION_PRE_GA = 246;
+        constexpr uint8_t OPCODE_MODULE_AUX = 247;
+        constexpr uint8_t OPCODE_IDLE = 248;
+        constexpr uint8_t OPCODE_FREQ = 249;
+        constexpr uint8_t OPCODE_AUX = 250;
+        constexpr uint8_t OPCODE_RESIZEDB = 251;
+        constexpr uint8_t OPCODE_EXPIRETIME_MS = 252;
+        constexpr uint8_t OPCODE_EXPIRETIME = 253;
+        constexpr uint8_t OPCODE_SELECTDB = 254;
+        constexpr uint8_t OPCODE_EOF = 255;
+
+        // the two high bits of the first byte of a length tell how it is encoded
+        constexpr uint8_t LEN_6BIT = 0;
+        constexpr uint8_t LEN_14BIT = 1;
+        constexpr uint8_t LEN_ENCODED = 3;
+        constexpr uint8_t LEN_32BIT = 0x80;
+        constexpr uint8_t LEN_64BIT = 0x81;
+
+        // the special encodings of strings, when the length is LEN_ENCODED
+        constexpr uint8_t ENC_INT8 = 0;
+        constexpr uint8_t ENC_INT16 = 1;
+        constexpr uint8_t ENC_INT32 = 2;
+        constexpr uint8_t ENC_LZF = 3;
+    }  // namespace rdb
+
+    /// sync_directory makes the rename of a file of the directory of path durable.
+    void sync_directory(const std::string& path);
+
+    /**
+     * @class MappedFile
+     * @brief A file mapped read only in memory, for a single sequential pass.
+     *
+     * Reading through the mapping saves a copy of every byte to a user buffer, and the kernel reads ahead. The pages
+     * already read can be released so that a snapshot much larger than the memory can be streamed.
+     */
+    class MappedFile
+    {
+    public:
+        /// Map the file at path. is_open is false if it failed, errno tells why.
+        explicit MappedFile(const std::string& path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        [[nodiscard]] bool is_open() const noexcept { return opened_; }
+        [[nodiscard]] std::span<const char> data() const noexcept { return {data_, size_}; }
+
+        /// release drops the pages of the first size bytes from the memory of the process, they must not be read again.
+        void release(size_t size) noexcept;
+
+    private:
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+        // the pages before are released already
+        size_t released_ = 0;
+        bool opened_ = false;
+    };
+
+    /// RdbEvent is what RdbReader::next stopped at.
+    enum class RdbEvent : uint8_t
+    {
+        Key,
+        ResizeDb,
+        End,
+    };
+
+    /// RdbEntry is a key read from an RDB file.
+    struct RdbEntry
+    {
+        // database of the key, and its amount of keys if the file announced it
+        uint64_t db = 0;
+        uint64_t db_size = 0;
+        // one of the rdb::TYPE_ constants
+        uint8_t type = rdb::TYPE_STRING;
+        std::string_view key;
+        // the value of a string, empty for other types
+        std::string_view value;
+        // absolute expiry time in milliseconds, NO_EXPIRY if none
+        int64_t expire_at = -1;
+    };
+
+    /**
+     * @class RdbReader
+     * @brief A streaming parser of the RDB format, from version 1 to rdb::VERSION.
+     *
+     * The reader makes a single pass over the bytes, without copying them: keys and values are views of the input,
+     * except the compressed or integer ones which are decoded to a buffer of the reader. Lists, sets, sorted sets and
+     * hashes are parsed, in all their encodings, but only their key is reported since the keyspace only holds strings.
+     * Modules and streams are not supported.
+     *
+     * The checksum which ends the file is computed on the way, over chunks of CHECKSUM_CHUNK bytes still in the cache,
+     * and verified when the end is reached.
+     */
+    class RdbReader
+    {
+    public:
+        explicit RdbReader(const std::span<const char> data) noexcept : data_(data) {}
+
+        /// read_header checks the magic string. @return the version of the file.
+        Result<uint32_t> read_header();
+
+        /**
+         * next reads up to the next key, or the next size of database, into entry. The views of entry are valid until
+         * the next call. Auxiliary fields and the other opcodes are consumed on the way.
+         * @return RdbEvent::End once the end of the file is read and its checksum verified, RedisError::rdb_corrupted
+         * if the file is truncated, invalid or does not match its checksum, or RedisError::rdb_unsupported.
+         */
+        Result<RdbEvent> next(RdbEntry& entry);
+
+        /// offset returns the amount of bytes consumed.
+        [[nodiscard]] size_t offset() const noexcept { return offset_; }
+
+        /// checksummed returns the amount of bytes added to the checksum, they are not read again.
+        [[nodiscard]] size_t checksummed() const noexcept { return checksummed_; }
+
+        /// CHECKSUM_CHUNK is the amount of bytes parsed between two updates of the checksum.
+        static constexpr size_t CHECKSUM_CHUNK = 1 << 20;
+
+    private:
+        void update_checksum_() noexcept;
+        // verify_checksum_ reads the checksum following the end of the file and compares it to the computed one
+        Result<RdbEvent> verify_checksum_();
+        std::optional<uint8_t> read_byte_();
+        std::optional<std::span<const char>> read_bytes_(size_t size);
+        template<typename T>
+        std::optional<T> read_le_();
+        // read_length_ reads a length, or the special encoding of a string if encoded is set
+        std::optional<uint64_t> read_length_(bool* encoded = nullptr);
+        // read_string_ reads a string, decoding it to buffer when it is compressed or an integer
+        std::optional<std::string_view> read_string_(std::string& buffer);
+        bool skip_string_();
+        // skip_object_ reads an object of the given type, other than a string
+        bool skip_object_(uint8_t type);
+
+        std::span<const char> data_;
+        size_t offset_ = 0;
+        uint32_t version_ = 0;
+        RedisError error_ = RedisError::rdb_corrupted;
+        // the checksum of the bytes before checksummed_
+        uint64_t crc_ = 0;
+        size_t checksummed_ = 0;
+        std::string key_buffer_;
+        std::string value_buffer_;
+    };
+
+    /// RdbLoadStats sums up the loading of an RDB file.
+    struct RdbLoadStats
+    {
+        uint64_t keys = 0;
+        // keys which expired before the file was loaded
+        uint64_t expired = 0;
+        // keys of other databases, or of types not held by the keyspace
+        uint64_t skipped = 0;
+        size_t bytes = 0;
+    };
+
+    /**
+     * load_rdb loads the RDB file at path into keyspace, usually empty. The file is parsed by the calling thread, which
+     * hands the keys over to their shards in batches. The shards insert them in parallel on their own vCPU, while the
+     * parsing goes on: loading scales with the amount of shards until the parsing is the bottleneck.
+     * @return the statistics of the load, RedisError::eof if the file cannot be read (errno tells why) or a parsing
+     * error. After an error, the keys loaded so far are kept.
+     */
+    Result<RdbLoadStats> load_rdb(const std::string& path, Keyspace& keyspace);
+
+    /**
+     * @class RdbWriter
+     * @brief Appends the RDB encoding of a dataset to a buffer, in the format of rdb::VERSION.
+     *
+     * Keys and values made of an integer which fits 32 bits are written with the integer encodings, like Redis does.
+     * Strings are not compressed with LZF: the values of a cache are mostly small, compressing them would cost more
+     * CPU than the IO it saves.
+     */
+    class RdbWriter
+    {
+    public:
+        explicit RdbWriter(std::string& out) noexcept : out_(out) {}
+
+        /// write_header writes the magic string, the version and the auxiliary fields describing the snapshot.
+        void write_header(int64_t now_ms, size_t used_memory);
+
+        void write_aux(std::string_view key, std::string_view value);
+
+        /// select_db starts the keys of database db, holding about size keys of which expires have a time to live.
+        void select_db(uint64_t db, uint64_t size, uint64_t expires);
+
+        /// write_string writes a string key, expiring at expire_at.
+        void write_string(std::string_view key, std::string_view value, int64_t expire_at);
+
+        /// write_end writes the end of file opcode. The checksum of the whole file, write_checksum, must follow.
+        void write_end();
+
+        void write_checksum(uint64_t crc);
+
+    private:
+        void write_byte_(uint8_t value);
+        void write_length_(uint64_t length);
+        void write_string_(std::string_view value);
+
+        std::string& out_;
+    };
+
+    /// SaveProgress lets other threads follow a save.
+    struct SaveProgress
+    {
+        std::atomic<uint64_t> keys_processed{0};
+        // the amount of keys when the save began, expired ones included
+        std::atomic<uint64_t> keys_total{0};
+    };
+
+    /// RdbSaveStats sums up the saving of an RDB file.
+    struct RdbSaveStats
+    {
+        uint64_t keys = 0;
+        size_t bytes = 0;
+    };
+
+    /**
+     * save_rdb writes a snapshot of keyspace to the RDB file at path, without fork. Every shard begins a point in time
+     * snapshot of itself, then serializes it from its own vCPU in steps of SAVE_STEP keys, all the shards in parallel.
+     * The commands keep being served between the steps: a write to a key not serialized yet saves the previous value
+     * aside, so that only the keys changed during the save are copied. Serialized keys are written to path.tmp in
+     * chunks with io_uring, the file is synced then renamed to path, replacing the previous snapshot atomically.
+     * @return the statistics of the save, or RedisError::io_error if the file cannot be written, errno tells why.
+     */
+    Result<RdbSaveStats> save_rdb(const std::string& path, Keyspace& keyspace, SaveProgress* progress = nullptr);
+
+    /// SAVE_STEP is the amount of keys serialized by a shard at once, between two commands it serves.
+    constexpr size_t SAVE_STEP = 128;
+}  // namespace redis
+
+#endif  // RDB_H
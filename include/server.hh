@@ -18,13 +18,40 @@ namespace redis
     {
         size_t worker_thread_count_ = std::thread::hardware_concurrency();
         size_t io_thread_count_ = std::thread::hardware_concurrency();
+        // maxclients, the connections past it are rejected with an error. It sizes the thread pool of the workers too.
         ssize_t max_concurrent_connections_ = 250;
         size_t event_engine_ = photon::INIT_EVENT_IOURING;
         size_t io_engine_ = photon::INIT_IO_NONE;
         photon::net::IPAddr host_{"127.0.0.1"};
         size_t network_read_chunk_{1024};
+        // replies are batched per connection and written once this many bytes are pending
+        size_t output_flush_threshold_{DEFAULT_FLUSH_THRESHOLD};
+        // GET replies of values this large are written from the keyspace, without a copy to the output buffer
+        size_t reference_threshold_{DEFAULT_REFERENCE_THRESHOLD};
+        // the input and output buffer sizes clients are disconnected at
+        ClientLimits client_limits_{};
         uint16_t port_ = 6379;
         size_t max_recursion_depth_ = 30;
+        // frequency of the active expire cycle of each shard
+        uint64_t hz_ = 10;
+        // memory limit of the dataset in bytes, 0 for no limit, and what to evict to stay under it
+        size_t maxmemory_ = 0;
+        EvictionPolicy maxmemory_policy_ = EvictionPolicy::NoEviction;
+        // the snapshot loaded at startup if it exists, and written by SAVE and BGSAVE
+        std::string dir_ = ".";
+        std::string dbfilename_ = "dump.rdb";
+        // the append only file, replayed at startup instead of the snapshot when enabled
+        bool appendonly_ = false;
+        std::string appendfilename_ = "appendonly.aof";
+        FsyncPolicy appendfsync_ = FsyncPolicy::EverySec;
+
+        // Every worker vCPU listens on the port with SO_REUSEPORT and serves the connections it accepts, instead of a
+        // single accept loop handing them over to the pool. The kernel spreads the connections over the listeners.
+        bool reuseport_ = false;
+        // with reuseport_, vCPU i is pinned to CPU i and gets the connections received by that CPU rather than by hash
+        bool reuseport_cpu_steering_ = false;
+        // port of the Prometheus endpoint, which serves the metrics of INFO over HTTP on host_, 0 to disable it
+        uint16_t metrics_port_ = 0;
     };
 
     class Server : public std::enable_shared_from_this<Server>
@@ -51,8 +78,45 @@ namespace redis
         void run();
 
     private:
+        // snapshot_path_ is the path of the RDB file
+        [[nodiscard]] std::string snapshot_path_() const
+        {
+            return this->server_config_.dir_ + "/" + this->server_config_.dbfilename_;
+        }
+        // aof_path_ is the path of the append only file
+        [[nodiscard]] std::string aof_path_() const
+        {
+            return this->server_config_.dir_ + "/" + this->server_config_.appendfilename_;
+        }
+        // load_snapshot_ loads the RDB file of the configuration, if any. @return false if it is corrupted
+        bool load_snapshot_(Keyspace& keyspace) const;
+        // load_aof_ replays the append only file, or loads the snapshot if there is none. @return false if it failed
+        bool load_aof_(Keyspace& keyspace) const;
+
+        // Services are what the sessions of every vCPU share
+        struct Services
+        {
+            Keyspace* keyspace;
+            Persistence* persistence;
+            Aof* aof;
+            // signaled by every listener when it stops, and once it listens or failed to
+            photon::semaphore stopped{0};
+            photon::semaphore listening{0};
+        };
+        // listen_ runs the accept loop of a vCPU listening with SO_REUSEPORT, vcpu is its index in the pool
+        void listen_(Services* services, int vcpu);
+        // admit_ counts a new connection in, or replies with an error and returns false when maxclients are connected
+        bool admit_(photon::net::ISocketStream& stream);
+        // serve_ runs the session of handler, which it owns, on the current vCPU
+        void serve_(Handler* handler);
+        // serve_metrics_ accepts the scrapes of the Prometheus endpoint, each one is answered by a thread of its own
+        void serve_metrics_(Keyspace* keyspace);
+        // scrape_ replies to a scrape with the metrics, closing connection which it owns
+        void scrape_(photon::net::ISocketStream* connection, Keyspace* keyspace);
+
         ServerConfig server_config_{};
         std::unique_ptr<photon::net::ISocketServer> socket_server_;
+        std::atomic<ssize_t> clients_{0};
     };
 }  // namespace redis
 
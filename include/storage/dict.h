@@ -0,0 +1,622 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef DICT_H
+#define DICT_H
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace redis
+{
+    /// hash_key is the hash of keys, shared by the keyspace partitioning and the dictionaries.
+    inline uint64_t hash_key(const std::string_view key) noexcept { return std::hash<std::string_view>{}(key); }
+
+    namespace dict_detail
+    {
+        using ctrl_t = int8_t;
+
+        // A control byte is either one of these two, or the 7 low bits of the hash of a full slot.
+        constexpr ctrl_t EMPTY = -128;  // 0b10000000
+        constexpr ctrl_t DELETED = -2;  // 0b11111110
+
+        constexpr size_t GROUP_WIDTH = 16;
+
+        inline size_t h1(const uint64_t hash) noexcept { return hash >> 7; }
+        inline ctrl_t h2(const uint64_t hash) noexcept { return static_cast<ctrl_t>(hash & 0x7F); }
+
+        /// Group holds the control bytes of GROUP_WIDTH consecutive slots and matches them all at once.
+        struct Group
+        {
+#if defined(__SSE2__)
+            __m128i ctrl;
+
+            explicit Group(const ctrl_t* pos) noexcept : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+
+            /// match returns a bit mask of the slots whose control byte is h.
+            [[nodiscard]] uint32_t match(const ctrl_t h) const noexcept
+            {
+                return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h))));
+            }
+
+            /// match_free returns a bit mask of the empty and deleted slots, the only control bytes below -1.
+            [[nodiscard]] uint32_t match_free() const noexcept
+            {
+                return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl)));
+            }
+#else
+            const ctrl_t* ctrl;
+
+            explicit Group(const ctrl_t* pos) noexcept : ctrl(pos) {}
+
+            [[nodiscard]] uint32_t match(const ctrl_t h) const noexcept
+            {
+                uint32_t mask = 0;
+                for (size_t i = 0; i < GROUP_WIDTH; ++i)
+                {
+                    mask |= static_cast<uint32_t>(ctrl[i] == h) << i;
+                }
+                return mask;
+            }
+
+            [[nodiscard]] uint32_t match_free() const noexcept
+            {
+                uint32_t mask = 0;
+                for (size_t i = 0; i < GROUP_WIDTH; ++i)
+                {
+                    mask |= static_cast<uint32_t>(ctrl[i] < -1) << i;
+                }
+                return mask;
+            }
+#endif
+            [[nodiscard]] uint32_t match_empty() const noexcept { return this->match(EMPTY); }
+        };
+
+        inline uint64_t reverse_bits(uint64_t v) noexcept
+        {
+            v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+            v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+            v = ((v >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((v & 0x0F0F0F0F0F0F0F0FULL) << 4);
+            return __builtin_bswap64(v);
+        }
+    }  // namespace dict_detail
+
+    /**
+     * @class Dict
+     * @brief Open addressing hash table from string keys to V, in the spirit of Swiss tables.
+     *
+     * Slots are stored in flat arrays, next to an array of one control byte per slot holding 7 bits of the key hash.
+     * A lookup loads the 16 control bytes of a group and compares them at once, so most lookups touch a single cache
+     * line of metadata and the slot of the key, with no pointer chasing.
+     *
+     * Growing is incremental, like the Redis dict: a second table is allocated and every following operation moves a
+     * couple of groups to it. A resize never stalls the caller for the time needed to move every entry. Lookups check
+     * both tables while a rehash is running.
+     *
+     * scan walks the table with a cursor that stays valid across resizes. Entries present during the whole iteration
+     * are returned at least once, some may be returned more than once.
+     *
+     * Pointers to values are invalidated by any change of the dictionary.
+     *
+     * The tables and the keys are allocated with Allocator, rebound to each type.
+     */
+    template<typename V, typename Allocator = std::allocator<char>>
+    class Dict
+    {
+        template<typename T>
+        using rebind = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+
+    public:
+        using Key = std::basic_string<char, std::char_traits<char>, rebind<char>>;
+
+        struct Slot
+        {
+            Key key;
+            V value;
+        };
+
+        Dict() = default;
+        ~Dict()
+        {
+            destroy_(tables_[0]);
+            destroy_(tables_[1]);
+        }
+
+        Dict(const Dict&) = delete;
+        Dict& operator=(const Dict&) = delete;
+
+        Dict(Dict&& other) noexcept :
+            tables_{std::exchange(other.tables_[0], {}), std::exchange(other.tables_[1], {})},
+            rehash_index_(other.rehash_index_)
+        {
+        }
+
+        Dict& operator=(Dict&& other) noexcept
+        {
+            if (this != &other)
+            {
+                destroy_(tables_[0]);
+                destroy_(tables_[1]);
+                tables_[0] = std::exchange(other.tables_[0], {});
+                tables_[1] = std::exchange(other.tables_[1], {});
+                rehash_index_ = other.rehash_index_;
+            }
+            return *this;
+        }
+
+        [[nodiscard]] size_t size() const noexcept { return tables_[0].size + tables_[1].size; }
+        [[nodiscard]] bool empty() const noexcept { return this->size() == 0; }
+
+        /// capacity returns the amount of slots, of both tables while rehashing.
+        [[nodiscard]] size_t capacity() const noexcept { return tables_[0].capacity() + tables_[1].capacity(); }
+
+        [[nodiscard]] bool rehashing() const noexcept { return tables_[1].groups != 0; }
+
+        /// find returns the value of key, or nullptr.
+        [[nodiscard]] V* find(const std::string_view key)
+        {
+            this->rehash_step_();
+            return this->lookup_(key, hash_key(key));
+        }
+
+        /**
+         * try_emplace returns the value of key, a default constructed value being inserted if the key is missing.
+         * @return the value and whether it was inserted.
+         */
+        std::pair<V*, bool> try_emplace(const std::string_view key)
+        {
+            this->rehash_step_();
+            const auto hash = hash_key(key);
+            if (auto* value = this->lookup_(key, hash); value != nullptr)
+            {
+                return {value, false};
+            }
+            auto& table = this->table_for_insert_();
+            auto* slot = table.insert(hash);
+            new (slot) Slot{Key(key), V{}};
+            return {&slot->value, true};
+        }
+
+        /// erase removes key. @return true if the key was found.
+        bool erase(const std::string_view key)
+        {
+            this->rehash_step_();
+            const auto hash = hash_key(key);
+            for (auto& table: tables_)
+            {
+                if (const auto index = table.find(key, hash); index != NOT_FOUND)
+                {
+                    table.erase(index);
+                    this->maybe_shrink_();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// reserve makes room for size entries, so that inserting them does not resize the table again.
+        void reserve(const size_t size)
+        {
+            const auto groups = groups_for(size);
+            if (this->rehashing() || groups <= tables_[0].groups)
+            {
+                return;
+            }
+            if (tables_[0].size == 0)
+            {
+                destroy_(tables_[0]);
+                tables_[0] = allocate_(groups);
+                return;
+            }
+            this->start_rehash_(groups);
+        }
+
+        void clear()
+        {
+            destroy_(tables_[0]);
+            destroy_(tables_[1]);
+            tables_[0] = {};
+            tables_[1] = {};
+            rehash_index_ = 0;
+        }
+
+        /**
+         * rehash moves at most groups groups of a running rehash to the new table. It lets an idle owner finish a
+         * rehash faster than the traffic would.
+         * @return true if the rehash is still running.
+         */
+        bool rehash(size_t groups)
+        {
+            while (groups-- > 0 && this->rehashing())
+            {
+                this->move_group_();
+            }
+            return this->rehashing();
+        }
+
+        /**
+         * scan calls fn(key, value) with the entries of a slice of the dictionary and returns the cursor of the next
+         * slice. Iteration starts with cursor 0 and is over when 0 is returned. fn must not change the dictionary.
+         */
+        template<typename F>
+        uint64_t scan(uint64_t cursor, F&& fn)
+        {
+            using dict_detail::reverse_bits;
+            if (this->empty())
+            {
+                return 0;
+            }
+            if (!this->rehashing())
+            {
+                const auto mask = tables_[0].groups - 1;
+                tables_[0].visit_home(cursor & mask, fn);
+                cursor |= ~mask;
+                return reverse_bits(reverse_bits(cursor) + 1);
+            }
+            // The entries of a home group of the small table are spread over several home groups of the large one,
+            // which share the low bits of the cursor. Visit all of them before moving on.
+            auto* small = &tables_[0];
+            auto* large = &tables_[1];
+            if (small->groups > large->groups)
+            {
+                std::swap(small, large);
+            }
+            const auto small_mask = small->groups - 1;
+            const auto large_mask = large->groups - 1;
+            small->visit_home(cursor & small_mask, fn);
+            do
+            {
+                large->visit_home(cursor & large_mask, fn);
+                cursor |= ~large_mask;
+                cursor = reverse_bits(reverse_bits(cursor) + 1);
+            }
+            while (cursor & (small_mask ^ large_mask));
+            return cursor;
+        }
+
+        /**
+         * scanned tells whether an iteration of scan which returned cursor went past the slot of key already, 0 meaning
+         * the iteration did not start. An entry present during the whole iteration was then returned. It only depends
+         * on the hash of the key and on the cursor, so it holds across resizes.
+         */
+        [[nodiscard]] static bool scanned(const std::string_view key, const uint64_t cursor) noexcept
+        {
+            using dict_detail::reverse_bits;
+            // cursors count in reverse binary, the keys of the homes visited so far are below it in that order
+            return cursor != 0 && reverse_bits(dict_detail::h1(hash_key(key))) < reverse_bits(cursor);
+        }
+
+        /**
+         * sample calls fn(key, value) with up to count entries, the first ones found from a random slot. Like Redis
+         * dictGetSomeKeys, the entries are not independent, but it only costs a scan of consecutive slots, bounded by
+         * count * SAMPLE_VISITS slots on a sparse table. fn must not change the dictionary.
+         * @return the amount of entries sampled.
+         */
+        template<typename F>
+        size_t sample(const uint64_t random, const size_t count, F&& fn)
+        {
+            size_t found = 0;
+            for (auto& table: tables_)
+            {
+                if (table.size == 0)
+                {
+                    continue;
+                }
+                const auto mask = table.capacity() - 1;
+                const auto visits = std::min(table.capacity(), count * SAMPLE_VISITS);
+                for (size_t i = 0; i < visits && found < count; ++i)
+                {
+                    const auto index = (random + i) & mask;
+                    if (table.ctrl[index] >= 0)
+                    {
+                        fn(std::as_const(table.slots[index].key), table.slots[index].value);
+                        ++found;
+                    }
+                }
+            }
+            return found;
+        }
+
+        /// for_each calls fn(key, value) for every entry. fn must not change the dictionary.
+        template<typename F>
+        void for_each(F&& fn)
+        {
+            for (auto& table: tables_)
+            {
+                table.for_each(fn);
+            }
+        }
+
+    private:
+        using ctrl_t = dict_detail::ctrl_t;
+        static constexpr size_t NOT_FOUND = SIZE_MAX;
+        static constexpr size_t WIDTH = dict_detail::GROUP_WIDTH;
+        // groups moved by each operation while a rehash is running
+        static constexpr size_t REHASH_STEP = 2;
+        // empty groups skipped in addition by each operation, they only cost a control bytes load
+        static constexpr size_t REHASH_EMPTY_VISITS = 16;
+        // slots visited per entry asked by sample
+        static constexpr size_t SAMPLE_VISITS = 10;
+
+        struct Table
+        {
+            ctrl_t* ctrl = nullptr;
+            Slot* slots = nullptr;
+            // always a power of two
+            size_t groups = 0;
+            size_t size = 0;
+            size_t deleted = 0;
+
+            [[nodiscard]] size_t capacity() const noexcept { return groups * WIDTH; }
+
+            // a table is considered full at 7/8 of its capacity, deleted slots count as used
+            [[nodiscard]] bool full() const noexcept { return (size + deleted + 1) * 8 > this->capacity() * 7; }
+
+            // probe_ returns the index of the i-th group visited for a home group, using triangular numbers which
+            // visit every group of a power of two table.
+            [[nodiscard]] size_t probe(const size_t home, const size_t i) const noexcept
+            {
+                return (home + i * (i + 1) / 2) & (groups - 1);
+            }
+
+            [[nodiscard]] size_t home(const uint64_t hash) const noexcept { return dict_detail::h1(hash) & (groups - 1); }
+
+            [[nodiscard]] size_t find(const std::string_view key, const uint64_t hash) const noexcept
+            {
+                if (groups == 0)
+                {
+                    return NOT_FOUND;
+                }
+                const auto h = dict_detail::h2(hash);
+                const auto start = this->home(hash);
+                for (size_t i = 0; i < groups; ++i)
+                {
+                    const auto base = this->probe(start, i) * WIDTH;
+                    const dict_detail::Group group(ctrl + base);
+                    for (auto mask = group.match(h); mask != 0; mask &= mask - 1)
+                    {
+                        const auto index = base + std::countr_zero(mask);
+                        if (slots[index].key == key)
+                        {
+                            return index;
+                        }
+                    }
+                    // a group with an empty slot was never full, the key would have been placed there
+                    if (group.match_empty() != 0)
+                    {
+                        return NOT_FOUND;
+                    }
+                }
+                return NOT_FOUND;
+            }
+
+            // insert reserves a slot for a key known to be missing and returns it, not constructed.
+            Slot* insert(const uint64_t hash) noexcept
+            {
+                const auto start = this->home(hash);
+                for (size_t i = 0;; ++i)
+                {
+                    const auto base = this->probe(start, i) * WIDTH;
+                    if (const auto mask = dict_detail::Group(ctrl + base).match_free(); mask != 0)
+                    {
+                        const auto index = base + std::countr_zero(mask);
+                        deleted -= ctrl[index] == dict_detail::DELETED;
+                        ctrl[index] = dict_detail::h2(hash);
+                        ++size;
+                        return slots + index;
+                    }
+                }
+            }
+
+            void erase(const size_t index) noexcept
+            {
+                slots[index].~Slot();
+                // Probes only stop on empty slots. A group holding one was never full, so no probe ever went past
+                // it and the slot can be made empty again. Otherwise it must stay a tombstone.
+                const auto base = index - index % WIDTH;
+                if (dict_detail::Group(ctrl + base).match_empty() != 0)
+                {
+                    ctrl[index] = dict_detail::EMPTY;
+                }
+                else
+                {
+                    ctrl[index] = dict_detail::DELETED;
+                    ++deleted;
+                }
+                --size;
+            }
+
+            // visit_home calls fn with every entry whose home group is home
+            template<typename F>
+            void visit_home(const size_t home, F& fn) const
+            {
+                for (size_t i = 0; i < groups; ++i)
+                {
+                    const auto base = this->probe(home, i) * WIDTH;
+                    const dict_detail::Group group(ctrl + base);
+                    for (size_t j = 0; j < WIDTH; ++j)
+                    {
+                        if (ctrl[base + j] >= 0 && this->home(hash_key(slots[base + j].key)) == home)
+                        {
+                            fn(std::as_const(slots[base + j].key), slots[base + j].value);
+                        }
+                    }
+                    if (group.match_empty() != 0)
+                    {
+                        return;
+                    }
+                }
+            }
+
+            template<typename F>
+            void for_each(F& fn) const
+            {
+                for (size_t i = 0; i < this->capacity(); ++i)
+                {
+                    if (ctrl[i] >= 0)
+                    {
+                        fn(std::as_const(slots[i].key), slots[i].value);
+                    }
+                }
+            }
+        };
+
+        static Table allocate_(const size_t groups)
+        {
+            Table table;
+            table.groups = groups;
+            table.ctrl = rebind<ctrl_t>().allocate(table.capacity());
+            std::memset(table.ctrl, dict_detail::EMPTY, table.capacity());
+            table.slots = rebind<Slot>().allocate(table.capacity());
+            return table;
+        }
+
+        static void destroy_(Table& table) noexcept
+        {
+            if (table.groups == 0)
+            {
+                return;
+            }
+            for (size_t i = 0; i < table.capacity(); ++i)
+            {
+                if (table.ctrl[i] >= 0)
+                {
+                    table.slots[i].~Slot();
+                }
+            }
+            rebind<Slot>().deallocate(table.slots, table.capacity());
+            rebind<ctrl_t>().deallocate(table.ctrl, table.capacity());
+        }
+
+        // groups_for returns the amount of groups needed to hold size entries at half load
+        static size_t groups_for(const size_t size) noexcept
+        {
+            return std::bit_ceil(std::max<size_t>(1, (size * 2 + WIDTH - 1) / WIDTH));
+        }
+
+        V* lookup_(const std::string_view key, const uint64_t hash)
+        {
+            for (auto& table: tables_)
+            {
+                if (const auto index = table.find(key, hash); index != NOT_FOUND)
+                {
+                    return &table.slots[index].value;
+                }
+            }
+            return nullptr;
+        }
+
+        // table_for_insert_ returns the table new keys go to, starting a rehash when the current one is full
+        Table& table_for_insert_()
+        {
+            if (this->rehashing())
+            {
+                if (!tables_[1].full())
+                {
+                    return tables_[1];
+                }
+                // the new table filled up before the old one was drained, finish the job
+                this->rehash(SIZE_MAX);
+            }
+            if (tables_[0].groups == 0)
+            {
+                tables_[0] = allocate_(1);
+            }
+            else if (tables_[0].full())
+            {
+                // a table full of tombstones is rebuilt at the same size
+                this->start_rehash_(groups_for(tables_[0].size + 1));
+                return tables_[1];
+            }
+            return tables_[0];
+        }
+
+        void maybe_shrink_()
+        {
+            const auto& table = tables_[0];
+            if (!this->rehashing() && table.groups > 1 && table.size * 8 < table.capacity())
+            {
+                this->start_rehash_(groups_for(table.size));
+            }
+        }
+
+        void start_rehash_(const size_t groups)
+        {
+            tables_[1] = allocate_(groups);
+            rehash_index_ = 0;
+        }
+
+        void rehash_step_()
+        {
+            if (!this->rehashing())
+            {
+                return;
+            }
+            size_t empty_visits = REHASH_EMPTY_VISITS;
+            for (size_t moved = 0; moved < REHASH_STEP && this->rehashing();)
+            {
+                const auto& from = tables_[0];
+                if (from.size != 0 && empty_visits > 0 &&
+                    dict_detail::Group(from.ctrl + rehash_index_ * WIDTH).match_free() == (1u << WIDTH) - 1)
+                {
+                    --empty_visits;
+                    ++rehash_index_;
+                    continue;
+                }
+                this->move_group_();
+                ++moved;
+            }
+        }
+
+        // move_group_ moves the group at rehash_index_ to the new table and swaps the tables once all are moved
+        void move_group_()
+        {
+            auto& from = tables_[0];
+            auto& to = tables_[1];
+            if (from.size != 0)
+            {
+                const auto base = rehash_index_ * WIDTH;
+                for (size_t i = base; i < base + WIDTH; ++i)
+                {
+                    if (from.ctrl[i] < 0)
+                    {
+                        continue;
+                    }
+                    auto* slot = to.insert(hash_key(from.slots[i].key));
+                    new (slot) Slot(std::move(from.slots[i]));
+                    from.slots[i].~Slot();
+                    // a tombstone, the probes of keys not moved yet may go through this group
+                    from.ctrl[i] = dict_detail::DELETED;
+                    --from.size;
+                }
+                ++rehash_index_;
+            }
+            if (from.size == 0)
+            {
+                destroy_(from);
+                tables_[0] = std::exchange(tables_[1], {});
+                rehash_index_ = 0;
+            }
+        }
+
+        // tables_[1] is only allocated while the entries of tables_[0] are moved to it
+        Table tables_[2]{};
+        // next group of tables_[0] to move
+        size_t rehash_index_ = 0;
+    };
+}  // namespace redis
+
+#endif  // DICT_H
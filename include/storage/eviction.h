@@ -0,0 +1,106 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef EVICTION_H
+#define EVICTION_H
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "slab.h"
+
+namespace redis
+{
+    /// EvictionPolicy is the maxmemory-policy, what is evicted when a shard is over its memory limit.
+    enum class EvictionPolicy : uint8_t
+    {
+        NoEviction,
+        AllKeysLru,
+        AllKeysLfu,
+        AllKeysRandom,
+        VolatileLru,
+        VolatileTtl,
+    };
+
+    /// parse_eviction_policy returns the policy named like the Redis maxmemory-policy option, if any.
+    std::optional<EvictionPolicy> parse_eviction_policy(std::string_view name) noexcept;
+
+    std::string_view to_string(EvictionPolicy policy) noexcept;
+
+    /**
+     * The access metadata of a key lives in the 24 spare bits of its value, like Redis does:
+     * - LRU: the clock of the last access, in seconds, wrapping after about 194 days.
+     * - LFU: the minutes of the last decrement on 16 bits, then a logarithmic access counter on 8 bits.
+     */
+    namespace eviction
+    {
+        constexpr uint32_t LRU_CLOCK_MAX = (1u << 24) - 1;
+        // counter of new keys, so that they are not evicted before they had a chance to be accessed
+        constexpr uint8_t LFU_INIT_VAL = 5;
+        // the higher, the more accesses are needed to increment the counter
+        constexpr uint32_t LFU_LOG_FACTOR = 10;
+        // minutes for the counter to be decremented once
+        constexpr uint32_t LFU_DECAY_TIME = 1;
+
+        inline uint32_t lru_clock(const int64_t now_ms) noexcept
+        {
+            return static_cast<uint32_t>(now_ms / 1000) & LRU_CLOCK_MAX;
+        }
+
+        /// lru_idle returns the seconds since the access recorded in meta, the clock wrapping being accounted for.
+        inline uint64_t lru_idle(const uint32_t meta, const int64_t now_ms) noexcept
+        {
+            const auto clock = lru_clock(now_ms);
+            return clock >= meta ? clock - meta : clock + (LRU_CLOCK_MAX - meta);
+        }
+
+        /// lfu_counter returns the access counter of meta, decayed by the time elapsed since it was last decremented.
+        uint8_t lfu_counter(uint32_t meta, int64_t now_ms) noexcept;
+
+        /// lfu_touch returns the metadata of an access to a key whose metadata is meta. random is a random number.
+        uint32_t lfu_touch(uint32_t meta, int64_t now_ms, uint64_t random) noexcept;
+
+        /// lfu_new returns the metadata of a new key.
+        uint32_t lfu_new(int64_t now_ms) noexcept;
+    }  // namespace eviction
+
+    /**
+     * @class EvictionPool
+     * @brief The best candidates for eviction seen by the previous samplings, as in Redis.
+     *
+     * Sampling a few keys at each eviction only gives a rough approximation of LRU. Keeping the best candidates across
+     * samplings makes it much closer, for the cost of a handful of keys. Candidates are sorted by score, the higher the
+     * better to evict. They can be stale: the key may be gone or accessed since it was sampled, the owner checks.
+     */
+    class EvictionPool
+    {
+    public:
+        static constexpr size_t SIZE = 16;
+
+        /// offer adds key to the pool if it has room or if score beats the worst candidate.
+        void offer(std::string_view key, uint64_t score);
+
+        /// pop moves the best candidate to key. @return false if the pool is empty.
+        bool pop(SlabString& key);
+
+        [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+
+        void clear() noexcept;
+
+    private:
+        struct Candidate
+        {
+            SlabString key;
+            uint64_t score = 0;
+        };
+
+        // sorted by ascending score, the best candidate is the last one
+        std::array<Candidate, SIZE> candidates_{};
+        size_t size_ = 0;
+    };
+}  // namespace redis
+
+#endif  // EVICTION_H
@@ -0,0 +1,149 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef KEYSPACE_H
+#define KEYSPACE_H
+
+#include <atomic>
+#include <memory>
+#include <photon/thread/thread.h>
+#include <photon/thread/thread11.h>
+#include <photon/thread/workerpool.h>
+#include <string_view>
+#include <vector>
+
+#include "shard.h"
+
+namespace redis
+{
+    /**
+     * @class Keyspace
+     * @brief The whole dataset, partitioned in one shard per vCPU of the worker pool.
+     *
+     * Shards are shared-nothing: a shard is only touched by the vCPU which owns it, there is no lock on the command
+     * path. A command on a key owned by another vCPU migrates the calling photon thread to the owner, runs there and
+     * migrates back. A migration is a single hand-off through the run queue of the target vCPU, which is much cheaper
+     * than any lock held for the duration of the command.
+     */
+    class Keyspace
+    {
+    public:
+        /// Build a keyspace with shard_count shards which are run inline on the calling vCPU, mostly for tests.
+        explicit Keyspace(size_t shard_count);
+
+        /// Build a keyspace with a shard per vCPU of pool. The pool must outlive the keyspace.
+        explicit Keyspace(photon::WorkPool& pool);
+
+        /// Stops the expire cycles, if they were started.
+        ~Keyspace();
+
+        Keyspace(const Keyspace&) = delete;
+        Keyspace& operator=(const Keyspace&) = delete;
+
+        /**
+         * start_expire_cycle starts a photon thread on the owner of every shard, which removes expired keys hz times per
+         * second. A cycle works in slices of EXPIRE_SLICE_US and yields to the sessions of the vCPU between them, so it
+         * never delays a command by more than a slice. A cycle which cannot catch up stops after a quarter of its
+         * period, the next one carries on.
+         */
+        void start_expire_cycle(uint64_t hz);
+
+        /**
+         * set_maxmemory limits the memory of the dataset to maxmemory bytes, 0 meaning no limit. Shards are
+         * shared-nothing, each of them gets an equal part of the limit and evicts on its own.
+         */
+        void set_maxmemory(size_t maxmemory, EvictionPolicy policy);
+
+        /// set_eviction_listener gives every shard a copy of listener, called from the vCPU owning the shard.
+        void set_eviction_listener(const EvictionListener& listener);
+
+        [[nodiscard]] size_t maxmemory() const noexcept { return maxmemory_; }
+        [[nodiscard]] EvictionPolicy eviction_policy() const noexcept { return policy_; }
+
+        /// stats returns the statistics of all the shards added up.
+        [[nodiscard]] Shard::Stats stats();
+
+        [[nodiscard]] size_t shard_count() const noexcept { return shards_.size(); }
+
+        /// shard_of returns the index of the shard owning key.
+        [[nodiscard]] size_t shard_of(std::string_view key) const noexcept;
+
+        /**
+         * run_on calls fn with the shard at index, on the vCPU owning it. The calling photon thread is migrated there
+         * and brought back before run_on returns. fn must not do any IO bound to the calling vCPU, like writing to a
+         * socket, and must not yield: other threads of the owner would see the shard in the middle of a change.
+         * @return what fn returns.
+         */
+        template<typename F>
+        decltype(auto) run_on(const size_t index, F&& fn)
+        {
+            auto* owner = vcpus_.empty() ? nullptr : vcpus_[index];
+            auto* home = photon::get_vcpu();
+            if (owner == nullptr || owner == home)
+            {
+                return fn(*shards_[index]);
+            }
+            photon::thread_migrate(photon::CURRENT, owner);
+            const Homecoming back{home};
+            return fn(*shards_[index]);
+        }
+
+        /**
+         * post calls fn with the shard at index on the vCPU owning it, without waiting for it: fn runs in a new photon
+         * thread while the caller carries on. It is run inline when the shards are. The rules of run_on apply to fn.
+         */
+        template<typename F>
+        void post(const size_t index, F fn)
+        {
+            auto* owner = vcpus_.empty() ? nullptr : vcpus_[index];
+            if (owner == nullptr)
+            {
+                fn(*shards_[index]);
+                return;
+            }
+            auto* thread =
+                    photon::thread_create11(&Keyspace::run_posted_<F>, new F(std::move(fn)), shards_[index].get());
+            photon::thread_migrate(thread, owner);
+        }
+
+        /// with_key calls fn with the shard owning key, see run_on.
+        template<typename F>
+        decltype(auto) with_key(const std::string_view key, F&& fn)
+        {
+            return this->run_on(this->shard_of(key), std::forward<F>(fn));
+        }
+
+        /// EXPIRE_SLICE_US is the longest run of the expire cycle without yielding.
+        static constexpr int64_t EXPIRE_SLICE_US = 500;
+
+    private:
+        void expire_cycle_(size_t index, uint64_t period_us);
+
+        template<typename F>
+        static void run_posted_(F* fn, Shard* shard)
+        {
+            const std::unique_ptr<F> owned(fn);
+            (*owned)(*shard);
+        }
+
+        // Homecoming migrates the current photon thread back to its vCPU when it goes out of scope
+        struct Homecoming
+        {
+            photon::vcpu_base* home;
+            ~Homecoming() { photon::thread_migrate(photon::CURRENT, home); }
+        };
+
+        std::vector<std::unique_ptr<Shard>> shards_;
+        // vCPU owning each shard, empty when shards are run inline
+        std::vector<photon::vcpu_base*> vcpus_;
+        // expire cycle thread of each shard, running on its owner
+        std::vector<photon::thread*> expire_threads_;
+        std::vector<photon::join_handle*> expire_joins_;
+        std::atomic<bool> stopping_{false};
+        size_t maxmemory_ = 0;
+        EvictionPolicy policy_ = EvictionPolicy::NoEviction;
+    };
+}  // namespace redis
+
+#endif  // KEYSPACE_H
@@ -0,0 +1,349 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "dict.h"
+#include "errors.h"
+#include "eviction.h"
+#include "slab.h"
+#include "timing_wheel.h"
+#include "value.h"
+
+namespace redis
+{
+    /// NO_EXPIRY marks a key without time to live.
+    constexpr int64_t NO_EXPIRY = -1;
+
+    /// unix_time_ms returns the wall clock in milliseconds, the unit used for absolute expiry times.
+    int64_t unix_time_ms() noexcept;
+
+    /// EvictionListener is called with every key a shard evicts, from the vCPU owning it, right before the removal.
+    using EvictionListener = std::function<void(std::string_view key)>;
+
+    /**
+     * @class Shard
+     * @brief A partition of the keyspace.
+     *
+     * A shard is owned by a single vCPU and is only ever accessed from it, so it does not synchronize anything. Keys
+     * are given to a shard by Keyspace::shard_of.
+     *
+     * Expired keys are removed lazily when they are accessed, and actively by active_expire, which pops the deadlines
+     * of a timing wheel. Each key with a time to live has a single live timer: extending a time to live does not add a
+     * timer, the existing one is pushed back when it fires.
+     *
+     * Every byte of the shard, its tables, keys, values and timers, comes from its own SlabAllocator, so that its
+     * memory usage is known exactly.
+     *
+     * A shard can be given a memory limit. make_room then evicts keys following the eviction policy, picked by sampling
+     * like Redis does, with the access metadata of the policy kept in the spare bits of each value.
+     *
+     * A shard can be snapshotted while it keeps serving writes, without fork. The snapshot walks the table with the
+     * scan cursor, and the first change of a key the cursor did not reach yet saves the previous value of the key
+     * aside: only the keys changed while the snapshot runs are copied.
+     */
+    class Shard
+    {
+    public:
+        struct Entry
+        {
+            Value value;
+            // absolute expiry time in milliseconds, or NO_EXPIRY
+            int64_t expire_at = NO_EXPIRY;
+            // deadline of the live timer of the key in the timing wheel, or NO_EXPIRY
+            int64_t timer_at = NO_EXPIRY;
+        };
+
+        struct Stats
+        {
+            // keys removed because their time to live elapsed, lazily or actively
+            uint64_t expired_keys = 0;
+            // keys with a time to live
+            uint64_t volatile_keys = 0;
+            uint64_t keys = 0;
+            // keys evicted to stay under the memory limit
+            uint64_t evicted_keys = 0;
+            // successful and failed lookups of read commands
+            uint64_t keyspace_hits = 0;
+            uint64_t keyspace_misses = 0;
+            SlabAllocator::Stats memory;
+
+            Stats& operator+=(const Stats& other) noexcept
+            {
+                expired_keys += other.expired_keys;
+                volatile_keys += other.volatile_keys;
+                keys += other.keys;
+                evicted_keys += other.evicted_keys;
+                keyspace_hits += other.keyspace_hits;
+                keyspace_misses += other.keyspace_misses;
+                memory += other.memory;
+                return *this;
+            }
+        };
+
+        Shard() : timers_(unix_time_ms()) {}
+
+        /**
+         * set_maxmemory limits the memory of the shard to limit bytes, 0 meaning no limit. The limit is enforced by
+         * make_room, following policy.
+         */
+        void set_maxmemory(size_t limit, EvictionPolicy policy);
+
+        /// set_eviction_listener replaces the listener told about the evicted keys, an empty one removes it.
+        void set_eviction_listener(EvictionListener listener) { on_evict_ = std::move(listener); }
+
+        /**
+         * make_room evicts keys until the shard is under its memory limit, to be called before a write which can grow
+         * it. At most EVICTION_BATCH keys are evicted per call, so a write never waits for more than that: a shard
+         * still above the limit afterward is brought back by the next writes.
+         * @return false if the shard is over its limit and nothing can be evicted, the write must then be refused.
+         */
+        bool make_room();
+
+        /// EVICTION_BATCH is the most keys evicted by a call to make_room.
+        static constexpr size_t EVICTION_BATCH = 64;
+        /// EVICTION_SAMPLES is the amount of keys sampled to find an eviction candidate, maxmemory-samples in Redis.
+        static constexpr size_t EVICTION_SAMPLES = 5;
+
+        /// get returns the value of key, or nullptr if it does not exist. The pointer is valid until the shard changes.
+        [[nodiscard]] const Value* get(std::string_view key);
+
+        /// set stores value at key, expiring at expire_at. Any previous value and time to live are discarded.
+        void set(std::string_view key, std::span<const char> value, int64_t expire_at = NO_EXPIRY);
+
+        /// set stores the value streamed into buffer at key, without copying it.
+        void set(std::string_view key, Value::Buffer&& value, int64_t expire_at = NO_EXPIRY);
+
+        /**
+         * incr_by adds delta to the integer stored at key, a missing key counting as 0. The time to live of the key is
+         * kept.
+         * @return the new value, RedisError::not_integer if the value is not an integer or RedisError::integer_overflow.
+         */
+        Result<int64_t> incr_by(std::string_view key, int64_t delta);
+
+        /// del removes key. @return true if the key existed.
+        bool del(std::string_view key);
+
+        /**
+         * expire sets the absolute expiry time of key in milliseconds. A time in the past deletes the key.
+         * @return true if the key exists.
+         */
+        bool expire(std::string_view key, int64_t at_ms);
+
+        /// persist removes the time to live of key. @return true if the key exists and had one.
+        bool persist(std::string_view key);
+
+        /// expire_time returns the absolute expiry time of key, NO_EXPIRY if it has none, or nullopt if it is missing.
+        [[nodiscard]] std::optional<int64_t> expire_time(std::string_view key);
+
+        /**
+         * active_expire removes the keys whose deadline is at now_ms or before, for about budget_us microseconds.
+         * @return true if every expired key was removed, false if the budget ran out first.
+         */
+        bool active_expire(int64_t now_ms, int64_t budget_us);
+
+        [[nodiscard]] Stats stats() const noexcept
+        {
+            return Stats{expired_keys_, volatile_keys_, static_cast<uint64_t>(entries_.size()), evicted_keys_, hits_,
+                         misses_,       slab_.stats()};
+        }
+
+        /// size returns the amount of keys, expired keys not reclaimed yet included.
+        [[nodiscard]] size_t size() const noexcept { return entries_.size(); }
+
+        /**
+         * scan calls fn(key) with the live keys of a slice of the shard, at least count of them unless the iteration is
+         * over, and returns the cursor of the next slice. The iteration starts and ends with cursor 0.
+         */
+        template<typename F>
+        uint64_t scan(uint64_t cursor, const size_t count, F&& fn)
+        {
+            const SlabAllocator::Scope scope(slab_);
+            const auto now = unix_time_ms();
+            size_t found = 0;
+            // bound the work done on a sparse table, like Redis does
+            size_t budget = count * 10;
+            do
+            {
+                cursor = entries_.scan(cursor,
+                                       [&](const auto& key, const Entry& entry)
+                                       {
+                                           if (entry.expire_at == NO_EXPIRY || entry.expire_at > now)
+                                           {
+                                               fn(std::string_view(key));
+                                               ++found;
+                                           }
+                                       });
+            }
+            while (cursor != 0 && found < count && --budget > 0);
+            return cursor;
+        }
+
+        /**
+         * begin_snapshot starts a point in time snapshot of the shard as of now_ms, read with snapshot_step. Keys which
+         * expire at now_ms or before are left out of it.
+         */
+        void begin_snapshot(int64_t now_ms);
+
+        /**
+         * snapshot_step calls fn(key, value, expire_at) with about count keys of the snapshot, as they were when it
+         * began. Every key is returned once, in no particular order.
+         * @return false once every key was returned, the snapshot is then over.
+         */
+        template<typename F>
+        bool snapshot_step(const size_t count, F&& fn)
+        {
+            const SlabAllocator::Scope scope(slab_);
+            auto& snapshot = snapshot_;
+            if (!snapshot.active)
+            {
+                return false;
+            }
+            const auto live = [&](const int64_t expire_at)
+            { return expire_at == NO_EXPIRY || expire_at > snapshot.at; };
+            size_t found = 0;
+            // bound the work done on a sparse table, like scan does
+            size_t budget = count * 10;
+            while (!snapshot.draining && found < count && budget-- > 0)
+            {
+                const auto from = snapshot.cursor;
+                snapshot.cursor = entries_.scan(
+                        from,
+                        [&](const auto& key, const Entry& entry)
+                        {
+                            // returned by an earlier step already, the table shrank since
+                            if (decltype(entries_)::scanned(key, from))
+                            {
+                                return;
+                            }
+                            // the key changed since the snapshot began, its previous state was saved
+                            if (const auto* preimage = snapshot.preimages.find(key); preimage != nullptr)
+                            {
+                                if (preimage->existed && live(preimage->expire_at))
+                                {
+                                    fn(std::string_view(key), preimage->value, preimage->expire_at);
+                                    ++found;
+                                }
+                                snapshot.preimages.erase(key);
+                                return;
+                            }
+                            if (live(entry.expire_at))
+                            {
+                                fn(std::string_view(key), entry.value, entry.expire_at);
+                                ++found;
+                            }
+                        });
+                snapshot.draining = snapshot.cursor == 0;
+            }
+            // What is left are the keys deleted before the cursor reached them. The preimages do not change anymore,
+            // every key is behind the cursor.
+            while (snapshot.draining && found < count && budget-- > 0)
+            {
+                snapshot.cursor = snapshot.preimages.scan(snapshot.cursor,
+                                                          [&](const auto& key, const Preimage& preimage)
+                                                          {
+                                                              if (preimage.existed && live(preimage.expire_at))
+                                                              {
+                                                                  fn(std::string_view(key), preimage.value,
+                                                                     preimage.expire_at);
+                                                                  ++found;
+                                                              }
+                                                          });
+                if (snapshot.cursor == 0)
+                {
+                    this->end_snapshot();
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /// end_snapshot drops the running snapshot, if any.
+        void end_snapshot();
+
+        [[nodiscard]] bool snapshotting() const noexcept { return snapshot_.active; }
+
+        /// reserve makes room for keys keys, when their amount is known beforehand like when loading a snapshot.
+        void reserve(const size_t keys)
+        {
+            const SlabAllocator::Scope scope(slab_);
+            entries_.reserve(keys);
+        }
+
+        /// rehash lets the owner move a few groups of a running resize while it is idle. @see Dict::rehash
+        bool rehash(const size_t groups)
+        {
+            const SlabAllocator::Scope scope(slab_);
+            return entries_.rehash(groups);
+        }
+
+    private:
+        // find_ looks key up and reclaims it if it expired
+        Entry* find_(std::string_view key);
+        // store_ is set, with the allocator of the shard current
+        void store_(std::string_view key, Value&& value, int64_t expire_at);
+        // set_expiry_ changes the time to live of the entry of key, filing a timer if needed
+        void set_expiry_(std::string_view key, Entry& entry, int64_t at_ms);
+        // erase_ removes the entry of key
+        void erase_(std::string_view key, const Entry& entry);
+        // on_timer_ handles a timer popped from the wheel
+        void on_timer_(const TimingWheel::Timer& timer, int64_t now_ms);
+        // touch_ records an access to entry for the eviction policy
+        void touch_(Entry& entry);
+        // fill_pool_ samples keys into the eviction pool
+        void fill_pool_(int64_t now_ms);
+        // evict_one_ evicts a key following the policy. @return false if there was no candidate
+        bool evict_one_();
+        uint64_t random_() noexcept;
+        // preserve_ saves the state of key, entry being null if it is missing, before the first change of a key the
+        // running snapshot did not reach yet
+        void preserve_(std::string_view key, const Entry* entry);
+
+        // Preimage is the state of a key when the snapshot began
+        struct Preimage
+        {
+            Value value;
+            int64_t expire_at = NO_EXPIRY;
+            // false if the key was created afterward
+            bool existed = false;
+        };
+
+        struct Snapshot
+        {
+            bool active = false;
+            // the table was scanned, the preimages of the deleted keys are left
+            bool draining = false;
+            uint64_t cursor = 0;
+            int64_t at = 0;
+            Dict<Preimage, SlabStdAllocator<char>> preimages;
+        };
+
+        // first, to outlive everything it allocated
+        SlabAllocator slab_;
+        Dict<Entry, SlabStdAllocator<char>> entries_;
+        TimingWheel timers_;
+        EvictionPool pool_;
+        Snapshot snapshot_;
+        uint64_t expired_keys_ = 0;
+        uint64_t volatile_keys_ = 0;
+        uint64_t evicted_keys_ = 0;
+        uint64_t hits_ = 0;
+        uint64_t misses_ = 0;
+        size_t maxmemory_ = 0;
+        EvictionPolicy policy_ = EvictionPolicy::NoEviction;
+        EvictionListener on_evict_;
+        // state of the xorshift generator used by sampling
+        uint64_t random_state_ = 0x9E3779B97F4A7C15ULL;
+    };
+}  // namespace redis
+
+#endif  // SHARD_H
@@ -0,0 +1,259 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace redis
+{
+    /**
+     * @class SlabAllocator
+     * @brief The allocator of the memory of a shard, with exact accounting.
+     *
+     * Small blocks are served from size classes, 4 per power of two, like jemalloc. A class carves its objects from
+     * pages of PAGE_SIZE bytes, which come from ARENA_SIZE arenas mapped on their own and advised to be backed by huge
+     * pages. An arena is aligned on its size and starts with the metadata of its pages, so the page of any small block
+     * is found from its address, without a lookup table. Blocks larger than MAX_SMALL are allocated by malloc, after a
+     * header naming their allocator.
+     *
+     * A page left without live object goes back to the allocator and can be reused by any class, an arena left
+     * without used page is unmapped unless it is the last one.
+     *
+     * Allocators are not thread safe, each shard has its own, only used from the vCPU owning the shard. The allocator
+     * of the code running is set by a Scope, SlabStdAllocator relies on it to stay as small as std::allocator.
+     */
+    class SlabAllocator
+    {
+    public:
+        static constexpr size_t ARENA_SIZE = 2 * 1024 * 1024;
+        static constexpr size_t PAGE_SIZE = 64 * 1024;
+        static constexpr size_t PAGES_PER_ARENA = ARENA_SIZE / PAGE_SIZE;
+        static constexpr size_t MAX_SMALL = 16 * 1024;
+        // blocks are aligned on this, whatever their size
+        static constexpr size_t ALIGNMENT = 16;
+        static constexpr size_t CLASS_COUNT = 36;
+
+        /// CLASS_SIZES are the sizes of the small blocks: every 16 bytes up to 128, then 4 steps per power of two.
+        static constexpr std::array<uint32_t, CLASS_COUNT> CLASS_SIZES = []
+        {
+            std::array<uint32_t, CLASS_COUNT> sizes{};
+            size_t i = 0;
+            for (uint32_t size = 16; size <= 128; size += 16)
+            {
+                sizes[i++] = size;
+            }
+            for (uint32_t base = 128; base < MAX_SMALL; base *= 2)
+            {
+                for (uint32_t step = 1; step <= 4; ++step)
+                {
+                    sizes[i++] = base + step * base / 4;
+                }
+            }
+            return sizes;
+        }();
+        static_assert(CLASS_SIZES.back() == MAX_SMALL);
+
+        struct ClassStats
+        {
+            // live blocks
+            size_t objects = 0;
+            // blocks the pages assigned to the class can hold
+            size_t slots = 0;
+        };
+
+        struct Stats
+        {
+            // bytes requested and not freed yet
+            size_t used = 0;
+            // bytes handed out, rounded up to the size classes and headers of large blocks included
+            size_t allocated = 0;
+            // bytes held from the system: mapped arenas and large blocks
+            size_t resident = 0;
+            std::array<ClassStats, CLASS_COUNT> classes{};
+
+            Stats& operator+=(const Stats& other) noexcept;
+        };
+
+        /**
+         * @class Scope
+         * @brief Makes an allocator the current one of the thread until the scope ends.
+         */
+        class Scope
+        {
+        public:
+            explicit Scope(SlabAllocator& allocator) noexcept : previous_(current_) { current_ = &allocator; }
+            ~Scope() { current_ = previous_; }
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+        private:
+            SlabAllocator* previous_;
+        };
+
+        SlabAllocator() = default;
+        ~SlabAllocator();
+
+        // pages point back to their allocator
+        SlabAllocator(const SlabAllocator&) = delete;
+        SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+        /// allocate returns a block of size bytes, aligned on ALIGNMENT. @throw std::bad_alloc
+        void* allocate(size_t size);
+
+        /// deallocate frees a block of size bytes, whatever the allocator it came from.
+        static void deallocate(void* block, size_t size) noexcept;
+
+        /**
+         * allocate_detached returns a block of size bytes, larger than MAX_SMALL, owned by no allocator: it can be
+         * filled from any thread, then attached to the allocator of a shard. A detached block is freed by deallocate.
+         * @throw std::bad_alloc
+         */
+        static void* allocate_detached(size_t size);
+
+        /// attach makes this allocator the owner of a detached block, it is accounted from then on.
+        void attach(void* block) noexcept;
+
+        /**
+         * pin keeps a block larger than MAX_SMALL allocated past its deallocation, until unpin: its bytes can be read
+         * from another vCPU while the shard goes on. A pinned block is accounted as freed once deallocated.
+         */
+        static void pin(const void* block) noexcept;
+
+        /// unpin releases a pin, from any thread, the block is freed if it was deallocated meanwhile.
+        static void unpin(const void* block) noexcept;
+
+        [[nodiscard]] const Stats& stats() const noexcept { return stats_; }
+
+        /// current returns the allocator set by the innermost Scope of the thread.
+        [[nodiscard]] static SlabAllocator& current() noexcept
+        {
+            assert(current_ != nullptr && "shard memory allocated out of a SlabAllocator::Scope");
+            return *current_;
+        }
+
+        /// class_of returns the index of the class serving blocks of size bytes, size being at most MAX_SMALL.
+        [[nodiscard]] static size_t class_of(const size_t size) noexcept
+        {
+            return CLASS_LOOKUP[(std::max<size_t>(size, 1) + ALIGNMENT - 1) / ALIGNMENT];
+        }
+
+    private:
+        struct Page
+        {
+            // links in the list of the pages of a class with room left, or in the list of unused pages
+            Page* prev = nullptr;
+            Page* next = nullptr;
+            // freed blocks, linked through their first bytes
+            void* free = nullptr;
+            // the next block never handed out and the end of the blocks of the page
+            char* bump = nullptr;
+            char* end = nullptr;
+            uint32_t live = 0;
+            uint32_t slots = 0;
+            uint8_t size_class = 0;
+            bool listed = false;
+        };
+
+        struct Arena
+        {
+            SlabAllocator* owner;
+            uint32_t used_pages;
+            Page pages[PAGES_PER_ARENA];
+        };
+
+        struct PageList
+        {
+            Page* head = nullptr;
+
+            void push(Page* page) noexcept;
+            void remove(Page* page) noexcept;
+        };
+
+        struct alignas(ALIGNMENT) LargeHeader
+        {
+            SlabAllocator* owner;
+            size_t size;
+            // the allocation and the pins, the last one released frees the block
+            std::atomic<uint32_t> refs;
+        };
+
+        static constexpr auto CLASS_LOOKUP = []
+        {
+            std::array<uint8_t, MAX_SMALL / ALIGNMENT + 1> lookup{};
+            size_t index = 0;
+            for (size_t i = 1; i < lookup.size(); ++i)
+            {
+                while (CLASS_SIZES[index] < i * ALIGNMENT)
+                {
+                    ++index;
+                }
+                lookup[i] = static_cast<uint8_t>(index);
+            }
+            return lookup;
+        }();
+
+        // the first page starts after the metadata of the arena
+        static constexpr size_t ARENA_HEADER_SIZE = (sizeof(Arena) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        static_assert(ARENA_HEADER_SIZE + MAX_SMALL <= PAGE_SIZE);
+        static_assert(sizeof(LargeHeader) % ALIGNMENT == 0);
+
+        static Arena* arena_of(const void* block) noexcept
+        {
+            return reinterpret_cast<Arena*>(reinterpret_cast<uintptr_t>(block) & ~(ARENA_SIZE - 1));
+        }
+
+        void* allocate_small_(size_t size_class);
+        void deallocate_small_(Arena* arena, void* block, size_t size) noexcept;
+        // take_page_ returns an unused page set up for size_class, mapping a new arena if needed
+        Page* take_page_(size_t size_class);
+        void release_page_(Arena* arena, Page* page) noexcept;
+        void map_arena_();
+        void unmap_arena_(Arena* arena) noexcept;
+
+        static thread_local SlabAllocator* current_;
+
+        // pages of each class with room for more blocks
+        std::array<PageList, CLASS_COUNT> partial_{};
+        PageList unused_;
+        std::vector<Arena*> arenas_;
+        Stats stats_;
+    };
+
+    /// SlabStdAllocator is a standard allocator taking its memory from the current SlabAllocator.
+    template<typename T>
+    struct SlabStdAllocator
+    {
+        static_assert(alignof(T) <= SlabAllocator::ALIGNMENT);
+        using value_type = T;
+
+        SlabStdAllocator() noexcept = default;
+        template<typename U>
+        SlabStdAllocator(const SlabStdAllocator<U>&) noexcept  // NOLINT(*-explicit-constructor)
+        {
+        }
+
+        T* allocate(const size_t n) { return static_cast<T*>(SlabAllocator::current().allocate(n * sizeof(T))); }
+        void deallocate(T* block, const size_t n) noexcept { SlabAllocator::deallocate(block, n * sizeof(T)); }
+
+        template<typename U>
+        bool operator==(const SlabStdAllocator<U>&) const noexcept
+        {
+            return true;
+        }
+    };
+
+    using SlabString = std::basic_string<char, std::char_traits<char>, SlabStdAllocator<char>>;
+}  // namespace redis
+
+#endif  // SLAB_H
@@ -0,0 +1,105 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "slab.h"
+
+namespace redis
+{
+    /**
+     * @class TimingWheel
+     * @brief Hierarchical timing wheel of key deadlines, with a resolution of a millisecond.
+     *
+     * A deadline is filed in the level of the highest 6 bits digit where it differs from the current tick, in the slot
+     * of that digit. When the clock reaches a slot of an upper level, its timers are cascaded to the lower levels. So
+     * adding a timer is O(1), and popping the due ones only touches the slots of the elapsed ticks, whatever the
+     * amount of keys with a time to live.
+     *
+     * Timers are not removed when a key changes, the owner checks what a popped timer still means.
+     *
+     * Timers are allocated from the current SlabAllocator.
+     */
+    class TimingWheel
+    {
+    public:
+        struct Timer
+        {
+            SlabString key;
+            int64_t at;
+        };
+
+        /// @param now_ms the first tick of the wheel.
+        explicit TimingWheel(int64_t now_ms) : current_(now_ms) {}
+
+        /// add files a timer for key at at_ms. A deadline already elapsed fires on the next advance.
+        void add(std::string_view key, int64_t at_ms);
+
+        [[nodiscard]] size_t size() const noexcept { return size_; }
+
+        /**
+         * advance pops the timers due at now_ms or before, calling on_timer(Timer&) on each of them. out_of_budget() is
+         * called before each timer, advance stops as soon as it returns true and resumes from there on the next call.
+         * on_timer can add timers for later ticks.
+         * @return true if every due timer was popped.
+         */
+        template<typename F, typename B>
+        bool advance(const int64_t now_ms, F&& on_timer, B&& out_of_budget)
+        {
+            while (current_ <= now_ms)
+            {
+                if (!cascaded_)
+                {
+                    this->cascade_();
+                }
+                auto& slot = levels_[0][current_ & (SLOTS - 1)];
+                while (!slot.empty())
+                {
+                    if (out_of_budget())
+                    {
+                        return false;
+                    }
+                    auto timer = std::move(slot.back());
+                    slot.pop_back();
+                    --size_;
+                    on_timer(timer);
+                }
+                release_(slot);
+                ++current_;
+                cascaded_ = false;
+            }
+            return true;
+        }
+
+    private:
+        static constexpr unsigned BITS = 6;
+        static constexpr size_t SLOTS = 1 << BITS;
+        // enough levels for the whole int64_t range
+        static constexpr size_t LEVELS = (64 + BITS - 1) / BITS;
+
+        using Slot = std::vector<Timer, SlabStdAllocator<Timer>>;
+
+        // file_ puts a timer in its slot relative to current_
+        void file_(Timer&& timer);
+        // cascade_ moves down the timers of the upper level slots starting at current_
+        void cascade_();
+        // release_ drops the memory of a slot which held a burst of timers
+        static void release_(Slot& slot);
+
+        std::array<std::array<Slot, SLOTS>, LEVELS> levels_{};
+        // the next tick to process, every timer before it was popped
+        int64_t current_;
+        // the upper levels were cascaded for current_
+        bool cascaded_ = false;
+        size_t size_ = 0;
+    };
+}  // namespace redis
+
+#endif  // TIMING_WHEEL_H
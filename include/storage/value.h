@@ -0,0 +1,200 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+
+namespace redis
+{
+    /**
+     * @class Value
+     * @brief The value of a key, in 16 bytes.
+     *
+     * Values are encoded the way Redis encodes small objects:
+     * - Int: the value is the canonical text of an int64_t, like a counter. It is stored as the integer itself, so
+     *   INCR and friends work on it without any string round trip.
+     * - Embedded: up to EMBEDDED_CAPACITY bytes stored inline, right in the slot of the key. No allocation at all.
+     * - Raw: anything else, in a buffer of the exact size taken from the current SlabAllocator.
+     *
+     * The 4 bytes header holds the encoding, the length of embedded strings and 24 spare bits, meant for eviction
+     * bookkeeping.
+     */
+    class Value
+    {
+    public:
+        enum class Encoding : uint8_t
+        {
+            Embedded = 0,
+            Int = 1,
+            Raw = 2,
+        };
+
+        static constexpr size_t EMBEDDED_CAPACITY = 12;
+        /// MAX_SIZE is the size of the largest value, raw values store their size on 32 bits.
+        static constexpr size_t MAX_SIZE = std::numeric_limits<uint32_t>::max();
+
+        /// IntText is a buffer large enough for the text of any int64_t.
+        using IntText = std::array<char, 20>;
+
+        /**
+         * @class Pin
+         * @brief A reference to the bytes of a large value which keeps them alive, see pin.
+         */
+        class Pin
+        {
+        public:
+            Pin() noexcept = default;
+            ~Pin() { this->reset(); }
+
+            Pin(const Pin&) = delete;
+            Pin& operator=(const Pin&) = delete;
+
+            Pin(Pin&& other) noexcept : bytes_(std::exchange(other.bytes_, {})) {}
+            Pin& operator=(Pin&& other) noexcept
+            {
+                if (this != &other)
+                {
+                    this->reset();
+                    bytes_ = std::exchange(other.bytes_, {});
+                }
+                return *this;
+            }
+
+            [[nodiscard]] bool empty() const noexcept { return bytes_.data() == nullptr; }
+            [[nodiscard]] std::string_view bytes() const noexcept { return bytes_; }
+
+            /// reset releases the bytes, from any thread.
+            void reset() noexcept;
+
+        private:
+            friend class Value;
+            explicit Pin(std::string_view bytes) noexcept;
+
+            std::string_view bytes_;
+        };
+
+        /**
+         * @class Buffer
+         * @brief The storage of a large value, filled before the value exists and from any vCPU, see adopt.
+         */
+        class Buffer
+        {
+        public:
+            Buffer() noexcept = default;
+            /// size must be larger than SlabAllocator::MAX_SMALL. @throw std::length_error over MAX_SIZE, bad_alloc
+            explicit Buffer(size_t size);
+            ~Buffer();
+
+            Buffer(const Buffer&) = delete;
+            Buffer& operator=(const Buffer&) = delete;
+
+            Buffer(Buffer&& other) noexcept :
+                data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0))
+            {
+            }
+            Buffer& operator=(Buffer&& other) noexcept
+            {
+                std::swap(data_, other.data_);
+                std::swap(size_, other.size_);
+                return *this;
+            }
+
+            [[nodiscard]] char* data() const noexcept { return data_; }
+            [[nodiscard]] size_t size() const noexcept { return size_; }
+            [[nodiscard]] bool empty() const noexcept { return data_ == nullptr; }
+
+        private:
+            friend class Value;
+
+            char* data_ = nullptr;
+            size_t size_ = 0;
+        };
+
+        /// An empty string.
+        Value() noexcept = default;
+
+        /// Build a value holding data, with the most compact encoding. @throw std::length_error over MAX_SIZE
+        explicit Value(std::span<const char> data);
+
+        /// Build an integer value.
+        static Value from_int(int64_t value) noexcept;
+
+        /// adopt builds a raw value from the bytes of buffer, not copied: they belong to the current allocator.
+        static Value adopt(Buffer&& buffer) noexcept;
+
+        ~Value() { this->release_(); }
+
+        Value(const Value&) = delete;
+        Value& operator=(const Value&) = delete;
+
+        Value(Value&& other) noexcept;
+        Value& operator=(Value&& other) noexcept;
+
+        [[nodiscard]] Encoding encoding() const noexcept { return static_cast<Encoding>(header_ >> ENCODING_SHIFT); }
+
+        /// size returns the length of the value as a string.
+        [[nodiscard]] size_t size() const noexcept;
+
+        /**
+         * str returns the value as a string. Integers are written in scratch, the view is then valid as long as scratch
+         * is. Other encodings are returned in place.
+         */
+        [[nodiscard]] std::string_view str(IntText& scratch) const noexcept;
+
+        /**
+         * pin returns a reference to the bytes of a Raw value larger than SlabAllocator::MAX_SMALL, valid from any vCPU
+         * until the Pin is released, whatever happens to the value meanwhile. Smaller values are not pinned, the Pin is
+         * then empty.
+         */
+        [[nodiscard]] Pin pin() const noexcept;
+
+        /// integer returns the value of integer encoded values.
+        [[nodiscard]] std::optional<int64_t> integer() const noexcept;
+
+        /// heap_size returns the bytes allocated on the heap for the value, on top of the value itself.
+        [[nodiscard]] size_t heap_size() const noexcept
+        {
+            return this->encoding() == Encoding::Raw ? this->raw_size_() : 0;
+        }
+
+        /// meta returns the 24 spare bits of the header.
+        [[nodiscard]] uint32_t meta() const noexcept { return header_ & META_MASK; }
+        void set_meta(const uint32_t meta) noexcept { header_ = (header_ & ~META_MASK) | (meta & META_MASK); }
+
+    private:
+        static constexpr uint32_t META_MASK = (1u << 24) - 1;
+        static constexpr unsigned LENGTH_SHIFT = 24;
+        static constexpr unsigned ENCODING_SHIFT = 30;
+
+        void set_header_(Encoding encoding, size_t embedded_length) noexcept
+        {
+            header_ = (static_cast<uint32_t>(encoding) << ENCODING_SHIFT) |
+                      (static_cast<uint32_t>(embedded_length) << LENGTH_SHIFT) | this->meta();
+        }
+        [[nodiscard]] size_t embedded_size_() const noexcept { return (header_ >> LENGTH_SHIFT) & 0x3F; }
+        [[nodiscard]] char* raw_data_() const noexcept;
+        [[nodiscard]] uint32_t raw_size_() const noexcept;
+        void release_() noexcept;
+
+        // the integer, the heap pointer and size of raw strings, or the bytes of embedded strings
+        alignas(8) char payload_[EMBEDDED_CAPACITY]{};
+        // encoding (2 bits), embedded length (6 bits), meta (24 bits)
+        uint32_t header_ = 0;
+    };
+
+    static_assert(sizeof(Value) == 16);
+
+    /// parse_canonical_int returns the integer text is the canonical representation of, if any.
+    std::optional<int64_t> parse_canonical_int(std::string_view text) noexcept;
+}  // namespace redis
+
+#endif  // VALUE_H
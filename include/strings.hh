@@ -5,8 +5,24 @@
 #ifndef STRINGS_HH
 #define STRINGS_HH
 
+#include <cstdint>
+#include <string>
+#include <string_view>
+
 namespace utils {
 std::string to_upper(const std::string& s) noexcept;
+
+/**
+ * glob_match matches text against a glob style pattern, like the MATCH option of SCAN. Supports '*', '?', character
+ * classes with ranges and negation ("[a-z]", "[^0-9]"), and '\' to escape the next character.
+ */
+bool glob_match(std::string_view pattern, std::string_view text) noexcept;
+
+/// parse_int converts the whole text to an integer, it returns false if text is not one.
+bool parse_int(std::string_view text, int64_t& out) noexcept;
+
+/// equals_ignore_case compares text to an upper case name, like a command or an option name.
+bool equals_ignore_case(std::string_view text, std::string_view name) noexcept;
 }
 
 
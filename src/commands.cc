@@ -2,85 +2,145 @@
 // Created by ynachi on 9/12/24.
 //
 
+#include <algorithm>
 #include <commands.hh>
 #include <format>
-#include <iostream>
 #include <optional>
-#include <strings.hh>
 
 namespace redis
 {
-    std::optional<Command> _check_array(const Frame& frame)
+    std::optional<Command> _check_array(const FrameView& frame)
     {
-        if (frame.frame_id != FrameID::Array)
+        if (frame.frame_id() != FrameID::Array)
         {
-            return Command{CommandType::ERROR, {"only array can represent a redis command"}};
+            return Command{CommandType::ERROR, "only array can represent a redis command"};
         }
 
-        const auto& array_content = std::get<std::vector<Frame>>(frame.data);
-
-        if (array_content.empty())
+        if (frame.empty())
         {
-            return Command{CommandType::ERROR, {"cannot parse command from empty frame array"}};
+            return Command{CommandType::ERROR, "cannot parse command from empty frame array"};
         }
 
-        for (const auto& [frame_id, _]: array_content)
+        for (const auto item: frame)
         {
-            if (frame_id != FrameID::BulkString)
+            if (item.frame_id() != FrameID::BulkString)
             {
-                return Command{CommandType::ERROR, {"redis command should be an array of bulk strings only"}};
+                return Command{CommandType::ERROR, "redis command should be an array of bulk strings only"};
             }
         }
         return std::nullopt;
     }
 
-    std::string _get_string_at_index(const std::vector<Frame>& frames, const int index)
+    Command _parse_ping_command(const FrameView& frame)
     {
-        const auto& frame_content = std::get<std::string>(frames.at(index).data);
-        return frame_content;
+        if (frame.size() > 2)
+        {
+            return Command{CommandType::ERROR, "PING command must have at most 1 argument"};
+        }
+        return Command{CommandType::PING, frame, find_command("ping")};
     }
 
-    Command _parse_ping_command(const std::vector<Frame>& frames)
+    namespace
     {
-        if (frames.size() > 2)
+        constexpr size_t TABLE_SIZE = 64;
+        // longest command name, longer names cannot be commands
+        constexpr size_t MAX_NAME_SIZE = 16;
+
+        // fold turns ascii letters to lower case, command names are made of letters only
+        constexpr char fold(const char c) noexcept { return c >= 'A' && c <= 'Z' ? static_cast<char>(c | 0x20) : c; }
+
+        // hash_name is a seeded FNV-1a of the case folded name
+        constexpr uint32_t hash_name(const std::string_view name, const uint32_t seed) noexcept
         {
-            return Command{CommandType::ERROR, {"PING command must have at most 1 argument"}};
+            uint32_t hash = 2166136261u ^ seed;
+            for (const char c: name)
+            {
+                hash = (hash ^ static_cast<unsigned char>(fold(c))) * 16777619u;
+            }
+            return hash;
         }
-        Command ping_cmd{CommandType::PING, {"PONG"}};
-        if (frames.size() == 2)
+
+        struct PerfectHash
+        {
+            uint32_t seed = 0;
+            // index in COMMAND_TABLE of the command hashed to each slot, -1 for free slots
+            std::array<int8_t, TABLE_SIZE> slots{};
+        };
+
+        // build_perfect_hash looks for the first seed mapping every command to a different slot
+        constexpr PerfectHash build_perfect_hash()
         {
-            auto ping_msg = _get_string_at_index(frames, 1);
-            ping_cmd.args[0] = std::move(ping_msg);
+            for (uint32_t seed = 1; seed < 100'000; ++seed)
+            {
+                PerfectHash table{seed};
+                table.slots.fill(-1);
+                bool collision = false;
+                for (size_t i = 0; i < COMMAND_TABLE.size() && !collision; ++i)
+                {
+                    auto& slot = table.slots[hash_name(COMMAND_TABLE[i].name, seed) % TABLE_SIZE];
+                    collision = slot != -1;
+                    slot = static_cast<int8_t>(i);
+                }
+                if (!collision)
+                {
+                    return table;
+                }
+            }
+            return {};
         }
-        return ping_cmd;
+
+        constexpr PerfectHash PERFECT_HASH = build_perfect_hash();
+        static_assert(PERFECT_HASH.seed != 0, "no perfect hash seed found for the command table, grow TABLE_SIZE");
+        static_assert(std::ranges::all_of(COMMAND_TABLE,
+                                          [](const auto& spec) { return spec.name.size() <= MAX_NAME_SIZE; }));
+    }  // namespace
+
+    const CommandSpec* find_command(const std::string_view name) noexcept
+    {
+        if (name.size() > MAX_NAME_SIZE)
+        {
+            return nullptr;
+        }
+        const auto index = PERFECT_HASH.slots[hash_name(name, PERFECT_HASH.seed) % TABLE_SIZE];
+        if (index < 0)
+        {
+            return nullptr;
+        }
+        const auto& spec = COMMAND_TABLE[index];
+        if (!std::ranges::equal(name, spec.name, [](const char a, const char b) { return fold(a) == b; }))
+        {
+            return nullptr;
+        }
+        return &spec;
     }
 
-    Command Command::command_from_frame(const Frame& frame) noexcept
+    Command Command::command_from_frame(const FrameView& frame) noexcept
     {
-        std::cout << "received a frame: " << frame.to_string() << "\n";
         // check the validity of the frame first
-        if (const auto& frame_status = _check_array(frame); frame_status.has_value())
+        if (auto frame_status = _check_array(frame); frame_status.has_value())
         {
-            return frame_status.value();
+            return std::move(frame_status.value());
         }
 
-        // get the command name
-        const auto& array_content = std::get<std::vector<Frame>>(frame.data);
-        const auto& command_name = _get_string_at_index(array_content, 0);
-
         // is it an existing known command?
-        if (!redis_command_map.contains(utils::to_upper(command_name)))
+        const auto command_name = frame[0].str();
+        const auto* spec = find_command(command_name);
+        if (spec == nullptr)
+        {
+            return Command{CommandType::ERROR, std::format("unknown command '{}'", command_name)};
+        }
+
+        const auto argc = static_cast<int>(frame.size());
+        if ((spec->arity >= 0 && argc != spec->arity) || (spec->arity < 0 && argc < -spec->arity))
         {
-            return Command{CommandType::ERROR, {std::format("unknown command '{}'", command_name)}};
+            return Command{CommandType::ERROR, std::format("wrong number of arguments for '{}' command", spec->name)};
         }
 
-        switch (const auto command = redis_command_map.at(utils::to_upper(command_name)); command)
+        if (spec->type == CommandType::PING)
         {
-            case CommandType::PING:
-                return _parse_ping_command(array_content);
-            default:
-                return Command{CommandType::ERROR, {std::format("unknown command '{}'", command_name)}};
+            return _parse_ping_command(frame);
         }
+        return Command{spec->type, frame, spec};
     }
 
 }  // namespace redis
@@ -29,6 +29,26 @@ namespace redis
                 return o << "RedisError::generic_network_error";
             case RedisError::max_recursion_depth:
                 return o << "RedisError::max_recursion_depth";
+            case RedisError::not_integer:
+                return o << "RedisError::not_integer";
+            case RedisError::integer_overflow:
+                return o << "RedisError::integer_overflow";
+            case RedisError::out_of_memory:
+                return o << "RedisError::out_of_memory";
+            case RedisError::rdb_corrupted:
+                return o << "RedisError::rdb_corrupted";
+            case RedisError::rdb_unsupported:
+                return o << "RedisError::rdb_unsupported";
+            case RedisError::io_error:
+                return o << "RedisError::io_error";
+            case RedisError::save_in_progress:
+                return o << "RedisError::save_in_progress";
+            case RedisError::aof_corrupted:
+                return o << "RedisError::aof_corrupted";
+            case RedisError::query_buffer_limit:
+                return o << "RedisError::query_buffer_limit";
+            case RedisError::invalid_bulk_length:
+                return o << "RedisError::invalid_bulk_length";
         }
         return o << "redis::RedisError::unknown";
     }
@@ -0,0 +1,115 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "framer/arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace redis
+{
+    Arena::Arena(const size_t block_size) : block_size_(std::max<size_t>(block_size, 64))
+    {
+        // the first block is only allocated when needed, idle connections do not pay for it
+    }
+
+    Arena::Arena(Arena&& other) noexcept :
+        blocks_(std::move(other.blocks_)), block_size_(other.block_size_), used_(other.used_),
+        capacity_(other.capacity_), begin_(other.begin_), cursor_(other.cursor_), end_(other.end_)
+    {
+        other.blocks_.clear();
+        other.used_ = other.capacity_ = 0;
+        other.begin_ = other.cursor_ = other.end_ = nullptr;
+    }
+
+    Arena& Arena::operator=(Arena&& other) noexcept
+    {
+        if (this != &other)
+        {
+            blocks_ = std::move(other.blocks_);
+            block_size_ = other.block_size_;
+            used_ = std::exchange(other.used_, 0);
+            capacity_ = std::exchange(other.capacity_, 0);
+            begin_ = std::exchange(other.begin_, nullptr);
+            cursor_ = std::exchange(other.cursor_, nullptr);
+            end_ = std::exchange(other.end_, nullptr);
+            other.blocks_.clear();
+        }
+        return *this;
+    }
+
+    void Arena::add_block_(const size_t size)
+    {
+        used_ += static_cast<size_t>(cursor_ - begin_);
+        // blocks grow geometrically, a large batch only chains a few of them
+        const auto block_size = std::max({size, block_size_, capacity_});
+        blocks_.push_back(Block{std::make_unique_for_overwrite<char[]>(block_size), block_size});
+        capacity_ += block_size;
+        begin_ = cursor_ = blocks_.back().data.get();
+        end_ = begin_ + block_size;
+    }
+
+    void* Arena::do_allocate(const size_t bytes, const size_t alignment)
+    {
+        auto address = reinterpret_cast<uintptr_t>(cursor_);
+        auto padding = (alignment - address % alignment) % alignment;
+        if (cursor_ == nullptr || padding + bytes > static_cast<size_t>(end_ - cursor_))
+        {
+            // new blocks come from new[], they are aligned for any fundamental type
+            this->add_block_(bytes + alignment);
+            address = reinterpret_cast<uintptr_t>(cursor_);
+            padding = (alignment - address % alignment) % alignment;
+        }
+        auto* result = cursor_ + padding;
+        cursor_ = result + bytes;
+        return result;
+    }
+
+    std::string_view Arena::copy(const std::string_view str)
+    {
+        if (str.empty())
+        {
+            return {};
+        }
+        auto* data = static_cast<char*>(this->allocate(str.size(), 1));
+        std::memcpy(data, str.data(), str.size());
+        return {data, str.size()};
+    }
+
+    void Arena::reset() noexcept
+    {
+        if (blocks_.size() > 1 || capacity_ > MAX_RETAINED)
+        {
+            // Coalesce, so that the next batch of the same size fits in a single block. Allocating can throw, the
+            // arena is then left empty and will allocate on demand.
+            const auto size = capacity_ > MAX_RETAINED ? block_size_ : capacity_;
+            blocks_.clear();
+            capacity_ = 0;
+            used_ = 0;
+            begin_ = cursor_ = end_ = nullptr;
+            try
+            {
+                this->add_block_(size);
+            }
+            catch (const std::bad_alloc&)
+            {
+                return;
+            }
+        }
+        used_ = 0;
+        cursor_ = begin_;
+    }
+
+    void Arena::release() noexcept
+    {
+        blocks_.clear();
+        blocks_.shrink_to_fit();
+        used_ = 0;
+        capacity_ = 0;
+        begin_ = cursor_ = end_ = nullptr;
+    }
+}  // namespace redis
@@ -0,0 +1,154 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "framer/buffer.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include <new>
+
+namespace redis
+{
+    BufferPool& BufferPool::local() noexcept
+    {
+        // the photon threads of a vCPU all run on the same OS thread
+        thread_local BufferPool pool;
+        return pool;
+    }
+
+    size_t BufferPool::class_of(const size_t size) noexcept
+    {
+        if (size < MIN_SIZE || size > MAX_SIZE || !std::has_single_bit(size))
+        {
+            return CLASSES;
+        }
+        return std::countr_zero(size) - std::countr_zero(MIN_SIZE);
+    }
+
+    std::vector<char> BufferPool::acquire(const size_t size)
+    {
+        if (const auto index = class_of(size); index < CLASSES && !free_[index].empty())
+        {
+            auto storage = std::move(free_[index].back());
+            free_[index].pop_back();
+            return storage;
+        }
+        return std::vector<char>(size);
+    }
+
+    void BufferPool::release(std::vector<char>&& storage) noexcept
+    {
+        const auto index = class_of(storage.size());
+        if (index == CLASSES || (free_[index].size() + 1) * storage.size() > MAX_FREE_BYTES)
+        {
+            storage = {};
+            return;
+        }
+        try
+        {
+            free_[index].push_back(std::move(storage));
+        }
+        catch (const std::bad_alloc&)
+        {
+            storage = {};
+        }
+    }
+
+    size_t BufferPool::free_count(const size_t size) const noexcept
+    {
+        const auto index = class_of(size);
+        return index == CLASSES ? 0 : free_[index].size();
+    }
+
+    IOBuffer::~IOBuffer() { BufferPool::local().release(std::move(storage_)); }
+
+    void IOBuffer::release() noexcept
+    {
+        if (this->empty() && !storage_.empty())
+        {
+            BufferPool::local().release(std::move(storage_));
+            read_pos_ = write_pos_ = 0;
+        }
+    }
+
+    std::span<char> IOBuffer::prepare(const size_t n)
+    {
+        if (storage_.empty())
+        {
+            storage_ = BufferPool::local().acquire(std::max(initial_capacity_, n));
+            read_pos_ = write_pos_ = 0;
+            return {storage_.data(), storage_.size()};
+        }
+        if (storage_.size() - write_pos_ >= n)
+        {
+            return {storage_.data() + write_pos_, storage_.size() - write_pos_};
+        }
+
+        const auto live = this->size();
+        // Only compact when the consumed prefix is at least as large as the live region, so every byte moved here
+        // was paid for by a consumed byte. Otherwise, grow the storage.
+        if (read_pos_ >= live && storage_.size() - live >= n)
+        {
+            if (live > 0)
+            {
+                std::memmove(storage_.data(), storage_.data() + read_pos_, live);
+            }
+        }
+        else
+        {
+            auto grown = BufferPool::local().acquire(std::max(storage_.size() * 2, live + n));
+            if (live > 0)
+            {
+                std::memcpy(grown.data(), storage_.data() + read_pos_, live);
+            }
+            BufferPool::local().release(std::move(storage_));
+            storage_ = std::move(grown);
+        }
+        read_pos_ = 0;
+        write_pos_ = live;
+        return {storage_.data() + write_pos_, storage_.size() - write_pos_};
+    }
+
+    void IOBuffer::commit(const size_t n) noexcept
+    {
+        assert(write_pos_ + n <= storage_.size());
+        write_pos_ += n;
+    }
+
+    void IOBuffer::consume(const size_t n) noexcept
+    {
+        assert(n <= this->size());
+        read_pos_ += n;
+        if (read_pos_ == write_pos_)
+        {
+            // Fully drained, rewinding is free.
+            read_pos_ = write_pos_ = 0;
+        }
+    }
+
+    void IOBuffer::erase(const size_t offset, const size_t n) noexcept
+    {
+        assert(offset + n <= this->size());
+        auto* begin = storage_.data() + read_pos_ + offset;
+        std::memmove(begin, begin + n, this->size() - offset - n);
+        write_pos_ -= n;
+        if (read_pos_ == write_pos_)
+        {
+            read_pos_ = write_pos_ = 0;
+        }
+    }
+
+    void IOBuffer::append(const std::span<const char> bytes)
+    {
+        if (bytes.empty())
+        {
+            return;
+        }
+        const auto space = this->prepare(bytes.size());
+        std::memcpy(space.data(), bytes.data(), bytes.size());
+        this->commit(bytes.size());
+    }
+}  // namespace redis
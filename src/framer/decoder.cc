@@ -0,0 +1,229 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "framer/decoder.h"
+
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <photon/common/alog.h>
+
+#include "framer/scan.h"
+
+namespace redis
+{
+    constexpr char CR = '\r';
+    constexpr char LF = '\n';
+
+    namespace
+    {
+        // parse_integer converts the whole line to an integer.
+        std::optional<int64_t> parse_integer(const std::span<const char> line) noexcept
+        {
+            int64_t ans;
+            auto [ptr, ec] = std::from_chars(line.data(), line.data() + line.size(), ans);
+            if (ec != std::errc() || ptr != line.data() + line.size())
+            {
+                return std::nullopt;
+            }
+            return ans;
+        }
+    }  // namespace
+
+    Result<FrameView> Decoder::decode_view(const std::span<const char> input, size_t& consumed,
+                                           const uint8_t max_depth)
+    {
+        consumed = 0;
+        if (this->idle())
+        {
+            // a new frame starts, the nodes of the previous one are not referenced anymore
+            nodes_.clear();
+        }
+        for (;;)
+        {
+            const auto rest = input.subspan(scan_);
+            if (pending_bulk_.has_value())
+            {
+                // The header was decoded by a previous iteration, only wait for the payload and its CRLF.
+                auto& node = nodes_[pending_bulk_.value()];
+                const auto needed = (node.external == nullptr ? node.size : 0) + 2;
+                if (rest.size() < needed)
+                {
+                    return {RedisError::not_enough_data};
+                }
+                if (rest[needed - 2] != CR || rest[needed - 1] != LF)
+                {
+                    return fail_(RedisError::invalid_frame, consumed, scan_ + needed);
+                }
+                node.offset = scan_;
+                scan_ += needed;
+                pending_bulk_.reset();
+            }
+            else
+            {
+                // find the end of the line and validate it in a single pass
+                const auto [lf, stray_cr] = scan_line(rest);
+                if (lf == NO_LF)
+                {
+                    return {RedisError::incomplete_frame};
+                }
+                const auto line_size = lf + 1;
+                const auto line_end = scan_ + line_size;
+                if (line_size < 3)
+                {
+                    LOG_DEBUG("decode: a line is at least made of an identifier and CRLF");
+                    return fail_(RedisError::invalid_frame, consumed, line_end);
+                }
+                if (rest[line_size - 2] != CR)
+                {
+                    LOG_DEBUG("decode: found a standalone LF in the frame, this should not be in simple frames");
+                    return fail_(RedisError::invalid_frame, consumed, line_end);
+                }
+                if (stray_cr)
+                {
+                    LOG_DEBUG("decode: found a standalone CR in the frame, this should not be in simple frames");
+                    return fail_(RedisError::invalid_frame, consumed, line_end);
+                }
+                const auto payload = rest.subspan(1, line_size - 3);
+                if (stack_.size() >= max_depth)
+                {
+                    return fail_(RedisError::max_recursion_depth, consumed, line_end);
+                }
+
+                const auto id = frame_id_from_char(rest[0]);
+                FrameNode node{id, scan_ + 1, payload.size(), 1, 0};
+                switch (id)
+                {
+                    case FrameID::Integer:
+                    {
+                        const auto value = parse_integer(payload);
+                        if (!value.has_value())
+                        {
+                            return fail_(RedisError::atoi, consumed, line_end);
+                        }
+                        node.integer = value.value();
+                        break;
+                    }
+                    case FrameID::SimpleString:
+                    case FrameID::SimpleError:
+                    case FrameID::BigNumber:
+                        break;
+                    case FrameID::Null:
+                        if (!payload.empty())
+                        {
+                            LOG_DEBUG("decode: got a non-null frame with data");
+                            return fail_(RedisError::invalid_frame, consumed, line_end);
+                        }
+                        break;
+                    case FrameID::Boolean:
+                        if (payload.size() != 1 || (payload[0] != 't' && payload[0] != 'f'))
+                        {
+                            LOG_DEBUG("decode: got a bool frame with data other than bool");
+                            return fail_(RedisError::invalid_frame, consumed, line_end);
+                        }
+                        node.integer = payload[0] == 't';
+                        break;
+                    case FrameID::BulkString:
+                    case FrameID::BulkError:
+                    {
+                        const auto size = parse_integer(payload);
+                        if (!size.has_value())
+                        {
+                            return fail_(RedisError::atoi, consumed, line_end);
+                        }
+                        if (size.value() == -1)
+                        {
+                            // if size == -1, the user intent was to specially send empty bulk frame
+                            node.size = 0;
+                            break;
+                        }
+                        if (size.value() < 0)
+                        {
+                            return fail_(RedisError::invalid_frame, consumed, line_end);
+                        }
+                        if (static_cast<size_t>(size.value()) > max_bulk_len_)
+                        {
+                            return fail_(RedisError::invalid_bulk_length, consumed, line_end);
+                        }
+                        node.size = size.value();
+                        nodes_.push_back(node);
+                        pending_bulk_ = nodes_.size() - 1;
+                        scan_ = line_end;
+                        continue;
+                    }
+                    case FrameID::Array:
+                    {
+                        const auto size = parse_integer(payload);
+                        if (!size.has_value())
+                        {
+                            return fail_(RedisError::atoi, consumed, line_end);
+                        }
+                        node.size = std::max<int64_t>(size.value(), 0);
+                        nodes_.push_back(node);
+                        scan_ = line_end;
+                        if (node.size > 0)
+                        {
+                            stack_.push_back(OpenArray{nodes_.size() - 1, size.value()});
+                            continue;
+                        }
+                        break;
+                    }
+                    default:
+                        LOG_DEBUG("decode: unknown frame identifier");
+                        return fail_(RedisError::invalid_frame, consumed, line_end);
+                }
+                if (id != FrameID::Array)
+                {
+                    nodes_.push_back(node);
+                    scan_ = line_end;
+                }
+            }
+
+            // An element is complete, close every array it completes.
+            bool array_pending = false;
+            while (!stack_.empty())
+            {
+                auto& top = stack_.back();
+                if (--top.remaining > 0)
+                {
+                    array_pending = true;
+                    break;
+                }
+                nodes_[top.node].span = static_cast<uint32_t>(nodes_.size() - top.node);
+                stack_.pop_back();
+            }
+            if (!array_pending)
+            {
+                consumed = scan_;
+                scan_ = 0;
+                return {FrameView{nodes_.data(), input.data()}};
+            }
+        }
+    }
+
+    std::optional<Decoder::PendingBulk> Decoder::pending_bulk() const noexcept
+    {
+        if (!pending_bulk_.has_value() || nodes_[pending_bulk_.value()].external != nullptr)
+        {
+            return std::nullopt;
+        }
+        return PendingBulk{scan_, nodes_[pending_bulk_.value()].size};
+    }
+
+    void Decoder::set_bulk_payload(const char* data) noexcept
+    {
+        assert(pending_bulk_.has_value());
+        nodes_[pending_bulk_.value()].external = data;
+    }
+
+    Result<Frame> Decoder::decode(const std::span<const char> input, size_t& consumed, const uint8_t max_depth)
+    {
+        const auto view = this->decode_view(input, consumed, max_depth);
+        if (view.is_error())
+        {
+            return {view.error()};
+        }
+        return {view.value().to_frame()};
+    }
+}  // namespace redis
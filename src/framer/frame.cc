@@ -1,10 +1,10 @@
 //
 // Created by ynachi on 8/17/24.
 //
-#include <format>
+#include <algorithm>
+#include <charconv>
+#include <framer/buffer.h>
 #include <framer/frame.h>
-#include <iostream>
-#include <sstream>
 
 namespace redis
 {
@@ -59,6 +59,43 @@ namespace redis
         return Frame{FrameID::Undefined, std::monostate()};
     }
 
+    size_t header_size(const int64_t n) noexcept
+    {
+        // identifier + digits + CRLF
+        size_t digits = n < 0 ? 2 : 1;
+        for (auto v = n < 0 ? -(n / 10) : n / 10; v != 0; v /= 10)
+        {
+            ++digits;
+        }
+        return 1 + digits + 2;
+    }
+
+    char* encode_header(char* out, const char prefix, const int64_t n) noexcept
+    {
+        *out++ = prefix;
+        out = std::to_chars(out, out + MAX_HEADER_SIZE, n).ptr;
+        *out++ = '\r';
+        *out++ = '\n';
+        return out;
+    }
+
+    namespace
+    {
+        char* encode_crlf(char* out) noexcept
+        {
+            *out++ = '\r';
+            *out++ = '\n';
+            return out;
+        }
+
+        char* encode_line(char* out, const char prefix, const bytes& data) noexcept
+        {
+            *out++ = prefix;
+            out = std::ranges::copy(data, out).out;
+            return encode_crlf(out);
+        }
+    }  // namespace
+
     // use this for debug
     std::string Frame::to_string() const noexcept
     {
@@ -68,63 +105,141 @@ namespace redis
 
     bytes Frame::as_bytes() const noexcept
     {
-        std::vector<char> out;
-        out.push_back(static_cast<char>(frame_id));
+        bytes out(this->encoded_size());
+        this->encode_to(out.data());
+        return out;
+    }
+
+    size_t Frame::encoded_size() const noexcept { return this->copied_size_(SIZE_MAX); }
+
+    size_t Frame::copied_size_(const size_t by_ref_threshold) const noexcept
+    {
         switch (this->frame_id)
         {
             case FrameID::Integer:
-            {
-                auto data_str = std::to_string(std::get<int64_t>(this->data));
-                out.insert(out.end(), data_str.begin(), data_str.end());
-                out.push_back('\r');
-                out.push_back('\n');
-                break;
-            }
+                return header_size(std::get<int64_t>(this->data));
             case FrameID::SimpleString:
             case FrameID::SimpleError:
             case FrameID::BigNumber:
-            {
-                out.insert(out.end(), std::get<bytes>(this->data).begin(), std::get<bytes>(this->data).end());
-                out.push_back('\r');
-                out.push_back('\n');
-                break;
-            }
+                return 1 + std::get<bytes>(this->data).size() + 2;
             case FrameID::BulkString:
             case FrameID::BulkError:
             {
-                auto data = std::get<bytes>(this->data);
-                auto size_str = std::to_string(data.size());
-                out.insert(out.end(), size_str.begin(), size_str.end());
-                out.push_back('\r');
-                out.push_back('\n');
-                out.insert(out.end(), data.begin(), data.end());
-                out.push_back('\r');
-                out.push_back('\n');
-                break;
+                const auto size = std::get<bytes>(this->data).size();
+                const auto payload = size >= by_ref_threshold ? 0 : size;
+                return header_size(static_cast<int64_t>(size)) + payload + 2;
             }
             case FrameID::Boolean:
+                return 4;
+            case FrameID::Array:
+            {
+                const auto& items = std::get<std::vector<Frame>>(this->data);
+                auto total = header_size(static_cast<int64_t>(items.size()));
+                for (const auto& item: items)
+                {
+                    total += item.copied_size_(by_ref_threshold);
+                }
+                return total;
+            }
+            case FrameID::Null:
+            default:
+                return 3;
+        }
+    }
+
+    char* Frame::encode_to(char* out) const noexcept
+    {
+        switch (this->frame_id)
+        {
+            case FrameID::Integer:
+                return encode_header(out, kInteger, std::get<int64_t>(this->data));
+            case FrameID::SimpleString:
+            case FrameID::SimpleError:
+            case FrameID::BigNumber:
+                return encode_line(out, static_cast<char>(this->frame_id), std::get<bytes>(this->data));
+            case FrameID::BulkString:
+            case FrameID::BulkError:
             {
-                auto content = std::get<bool>(this->data) ? std::vector{'t', '\r', '\n'} : std::vector{'f', '\r', '\n'};
-                out.insert(out.end(), content.begin(), content.end());
-                break;
+                const auto& data = std::get<bytes>(this->data);
+                out = encode_header(out, static_cast<char>(this->frame_id), static_cast<int64_t>(data.size()));
+                out = std::ranges::copy(data, out).out;
+                return encode_crlf(out);
             }
+            case FrameID::Boolean:
+                *out++ = kBoolean;
+                *out++ = std::get<bool>(this->data) ? 't' : 'f';
+                return encode_crlf(out);
             case FrameID::Array:
             {
-                for (const auto &frame_value = std::get<std::vector<Frame>>(this->data); const auto &item: frame_value)
+                const auto& items = std::get<std::vector<Frame>>(this->data);
+                out = encode_header(out, kArray, static_cast<int64_t>(items.size()));
+                for (const auto& item: items)
                 {
-                    out.insert(out.end(), item.as_bytes().begin(), item.as_bytes().end());
+                    out = item.encode_to(out);
                 }
-                break;
+                return out;
             }
             case FrameID::Null:
             default:
+                *out++ = kNull;
+                return encode_crlf(out);
+        }
+    }
+
+    void Frame::encode_to(IOBuffer& out) const
+    {
+        const auto size = this->encoded_size();
+        this->encode_to(out.prepare(size).data());
+        out.commit(size);
+    }
+
+    void Frame::encode_to_iov(IOBuffer& scratch, std::vector<iovec>& iov, const size_t by_ref_threshold) const
+    {
+        // Reserve all the copied bytes at once, the iovecs point into the reserved region.
+        const auto size = this->copied_size_(by_ref_threshold);
+        auto* const begin = scratch.prepare(size).data();
+        auto* segment = begin;
+        auto* const end = this->encode_to_iov_(begin, segment, iov, by_ref_threshold);
+        if (end != segment)
+        {
+            iov.push_back({segment, static_cast<size_t>(end - segment)});
+        }
+        scratch.commit(size);
+    }
+
+    char* Frame::encode_to_iov_(char* out, char*& segment, std::vector<iovec>& iov,
+                                const size_t by_ref_threshold) const noexcept
+    {
+        switch (this->frame_id)
+        {
+            case FrameID::BulkString:
+            case FrameID::BulkError:
             {
-                out.push_back('\r');
-                out.push_back('\n');
-                break;
+                const auto& data = std::get<bytes>(this->data);
+                if (data.size() < by_ref_threshold)
+                {
+                    return this->encode_to(out);
+                }
+                out = encode_header(out, static_cast<char>(this->frame_id), static_cast<int64_t>(data.size()));
+                iov.push_back({segment, static_cast<size_t>(out - segment)});
+                // The payload is referenced, not copied. The CRLF which follows starts a new copied segment.
+                iov.push_back({const_cast<char*>(data.data()), data.size()});
+                segment = out;
+                return encode_crlf(out);
+            }
+            case FrameID::Array:
+            {
+                const auto& items = std::get<std::vector<Frame>>(this->data);
+                out = encode_header(out, kArray, static_cast<int64_t>(items.size()));
+                for (const auto& item: items)
+                {
+                    out = item.encode_to_iov_(out, segment, iov, by_ref_threshold);
+                }
+                return out;
             }
+            default:
+                return this->encode_to(out);
         }
-        return out;
     }
 
 }  // namespace redis
@@ -0,0 +1,51 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "framer/frame_view.h"
+
+namespace redis
+{
+    FrameView FrameView::operator[](const size_t index) const noexcept
+    {
+        auto child = node_ + 1;
+        for (size_t i = 0; i < index; ++i)
+        {
+            child += child->span;
+        }
+        return {child, base_};
+    }
+
+    Frame FrameView::to_frame() const
+    {
+        switch (const auto id = this->frame_id())
+        {
+            case FrameID::Integer:
+                return Frame{id, this->integer()};
+            case FrameID::Boolean:
+                return Frame{id, this->boolean()};
+            case FrameID::SimpleString:
+            case FrameID::SimpleError:
+            case FrameID::BigNumber:
+            case FrameID::BulkString:
+            case FrameID::BulkError:
+            {
+                const auto payload = this->str();
+                return Frame{id, bytes(payload.begin(), payload.end())};
+            }
+            case FrameID::Array:
+            {
+                std::vector<Frame> frames;
+                frames.reserve(this->size());
+                for (const auto child: *this)
+                {
+                    frames.emplace_back(child.to_frame());
+                }
+                return Frame{id, std::move(frames)};
+            }
+            case FrameID::Null:
+            default:
+                return Frame{id, std::monostate{}};
+        }
+    }
+}  // namespace redis
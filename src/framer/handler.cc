@@ -5,55 +5,460 @@
 #include "framer/handler.h"
 
 #include <algorithm>
+#include <bit>
+#include <cerrno>
 #include <charconv>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <format>
+#include <iterator>
+#include <limits>
+#include <memory_resource>
+#include <new>
 #include <photon/common/alog.h>
+#include <photon/common/utility.h>
+#include <photon/io/fd-events.h>
+#include <strings.hh>
+#include <sys/socket.h>
+
+#include "metrics/metrics.h"
 
 
 namespace redis
 {
     constexpr char CR = '\r';
     constexpr char LF = '\n';
+    constexpr std::string_view OOM_ERROR = "OOM command not allowed when used memory > 'maxmemory'.";
+
+    using utils::equals_ignore_case;
+    using utils::parse_int;
+
+    namespace
+    {
+        // deadline returns the absolute time in milliseconds amount units of unit_ms from now, nullopt on overflow
+        std::optional<int64_t> deadline(const int64_t amount, const int64_t unit_ms) noexcept
+        {
+            int64_t ms;
+            int64_t at;
+            if (__builtin_mul_overflow(amount, unit_ms, &ms) || __builtin_add_overflow(unix_time_ms(), ms, &at))
+            {
+                return std::nullopt;
+            }
+            return at;
+        }
+
+        // int_text writes value in out and returns it
+        std::string_view int_text(const int64_t value, Value::IntText& out) noexcept
+        {
+            const auto end = std::to_chars(out.data(), out.data() + out.size(), value).ptr;
+            return {out.data(), static_cast<size_t>(end - out.data())};
+        }
+
+        // format_human_bytes writes a size to out like Redis does for the *_human fields
+        template<typename Out>
+        void format_human_bytes(Out out, const size_t size)
+        {
+            constexpr std::string_view units[] = {"B", "K", "M", "G", "T"};
+            auto value = static_cast<double>(size);
+            size_t unit = 0;
+            while (value >= 1024 && unit + 1 < std::size(units))
+            {
+                value /= 1024;
+                ++unit;
+            }
+            if (unit == 0)
+            {
+                std::format_to(out, "{}B", size);
+                return;
+            }
+            std::format_to(out, "{:.2f}{}", value, units[unit]);
+        }
+    }  // namespace
+
+    Handler::Handler(std::unique_ptr<photon::net::ISocketStream> stream, const size_t chunk_size,
+                     const size_t flush_threshold, Keyspace* keyspace, Persistence* persistence, Aof* aof,
+                     const ClientLimits& limits, const size_t reference_threshold) :
+        chunk_size_(chunk_size), buffer_(chunk_size * 2), decoder_(limits.proto_max_bulk_len),
+        out_buffer_(chunk_size), reference_threshold_(reference_threshold), flush_threshold_(flush_threshold),
+        limits_(limits), stream_(std::move(stream)), keyspace_(keyspace), persistence_(persistence), aof_(aof)
+    {
+    }
+
+    void Handler::log_(const std::string_view key, const std::initializer_list<std::string_view> args)
+    {
+        if (aof_ != nullptr)
+        {
+            wait_epoch_ = aof_->append(key, args);
+        }
+    }
+
+    void Handler::write_frame(const Frame& frame)
+    {
+        frame.encode_to(out_buffer_);
+        this->maybe_flush_();
+    }
+
+    ssize_t Handler::send_frame(const Frame& frame)
+    {
+        // replies buffered before this one must be written first
+        if (this->flush() < 0)
+        {
+            return -1;
+        }
+        // Large payloads are referenced by the iovecs instead of being copied, the frame outlives the write.
+        iov_.clear();
+        frame.encode_to_iov(out_buffer_, iov_, flush_threshold_);
+        const auto total = this->writev_(false);
+        out_buffer_.clear();
+        return total;
+    }
+
+    ssize_t Handler::writev_(const bool limited)
+    {
+        auto pending = size_t{0};
+        for (const auto& vec: iov_)
+        {
+            pending += vec.iov_len;
+        }
+        ssize_t total = 0;
+        size_t index = 0;
+        while (index < iov_.size())
+        {
+            const auto count = std::min<size_t>(iov_.size() - index, IOV_MAX);
+            const auto wr = this->send_some_(iov_.data() + index, static_cast<int>(count), pending, limited);
+            if (wr <= 0)
+            {
+                LOG_WARN("failed to write to stream, error: {}", wr);
+                write_failed_ = true;
+                return -1;
+            }
+            total += wr;
+            pending -= wr;
+            Metrics::local().net_output_bytes += wr;
+            // skip what was fully written and adjust a partially written iovec
+            for (auto left = static_cast<size_t>(wr); left > 0;)
+            {
+                auto& vec = iov_[index];
+                const auto step = std::min(left, vec.iov_len);
+                vec.iov_base = static_cast<char*>(vec.iov_base) + step;
+                vec.iov_len -= step;
+                left -= step;
+                if (vec.iov_len == 0)
+                {
+                    ++index;
+                }
+            }
+            if (limited && pending > 0 && !this->check_output_limit_(pending))
+            {
+                return -1;
+            }
+        }
+        return total;
+    }
+
+    ssize_t Handler::send_some_(const iovec* iov, const int count, const size_t pending, const bool limited)
+    {
+        // The writes of photon streams only return once everything is written: a peer which stops reading would hold
+        // the session for as long as it stays connected. A plain socket is written to without blocking instead, and
+        // is waited for no longer than the soft limit allows once it is reached.
+        const auto fd = stream_->get_underlay_fd();
+        if (fd < 0)
+        {
+            return stream_->writev(iov, count);
+        }
+        msghdr message{};
+        message.msg_iov = const_cast<iovec*>(iov);
+        message.msg_iovlen = count;
+        for (;;)
+        {
+            const auto wr = ::sendmsg(fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (wr >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                return wr;
+            }
+            if (limited && !this->check_output_limit_(pending))
+            {
+                return -1;
+            }
+            auto timeout = std::numeric_limits<uint64_t>::max();
+            if (limited && soft_limit_since_ms_ != 0)
+            {
+                const auto& limit = client_class_ == ClientClass::PubSub ? limits_.pubsub : limits_.normal;
+                const auto deadline_ms = soft_limit_since_ms_ + limit.soft_seconds * 1000;
+                // a millisecond past the deadline, so that the next check is past it too
+                timeout = std::max<int64_t>(0, deadline_ms - unix_time_ms() + 1) * 1000;
+            }
+            if (photon::wait_for_fd_writable(fd, timeout) != 0 && errno != ETIMEDOUT)
+            {
+                return -1;
+            }
+        }
+    }
+
+    void Handler::maybe_flush_()
+    {
+        if (const auto pending = this->pending_output();
+            this->check_output_limit_(pending) && pending >= flush_threshold_)
+        {
+            this->flush();
+        }
+    }
+
+    bool Handler::check_output_limit_(const size_t pending)
+    {
+        const auto& limit = client_class_ == ClientClass::PubSub ? limits_.pubsub : limits_.normal;
+        auto reached = limit.hard_bytes != 0 && pending >= limit.hard_bytes;
+        if (limit.soft_bytes != 0 && pending >= limit.soft_bytes)
+        {
+            const auto now = unix_time_ms();
+            if (soft_limit_since_ms_ == 0)
+            {
+                soft_limit_since_ms_ = now;
+            }
+            reached = reached || now - soft_limit_since_ms_ >= limit.soft_seconds * 1000;
+        }
+        else
+        {
+            soft_limit_since_ms_ = 0;
+        }
+        if (reached && !write_failed_)
+        {
+            LOG_WARN("closing a client past its output buffer limit with ", pending, " bytes pending");
+            this->clear_output_();
+            write_failed_ = true;
+        }
+        return !write_failed_;
+    }
+
+    void Handler::write_simple_(const FrameID frame_id, const std::string_view data)
+    {
+        if (frame_id == FrameID::SimpleError)
+        {
+            // it may be written from the vCPU of a shard, whose counters are the ones of the running thread then
+            ++Metrics::local().total_error_replies;
+            error_replied_ = true;
+        }
+        const char header = static_cast<char>(frame_id);
+        out_buffer_.append(std::span(&header, 1));
+        out_buffer_.append(data);
+        out_buffer_.append(std::string_view("\r\n"));
+    }
+
+    void Handler::write_bulk_(const std::string_view data)
+    {
+        char header[MAX_HEADER_SIZE];
+        const auto end = encode_header(header, kBulkString, static_cast<int64_t>(data.size()));
+        out_buffer_.append(std::span<const char>(header, end));
+        out_buffer_.append(data);
+        out_buffer_.append(std::string_view("\r\n"));
+    }
+
+    void Handler::write_null_()
+    {
+        // RESP2 null bulk string, understood by every client
+        out_buffer_.append(std::string_view("$-1\r\n"));
+    }
+
+    void Handler::write_value_(const Value& value)
+    {
+        if (value.size() >= reference_threshold_)
+        {
+            if (auto pin = value.pin(); !pin.empty())
+            {
+                const auto size = pin.bytes().size();
+                char header[MAX_HEADER_SIZE];
+                const auto end = encode_header(header, kBulkString, static_cast<int64_t>(size));
+                out_buffer_.append(std::span<const char>(header, end));
+                references_.push_back(Reference{out_buffer_.size(), std::move(pin)});
+                referenced_bytes_ += size;
+                out_buffer_.append(std::string_view("\r\n"));
+                return;
+            }
+        }
+        Value::IntText scratch;
+        this->write_bulk_(value.str(scratch));
+    }
+
+    void Handler::clear_output_() noexcept
+    {
+        out_buffer_.clear();
+        // the values are released from the vCPU of the connection, the pins are thread safe
+        references_.clear();
+        referenced_bytes_ = 0;
+    }
+
+    void Handler::write_integer_(const int64_t value)
+    {
+        char header[MAX_HEADER_SIZE];
+        const auto end = encode_header(header, kInteger, value);
+        out_buffer_.append(std::span<const char>(header, end));
+    }
+
+    void Handler::write_array_header_(const size_t size)
+    {
+        char header[MAX_HEADER_SIZE];
+        const auto end = encode_header(header, kArray, static_cast<int64_t>(size));
+        out_buffer_.append(std::span<const char>(header, end));
+    }
 
-    Handler::Handler(std::unique_ptr<photon::net::ISocketStream> stream, const size_t chunk_size) :
-        chunk_size_(chunk_size), stream_(std::move(stream))
+    ssize_t Handler::flush()
     {
-        buffer_.reserve(chunk_size_ * 2);
+        if (write_failed_)
+        {
+            return -1;
+        }
+        // the replies to writes are only sent once the writes are durable, when the fsync policy asks for it
+        if (wait_epoch_ != 0)
+        {
+            aof_->wait_durable(wait_epoch_);
+            wait_epoch_ = 0;
+        }
+        if (!references_.empty())
+        {
+            return this->flush_referenced_();
+        }
+        ssize_t total = 0;
+        while (!out_buffer_.empty())
+        {
+            const iovec vec{out_buffer_.data_mut(), out_buffer_.size()};
+            const auto wr = this->send_some_(&vec, 1, out_buffer_.size(), true);
+            if (wr <= 0)
+            {
+                LOG_WARN("failed to write to stream, error: {}", wr);
+                out_buffer_.clear();
+                write_failed_ = true;
+                return -1;
+            }
+            out_buffer_.consume(wr);
+            total += wr;
+            Metrics::local().net_output_bytes += wr;
+            // a peer which does not drain its replies keeps them pending, for as long as the soft limit allows
+            if (!out_buffer_.empty() && !this->check_output_limit_(out_buffer_.size()))
+            {
+                return -1;
+            }
+        }
+        return total;
+    }
+
+    ssize_t Handler::flush_referenced_()
+    {
+        // One writev sends the output buffer and the referenced values in between: they are only copied once, by
+        // the kernel. They stay pinned until then.
+        iov_.clear();
+        size_t offset = 0;
+        for (const auto& reference: references_)
+        {
+            iov_.push_back({out_buffer_.data_mut() + offset, reference.offset - offset});
+            const auto bytes = reference.value.bytes();
+            iov_.push_back({const_cast<char*>(bytes.data()), bytes.size()});
+            offset = reference.offset;
+        }
+        iov_.push_back({out_buffer_.data_mut() + offset, out_buffer_.size() - offset});
+        const auto total = this->writev_(true);
+        this->clear_output_();
+        return total;
     }
 
     Result<ssize_t> Handler::get_more_data_upstream_()
     {
-        char read_buffer[chunk_size_];
-        const auto rd = stream_->recv(read_buffer, chunk_size_);
+        // The buffered input is exhausted, this is the end of the batch. Reply before waiting for the peer.
+        if (this->flush() < 0)
+        {
+            return {RedisError::generic_network_error};
+        }
+        // nothing of the batch is referenced anymore
+        arena_.reset();
+        // The input is only read once the replies are written: a client which does not drain them is not read from.
+        // A frame larger than the limit is not, either.
+        if (buffer_.size() + streamed_bytes_ >= limits_.query_buffer_bytes)
+        {
+            return {RedisError::query_buffer_limit};
+        }
+        // recv straight into the free space of the buffer, there is no intermediate copy.
+        auto rd = ssize_t{-1};
+        if (buffer_.empty())
+        {
+            const auto idle = this->recv_idle_();
+            if (idle.is_error())
+            {
+                return idle;
+            }
+            rd = idle.value();
+        }
+        if (rd < 0)
+        {
+            const auto space = buffer_.prepare(chunk_size_);
+            rd = stream_->recv(space.data(), chunk_size_);
+        }
         if (rd < 0)
         {
             LOG_WARN("failed to read from stream, error: {}", rd);
             return {RedisError::generic_network_error};
         }
-        if (rd == 0 && buffer_.empty()) return {RedisError::eof};
-        if (rd < chunk_size_)
+        if (rd == 0)
         {
-            // getting less than chunk_size means we got EOF
+            // A short read is a normal thing on a socket, only a read of 0 bytes means the peer closed the stream.
             eof_reached_ = true;
+            if (buffer_.empty()) return {RedisError::eof};
+            return {0};
         }
-        this->add_more_data(std::span(read_buffer, rd));
+        buffer_.commit(rd);
+        Metrics::local().net_input_bytes += rd;
         return {rd};
     }
 
+    Result<ssize_t> Handler::recv_idle_()
+    {
+        // Only a plain socket can be waited for, a recv on any other stream waits with the buffer.
+        const auto fd = stream_->get_underlay_fd();
+        if (fd < 0)
+        {
+            return {-1};
+        }
+        // The next request is usually there already, when the client pipelines or is busy: one recv takes it.
+        const auto space = buffer_.prepare(chunk_size_);
+        const auto rd = ::recv(fd, space.data(), chunk_size_, MSG_DONTWAIT);
+        if (rd >= 0)
+        {
+            return {rd};
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            return {-1};
+        }
+        // The connection is idle. Most connections of a pool are, most of the time: they keep no buffer while
+        // waiting, the storage goes back to the pool of the vCPU and is taken again once there is something to read.
+        // The scratch memory of the last batch is freed too, it can be larger than both buffers.
+        buffer_.release();
+        out_buffer_.release();
+        arena_.release();
+        if (photon::wait_for_fd_readable(fd) != 0)
+        {
+            LOG_WARN("failed to wait for the stream to be readable, errno: ", errno);
+            return {RedisError::generic_network_error};
+        }
+        return {-1};
+    }
+
 
     Result<bytes> Handler::read_until(const char c)
     {
+        this->release_view_();
         if (this->empty() && this->seen_eof())
         {
             return {RedisError::eof};
         }
 
-        int64_t cursor{0};
+        size_t cursor{0};
         for (;;)
         {
-            if (auto it = std::ranges::find(buffer_.begin() + cursor, buffer_.end(), c); it != buffer_.end())
+            const auto view = buffer_.readable();
+            if (auto it = std::ranges::find(view.begin() + cursor, view.end(), c); it != view.end())
             {
-                bytes data{buffer_.begin(), it + 1};
-                buffer_.erase(buffer_.begin(), it + 1);
+                bytes data{view.begin(), it + 1};
+                buffer_.consume(data.size());
                 return {data};
             }
             // LOG_DEBUG("could not find the delimiter in the internal buffer, calling more from source stream");
@@ -62,7 +467,7 @@ namespace redis
                 const auto err = buffer_.empty() ? RedisError::eof : RedisError::incomplete_frame;
                 return {err};
             }
-            cursor = static_cast<int64_t>(this->buffer_size());
+            cursor = view.size();
             // read more data from upstream
             auto maybe_error = this->get_more_data_upstream_();
             if (maybe_error.is_error())
@@ -76,6 +481,7 @@ namespace redis
     Result<bytes> Handler::read_exact(const int64_t n)
     {
         assert(n > 0);
+        this->release_view_();
         if (this->empty() && this->seen_eof())
         {
             return {RedisError::eof};
@@ -91,235 +497,804 @@ namespace redis
         {
             return {RedisError::not_enough_data};
         }
-        auto ans = bytes(buffer_.begin(), buffer_.begin() + n);
-        buffer_.erase(buffer_.begin(), buffer_.begin() + n);
+        auto ans = bytes(buffer_.data(), buffer_.data() + n);
+        buffer_.consume(n);
         return {ans};
     }
 
-    Result<bytes> Handler::get_simple_string_()
+    Result<Frame> Handler::decode(const u_int8_t max_depth)
     {
-        const auto maybe_ans = this->read_until(LF);
-        if (maybe_ans.is_error())
-        {
-            return {maybe_ans.error()};
-        }
-        auto ans_view = std::span(maybe_ans.value());
-        if (ans_view.size() < 2)
+        const auto view = this->decode_view(max_depth);
+        if (view.is_error())
         {
-            LOG_DEBUG("get_simple_string: data is less than 2 bytes");
-            return {RedisError::incomplete_frame};
-        };
-        if (ans_view[ans_view.size() - 2] != CR)
-        {
-            LOG_DEBUG("get_simple_string: found a standalone LF in the frame, this should not be in simple frames");
-            return {RedisError::invalid_frame};
+            return {view.error()};
         }
-        if (std::ranges::find(ans_view.begin(), ans_view.end() - 2, CR) != ans_view.end() - 2)
-        {
-            LOG_DEBUG("get_simple_string: found a standalone CR in the frame, this should not be in simple frames");
-            return {RedisError::invalid_frame};
-        }
-        return {bytes(ans_view.begin(), ans_view.end() - 2)};
+        auto frame = view.value().to_frame();
+        this->release_view_();
+        return {std::move(frame)};
     }
 
-    Result<int64_t> Handler::get_integer_()
+    Result<FrameView> Handler::decode_view(const u_int8_t max_depth)
     {
-        const auto maybe_ans = this->get_simple_string_();
-        if (maybe_ans.is_error())
-        {
-            return {maybe_ans.error()};
-        }
-        int64_t ans;
-        auto [_, ec] =
-                std::from_chars(maybe_ans.value().data(), maybe_ans.value().data() + maybe_ans.value().size(), ans);
-        if (ec == std::errc())
+        this->release_view_();
+        for (;;)
         {
-            return {ans};
+            // Always try the buffered bytes first, a pipelined client usually sent the next frame already.
+            size_t consumed = 0;
+            auto result = decoder_.decode_view(buffer_.readable(), consumed, max_depth);
+            if (!result.is_error())
+            {
+                // The frame references the buffer, it is only released on the next decode.
+                view_size_ = consumed;
+                return result;
+            }
+            buffer_.consume(consumed);
+            const auto err = result.error();
+            if (err != RedisError::incomplete_frame && err != RedisError::not_enough_data)
+            {
+                return result;
+            }
+            if (eof_reached_)
+            {
+                if (buffer_.empty() && decoder_.idle())
+                {
+                    return {RedisError::eof};
+                }
+                // The peer is gone, the partial frame will never be completed.
+                buffer_.consume(buffer_.size());
+                decoder_.reset();
+                return result;
+            }
+            // A large bulk string goes straight to the storage of its value, the buffer keeps the size of a chunk.
+            if (const auto bulk = decoder_.pending_bulk(); bulk.has_value() && bulk->size >= PROTO_MBULK_BIG_ARG)
+            {
+                if (auto maybe_error = this->stream_bulk_(bulk.value()); maybe_error.is_error())
+                {
+                    return {maybe_error.error()};
+                }
+                continue;
+            }
+            if (auto maybe_error = this->get_more_data_upstream_();
+                maybe_error.is_error() && maybe_error.error() != RedisError::eof)
+            {
+                return {maybe_error.error()};
+            }
         }
-        return {RedisError::atoi};
     }
 
-
-    Result<bytes> Handler::get_bulk_string_()
+    Result<ssize_t> Handler::stream_bulk_(const Decoder::PendingBulk& bulk)
     {
-        auto size_result = this->get_integer_();
-        if (size_result.is_error())
+        // like get_more_data_upstream_, the replies of the batch are sent before waiting for the peer
+        if (this->flush() < 0)
         {
-            return {size_result.error()};
+            return {RedisError::generic_network_error};
         }
-        auto size = size_result.value();
-        if (size == -1)
+        arena_.reset();
+        // the beginning of the payload, received along with its header, leaves the buffer
+        const auto received = std::min(buffer_.size() - bulk.offset, bulk.size);
+        // the payloads are held until the command runs, they count toward the limit like the buffer
+        if (buffer_.size() - received + streamed_bytes_ + bulk.size > limits_.query_buffer_bytes)
         {
-            // if size == -1, the user intent was to specially send empty bulk frame
-            return {{}};
+            return {RedisError::query_buffer_limit};
         }
-        if (size == 0)
+        Value::Buffer payload;
+        try
         {
-            // LOG_ERROR("decode: got a bulk frame with size 0");
-            return {RedisError::invalid_frame};
+            payload = Value::Buffer(bulk.size);
         }
-
-        // also read the CRLF, hence, size + 2
-        auto interim_read = read_exact(size + 2);
-        if (interim_read.is_error())
+        catch (const std::bad_alloc&)
         {
-            return {interim_read.error()};
+            LOG_WARN("cannot allocate a bulk string of {} bytes", bulk.size);
+            return {RedisError::out_of_memory};
         }
-
-        auto ans_view = std::span(interim_read.value());
-
-
-        if (ans_view[ans_view.size() - 2] != CR || ans_view[ans_view.size() - 1] != LF)
+        std::memcpy(payload.data(), buffer_.data() + bulk.offset, received);
+        buffer_.erase(bulk.offset, received);
+        for (auto filled = received; filled < bulk.size;)
         {
-            return {RedisError::invalid_frame};
+            const auto rd = stream_->recv(payload.data() + filled, bulk.size - filled);
+            if (rd < 0)
+            {
+                LOG_WARN("failed to read from stream, error: {}", rd);
+                return {RedisError::generic_network_error};
+            }
+            if (rd == 0)
+            {
+                // the partial frame is dropped by the caller
+                eof_reached_ = true;
+                return {0};
+            }
+            filled += rd;
+            Metrics::local().net_input_bytes += rd;
         }
-
-        return {bytes(ans_view.begin(), ans_view.end() - 2)};
+        decoder_.set_bulk_payload(payload.data());
+        streamed_bytes_ += bulk.size;
+        streamed_.push_back(std::move(payload));
+        return {static_cast<ssize_t>(bulk.size)};
     }
 
-    Result<FrameID> Handler::get_frame_id_()
+    Value::Buffer* Handler::streamed_payload_(const std::string_view arg) noexcept
     {
-        if (!this->seen_eof())
+        for (auto& payload: streamed_)
         {
-            if (auto maybe_err = this->get_more_data_upstream_(); maybe_err.is_error())
+            if (payload.data() == arg.data())
             {
-                return {maybe_err.error()};
+                return &payload;
             }
         }
-        if (this->empty())
-        {
-            return {RedisError::eof};
-        }
-        auto c = this->buffer_[0];
-        this->buffer_.erase(this->buffer_.begin());
-        return {frame_id_from_char(c)};
+        return nullptr;
     }
 
-    Result<Frame> Handler::decode(const u_int8_t dept, const u_int8_t max_depth)
+    void Handler::handle_command(const Command& command)
     {
-        if (dept >= max_depth)
+        const auto start = std::chrono::steady_clock::now();
+        error_replied_ = false;
+        rejected_ = false;
+        switch (command.type)
         {
-            return {RedisError::max_recursion_depth};
+            case CommandType::PING:
+                if (command.argc() == 1)
+                {
+                    this->write_simple_(FrameID::SimpleString, "PONG");
+                }
+                else
+                {
+                    this->write_bulk_(command.arg(1));
+                }
+                break;
+            case CommandType::GET:
+            case CommandType::SET:
+            case CommandType::DEL:
+            case CommandType::EXPIRE:
+            case CommandType::PEXPIRE:
+            case CommandType::TTL:
+            case CommandType::PTTL:
+            case CommandType::PERSIST:
+            case CommandType::INCR:
+            case CommandType::DECR:
+            case CommandType::INCRBY:
+            case CommandType::DECRBY:
+                if (keyspace_ == nullptr)
+                {
+                    this->write_simple_(FrameID::SimpleError, "ERR command not supported");
+                    break;
+                }
+                this->execute_key_command_(command);
+                break;
+            case CommandType::SCAN:
+                if (keyspace_ == nullptr)
+                {
+                    this->write_simple_(FrameID::SimpleError, "ERR command not supported");
+                    break;
+                }
+                this->execute_scan_(command);
+                break;
+            case CommandType::INFO:
+                if (keyspace_ == nullptr)
+                {
+                    this->write_simple_(FrameID::SimpleError, "ERR command not supported");
+                    break;
+                }
+                this->execute_info_(command);
+                break;
+            case CommandType::COMMAND:
+                this->execute_command_(command);
+                break;
+            case CommandType::SAVE:
+            case CommandType::BGSAVE:
+            case CommandType::BGREWRITEAOF:
+                if (persistence_ == nullptr || (command.type == CommandType::BGREWRITEAOF && aof_ == nullptr))
+                {
+                    this->write_simple_(FrameID::SimpleError, "ERR command not supported");
+                    break;
+                }
+                this->execute_save_(command);
+                break;
+            case CommandType::ERROR:
+            {
+                std::pmr::string message("ERR ", &arena_);
+                message += command.error;
+                this->write_simple_(FrameID::SimpleError, message);
+                break;
+            }
+            default:
+                this->write_simple_(FrameID::SimpleError, "ERR command not supported");
+                break;
         }
-        const auto maybe_id = this->get_frame_id_();
-        if (maybe_id.is_error())
+        // a request which is not a command is not one of the command statistics
+        if (rejected_)
         {
-            return {maybe_id.error()};
+            Metrics::local().record_rejected(command.type);
         }
-        switch (const auto id = maybe_id.value())
+        else if (command.type != CommandType::ERROR)
+        {
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            Metrics::local().record_command(
+                    command.type, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(),
+                    error_replied_);
+        }
+        this->maybe_flush_();
+    }
+
+    void Handler::execute_key_command_(const Command& command)
+    {
+        // The replies are written from the vCPU owning the key, straight into the output buffer. The buffer is only
+        // flushed once the thread is back home.
+        const auto key = command.arg(1);
+        switch (command.type)
         {
-            case FrameID::Integer:
+            case CommandType::GET:
+                keyspace_->with_key(key,
+                                    [&](Shard& shard)
+                                    {
+                                        if (const auto* value = shard.get(key); value != nullptr)
+                                        {
+                                            this->write_value_(*value);
+                                        }
+                                        else
+                                        {
+                                            this->write_null_();
+                                        }
+                                    });
+                break;
+            case CommandType::SET:
             {
-                const auto int_ans = this->get_integer_();
-                if (int_ans.is_error())
+                auto expire_at = NO_EXPIRY;
+                for (size_t i = 3; i < command.argc(); i += 2)
                 {
-                    return {int_ans.error()};
+                    const auto option = command.arg(i);
+                    const auto unit = equals_ignore_case(option, "EX") ? 1000 : equals_ignore_case(option, "PX") ? 1 : 0;
+                    if (unit == 0 || i + 1 >= command.argc() || expire_at != NO_EXPIRY)
+                    {
+                        this->write_simple_(FrameID::SimpleError, "ERR syntax error");
+                        return;
+                    }
+                    int64_t amount;
+                    if (!parse_int(command.arg(i + 1), amount))
+                    {
+                        this->write_simple_(FrameID::SimpleError, "ERR value is not an integer or out of range");
+                        return;
+                    }
+                    const auto at = deadline(amount, unit);
+                    if (amount <= 0 || !at.has_value())
+                    {
+                        this->write_simple_(FrameID::SimpleError, "ERR invalid expire time in 'set' command");
+                        return;
+                    }
+                    expire_at = at.value();
                 }
-                return {Frame{id, int_ans.value()}};
+                const auto value = command.arg(2);
+                auto* streamed = this->streamed_payload_(value);
+                const auto stored = keyspace_->with_key(key,
+                                                        [&](Shard& shard)
+                                                        {
+                                                            if (!shard.make_room())
+                                                            {
+                                                                return false;
+                                                            }
+                                                            // a streamed value is stored as it was received
+                                                            if (streamed != nullptr)
+                                                            {
+                                                                shard.set(key, std::move(*streamed), expire_at);
+                                                            }
+                                                            else
+                                                            {
+                                                                shard.set(key, value, expire_at);
+                                                            }
+                                                            if (expire_at == NO_EXPIRY)
+                                                            {
+                                                                this->log_(key, {"SET", key, value});
+                                                            }
+                                                            else
+                                                            {
+                                                                Value::IntText at;
+                                                                this->log_(key, {"SET", key, value, "PXAT",
+                                                                                 int_text(expire_at, at)});
+                                                            }
+                                                            return true;
+                                                        });
+                if (!stored)
+                {
+                    rejected_ = true;
+                    this->write_simple_(FrameID::SimpleError, OOM_ERROR);
+                    break;
+                }
+                this->write_simple_(FrameID::SimpleString, "OK");
+                break;
+            }
+            case CommandType::DEL:
+            {
+                // every key is deleted on its own shard, they can be owned by different vCPUs
+                int64_t deleted = 0;
+                command.for_each_key(
+                        [&](const size_t i)
+                        {
+                            const auto k = command.arg(i);
+                            deleted += keyspace_->with_key(k,
+                                                           [&](Shard& shard)
+                                                           {
+                                                               const auto found = shard.del(k);
+                                                               if (found)
+                                                               {
+                                                                   this->log_(k, {"DEL", k});
+                                                               }
+                                                               return found;
+                                                           });
+                        });
+                this->write_integer_(deleted);
+                break;
             }
-            case FrameID::SimpleString:
-            case FrameID::SimpleError:
-            case FrameID::BigNumber:
+            case CommandType::EXPIRE:
+            case CommandType::PEXPIRE:
             {
-                const auto simple_str_ans = this->get_simple_string_();
-                if (simple_str_ans.is_error())
+                const auto is_expire = command.type == CommandType::EXPIRE;
+                int64_t amount;
+                if (!parse_int(command.arg(2), amount))
+                {
+                    this->write_simple_(FrameID::SimpleError, "ERR value is not an integer or out of range");
+                    break;
+                }
+                const auto at = deadline(amount, is_expire ? 1000 : 1);
+                if (!at.has_value())
                 {
-                    LOG_DEBUG("decode: got an error while decoding a simple frame variant: {}", simple_str_ans.error());
-                    return {simple_str_ans.error()};
+                    this->write_simple_(FrameID::SimpleError, is_expire ? "ERR invalid expire time in 'expire' command"
+                                                                        : "ERR invalid expire time in 'pexpire' command");
+                    break;
                 }
-                return {Frame{id, simple_str_ans.value()}};
+                // the absolute time is logged, the replay does not depend on when it runs
+                this->write_integer_(keyspace_->with_key(key,
+                                                         [&](Shard& shard)
+                                                         {
+                                                             const auto found = shard.expire(key, at.value());
+                                                             if (found)
+                                                             {
+                                                                 Value::IntText text;
+                                                                 this->log_(key, {"PEXPIREAT", key,
+                                                                                  int_text(at.value(), text)});
+                                                             }
+                                                             return found;
+                                                         }));
+                break;
             }
-            case FrameID::Null:
-                return get_null_frame_();
-            case FrameID::Boolean:
-                return get_bool_frame_();
-            case FrameID::BulkString:
-            case FrameID::BulkError:
+            case CommandType::TTL:
+            case CommandType::PTTL:
             {
-                const auto content = this->get_bulk_string_();
-                if (content.is_error())
+                const auto at = keyspace_->with_key(key, [&](Shard& shard) { return shard.expire_time(key); });
+                if (!at.has_value())
                 {
-                    return {content.error()};
+                    this->write_integer_(-2);
                 }
-                return {Frame{id, content.value()}};
+                else if (at.value() == NO_EXPIRY)
+                {
+                    this->write_integer_(-1);
+                }
+                else
+                {
+                    const auto left = std::max<int64_t>(at.value() - unix_time_ms(), 0);
+                    this->write_integer_(command.type == CommandType::TTL ? (left + 500) / 1000 : left);
+                }
+                break;
             }
-            case FrameID::Array:
+            case CommandType::PERSIST:
+                this->write_integer_(keyspace_->with_key(key,
+                                                         [&](Shard& shard)
+                                                         {
+                                                             const auto found = shard.persist(key);
+                                                             if (found)
+                                                             {
+                                                                 this->log_(key, {"PERSIST", key});
+                                                             }
+                                                             return found;
+                                                         }));
+                break;
+            case CommandType::INCR:
+            case CommandType::DECR:
+            case CommandType::INCRBY:
+            case CommandType::DECRBY:
             {
-                return decode_array_(dept, max_depth);
+                int64_t delta = 1;
+                if (command.argc() > 2 && !parse_int(command.arg(2), delta))
+                {
+                    this->write_simple_(FrameID::SimpleError, "ERR value is not an integer or out of range");
+                    break;
+                }
+                if (command.type == CommandType::DECR || command.type == CommandType::DECRBY)
+                {
+                    if (delta == std::numeric_limits<int64_t>::min())
+                    {
+                        this->write_simple_(FrameID::SimpleError, "ERR decrement would overflow");
+                        break;
+                    }
+                    delta = -delta;
+                }
+                const auto result = keyspace_->with_key(key,
+                                                        [&](Shard& shard) -> Result<int64_t>
+                                                        {
+                                                            if (!shard.make_room())
+                                                            {
+                                                                return {RedisError::out_of_memory};
+                                                            }
+                                                            auto result = shard.incr_by(key, delta);
+                                                            if (!result.is_error())
+                                                            {
+                                                                Value::IntText text;
+                                                                this->log_(key, {"INCRBY", key, int_text(delta, text)});
+                                                            }
+                                                            return result;
+                                                        });
+                if (result.is_error() && result.error() == RedisError::out_of_memory)
+                {
+                    rejected_ = true;
+                    this->write_simple_(FrameID::SimpleError, OOM_ERROR);
+                    break;
+                }
+                if (result.is_error())
+                {
+                    std::pmr::string message("ERR ", &arena_);
+                    message += RedisErrorCategory().message(static_cast<int>(result.error()));
+                    this->write_simple_(FrameID::SimpleError, message);
+                    break;
+                }
+                this->write_integer_(result.value());
+                break;
             }
             default:
-                return {Frame{FrameID::Undefined, std::monostate{}}};
+                break;
+        }
+    }
+
+    void Handler::execute_scan_(const Command& command)
+    {
+        const auto parse_unsigned = [](const std::string_view arg, uint64_t& out)
+        {
+            auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), out);
+            return ec == std::errc() && ptr == arg.data() + arg.size();
+        };
+        uint64_t cursor;
+        if (!parse_unsigned(command.arg(1), cursor))
+        {
+            this->write_simple_(FrameID::SimpleError, "ERR invalid cursor");
+            return;
+        }
+        uint64_t count = 10;
+        std::string_view pattern;
+        for (size_t i = 2; i < command.argc(); i += 2)
+        {
+            const auto option = command.arg(i);
+            if (i + 1 >= command.argc())
+            {
+                this->write_simple_(FrameID::SimpleError, "ERR syntax error");
+                return;
+            }
+            if (equals_ignore_case(option, "COUNT"))
+            {
+                if (!parse_unsigned(command.arg(i + 1), count) || count == 0)
+                {
+                    this->write_simple_(FrameID::SimpleError, "ERR value is not an integer or out of range");
+                    return;
+                }
+            }
+            else if (equals_ignore_case(option, "MATCH"))
+            {
+                pattern = command.arg(i + 1);
+            }
+            else
+            {
+                this->write_simple_(FrameID::SimpleError, "ERR syntax error");
+                return;
+            }
+        }
+
+        // The cursor is made of the cursor within a shard and the index of the shard, so that each shard is walked
+        // with the cursor of its own dictionary, which survives resizes.
+        const auto shards = keyspace_->shard_count();
+        auto shard = cursor % shards;
+        auto inner = cursor / shards;
+        // the keys are copied out of the shards, which can change once the thread is back home
+        std::pmr::vector<std::string_view> keys(&arena_);
+        while (keys.size() < count)
+        {
+            inner = keyspace_->run_on(shard,
+                                      [&](Shard& owner)
+                                      {
+                                          return owner.scan(inner, count - keys.size(),
+                                                            [&](const std::string_view key)
+                                                            {
+                                                                if (pattern.empty() || utils::glob_match(pattern, key))
+                                                                {
+                                                                    keys.push_back(arena_.copy(key));
+                                                                }
+                                                            });
+                                      });
+            if (inner != 0)
+            {
+                break;
+            }
+            if (++shard == shards)
+            {
+                // every shard was walked, the iteration is over
+                shard = 0;
+                break;
+            }
+        }
+        char next[20];
+        const auto end = std::to_chars(next, next + sizeof(next), inner * shards + shard).ptr;
+        this->write_array_header_(2);
+        this->write_bulk_(std::string_view(next, end - next));
+        this->write_array_header_(keys.size());
+        for (const auto& key: keys)
+        {
+            this->write_bulk_(key);
         }
     }
 
-    Result<Frame> Handler::get_null_frame_()
+    void Handler::write_command_spec_(const CommandSpec& spec)
     {
-        const auto ans = this->get_simple_string_();
-        if (ans.is_error())
+        constexpr std::pair<uint32_t, std::string_view> flag_names[] = {
+                {CMD_WRITE, "write"},     {CMD_READONLY, "readonly"}, {CMD_FAST, "fast"},
+                {CMD_LOADING, "loading"}, {CMD_STALE, "stale"},       {CMD_DENYOOM, "denyoom"},
+                {CMD_ADMIN, "admin"},
+        };
+        this->write_array_header_(6);
+        this->write_bulk_(spec.name);
+        this->write_integer_(spec.arity);
+        this->write_array_header_(std::popcount(spec.flags));
+        for (const auto& [flag, name]: flag_names)
+        {
+            if ((spec.flags & flag) != 0)
+            {
+                this->write_simple_(FrameID::SimpleString, name);
+            }
+        }
+        this->write_integer_(spec.first_key);
+        this->write_integer_(spec.last_key);
+        this->write_integer_(spec.step);
+    }
+
+    void Handler::execute_command_(const Command& command)
+    {
+        if (command.argc() == 1)
+        {
+            this->write_array_header_(COMMAND_TABLE.size());
+            for (const auto& spec: COMMAND_TABLE)
+            {
+                this->write_command_spec_(spec);
+            }
+            return;
+        }
+        const auto subcommand = command.arg(1);
+        if (equals_ignore_case(subcommand, "COUNT") && command.argc() == 2)
+        {
+            this->write_integer_(static_cast<int64_t>(COMMAND_TABLE.size()));
+        }
+        else if (equals_ignore_case(subcommand, "INFO"))
         {
-            return {ans.error()};
+            this->write_array_header_(command.argc() - 2);
+            for (size_t i = 2; i < command.argc(); ++i)
+            {
+                if (const auto* spec = find_command(command.arg(i)); spec != nullptr)
+                {
+                    this->write_command_spec_(*spec);
+                }
+                else
+                {
+                    this->write_null_();
+                }
+            }
         }
-        if (!ans.value().empty())
+        else
         {
-            LOG_DEBUG("decode: got a non-null frame with data");
-            return {RedisError::invalid_frame};
+            std::pmr::string message(&arena_);
+            std::format_to(std::back_inserter(message), "ERR unknown subcommand '{}'. Try COMMAND HELP.", subcommand);
+            this->write_simple_(FrameID::SimpleError, message);
         }
-        return {Frame{FrameID::Null, std::monostate{}}};
     }
 
-    Result<Frame> Handler::get_bool_frame_()
+    void Handler::execute_info_(const Command& command)
     {
-        const auto data = this->get_simple_string_();
-        if (data.is_error())
+        // like Redis, commandstats and latencystats are only in ALL and EVERYTHING, not in the default sections
+        const auto wants = [&](const std::string_view section, const bool in_default = true)
         {
-            return {data.error()};
+            if (command.argc() == 1)
+            {
+                return in_default;
+            }
+            for (size_t i = 1; i < command.argc(); ++i)
+            {
+                const auto arg = command.arg(i);
+                if (equals_ignore_case(arg, "ALL") || equals_ignore_case(arg, "EVERYTHING") ||
+                    equals_ignore_case(arg, section) || (in_default && equals_ignore_case(arg, "DEFAULT")))
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+        const auto stats = keyspace_->stats();
+        // the counters of every vCPU are only summed when a section reports them
+        Metrics metrics;
+        if (wants("CLIENTS") || wants("STATS") || wants("COMMANDSTATS", false) || wants("LATENCYSTATS", false))
+        {
+            metrics = collect_metrics(*keyspace_);
+        }
+        std::pmr::string info(&arena_);
+        const auto out = std::back_inserter(info);
+        if (wants("CLIENTS"))
+        {
+            std::format_to(out, "# Clients\r\nconnected_clients:{}\r\n\r\n", metrics.connected_clients);
         }
-        bytes ans_view{data.value()};
-        if (ans_view == std::vector{'t'})
+        if (wants("STATS"))
         {
-            return {Frame{FrameID::Boolean, true}};
+            std::format_to(out, "# Stats\r\ntotal_connections_received:{}\r\ntotal_commands_processed:{}\r\n",
+                           metrics.total_connections_received, metrics.total_commands_processed);
+            std::format_to(out, "total_net_input_bytes:{}\r\ntotal_net_output_bytes:{}\r\n", metrics.net_input_bytes,
+                           metrics.net_output_bytes);
+            std::format_to(out, "rejected_connections:{}\r\n", metrics.rejected_connections);
+            std::format_to(out, "expired_keys:{}\r\nevicted_keys:{}\r\n", stats.expired_keys, stats.evicted_keys);
+            std::format_to(out, "keyspace_hits:{}\r\nkeyspace_misses:{}\r\n", stats.keyspace_hits,
+                           stats.keyspace_misses);
+            std::format_to(out, "total_error_replies:{}\r\nprotocol_errors:{}\r\n\r\n", metrics.total_error_replies,
+                           metrics.protocol_errors);
         }
-        if (ans_view == std::vector{'f'})
+        if (wants("MEMORY"))
         {
-            return {Frame{FrameID::Boolean, false}};
+            const auto& memory = stats.memory;
+            std::format_to(out, "# Memory\r\nused_memory:{}\r\nused_memory_human:", memory.used);
+            format_human_bytes(out, memory.used);
+            info += "\r\n";
+            std::format_to(out, "allocator_allocated:{}\r\nallocator_resident:{}\r\n", memory.allocated,
+                           memory.resident);
+            const auto ratio = memory.used == 0 ? 1.0 : static_cast<double>(memory.resident) / memory.used;
+            std::format_to(out, "mem_fragmentation_ratio:{:.2f}\r\nmem_allocator:slab\r\n", ratio);
+            std::format_to(out, "maxmemory:{}\r\nmaxmemory_human:", keyspace_->maxmemory());
+            format_human_bytes(out, keyspace_->maxmemory());
+            std::format_to(out, "\r\nmaxmemory_policy:{}\r\n", to_string(keyspace_->eviction_policy()));
+            for (size_t i = 0; i < SlabAllocator::CLASS_COUNT; ++i)
+            {
+                const auto& [objects, slots] = memory.classes[i];
+                if (slots == 0)
+                {
+                    continue;
+                }
+                std::format_to(out, "slab_class_{}:objects={},slots={},occupancy={:.2f}\r\n",
+                               SlabAllocator::CLASS_SIZES[i], objects, slots, static_cast<double>(objects) / slots);
+            }
+            info += "\r\n";
         }
-        LOG_DEBUG("decode: got a bool frame with data other than bool");
-        return {RedisError::invalid_frame};
+        if (persistence_ != nullptr && wants("PERSISTENCE"))
+        {
+            const auto persistence = persistence_->info();
+            std::format_to(out, "# Persistence\r\nrdb_bgsave_in_progress:{}\r\nrdb_saves:{}\r\n",
+                           static_cast<int>(persistence.bgsave_in_progress), persistence.saves);
+            std::format_to(out, "rdb_last_save_time:{}\r\nrdb_last_bgsave_status:{}\r\n", persistence.last_save_time,
+                           persistence.last_bgsave_ok ? "ok" : "err");
+            std::format_to(out, "rdb_last_bgsave_time_sec:{}\r\nrdb_current_bgsave_time_sec:{}\r\n",
+                           persistence.last_bgsave_time_sec, persistence.current_bgsave_time_sec);
+            std::format_to(out, "current_save_keys_processed:{}\r\ncurrent_save_keys_total:{}\r\n",
+                           persistence.current_save_keys_processed, persistence.current_save_keys_total);
+            std::format_to(out, "aof_enabled:{}\r\naof_rewrite_in_progress:{}\r\naof_rewrite_scheduled:{}\r\n",
+                           static_cast<int>(aof_ != nullptr), static_cast<int>(persistence.aof_rewrite_in_progress),
+                           static_cast<int>(persistence.aof_rewrite_scheduled));
+            std::format_to(out, "aof_last_rewrite_time_sec:{}\r\naof_current_rewrite_time_sec:{}\r\n",
+                           persistence.aof_last_rewrite_time_sec, persistence.aof_current_rewrite_time_sec);
+            std::format_to(out, "aof_last_bgrewrite_status:{}\r\naof_rewrites:{}\r\n",
+                           persistence.aof_last_bgrewrite_ok ? "ok" : "err", persistence.aof_rewrites);
+            if (aof_ != nullptr)
+            {
+                const auto aof = aof_->info();
+                std::format_to(out, "aof_last_write_status:{}\r\naof_current_size:{}\r\n",
+                               aof.last_write_ok ? "ok" : "err", aof.size);
+            }
+            info += "\r\n";
+        }
+        if (wants("KEYSPACE"))
+        {
+            info += "# Keyspace\r\n";
+            if (stats.keys > 0)
+            {
+                std::format_to(out, "db0:keys={},expires={}\r\n", stats.keys, stats.volatile_keys);
+            }
+            info += "\r\n";
+        }
+        if (wants("COMMANDSTATS", false))
+        {
+            info += "# Commandstats\r\n";
+            for (const auto& spec: COMMAND_TABLE)
+            {
+                const auto& [calls, failed_calls, rejected_calls, latency] =
+                        metrics.commands[static_cast<size_t>(spec.type)];
+                if (calls == 0 && rejected_calls == 0)
+                {
+                    continue;
+                }
+                std::format_to(out, "cmdstat_{}:calls={},usec={},usec_per_call={:.2f}", spec.name, calls, latency.sum(),
+                               calls == 0 ? 0.0 : static_cast<double>(latency.sum()) / calls);
+                std::format_to(out, ",rejected_calls={},failed_calls={}\r\n", rejected_calls, failed_calls);
+            }
+            info += "\r\n";
+        }
+        if (wants("LATENCYSTATS", false))
+        {
+            info += "# Latencystats\r\n";
+            for (const auto& spec: COMMAND_TABLE)
+            {
+                const auto& latency = metrics.commands[static_cast<size_t>(spec.type)].latency;
+                if (latency.count() == 0)
+                {
+                    continue;
+                }
+                std::format_to(out, "latency_percentiles_usec_{}:p50={},p99={},p99.9={}\r\n", spec.name,
+                               latency.percentile(50), latency.percentile(99), latency.percentile(99.9));
+            }
+            info += "\r\n";
+        }
+        this->write_bulk_(info);
     }
 
-    Result<Frame> Handler::decode_array_(const u_int8_t dept, const u_int8_t max_depth)
+    void Handler::execute_save_(const Command& command)
     {
-        const auto size_result = this->get_integer_();
-        if (size_result.is_error())
+        if (command.type == CommandType::SAVE)
         {
-            return {size_result.error()};
+            if (const auto stats = persistence_->save(); stats.is_error())
+            {
+                std::pmr::string message("ERR ", &arena_);
+                message += RedisErrorCategory().message(static_cast<int>(stats.error()));
+                this->write_simple_(FrameID::SimpleError, message);
+                return;
+            }
+            this->write_simple_(FrameID::SimpleString, "OK");
+            return;
         }
-        const auto size = size_result.value();
-        std::vector<Frame> frames;
-        frames.reserve(size);
-        for (int64_t i = 0; i < size; ++i)
+        if (command.type == CommandType::BGREWRITEAOF)
         {
-            const auto frame = this->decode(dept + 1, max_depth);
-            if (frame.is_error())
+            switch (persistence_->bgrewriteaof())
             {
-                return {frame.error()};
+                case Persistence::BgSave::Started:
+                    this->write_simple_(FrameID::SimpleString, "Background append only file rewriting started");
+                    break;
+                case Persistence::BgSave::Scheduled:
+                    this->write_simple_(FrameID::SimpleString, "Background append only file rewriting scheduled");
+                    break;
+                case Persistence::BgSave::AlreadyRunning:
+                    this->write_simple_(FrameID::SimpleError,
+                                        "ERR Background append only file rewriting already in progress");
+                    break;
             }
-            frames.emplace_back(frame.value());
+            return;
+        }
+        const auto schedule = command.argc() == 2 && equals_ignore_case(command.arg(1), "SCHEDULE");
+        if (command.argc() > 1 && !schedule)
+        {
+            this->write_simple_(FrameID::SimpleError, "ERR syntax error");
+            return;
+        }
+        switch (persistence_->bgsave(schedule))
+        {
+            case Persistence::BgSave::Started:
+                this->write_simple_(FrameID::SimpleString, "Background saving started");
+                break;
+            case Persistence::BgSave::Scheduled:
+                this->write_simple_(FrameID::SimpleString, "Background saving scheduled");
+                break;
+            case Persistence::BgSave::AlreadyRunning:
+                this->write_simple_(FrameID::SimpleError, persistence_->rewriting()
+                                                                  ? "ERR Background append only file rewriting in progress"
+                                                                  : "ERR Background save already in progress");
+                break;
         }
-        return {Frame{FrameID::Array, frames}};
     }
 
     void Handler::start_session()
     {
         LOG_DEBUG("starting a session on vcpu: ", sched_getcpu());
+        auto& metrics = Metrics::local();
+        ++metrics.total_connections_received;
+        ++metrics.connected_clients;
+        DEFER(--metrics.connected_clients);
         for (;;)
         {
-            if (auto maybe_frame = this->decode(0, 8); !maybe_frame.is_error())
+            if (auto maybe_frame = this->decode_view(8); !maybe_frame.is_error())
             {
-                if (auto ret = this->send_frame(maybe_frame.value()); ret <= 0)
-                {
-                    LOG_ERRNO_RETURN(0, , "error while sending frame");
-                }
+                this->handle_command(Command::command_from_frame(maybe_frame.value()));
             }
             else
             {
@@ -327,17 +1302,40 @@ namespace redis
                 if (err == RedisError::eof)
                 {
                     LOG_DEBUG("client disconnected");
+                    this->flush();
                     return;
                 }
-                std::error_code ec = make_error_code(err);
-                auto err_msg = ec.message();
-                auto err_frame{Frame{FrameID::SimpleError, std::vector<char>{err_msg.begin(), err_msg.end()}}};
-
-                LOG_DEBUG("error while decoding frame");
-                if (auto ret = this->send_frame(err_frame); ret <= 0)
+                if (err == RedisError::generic_network_error)
+                {
+                    LOG_ERRNO_RETURN(0, , "error while exchanging frames with the client");
+                }
+                if (err == RedisError::query_buffer_limit)
                 {
-                    LOG_ERRNO_RETURN(0, , "error while sending frame");
+                    LOG_WARN("closing a client past the query buffer limit");
+                    return;
+                }
+                if (err == RedisError::out_of_memory)
+                {
+                    // the payload cannot be received, nor skipped: only this client is closed
+                    this->write_simple_(FrameID::SimpleError, "ERR not enough memory to receive the request");
+                    this->flush();
+                    return;
+                }
+                if (err == RedisError::invalid_bulk_length)
+                {
+                    // the payload which follows cannot be told from the next requests, like Redis the client is closed
+                    ++metrics.protocol_errors;
+                    this->write_simple_(FrameID::SimpleError, "ERR Protocol error: invalid bulk length");
+                    this->flush();
+                    return;
                 }
+                ++metrics.protocol_errors;
+                LOG_DEBUG("error while decoding frame");
+                this->write_simple_(FrameID::SimpleError, RedisErrorCategory().message(static_cast<int>(err)));
+            }
+            if (write_failed_)
+            {
+                LOG_ERRNO_RETURN(0, , "error while sending frame");
             }
         }
     }
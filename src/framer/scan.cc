@@ -0,0 +1,150 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "framer/scan.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace redis
+{
+    constexpr char CR = '\r';
+    constexpr char LF = '\n';
+
+    namespace
+    {
+        struct ScanState
+        {
+            // a CR which does not terminate the line was seen
+            bool stray = false;
+            // the last scanned byte is a CR, it is stray unless the next byte is the LF
+            bool pending_cr = false;
+        };
+
+        /**
+         * step_block folds the LF and CR bit masks of a block of width bytes in the state.
+         * @return true if the block holds a LF, its position in the block is written to pos.
+         */
+        inline bool step_block(ScanState& state, const uint64_t lf, const uint64_t cr, const unsigned width,
+                               size_t& pos) noexcept
+        {
+            if (lf != 0)
+            {
+                const auto p = static_cast<unsigned>(__builtin_ctzll(lf));
+                auto before = cr & ((uint64_t{1} << p) - 1);
+                if (p > 0)
+                {
+                    // the CR right before the LF terminates the line, any other is stray
+                    before &= ~(uint64_t{1} << (p - 1));
+                    state.stray |= state.pending_cr;
+                }
+                state.stray |= before != 0;
+                pos = p;
+                return true;
+            }
+            const auto last = uint64_t{1} << (width - 1);
+            state.stray |= state.pending_cr || (cr & ~last) != 0;
+            state.pending_cr = (cr & last) != 0;
+            return false;
+        }
+
+        LineScan scan_tail(const char* data, size_t i, const size_t size, ScanState state) noexcept
+        {
+            for (; i < size; ++i)
+            {
+                const auto c = data[i];
+                if (c == LF)
+                {
+                    return {i, state.stray};
+                }
+                state.stray |= state.pending_cr;
+                state.pending_cr = c == CR;
+            }
+            return {NO_LF, state.stray || state.pending_cr};
+        }
+
+        using ScanFn = LineScan (*)(std::span<const char>) noexcept;
+
+        ScanFn resolve_scan_line() noexcept
+        {
+#if defined(__x86_64__)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+            {
+                return scan_line_avx2;
+            }
+            return scan_line_sse2;
+#else
+            return scan_line_scalar;
+#endif
+        }
+
+        const ScanFn scan_line_impl = resolve_scan_line();
+    }  // namespace
+
+    LineScan scan_line(const std::span<const char> input) noexcept { return scan_line_impl(input); }
+
+    LineScan scan_line_scalar(const std::span<const char> input) noexcept
+    {
+        return scan_tail(input.data(), 0, input.size(), ScanState{});
+    }
+
+#if defined(__x86_64__)
+    LineScan scan_line_sse2(const std::span<const char> input) noexcept
+    {
+        const auto* data = input.data();
+        const auto size = input.size();
+        const auto lf_v = _mm_set1_epi8(LF);
+        const auto cr_v = _mm_set1_epi8(CR);
+        ScanState state;
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16)
+        {
+            const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            const auto lf = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf_v)));
+            const auto cr = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, cr_v)));
+            if (size_t pos; step_block(state, lf, cr, 16, pos))
+            {
+                return {i + pos, state.stray};
+            }
+        }
+        return scan_tail(data, i, size, state);
+    }
+
+    __attribute__((target("avx2"))) LineScan scan_line_avx2(const std::span<const char> input) noexcept
+    {
+        const auto* data = input.data();
+        const auto size = input.size();
+        const auto lf_v = _mm256_set1_epi8(LF);
+        const auto cr_v = _mm256_set1_epi8(CR);
+        ScanState state;
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32)
+        {
+            const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            const auto lf = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, lf_v)));
+            const auto cr = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, cr_v)));
+            if (size_t pos; step_block(state, lf, cr, 32, pos))
+            {
+                return {i + pos, state.stray};
+            }
+        }
+        // finish with 16 bytes blocks before falling back to the scalar loop
+        const auto lf_h = _mm_set1_epi8(LF);
+        const auto cr_h = _mm_set1_epi8(CR);
+        for (; i + 16 <= size; i += 16)
+        {
+            const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            const auto lf = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf_h)));
+            const auto cr = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, cr_h)));
+            if (size_t pos; step_block(state, lf, cr, 16, pos))
+            {
+                return {i + pos, state.stray};
+            }
+        }
+        return scan_tail(data, i, size, state);
+    }
+#endif
+}  // namespace redis
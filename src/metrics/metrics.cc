@@ -0,0 +1,211 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "metrics/metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <format>
+#include <iterator>
+#include <photon/thread/thread.h>
+#include <vector>
+
+#include "storage/keyspace.h"
+
+namespace redis
+{
+    namespace
+    {
+        // the accept loop does not always run on a vCPU serving the sessions, this counter is shared
+        std::atomic<uint64_t> rejected_connections{0};
+    }  // namespace
+
+    size_t LatencyHistogram::bucket_of(const uint64_t usec) noexcept
+    {
+        const auto value = std::min(usec, MAX_VALUE);
+        if (value < SUB_BUCKETS)
+        {
+            return value;
+        }
+        // the highest bit picks the power of two, the next SUB_BUCKET_BITS ones the bucket in it
+        const auto exponent = static_cast<unsigned>(std::bit_width(value)) - 1;
+        const auto sub_bucket = (value >> (exponent - SUB_BUCKET_BITS)) - SUB_BUCKETS;
+        return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub_bucket;
+    }
+
+    uint64_t LatencyHistogram::upper_bound(const size_t index) noexcept
+    {
+        if (index < SUB_BUCKETS)
+        {
+            return index;
+        }
+        const auto exponent = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+        const auto sub_bucket = index % SUB_BUCKETS + SUB_BUCKETS;
+        return ((sub_bucket + 1) << (exponent - SUB_BUCKET_BITS)) - 1;
+    }
+
+    void LatencyHistogram::record(const uint64_t usec) noexcept
+    {
+        ++buckets_[bucket_of(usec)];
+        ++count_;
+        sum_ += usec;
+        max_ = std::max(max_, usec);
+    }
+
+    uint64_t LatencyHistogram::percentile(const double p) const noexcept
+    {
+        if (count_ == 0)
+        {
+            return 0;
+        }
+        const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p / 100 * count_)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i)
+        {
+            seen += buckets_[i];
+            if (seen >= rank)
+            {
+                // the bucket bound can be above every recorded latency
+                return std::min(upper_bound(i), max_);
+            }
+        }
+        return max_;
+    }
+
+    LatencyHistogram& LatencyHistogram::operator+=(const LatencyHistogram& other) noexcept
+    {
+        for (size_t i = 0; i < BUCKETS; ++i)
+        {
+            buckets_[i] += other.buckets_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        max_ = std::max(max_, other.max_);
+        return *this;
+    }
+
+    CommandMetrics& CommandMetrics::operator+=(const CommandMetrics& other) noexcept
+    {
+        calls += other.calls;
+        failed_calls += other.failed_calls;
+        rejected_calls += other.rejected_calls;
+        latency += other.latency;
+        return *this;
+    }
+
+    Metrics& Metrics::local() noexcept
+    {
+        // the photon threads of a vCPU all run on the same OS thread
+        thread_local Metrics metrics;
+        return metrics;
+    }
+
+    void Metrics::record_command(const CommandType type, const uint64_t usec, const bool failed) noexcept
+    {
+        auto& command = commands[static_cast<size_t>(type)];
+        ++command.calls;
+        command.failed_calls += failed;
+        command.latency.record(usec);
+        ++total_commands_processed;
+    }
+
+    void Metrics::record_rejected(const CommandType type) noexcept
+    {
+        ++commands[static_cast<size_t>(type)].rejected_calls;
+    }
+
+    Metrics& Metrics::operator+=(const Metrics& other) noexcept
+    {
+        total_connections_received += other.total_connections_received;
+        connected_clients += other.connected_clients;
+        total_commands_processed += other.total_commands_processed;
+        total_error_replies += other.total_error_replies;
+        protocol_errors += other.protocol_errors;
+        net_input_bytes += other.net_input_bytes;
+        net_output_bytes += other.net_output_bytes;
+        for (size_t i = 0; i < COMMAND_TYPE_COUNT; ++i)
+        {
+            commands[i] += other.commands[i];
+        }
+        return *this;
+    }
+
+    Metrics collect_metrics(Keyspace& keyspace)
+    {
+        Metrics total;
+        // A vCPU owns one shard in a server, but all of them in a keyspace run inline: every vCPU is counted once.
+        std::vector<const void*> seen;
+        for (size_t i = 0; i < keyspace.shard_count(); ++i)
+        {
+            keyspace.run_on(i,
+                            [&](const Shard&)
+                            {
+                                const void* vcpu = photon::get_vcpu();
+                                if (std::find(seen.begin(), seen.end(), vcpu) == seen.end())
+                                {
+                                    seen.push_back(vcpu);
+                                    total += Metrics::local();
+                                }
+                            });
+        }
+        total.rejected_connections = rejected_connections.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    void count_rejected_connection() noexcept { rejected_connections.fetch_add(1, std::memory_order_relaxed); }
+
+    std::string prometheus_text(const Metrics& metrics)
+    {
+        std::string text;
+        const auto out = std::back_inserter(text);
+        const auto metric = [&](const std::string_view name, const std::string_view type, const uint64_t value)
+        { std::format_to(out, "# TYPE redis_{} {}\nredis_{} {}\n", name, type, name, value); };
+        metric("connections_received_total", "counter", metrics.total_connections_received);
+        metric("connected_clients", "gauge", metrics.connected_clients);
+        metric("rejected_connections_total", "counter", metrics.rejected_connections);
+        metric("commands_processed_total", "counter", metrics.total_commands_processed);
+        metric("error_replies_total", "counter", metrics.total_error_replies);
+        metric("protocol_errors_total", "counter", metrics.protocol_errors);
+        metric("net_input_bytes_total", "counter", metrics.net_input_bytes);
+        metric("net_output_bytes_total", "counter", metrics.net_output_bytes);
+
+        text += "# TYPE redis_commands_total counter\n";
+        for (const auto& spec: COMMAND_TABLE)
+        {
+            const auto& command = metrics.commands[static_cast<size_t>(spec.type)];
+            std::format_to(out, "redis_commands_total{{cmd=\"{}\"}} {}\n", spec.name, command.calls);
+        }
+        text += "# TYPE redis_commands_failed_total counter\n";
+        for (const auto& spec: COMMAND_TABLE)
+        {
+            const auto& command = metrics.commands[static_cast<size_t>(spec.type)];
+            std::format_to(out, "redis_commands_failed_total{{cmd=\"{}\"}} {}\n", spec.name, command.failed_calls);
+        }
+        text += "# TYPE redis_commands_rejected_total counter\n";
+        for (const auto& spec: COMMAND_TABLE)
+        {
+            const auto& command = metrics.commands[static_cast<size_t>(spec.type)];
+            std::format_to(out, "redis_commands_rejected_total{{cmd=\"{}\"}} {}\n", spec.name, command.rejected_calls);
+        }
+        text += "# TYPE redis_command_latency_usec summary\n";
+        for (const auto& spec: COMMAND_TABLE)
+        {
+            const auto& latency = metrics.commands[static_cast<size_t>(spec.type)].latency;
+            if (latency.count() == 0)
+            {
+                continue;
+            }
+            for (const auto& [quantile, p]: {std::pair{"0.5", 50.0}, {"0.99", 99.0}, {"0.999", 99.9}})
+            {
+                std::format_to(out, "redis_command_latency_usec{{cmd=\"{}\",quantile=\"{}\"}} {}\n", spec.name,
+                               quantile, latency.percentile(p));
+            }
+            std::format_to(out, "redis_command_latency_usec_sum{{cmd=\"{}\"}} {}\n", spec.name, latency.sum());
+            std::format_to(out, "redis_command_latency_usec_count{{cmd=\"{}\"}} {}\n", spec.name, latency.count());
+        }
+        return text;
+    }
+}  // namespace redis
@@ -0,0 +1,551 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "persistence/aof.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <photon/common/alog.h>
+#include <photon/thread/thread11.h>
+#include <strings.hh>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+#include "framer/decoder.h"
+#include "persistence/loader.h"
+#include "persistence/rdb.h"
+#include "storage/keyspace.h"
+
+namespace redis
+{
+    using utils::equals_ignore_case;
+    using utils::parse_int;
+
+    namespace
+    {
+        constexpr std::pair<FsyncPolicy, std::string_view> POLICY_NAMES[] = {
+                {FsyncPolicy::Always, "always"},
+                {FsyncPolicy::EverySec, "everysec"},
+                {FsyncPolicy::No, "no"},
+        };
+
+        // logs are written in chunks of about this size when the file is rebuilt
+        constexpr size_t WRITE_BYTES = 1 << 20;
+
+        // append_command appends the RESP array of bulk strings args to out
+        void append_command(std::string& out, const std::initializer_list<std::string_view> args)
+        {
+            char digits[24];
+            const auto header = [&](const char type, const size_t size)
+            {
+                out.push_back(type);
+                out.append(digits, std::to_chars(digits, digits + sizeof(digits), size).ptr);
+                out.append("\r\n");
+            };
+            header('*', args.size());
+            for (const auto arg: args)
+            {
+                header('$', arg.size());
+                out.append(arg);
+                out.append("\r\n");
+            }
+        }
+
+        // append_set appends the command creating key, value and its expiry time
+        void append_set(std::string& out, const std::string_view key, const std::string_view value,
+                        const int64_t expire_at)
+        {
+            if (expire_at == NO_EXPIRY)
+            {
+                append_command(out, {"SET", key, value});
+                return;
+            }
+            char at[24];
+            const auto end = std::to_chars(at, at + sizeof(at), expire_at).ptr;
+            append_command(out, {"SET", key, value, "PXAT", std::string_view(at, end - at)});
+        }
+
+        // write_all writes data at offset size of file, size only moves past it once the whole data is written
+        bool write_all(photon::fs::IFile& file, const std::string_view data, size_t& size)
+        {
+            for (size_t done = 0; done < data.size();)
+            {
+                const auto written =
+                        file.pwrite(data.data() + done, data.size() - done, static_cast<off_t>(size + done));
+                if (written <= 0)
+                {
+                    return false;
+                }
+                done += written;
+            }
+            size += data.size();
+            return true;
+        }
+    }  // namespace
+
+    std::optional<FsyncPolicy> parse_fsync_policy(const std::string_view name) noexcept
+    {
+        for (const auto& [policy, policy_name]: POLICY_NAMES)
+        {
+            if (policy_name == name)
+            {
+                return policy;
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::string_view to_string(const FsyncPolicy policy) noexcept
+    {
+        for (const auto& [known, name]: POLICY_NAMES)
+        {
+            if (known == policy)
+            {
+                return name;
+            }
+        }
+        return "unknown";
+    }
+
+    Aof::Aof(Keyspace& keyspace, std::string path, const FsyncPolicy policy) :
+        keyspace_(keyspace), path_(std::move(path)), policy_(policy), logs_(keyspace.shard_count())
+    {
+    }
+
+    Aof::~Aof()
+    {
+        if (file_ != nullptr)
+        {
+            keyspace_.set_eviction_listener({});
+        }
+        if (flusher_ != nullptr)
+        {
+            stopping_ = true;
+            pending_.signal(1);
+            photon::thread_join(flusher_);
+        }
+        if (file_ != nullptr)
+        {
+            // like Redis, the file is synced on shutdown whatever the policy
+            this->flush();
+            file_->fdatasync();
+            file_->close();
+        }
+    }
+
+    Result<size_t> Aof::open()
+    {
+        struct stat st{};
+        if (::stat(path_.c_str(), &st) != 0)
+        {
+            if (errno != ENOENT)
+            {
+                return {RedisError::io_error};
+            }
+            // The file is rebuilt from the dataset, loaded from a snapshot maybe, in a temporary file renamed once
+            // complete: a crash never leaves a partial file behind.
+            const auto temp_path = path_ + ".tmp";
+            std::unique_ptr<photon::fs::IFile> file(
+                    photon::fs::open_localfile_adaptor(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                                       0644, photon::fs::ioengine_iouring));
+            if (file == nullptr)
+            {
+                return {RedisError::io_error};
+            }
+            size_t size = 0;
+            if (!this->write_snapshot_(*file, size, false) || file->fdatasync() != 0 ||
+                ::rename(temp_path.c_str(), path_.c_str()) != 0)
+            {
+                const auto error = errno;
+                file.reset();
+                ::unlink(temp_path.c_str());
+                errno = error;
+                return {RedisError::io_error};
+            }
+            sync_directory(path_);
+            file_ = std::move(file);
+            size_ = size;
+            this->log_evictions_();
+            return {size};
+        }
+        file_.reset(photon::fs::open_localfile_adaptor(path_.c_str(), O_WRONLY | O_CLOEXEC, 0644,
+                                                       photon::fs::ioengine_iouring));
+        if (file_ == nullptr)
+        {
+            return {RedisError::io_error};
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        this->log_evictions_();
+        return {size_.load()};
+    }
+
+    void Aof::log_evictions_()
+    {
+        // an evicted key is gone from the file too, like a deleted one
+        keyspace_.set_eviction_listener([this](const std::string_view key) { this->append(key, {"DEL", key}); });
+    }
+
+    void Aof::start()
+    {
+        last_sync_ms_ = unix_time_ms();
+        flusher_ = photon::thread_enable_join(photon::thread_create11(&Aof::flush_loop_, this));
+    }
+
+    uint64_t Aof::append(const std::string_view key, const std::initializer_list<std::string_view> args)
+    {
+        append_command(logs_[keyspace_.shard_of(key)].buffer, args);
+        // the flag is read first, so that the cache line is only written once per flush
+        if (!dirty_.load(std::memory_order_relaxed) && !dirty_.exchange(true))
+        {
+            pending_.signal(1);
+        }
+        return epoch_.load();
+    }
+
+    void Aof::wait_durable(const uint64_t epoch)
+    {
+        if (policy_ != FsyncPolicy::Always)
+        {
+            return;
+        }
+        const photon::scoped_lock lock(durable_mutex_);
+        while (durable_ < epoch && !stopping_)
+        {
+            durable_changed_.wait(lock);
+        }
+    }
+
+    bool Aof::flush()
+    {
+        const photon::scoped_lock lock(flush_mutex_);
+        return this->flush_(false);
+    }
+
+    bool Aof::flush_(const bool end_capture)
+    {
+        // every command appended at this epoch is collected below, the later ones get the next epoch
+        const auto epoch = epoch_.fetch_add(1);
+        dirty_ = false;
+        for (size_t i = 0; i < logs_.size(); ++i)
+        {
+            keyspace_.run_on(i,
+                             [&](Shard&)
+                             {
+                                 auto& log = logs_[i];
+                                 log.collected_capture =
+                                         log.capture == NO_CAPTURE ? NO_CAPTURE : log.collected.size() + log.capture;
+                                 if (log.capture != NO_CAPTURE)
+                                 {
+                                     // the next buffer is captured whole
+                                     log.capture = end_capture ? NO_CAPTURE : 0;
+                                 }
+                                 if (log.collected.empty())
+                                 {
+                                     // the buffers are swapped back and forth, they keep their capacity
+                                     std::swap(log.buffer, log.collected);
+                                 }
+                                 else
+                                 {
+                                     log.collected.append(log.buffer);
+                                     log.buffer.clear();
+                                 }
+                             });
+        }
+        auto ok = true;
+        for (auto& log: logs_)
+        {
+            // the copy is made here rather than on the vCPU owning the shard
+            if (log.collected_capture != NO_CAPTURE)
+            {
+                log.delta.append(log.collected, log.collected_capture);
+            }
+            if (ok && !log.collected.empty())
+            {
+                ok = this->write_(log.collected);
+                if (ok)
+                {
+                    log.collected.clear();
+                }
+            }
+        }
+        const auto now = unix_time_ms();
+        if (ok && (policy_ == FsyncPolicy::Always || (policy_ == FsyncPolicy::EverySec && now - last_sync_ms_ >= 1000)))
+        {
+            ok = file_->fdatasync() == 0;
+            last_sync_ms_ = now;
+        }
+        if (last_write_ok_ && !ok)
+        {
+            LOG_ERROR("failed to write the AOF ", path_.c_str(), ", writes are retried: ", strerror(errno));
+        }
+        last_write_ok_ = ok;
+        if (ok)
+        {
+            {
+                const photon::scoped_lock durable_lock(durable_mutex_);
+                durable_ = epoch;
+            }
+            durable_changed_.notify_all();
+        }
+        return ok;
+    }
+
+    Result<size_t> Aof::rewrite()
+    {
+        const auto temp_path = path_ + ".rewrite.tmp";
+        std::unique_ptr<photon::fs::IFile> file(
+                photon::fs::open_localfile_adaptor(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644,
+                                                   photon::fs::ioengine_iouring));
+        if (file == nullptr)
+        {
+            return {RedisError::io_error};
+        }
+        size_t size = 0;
+        auto written = this->write_snapshot_(*file, size, true);
+        if (written)
+        {
+            const photon::scoped_lock lock(flush_mutex_);
+            // The current file gets the last commands, in case the switch fails, and so do the deltas. Whatever this
+            // flush could not write is in the new file already, through the snapshots or the deltas.
+            this->flush_(true);
+            for (auto& log: logs_)
+            {
+                if (written && !log.delta.empty())
+                {
+                    written = write_all(*file, log.delta, size);
+                }
+            }
+            written = written && file->fdatasync() == 0 && ::rename(temp_path.c_str(), path_.c_str()) == 0;
+            if (written)
+            {
+                sync_directory(path_);
+                file_->close();
+                file_ = std::move(file);
+                size_ = size;
+                last_write_ok_ = true;
+                for (auto& log: logs_)
+                {
+                    log.collected.clear();
+                    std::string().swap(log.delta);
+                }
+                {
+                    // the new file is synced with every command collected by the last flush
+                    const photon::scoped_lock durable_lock(durable_mutex_);
+                    durable_ = epoch_ - 1;
+                }
+                durable_changed_.notify_all();
+                return {size};
+            }
+        }
+        const auto error = errno;
+        this->end_rewrite_();
+        file.reset();
+        ::unlink(temp_path.c_str());
+        errno = error;
+        return {RedisError::io_error};
+    }
+
+    void Aof::end_rewrite_()
+    {
+        const photon::scoped_lock lock(flush_mutex_);
+        for (size_t i = 0; i < logs_.size(); ++i)
+        {
+            keyspace_.run_on(i,
+                             [&](Shard& shard)
+                             {
+                                 shard.end_snapshot();
+                                 logs_[i].capture = NO_CAPTURE;
+                             });
+            std::string().swap(logs_[i].delta);
+        }
+    }
+
+    bool Aof::write_snapshot_(photon::fs::IFile& file, size_t& size, const bool rewriting)
+    {
+        using namespace std::chrono;
+        std::string buffer;
+        const auto now = unix_time_ms();
+        // one shard at a time, only one of them holds the preimages of its snapshot
+        for (size_t i = 0; i < keyspace_.shard_count(); ++i)
+        {
+            keyspace_.run_on(i,
+                             [&](Shard& shard)
+                             {
+                                 shard.begin_snapshot(now);
+                                 if (rewriting)
+                                 {
+                                     // the commands logged from now on are not in the snapshot
+                                     logs_[i].capture = logs_[i].buffer.size();
+                                 }
+                             });
+            int64_t busy_us = 0;
+            for (bool more = true; more;)
+            {
+                more = keyspace_.run_on(i,
+                                        [&](Shard& shard)
+                                        {
+                                            const auto start = steady_clock::now();
+                                            const auto pending = shard.snapshot_step(
+                                                    SAVE_STEP,
+                                                    [&](const std::string_view key, const Value& value,
+                                                        const int64_t at)
+                                                    {
+                                                        Value::IntText scratch;
+                                                        append_set(buffer, key, value.str(scratch), at);
+                                                    });
+                                            busy_us += duration_cast<microseconds>(steady_clock::now() - start).count();
+                                            return pending;
+                                        });
+                if (buffer.size() >= WRITE_BYTES || !more)
+                {
+                    if (!write_all(file, buffer, size))
+                    {
+                        keyspace_.run_on(i, [](Shard& shard) { shard.end_snapshot(); });
+                        return false;
+                    }
+                    buffer.clear();
+                }
+                if (rewriting && busy_us >= REWRITE_SLICE_US)
+                {
+                    // the shard serves its commands for as long as it spent on the rewrite
+                    photon::thread_usleep(busy_us);
+                    busy_us = 0;
+                }
+            }
+        }
+        return true;
+    }
+
+    void Aof::flush_loop_()
+    {
+        while (!stopping_)
+        {
+            // woken up by the first command logged since the last flush, or by the timeout
+            pending_.wait(1, FLUSH_INTERVAL_US);
+            this->flush();
+        }
+        durable_changed_.notify_all();
+    }
+
+    bool Aof::write_(const std::string_view data)
+    {
+        // the end of the file only moves once the whole data is written, a failed write is retried at the same place
+        auto size = size_.load();
+        if (!write_all(*file_, data, size))
+        {
+            return false;
+        }
+        size_ = size;
+        return true;
+    }
+
+    Result<AofLoadStats> load_aof(const std::string& path, Keyspace& keyspace)
+    {
+        MappedFile file(path);
+        if (!file.is_open())
+        {
+            return {RedisError::eof};
+        }
+        ShardLoader loader(keyspace, file);
+        AofLoadStats stats;
+        // the file was written by the server, a logged bulk string can be as long as it was configured to accept
+        // a string too large to be a value is corrupted, not a truncated tail
+        Decoder decoder(Value::MAX_SIZE);
+        const auto data = file.data();
+        size_t offset = 0;
+        auto error = RedisError::success;
+        while (offset < data.size())
+        {
+            size_t consumed = 0;
+            // a command is a flat array of bulk strings, the payloads are read in place
+            const auto frame = decoder.decode_view(data.subspan(offset), consumed, 2);
+            if (frame.is_error())
+            {
+                if (frame.error() == RedisError::incomplete_frame || frame.error() == RedisError::not_enough_data)
+                {
+                    stats.truncated = data.size() - offset;
+                }
+                else
+                {
+                    error = RedisError::aof_corrupted;
+                }
+                break;
+            }
+            const auto& command = frame.value();
+            const auto is_bulk = [](const FrameView& arg) { return arg.frame_id() == FrameID::BulkString; };
+            if (command.frame_id() != FrameID::Array || command.empty() || !std::ranges::all_of(command, is_bulk))
+            {
+                error = RedisError::aof_corrupted;
+                break;
+            }
+            const auto argc = command.size();
+            const auto name = command[0].str();
+            const auto key = argc > 1 ? command[1].str() : std::string_view();
+            int64_t number = NO_EXPIRY;
+            if (equals_ignore_case(name, "SET") && (argc == 3 || argc == 5))
+            {
+                const auto pxat = argc == 3 || equals_ignore_case(command[3].str(), "PXAT");
+                if (!pxat || (argc == 5 && !parse_int(command[4].str(), number)))
+                {
+                    error = RedisError::aof_corrupted;
+                }
+                else
+                {
+                    loader.add(LoadOp::Set, key, command[2].str(), number);
+                }
+            }
+            else if (equals_ignore_case(name, "DEL") && argc >= 2)
+            {
+                // the keys can be owned by different shards
+                for (auto arg = std::next(command.begin()); arg != command.end(); ++arg)
+                {
+                    loader.add(LoadOp::Del, (*arg).str(), {}, 0);
+                }
+            }
+            else if (equals_ignore_case(name, "PEXPIREAT") && argc == 3 && parse_int(command[2].str(), number))
+            {
+                loader.add(LoadOp::ExpireAt, key, {}, number);
+            }
+            else if (equals_ignore_case(name, "PERSIST") && argc == 2)
+            {
+                loader.add(LoadOp::Persist, key, {}, 0);
+            }
+            else if (equals_ignore_case(name, "INCRBY") && argc == 3 && parse_int(command[2].str(), number))
+            {
+                loader.add(LoadOp::IncrBy, key, {}, number);
+            }
+            else
+            {
+                error = RedisError::aof_corrupted;
+            }
+            if (error != RedisError::success)
+            {
+                break;
+            }
+            ++stats.commands;
+            offset += consumed;
+            // what was parsed is copied out already
+            loader.parsed(offset);
+        }
+
+        loader.finish();
+        if (error != RedisError::success)
+        {
+            return {error};
+        }
+        stats.bytes = offset;
+        // the end of a command which was being written when the server stopped, appending goes on before it
+        if (stats.truncated > 0 && ::truncate(path.c_str(), static_cast<off_t>(stats.bytes)) != 0)
+        {
+            return {RedisError::eof};
+        }
+        return {stats};
+    }
+}  // namespace redis
@@ -0,0 +1,69 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "persistence/crc64.h"
+
+#include <array>
+#include <bit>
+#include <cstring>
+
+namespace redis
+{
+    namespace
+    {
+        // the Jones polynomial, reflected
+        constexpr uint64_t POLY = 0x95AC9329AC4BC9B5ULL;
+
+        using Tables = std::array<std::array<uint64_t, 256>, 8>;
+
+        // tables[k][b] is the checksum of byte b followed by k zero bytes
+        constexpr Tables build_tables()
+        {
+            Tables tables{};
+            for (uint64_t b = 0; b < 256; ++b)
+            {
+                uint64_t crc = b;
+                for (int i = 0; i < 8; ++i)
+                {
+                    crc = (crc & 1) != 0 ? (crc >> 1) ^ POLY : crc >> 1;
+                }
+                tables[0][b] = crc;
+            }
+            for (size_t b = 0; b < 256; ++b)
+            {
+                for (size_t k = 1; k < 8; ++k)
+                {
+                    const auto previous = tables[k - 1][b];
+                    tables[k][b] = tables[0][previous & 0xFF] ^ (previous >> 8);
+                }
+            }
+            return tables;
+        }
+
+        constexpr Tables TABLES = build_tables();
+    }  // namespace
+
+    uint64_t crc64(uint64_t crc, const std::span<const char> data) noexcept
+    {
+        static_assert(std::endian::native == std::endian::little, "the words are folded in little endian order");
+        const auto* in = reinterpret_cast<const uint8_t*>(data.data());
+        auto size = data.size();
+        while (size >= 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, in, sizeof(word));
+            crc ^= word;
+            crc = TABLES[7][crc & 0xFF] ^ TABLES[6][(crc >> 8) & 0xFF] ^ TABLES[5][(crc >> 16) & 0xFF] ^
+                  TABLES[4][(crc >> 24) & 0xFF] ^ TABLES[3][(crc >> 32) & 0xFF] ^ TABLES[2][(crc >> 40) & 0xFF] ^
+                  TABLES[1][(crc >> 48) & 0xFF] ^ TABLES[0][crc >> 56];
+            in += 8;
+            size -= 8;
+        }
+        while (size-- > 0)
+        {
+            crc = TABLES[0][(crc ^ *in++) & 0xFF] ^ (crc >> 8);
+        }
+        return crc;
+    }
+}  // namespace redis
@@ -0,0 +1,182 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "persistence/loader.h"
+
+#include <photon/thread/thread.h>
+#include <span>
+#include <utility>
+
+#include "persistence/rdb.h"
+#include "storage/keyspace.h"
+
+namespace redis
+{
+    namespace
+    {
+        // writes are handed over to their shard in batches of about these sizes
+        constexpr size_t BATCH_BYTES = 256 * 1024;
+        constexpr size_t BATCH_WRITES = 4096;
+        // the pages of the file already parsed are released every RELEASE_BYTES
+        constexpr size_t RELEASE_BYTES = 64 << 20;
+
+        // Batch is a run of writes for a shard, copied out of the file so that they outlive the parsing
+        struct Batch
+        {
+            struct Record
+            {
+                LoadOp op;
+                size_t key_size;
+                size_t value_size;
+                // the expiry time or the increment
+                int64_t number;
+            };
+
+            std::vector<char> bytes;
+            std::vector<Record> records;
+
+            void add(const LoadOp op, const std::string_view key, const std::string_view value, const int64_t number)
+            {
+                bytes.insert(bytes.end(), key.begin(), key.end());
+                bytes.insert(bytes.end(), value.begin(), value.end());
+                records.push_back({op, key.size(), value.size(), number});
+            }
+
+            [[nodiscard]] bool full() const noexcept
+            {
+                return bytes.size() >= BATCH_BYTES || records.size() >= BATCH_WRITES;
+            }
+
+            void clear() noexcept
+            {
+                bytes.clear();
+                records.clear();
+            }
+
+            void apply(Shard& shard) const
+            {
+                const auto* data = bytes.data();
+                for (const auto& record: records)
+                {
+                    const std::string_view key(data, record.key_size);
+                    data += record.key_size;
+                    switch (record.op)
+                    {
+                        case LoadOp::Set:
+                            shard.set(key, std::span(data, record.value_size), record.number);
+                            break;
+                        case LoadOp::Del:
+                            shard.del(key);
+                            break;
+                        case LoadOp::ExpireAt:
+                            shard.expire(key, record.number);
+                            break;
+                        case LoadOp::Persist:
+                            shard.persist(key);
+                            break;
+                        case LoadOp::IncrBy:
+                            // it succeeded when it was logged, it does again
+                            static_cast<void>(shard.incr_by(key, record.number));
+                            break;
+                    }
+                    data += record.value_size;
+                }
+            }
+        };
+    }  // namespace
+
+    // ShardLoad is the loading state of a shard: a batch being filled by the parser, and one being applied by the
+    // owner of the shard
+    struct ShardLoader::ShardLoad
+    {
+        Batch filling;
+        Batch applying;
+        // 1 while no batch is being applied
+        photon::semaphore idle{1};
+        uint64_t applied = 0;
+    };
+
+    ShardLoader::ShardLoader(Keyspace& keyspace, MappedFile& file) : keyspace_(keyspace), file_(file)
+    {
+        loads_.reserve(keyspace.shard_count());
+        for (size_t i = 0; i < keyspace.shard_count(); ++i)
+        {
+            loads_.push_back(std::make_unique<ShardLoad>());
+        }
+    }
+
+    ShardLoader::~ShardLoader()
+    {
+        // the batches posted to the shards reference their load
+        for (const auto& load: loads_)
+        {
+            load->idle.wait(1);
+        }
+    }
+
+    void ShardLoader::add(const LoadOp op, const std::string_view key, const std::string_view value,
+                          const int64_t number)
+    {
+        const auto index = keyspace_.shard_of(key);
+        auto& batch = loads_[index]->filling;
+        batch.add(op, key, value, number);
+        if (batch.full())
+        {
+            this->dispatch_(index);
+        }
+    }
+
+    void ShardLoader::parsed(const size_t size) noexcept
+    {
+        if (size - released_ >= RELEASE_BYTES)
+        {
+            released_ = size;
+            file_.release(released_);
+        }
+    }
+
+    void ShardLoader::reserve(const size_t keys)
+    {
+        for (size_t i = 0; i < loads_.size(); ++i)
+        {
+            loads_[i]->idle.wait(1);
+            keyspace_.run_on(i, [&](Shard& shard) { shard.reserve(keys); });
+            loads_[i]->idle.signal(1);
+        }
+    }
+
+    uint64_t ShardLoader::finish()
+    {
+        for (size_t i = 0; i < loads_.size(); ++i)
+        {
+            if (!loads_[i]->filling.records.empty())
+            {
+                this->dispatch_(i);
+            }
+        }
+        uint64_t applied = 0;
+        for (const auto& load: loads_)
+        {
+            load->idle.wait(1);
+            applied += load->applied;
+            load->idle.signal(1);
+        }
+        return applied;
+    }
+
+    void ShardLoader::dispatch_(const size_t index)
+    {
+        auto& load = *loads_[index];
+        load.idle.wait(1);
+        std::swap(load.filling, load.applying);
+        load.filling.clear();
+        keyspace_.post(index,
+                       [&load](Shard& shard)
+                       {
+                           load.applying.apply(shard);
+                           load.applied += load.applying.records.size();
+                           load.idle.signal(1);
+                       });
+    }
+}  // namespace redis
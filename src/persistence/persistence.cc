@@ -0,0 +1,162 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "persistence/persistence.h"
+
+#include <photon/common/alog.h>
+#include <photon/thread/thread11.h>
+
+#include "storage/keyspace.h"
+
+namespace redis
+{
+    Persistence::Persistence(Keyspace& keyspace, std::string path, Aof* aof) :
+        keyspace_(keyspace), path_(std::move(path)), aof_(aof), last_save_time_(unix_time_ms() / 1000)
+    {
+    }
+
+    Persistence::~Persistence()
+    {
+        while (in_progress_)
+        {
+            photon::thread_usleep(1000);
+        }
+    }
+
+    Result<RdbSaveStats> Persistence::save()
+    {
+        if (bool expected = false; !in_progress_.compare_exchange_strong(expected, true))
+        {
+            return {RedisError::save_in_progress};
+        }
+        return this->run_(false);
+    }
+
+    Persistence::BgSave Persistence::bgsave(const bool schedule)
+    {
+        if (bool expected = false; !in_progress_.compare_exchange_strong(expected, true))
+        {
+            if (!schedule)
+            {
+                return BgSave::AlreadyRunning;
+            }
+            scheduled_ = true;
+            return BgSave::Scheduled;
+        }
+        background_ = true;
+        photon::thread_create11(&Persistence::bgsave_main_, this);
+        return BgSave::Started;
+    }
+
+    Persistence::BgSave Persistence::bgrewriteaof()
+    {
+        if (bool expected = false; !in_progress_.compare_exchange_strong(expected, true))
+        {
+            if (rewriting_)
+            {
+                return BgSave::AlreadyRunning;
+            }
+            rewrite_scheduled_ = true;
+            return BgSave::Scheduled;
+        }
+        rewriting_ = true;
+        photon::thread_create11(&Persistence::bgrewriteaof_main_, this);
+        return BgSave::Started;
+    }
+
+    void Persistence::bgsave_main_()
+    {
+        if (const auto stats = this->run_(true); stats.is_error())
+        {
+            LOG_ERROR("background save to ", path_.c_str(), " failed: ",
+                      RedisErrorCategory().message(static_cast<int>(stats.error())).c_str());
+        }
+        else
+        {
+            LOG_INFO("background save of ", stats.value().keys, " keys to ", path_.c_str(), " done");
+        }
+    }
+
+    void Persistence::bgrewriteaof_main_()
+    {
+        const auto start = unix_time_ms();
+        started_at_ = start;
+        const auto size = aof_->rewrite();
+        if (size.is_error())
+        {
+            LOG_ERROR("background AOF rewrite failed: ",
+                      RedisErrorCategory().message(static_cast<int>(size.error())).c_str());
+        }
+        else
+        {
+            ++rewrites_;
+            LOG_INFO("background AOF rewrite done, ", size.value(), " bytes");
+        }
+        last_rewrite_ok_ = !size.is_error();
+        last_rewrite_time_sec_ = (unix_time_ms() - start) / 1000;
+        rewriting_ = false;
+        this->finish_();
+    }
+
+    void Persistence::finish_()
+    {
+        in_progress_ = false;
+        // like Redis, a scheduled rewrite goes first, a scheduled save is then scheduled again
+        if (rewrite_scheduled_.exchange(false))
+        {
+            this->bgrewriteaof();
+        }
+        if (scheduled_.exchange(false))
+        {
+            this->bgsave(true);
+        }
+    }
+
+    Result<RdbSaveStats> Persistence::run_(const bool background)
+    {
+        const auto start = unix_time_ms();
+        started_at_ = start;
+        auto stats = save_rdb(path_, keyspace_, &progress_);
+        const auto now = unix_time_ms();
+        if (!stats.is_error())
+        {
+            ++saves_;
+            last_save_time_ = now / 1000;
+        }
+        if (background)
+        {
+            last_bgsave_ok_ = !stats.is_error();
+            last_bgsave_time_sec_ = (now - start) / 1000;
+        }
+        background_ = false;
+        this->finish_();
+        return stats;
+    }
+
+    Persistence::Info Persistence::info() const noexcept
+    {
+        Info info;
+        info.bgsave_in_progress = background_;
+        info.saves = saves_;
+        info.last_save_time = last_save_time_;
+        info.last_bgsave_ok = last_bgsave_ok_;
+        info.last_bgsave_time_sec = last_bgsave_time_sec_;
+        info.aof_rewrite_in_progress = rewriting_;
+        info.aof_rewrite_scheduled = rewrite_scheduled_;
+        info.aof_rewrites = rewrites_;
+        info.aof_last_bgrewrite_ok = last_rewrite_ok_;
+        info.aof_last_rewrite_time_sec = last_rewrite_time_sec_;
+        if (info.aof_rewrite_in_progress)
+        {
+            info.aof_current_rewrite_time_sec = (unix_time_ms() - started_at_) / 1000;
+        }
+        if (in_progress_ && !info.aof_rewrite_in_progress)
+        {
+            info.current_bgsave_time_sec = info.bgsave_in_progress ? (unix_time_ms() - started_at_) / 1000 : -1;
+            info.current_save_keys_processed = progress_.keys_processed;
+            info.current_save_keys_total = progress_.keys_total;
+        }
+        return info;
+    }
+}  // namespace redis
@@ -0,0 +1,909 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "persistence/rdb.h"
+
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <photon/fs/localfs.h>
+#include <photon/thread/thread.h>
+#include <photon/thread/thread11.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "persistence/crc64.h"
+#include "persistence/loader.h"
+#include "storage/keyspace.h"
+#include "storage/value.h"
+
+namespace redis
+{
+    static_assert(std::endian::native == std::endian::little, "RDB integers are read in place");
+
+    namespace
+    {
+        // lzf_decompress decodes the LZF block input to out, which must be exactly the size of the decoded data.
+        bool lzf_decompress(const std::span<const char> input, const std::span<char> out) noexcept
+        {
+            const auto* in = reinterpret_cast<const uint8_t*>(input.data());
+            const auto* const end = in + input.size();
+            size_t written = 0;
+            while (in < end)
+            {
+                size_t control = *in++;
+                if (control < 32)
+                {
+                    // a run of control + 1 literal bytes
+                    const auto size = control + 1;
+                    if (size > static_cast<size_t>(end - in) || size > out.size() - written)
+                    {
+                        return false;
+                    }
+                    std::memcpy(out.data() + written, in, size);
+                    in += size;
+                    written += size;
+                    continue;
+                }
+                // a back reference, the length and the distance are split over the control byte and the next ones
+                auto size = control >> 5;
+                if (size == 7)
+                {
+                    if (in == end)
+                    {
+                        return false;
+                    }
+                    size += *in++;
+                }
+                if (in == end)
+                {
+                    return false;
+                }
+                const auto distance = ((control & 0x1F) << 8) + *in++ + 1;
+                size += 2;
+                if (distance > written || size > out.size() - written)
+                {
+                    return false;
+                }
+                // the reference can overlap the bytes being written, they are copied one at a time
+                for (size_t i = 0; i < size; ++i, ++written)
+                {
+                    out[written] = out[written - distance];
+                }
+            }
+            return written == out.size();
+        }
+
+        // serialized keys are written to the file in chunks of about this size
+        constexpr size_t WRITE_BYTES = 1 << 20;
+
+        // RdbFile is a file being saved. Chunks are appended in the order they come, from any photon thread of the
+        // vCPU which opened it, and checksummed on the way.
+        class RdbFile
+        {
+        public:
+            explicit RdbFile(photon::fs::IFile* file) noexcept : file_(file) {}
+
+            [[nodiscard]] bool is_open() const noexcept { return file_ != nullptr; }
+            [[nodiscard]] bool failed() const noexcept { return failed_; }
+            [[nodiscard]] size_t size() const noexcept { return offset_; }
+            [[nodiscard]] uint64_t crc() const noexcept { return crc_; }
+
+            bool append(std::span<const char> data)
+            {
+                // the writes of the shards are serialized, a chunk is never interleaved with another one
+                const photon::scoped_lock lock(mutex_);
+                if (failed_)
+                {
+                    return false;
+                }
+                crc_ = crc64(crc_, data);
+                while (!data.empty())
+                {
+                    const auto written = file_->pwrite(data.data(), data.size(), static_cast<off_t>(offset_));
+                    if (written <= 0)
+                    {
+                        failed_ = true;
+                        return false;
+                    }
+                    offset_ += written;
+                    data = data.subspan(written);
+                }
+                return true;
+            }
+
+            // close makes the file durable and closes it
+            bool close()
+            {
+                const auto synced = !failed_ && file_->fdatasync() == 0;
+                const auto closed = file_->close() == 0;
+                failed_ = !synced || !closed;
+                return !failed_;
+            }
+
+        private:
+            std::unique_ptr<photon::fs::IFile> file_;
+            photon::mutex mutex_;
+            size_t offset_ = 0;
+            uint64_t crc_ = 0;
+            bool failed_ = false;
+        };
+
+        // SaveJob is the state shared by the threads serializing the shards
+        struct SaveJob
+        {
+            Keyspace& keyspace;
+            RdbFile& file;
+            SaveProgress* progress;
+            std::atomic<uint64_t> keys{0};
+        };
+
+        // save_shard serializes the snapshot of the shard at index, in steps run on its owner
+        void save_shard(SaveJob* job, const size_t index)
+        {
+            std::string buffer;
+            RdbWriter writer(buffer);
+            for (bool more = true; more && !job->file.failed();)
+            {
+                uint64_t keys = 0;
+                more = job->keyspace.run_on(index,
+                                            [&](Shard& shard)
+                                            {
+                                                return shard.snapshot_step(
+                                                        SAVE_STEP,
+                                                        [&](const std::string_view key, const Value& value,
+                                                            const int64_t expire_at)
+                                                        {
+                                                            Value::IntText scratch;
+                                                            writer.write_string(key, value.str(scratch), expire_at);
+                                                            ++keys;
+                                                        });
+                                            });
+                job->keys += keys;
+                if (job->progress != nullptr)
+                {
+                    job->progress->keys_processed += keys;
+                }
+                if (buffer.size() >= WRITE_BYTES || (!more && !buffer.empty()))
+                {
+                    job->file.append(buffer);
+                    buffer.clear();
+                }
+            }
+        }
+    }  // namespace
+
+    void sync_directory(const std::string& path)
+    {
+        const auto slash = path.rfind('/');
+        const auto directory = slash == std::string::npos ? std::string(".") : path.substr(0, slash + 1);
+        if (const auto fd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC); fd >= 0)
+        {
+            ::fsync(fd);
+            ::close(fd);
+        }
+    }
+
+    MappedFile::MappedFile(const std::string& path)
+    {
+        const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return;
+        }
+        struct stat st{};
+        if (::fstat(fd, &st) == 0)
+        {
+            size_ = static_cast<size_t>(st.st_size);
+            if (size_ == 0)
+            {
+                opened_ = true;
+            }
+            else if (auto* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0); data != MAP_FAILED)
+            {
+                ::madvise(data, size_, MADV_SEQUENTIAL);
+                data_ = static_cast<const char*>(data);
+                opened_ = true;
+            }
+        }
+        // keep the errno of the failure, if any
+        const auto error = errno;
+        ::close(fd);
+        errno = error;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (data_ != nullptr)
+        {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+    void MappedFile::release(const size_t size) noexcept
+    {
+        static const auto page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        const auto end = std::min(size, size_) & ~(page_size - 1);
+        if (data_ == nullptr || end <= released_)
+        {
+            return;
+        }
+        ::madvise(const_cast<char*>(data_) + released_, end - released_, MADV_DONTNEED);
+        released_ = end;
+    }
+
+    Result<uint32_t> RdbReader::read_header()
+    {
+        const auto header = this->read_bytes_(rdb::MAGIC.size() + 4);
+        if (!header.has_value() || !std::string_view(header->data(), header->size()).starts_with(rdb::MAGIC))
+        {
+            return {RedisError::rdb_corrupted};
+        }
+        const auto* digits = header->data() + rdb::MAGIC.size();
+        auto [end, ec] = std::from_chars(digits, digits + 4, version_);
+        if (ec != std::errc() || end != digits + 4)
+        {
+            return {RedisError::rdb_corrupted};
+        }
+        if (version_ == 0 || version_ > rdb::VERSION)
+        {
+            return {RedisError::rdb_unsupported};
+        }
+        return {version_};
+    }
+
+    Result<RdbEvent> RdbReader::next(RdbEntry& entry)
+    {
+        entry.expire_at = NO_EXPIRY;
+        entry.value = {};
+        if (offset_ - checksummed_ >= CHECKSUM_CHUNK)
+        {
+            this->update_checksum_();
+        }
+        for (;;)
+        {
+            const auto type = this->read_byte_();
+            if (!type.has_value())
+            {
+                return {RedisError::rdb_corrupted};
+            }
+            switch (type.value())
+            {
+                case rdb::OPCODE_EXPIRETIME_MS:
+                {
+                    const auto at = this->read_le_<int64_t>();
+                    if (!at.has_value())
+                    {
+                        return {RedisError::rdb_corrupted};
+                    }
+                    entry.expire_at = at.value();
+                    continue;
+                }
+                case rdb::OPCODE_EXPIRETIME:
+                {
+                    const auto at = this->read_le_<int32_t>();
+                    if (!at.has_value())
+                    {
+                        return {RedisError::rdb_corrupted};
+                    }
+                    entry.expire_at = static_cast<int64_t>(at.value()) * 1000;
+                    continue;
+                }
+                case rdb::OPCODE_IDLE:
+                    if (!this->read_length_().has_value())
+                    {
+                        return {RedisError::rdb_corrupted};
+                    }
+                    continue;
+                case rdb::OPCODE_FREQ:
+                    if (!this->read_byte_().has_value())
+                    {
+                        return {RedisError::rdb_corrupted};
+                    }
+                    continue;
+                case rdb::OPCODE_AUX:
+                    if (!this->skip_string_() || !this->skip_string_())
+                    {
+                        return {RedisError::rdb_corrupted};
+                    }
+                    continue;
+                case rdb::OPCODE_FUNCTION2:
+                    if (!this->skip_string_())
+                    {
+                        return {RedisError::rdb_corrupted};
+                    }
+                    continue;
+                case rdb::OPCODE_SLOT_INFO:
+                    if (!this->read_length_().has_value() || !this->read_length_().has_value() ||
+                        !this->read_length_().has_value())
+                    {
+                        return {RedisError::rdb_corrupted};
+                    }
+                    continue;
+                case rdb::OPCODE_SELECTDB:
+                {
+                    const auto db = this->read_length_();
+                    if (!db.has_value())
+                    {
+                        return {RedisError::rdb_corrupted};
+                    }
+                    entry.db = db.value();
+                    entry.db_size = 0;
+                    continue;
+                }
+                case rdb::OPCODE_RESIZEDB:
+                {
+                    const auto size = this->read_length_();
+                    // the amount of keys with a time to live is not needed
+                    if (!size.has_value() || !this->read_length_().has_value())
+                    {
+                        return {RedisError::rdb_corrupted};
+                    }
+                    entry.db_size = size.value();
+                    return {RdbEvent::ResizeDb};
+                }
+                case rdb::OPCODE_EOF:
+                    return this->verify_checksum_();
+                case rdb::OPCODE_FUNCTION_PRE_GA:
+                case rdb::OPCODE_MODULE_AUX:
+                    return {RedisError::rdb_unsupported};
+                default:
+                    break;
+            }
+
+            entry.type = type.value();
+            const auto key = this->read_string_(key_buffer_);
+            if (!key.has_value())
+            {
+                return {RedisError::rdb_corrupted};
+            }
+            entry.key = key.value();
+            if (entry.type == rdb::TYPE_STRING)
+            {
+                const auto value = this->read_string_(value_buffer_);
+                if (!value.has_value())
+                {
+                    return {RedisError::rdb_corrupted};
+                }
+                entry.value = value.value();
+            }
+            else if (error_ = RedisError::rdb_corrupted; !this->skip_object_(entry.type))
+            {
+                return {error_};
+            }
+            return {RdbEvent::Key};
+        }
+    }
+
+    void RdbReader::update_checksum_() noexcept
+    {
+        crc_ = crc64(crc_, data_.subspan(checksummed_, offset_ - checksummed_));
+        checksummed_ = offset_;
+    }
+
+    Result<RdbEvent> RdbReader::verify_checksum_()
+    {
+        this->update_checksum_();
+        // files older than version 5 do not end with a checksum
+        if (version_ < 5)
+        {
+            return {RdbEvent::End};
+        }
+        const auto checksum = this->read_le_<uint64_t>();
+        // a checksum of 0 means the writer did not compute it
+        if (!checksum.has_value() || (checksum.value() != 0 && checksum.value() != crc_))
+        {
+            return {RedisError::rdb_corrupted};
+        }
+        return {RdbEvent::End};
+    }
+
+    std::optional<uint8_t> RdbReader::read_byte_()
+    {
+        if (offset_ == data_.size())
+        {
+            return std::nullopt;
+        }
+        return static_cast<uint8_t>(data_[offset_++]);
+    }
+
+    std::optional<std::span<const char>> RdbReader::read_bytes_(const size_t size)
+    {
+        if (size > data_.size() - offset_)
+        {
+            return std::nullopt;
+        }
+        const auto bytes = data_.subspan(offset_, size);
+        offset_ += size;
+        return bytes;
+    }
+
+    template<typename T>
+    std::optional<T> RdbReader::read_le_()
+    {
+        const auto bytes = this->read_bytes_(sizeof(T));
+        if (!bytes.has_value())
+        {
+            return std::nullopt;
+        }
+        T value;
+        std::memcpy(&value, bytes->data(), sizeof(T));
+        return value;
+    }
+
+    std::optional<uint64_t> RdbReader::read_length_(bool* encoded)
+    {
+        const auto first = this->read_byte_();
+        if (!first.has_value())
+        {
+            return std::nullopt;
+        }
+        if (encoded != nullptr)
+        {
+            *encoded = false;
+        }
+        switch (first.value() >> 6)
+        {
+            case rdb::LEN_6BIT:
+                return first.value() & 0x3F;
+            case rdb::LEN_14BIT:
+            {
+                const auto second = this->read_byte_();
+                if (!second.has_value())
+                {
+                    return std::nullopt;
+                }
+                return (first.value() & 0x3F) << 8 | second.value();
+            }
+            case rdb::LEN_ENCODED:
+                if (encoded == nullptr)
+                {
+                    return std::nullopt;
+                }
+                *encoded = true;
+                return first.value() & 0x3F;
+            default:
+                break;
+        }
+        // big endian, unlike every other integer of the format
+        if (first.value() == rdb::LEN_32BIT)
+        {
+            const auto length = this->read_le_<uint32_t>();
+            return length.has_value() ? std::optional<uint64_t>(__builtin_bswap32(length.value())) : std::nullopt;
+        }
+        if (first.value() == rdb::LEN_64BIT)
+        {
+            const auto length = this->read_le_<uint64_t>();
+            return length.has_value() ? std::optional<uint64_t>(__builtin_bswap64(length.value())) : std::nullopt;
+        }
+        return std::nullopt;
+    }
+
+    std::optional<std::string_view> RdbReader::read_string_(std::string& buffer)
+    {
+        bool encoded;
+        const auto length = this->read_length_(&encoded);
+        if (!length.has_value())
+        {
+            return std::nullopt;
+        }
+        if (!encoded)
+        {
+            // a longer string could not be stored, see Value::MAX_SIZE
+            if (length.value() > Value::MAX_SIZE)
+            {
+                return std::nullopt;
+            }
+            const auto bytes = this->read_bytes_(length.value());
+            if (!bytes.has_value())
+            {
+                return std::nullopt;
+            }
+            return std::string_view(bytes->data(), bytes->size());
+        }
+        std::optional<int64_t> integer;
+        switch (length.value())
+        {
+            case rdb::ENC_INT8:
+                integer = this->read_le_<int8_t>();
+                break;
+            case rdb::ENC_INT16:
+                integer = this->read_le_<int16_t>();
+                break;
+            case rdb::ENC_INT32:
+                integer = this->read_le_<int32_t>();
+                break;
+            case rdb::ENC_LZF:
+            {
+                const auto compressed_size = this->read_length_();
+                const auto size = this->read_length_();
+                // LZF cannot expand a run of bytes by more than this, a larger size is corrupted
+                if (!compressed_size.has_value() || !size.has_value() || size.value() > compressed_size.value() * 256 ||
+                    size.value() > Value::MAX_SIZE)
+                {
+                    return std::nullopt;
+                }
+                const auto compressed = this->read_bytes_(compressed_size.value());
+                if (!compressed.has_value())
+                {
+                    return std::nullopt;
+                }
+                buffer.resize(size.value());
+                if (!lzf_decompress(compressed.value(), buffer))
+                {
+                    return std::nullopt;
+                }
+                return buffer;
+            }
+            default:
+                return std::nullopt;
+        }
+        if (!integer.has_value())
+        {
+            return std::nullopt;
+        }
+        buffer.resize(20);
+        const auto end = std::to_chars(buffer.data(), buffer.data() + buffer.size(), integer.value()).ptr;
+        buffer.resize(end - buffer.data());
+        return buffer;
+    }
+
+    bool RdbReader::skip_string_()
+    {
+        bool encoded;
+        const auto length = this->read_length_(&encoded);
+        if (!length.has_value())
+        {
+            return false;
+        }
+        if (!encoded)
+        {
+            return this->read_bytes_(length.value()).has_value();
+        }
+        switch (length.value())
+        {
+            case rdb::ENC_INT8:
+                return this->read_bytes_(1).has_value();
+            case rdb::ENC_INT16:
+                return this->read_bytes_(2).has_value();
+            case rdb::ENC_INT32:
+                return this->read_bytes_(4).has_value();
+            case rdb::ENC_LZF:
+            {
+                // no need to decompress what is skipped
+                const auto compressed_size = this->read_length_();
+                return compressed_size.has_value() && this->read_length_().has_value() &&
+                       this->read_bytes_(compressed_size.value()).has_value();
+            }
+            default:
+                return false;
+        }
+    }
+
+    bool RdbReader::skip_object_(const uint8_t type)
+    {
+        switch (type)
+        {
+            case rdb::TYPE_HASH_ZIPMAP:
+            case rdb::TYPE_LIST_ZIPLIST:
+            case rdb::TYPE_SET_INTSET:
+            case rdb::TYPE_ZSET_ZIPLIST:
+            case rdb::TYPE_HASH_ZIPLIST:
+            case rdb::TYPE_HASH_LISTPACK:
+            case rdb::TYPE_ZSET_LISTPACK:
+            case rdb::TYPE_SET_LISTPACK:
+                // the whole object is serialized as a single string
+                return this->skip_string_();
+            case rdb::TYPE_LIST:
+            case rdb::TYPE_SET:
+            case rdb::TYPE_ZSET:
+            case rdb::TYPE_ZSET_2:
+            case rdb::TYPE_HASH:
+            case rdb::TYPE_LIST_QUICKLIST:
+            case rdb::TYPE_LIST_QUICKLIST_2:
+                break;
+            default:
+                error_ = RedisError::rdb_unsupported;
+                return false;
+        }
+        const auto size = this->read_length_();
+        if (!size.has_value())
+        {
+            return false;
+        }
+        for (uint64_t i = 0; i < size.value(); ++i)
+        {
+            switch (type)
+            {
+                case rdb::TYPE_ZSET:
+                {
+                    // the score is a string of up to 255 bytes, or a length meaning nan or an infinity
+                    if (!this->skip_string_())
+                    {
+                        return false;
+                    }
+                    const auto score_size = this->read_byte_();
+                    if (!score_size.has_value() ||
+                        (score_size.value() < 253 && !this->read_bytes_(score_size.value()).has_value()))
+                    {
+                        return false;
+                    }
+                    break;
+                }
+                case rdb::TYPE_ZSET_2:
+                    // the score is a binary double
+                    if (!this->skip_string_() || !this->read_bytes_(sizeof(double)).has_value())
+                    {
+                        return false;
+                    }
+                    break;
+                case rdb::TYPE_HASH:
+                    if (!this->skip_string_() || !this->skip_string_())
+                    {
+                        return false;
+                    }
+                    break;
+                case rdb::TYPE_LIST_QUICKLIST_2:
+                    // the container of the node, packed or plain, then the node
+                    if (!this->read_length_().has_value() || !this->skip_string_())
+                    {
+                        return false;
+                    }
+                    break;
+                default:
+                    if (!this->skip_string_())
+                    {
+                        return false;
+                    }
+                    break;
+            }
+        }
+        return true;
+    }
+
+    Result<RdbLoadStats> load_rdb(const std::string& path, Keyspace& keyspace)
+    {
+        MappedFile file(path);
+        if (!file.is_open())
+        {
+            return {RedisError::eof};
+        }
+        RdbReader reader(file.data());
+        if (const auto version = reader.read_header(); version.is_error())
+        {
+            return {version.error()};
+        }
+
+        ShardLoader loader(keyspace, file);
+        RdbLoadStats stats;
+        RdbEntry entry;
+        const auto now = unix_time_ms();
+        auto error = RedisError::success;
+        for (;;)
+        {
+            const auto event = reader.next(entry);
+            if (event.is_error())
+            {
+                error = event.error();
+                break;
+            }
+            if (event.value() == RdbEvent::End)
+            {
+                break;
+            }
+            if (event.value() == RdbEvent::ResizeDb)
+            {
+                if (entry.db == 0)
+                {
+                    // size the tables once instead of growing them step by step, with some slack for the imbalance
+                    const auto shard_count = keyspace.shard_count();
+                    loader.reserve(entry.db_size / shard_count + entry.db_size / shard_count / 8);
+                }
+                continue;
+            }
+            // the keyspace is a single database of strings
+            if (entry.db != 0 || entry.type != rdb::TYPE_STRING)
+            {
+                ++stats.skipped;
+                continue;
+            }
+            if (entry.expire_at != NO_EXPIRY && entry.expire_at <= now)
+            {
+                ++stats.expired;
+                continue;
+            }
+            loader.add(LoadOp::Set, entry.key, entry.value, entry.expire_at);
+            // what was parsed is copied out and checksummed already
+            loader.parsed(reader.checksummed());
+        }
+
+        stats.keys = loader.finish();
+        if (error != RedisError::success)
+        {
+            return {error};
+        }
+        stats.bytes = reader.offset();
+        return {stats};
+    }
+
+    void RdbWriter::write_header(const int64_t now_ms, const size_t used_memory)
+    {
+        // the version is written on 4 digits
+        const auto version = std::to_string(rdb::VERSION);
+        out_.append(rdb::MAGIC).append(4 - version.size(), '0').append(version);
+        // the version of Redis which writes this format
+        this->write_aux("redis-ver", "7.4.0");
+        this->write_aux("redis-bits", std::to_string(sizeof(void*) * 8));
+        this->write_aux("ctime", std::to_string(now_ms / 1000));
+        this->write_aux("used-mem", std::to_string(used_memory));
+        this->write_aux("aof-base", "0");
+    }
+
+    void RdbWriter::write_aux(const std::string_view key, const std::string_view value)
+    {
+        this->write_byte_(rdb::OPCODE_AUX);
+        this->write_string_(key);
+        this->write_string_(value);
+    }
+
+    void RdbWriter::select_db(const uint64_t db, const uint64_t size, const uint64_t expires)
+    {
+        this->write_byte_(rdb::OPCODE_SELECTDB);
+        this->write_length_(db);
+        this->write_byte_(rdb::OPCODE_RESIZEDB);
+        this->write_length_(size);
+        this->write_length_(expires);
+    }
+
+    void RdbWriter::write_string(const std::string_view key, const std::string_view value, const int64_t expire_at)
+    {
+        if (expire_at != NO_EXPIRY)
+        {
+            this->write_byte_(rdb::OPCODE_EXPIRETIME_MS);
+            out_.append(reinterpret_cast<const char*>(&expire_at), sizeof(expire_at));
+        }
+        this->write_byte_(rdb::TYPE_STRING);
+        this->write_string_(key);
+        this->write_string_(value);
+    }
+
+    void RdbWriter::write_end() { this->write_byte_(rdb::OPCODE_EOF); }
+
+    void RdbWriter::write_checksum(const uint64_t crc)
+    {
+        out_.append(reinterpret_cast<const char*>(&crc), sizeof(crc));
+    }
+
+    void RdbWriter::write_byte_(const uint8_t value) { out_.push_back(static_cast<char>(value)); }
+
+    void RdbWriter::write_length_(const uint64_t length)
+    {
+        if (length < 1 << 6)
+        {
+            this->write_byte_(static_cast<uint8_t>(length));
+        }
+        else if (length < 1 << 14)
+        {
+            this->write_byte_(static_cast<uint8_t>(rdb::LEN_14BIT << 6 | length >> 8));
+            this->write_byte_(static_cast<uint8_t>(length & 0xFF));
+        }
+        else if (length <= UINT32_MAX)
+        {
+            this->write_byte_(rdb::LEN_32BIT);
+            const auto big_endian = __builtin_bswap32(static_cast<uint32_t>(length));
+            out_.append(reinterpret_cast<const char*>(&big_endian), sizeof(big_endian));
+        }
+        else
+        {
+            this->write_byte_(rdb::LEN_64BIT);
+            const auto big_endian = __builtin_bswap64(length);
+            out_.append(reinterpret_cast<const char*>(&big_endian), sizeof(big_endian));
+        }
+    }
+
+    void RdbWriter::write_string_(const std::string_view value)
+    {
+        // the text of an int32_t is at most 11 bytes long, only canonical texts are read back the same
+        if (const auto integer = value.size() <= 11 ? parse_canonical_int(value) : std::nullopt;
+            integer.has_value() && integer.value() >= INT32_MIN && integer.value() <= INT32_MAX)
+        {
+            const auto encoded = [&]<typename T>(const uint8_t encoding, T)
+            {
+                this->write_byte_(rdb::LEN_ENCODED << 6 | encoding);
+                const auto narrow = static_cast<T>(integer.value());
+                out_.append(reinterpret_cast<const char*>(&narrow), sizeof(narrow));
+            };
+            if (integer.value() >= INT8_MIN && integer.value() <= INT8_MAX)
+            {
+                encoded(rdb::ENC_INT8, int8_t{});
+            }
+            else if (integer.value() >= INT16_MIN && integer.value() <= INT16_MAX)
+            {
+                encoded(rdb::ENC_INT16, int16_t{});
+            }
+            else
+            {
+                encoded(rdb::ENC_INT32, int32_t{});
+            }
+            return;
+        }
+        this->write_length_(value.size());
+        out_.append(value);
+    }
+
+    Result<RdbSaveStats> save_rdb(const std::string& path, Keyspace& keyspace, SaveProgress* progress)
+    {
+        const auto temp_path = path + ".tmp";
+        RdbFile file(photon::fs::open_localfile_adaptor(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                                        0644, photon::fs::ioengine_iouring));
+        if (!file.is_open())
+        {
+            return {RedisError::io_error};
+        }
+
+        // the shards begin their snapshot right one after the other, the writes which follow are not part of it
+        const auto now = unix_time_ms();
+        Shard::Stats total;
+        for (size_t i = 0; i < keyspace.shard_count(); ++i)
+        {
+            total += keyspace.run_on(i,
+                                     [&](Shard& shard)
+                                     {
+                                         shard.begin_snapshot(now);
+                                         return shard.stats();
+                                     });
+        }
+        if (progress != nullptr)
+        {
+            progress->keys_processed = 0;
+            progress->keys_total = total.keys;
+        }
+
+        std::string buffer;
+        RdbWriter writer(buffer);
+        writer.write_header(now, total.memory.used);
+        writer.select_db(0, total.keys, total.volatile_keys);
+        file.append(buffer);
+
+        SaveJob job{keyspace, file, progress};
+        std::vector<photon::join_handle*> joins;
+        joins.reserve(keyspace.shard_count());
+        for (size_t i = 0; i < keyspace.shard_count(); ++i)
+        {
+            joins.push_back(photon::thread_enable_join(photon::thread_create11(&save_shard, &job, i)));
+        }
+        for (auto* join: joins)
+        {
+            photon::thread_join(join);
+        }
+
+        buffer.clear();
+        writer.write_end();
+        file.append(buffer);
+        buffer.clear();
+        writer.write_checksum(file.crc());
+        file.append(buffer);
+        const auto bytes = file.size();
+        if (!file.close() || ::rename(temp_path.c_str(), path.c_str()) != 0)
+        {
+            // keep the errno of the failure
+            const auto error = errno;
+            for (size_t i = 0; i < keyspace.shard_count(); ++i)
+            {
+                keyspace.run_on(i, [](Shard& shard) { shard.end_snapshot(); });
+            }
+            ::unlink(temp_path.c_str());
+            errno = error;
+            return {RedisError::io_error};
+        }
+        sync_directory(path);
+        return {RdbSaveStats{job.keys, bytes}};
+    }
+}  // namespace redis
@@ -1,15 +1,28 @@
 //
 // Created by ynachi on 8/17/24.
 //
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <format>
 #include <iostream>
+#include <linux/filter.h>
 #include <photon/common/alog.h>
+#include <photon/common/utility.h>
+#include <photon/io/fd-events.h>
+#include <photon/thread/thread11.h>
+#include <sched.h>
 #include <server.hh>
+#include <utility>
 
 #include "framer/handler.h"
+#include "metrics/metrics.h"
+#include "persistence/aof.h"
+#include "persistence/persistence.h"
+#include "persistence/rdb.h"
 
 namespace redis
 {
-
     Server::Server(const ServerConfig& config) :
         server_config_(config), socket_server_(photon::net::new_tcp_socket_server())
     {
@@ -30,12 +43,13 @@ namespace redis
     void Server::run()
     {
         LOG_DEBUG("server::run entering server main loop ", photon::get_vcpu_num());
-        if (const auto rc = socket_server_->bind(this->server_config_.port_, this->server_config_.host_); rc != 0)
+        const auto reuseport = this->server_config_.reuseport_;
+        if (!reuseport && socket_server_->bind(this->server_config_.port_, this->server_config_.host_) != 0)
         {
             LOG_ERRNO_RETURN(0, , "failed to bind tcp socket");
         }
 
-        if (socket_server_->listen() < 0)
+        if (!reuseport && socket_server_->listen() < 0)
         {
             LOG_ERRNO_RETURN(0, , "failed to listen on tcp socket");
         }
@@ -43,6 +57,47 @@ namespace redis
         // the worker init fails when it is done in the Constructor. I do not know why yet.
         photon::WorkPool wp(this->server_config_.worker_thread_count_, this->server_config_.event_engine_,
                             photon::INIT_IO_NONE, this->server_config_.max_concurrent_connections_);
+        // one shard per worker vCPU, the sessions are served by the same vCPUs
+        Keyspace keyspace(wp);
+        keyspace.set_maxmemory(this->server_config_.maxmemory_, this->server_config_.maxmemory_policy_);
+        const auto appendonly = this->server_config_.appendonly_;
+        if (!(appendonly ? this->load_aof_(keyspace) : this->load_snapshot_(keyspace)))
+        {
+            return;
+        }
+        keyspace.start_expire_cycle(this->server_config_.hz_);
+        Aof aof(keyspace, this->aof_path_(), this->server_config_.appendfsync_);
+        if (appendonly)
+        {
+            if (const auto size = aof.open(); size.is_error())
+            {
+                LOG_ERRNO_RETURN(0, , "failed to open the AOF ", this->aof_path_().c_str());
+            }
+            aof.start();
+        }
+        // destroyed first, it waits for the rewrite of the AOF still running
+        Persistence persistence(keyspace, this->snapshot_path_(), appendonly ? &aof : nullptr);
+        if (this->server_config_.metrics_port_ != 0)
+        {
+            photon::thread_create11(&Server::serve_metrics_, this, &keyspace);
+        }
+
+        if (reuseport)
+        {
+            Services services{&keyspace, &persistence, appendonly ? &aof : nullptr};
+            const auto vcpus = wp.get_vcpu_num();
+            for (int i = 0; i < vcpus; ++i)
+            {
+                auto* listener = photon::thread_create11(&Server::listen_, this, &services, i);
+                photon::thread_migrate(listener, wp.get_vcpu_in_pool(i));
+                // The kernel numbers the listeners of the port in the order they listen, the CPU steering picks them
+                // by that number: they listen one after another, in the order of the vCPUs.
+                services.listening.wait(1);
+            }
+            // the listeners only stop when they fail
+            services.stopped.wait(vcpus);
+            return;
+        }
 
         while (true)
         {
@@ -51,8 +106,205 @@ namespace redis
             {
                 LOG_ERRNO_RETURN(0, , "failed to accept tcp socket");
             }
-            auto handler = Handler(std::move(stream), this->server_config_.network_read_chunk_);
-            wp.async_call(new auto([handler = std::move(handler)]() mutable { handler.start_session(); }));
+            if (!this->admit_(*stream))
+            {
+                continue;
+            }
+            auto* handler = new Handler(std::move(stream), this->server_config_.network_read_chunk_,
+                                        this->server_config_.output_flush_threshold_, &keyspace, &persistence,
+                                        appendonly ? &aof : nullptr, this->server_config_.client_limits_,
+                                        this->server_config_.reference_threshold_);
+            wp.async_call(new auto([this, handler] { this->serve_(handler); }));
+        }
+    }
+
+    bool Server::load_snapshot_(Keyspace& keyspace) const
+    {
+        using namespace std::chrono;
+        const auto path = this->snapshot_path_();
+        const auto start = steady_clock::now();
+        const auto stats = load_rdb(path, keyspace);
+        if (stats.is_error() && stats.error() == RedisError::eof && errno == ENOENT)
+        {
+            LOG_INFO("no snapshot to load at ", path.c_str());
+            return true;
+        }
+        if (stats.is_error())
+        {
+            // like Redis, do not start with a partial dataset
+            LOG_ERROR("failed to load the snapshot ", path.c_str(), ": ",
+                      RedisErrorCategory().message(static_cast<int>(stats.error())).c_str());
+            return false;
+        }
+        const auto elapsed = duration_cast<milliseconds>(steady_clock::now() - start);
+        LOG_INFO("loaded ", stats.value().keys, " keys from ", path.c_str(), " in ", elapsed.count(), "ms, ",
+                 stats.value().expired, " expired and ", stats.value().skipped, " skipped");
+        return true;
+    }
+
+    bool Server::load_aof_(Keyspace& keyspace) const
+    {
+        using namespace std::chrono;
+        const auto path = this->aof_path_();
+        const auto start = steady_clock::now();
+        const auto stats = load_aof(path, keyspace);
+        if (stats.is_error() && stats.error() == RedisError::eof && errno == ENOENT)
+        {
+            // the AOF is created from the dataset of the snapshot
+            LOG_INFO("no AOF to replay at ", path.c_str());
+            return this->load_snapshot_(keyspace);
+        }
+        if (stats.is_error())
+        {
+            LOG_ERROR("failed to replay the AOF ", path.c_str(), ": ",
+                      RedisErrorCategory().message(static_cast<int>(stats.error())).c_str());
+            return false;
+        }
+        if (stats.value().truncated > 0)
+        {
+            LOG_WARN("cut off ", stats.value().truncated, " bytes of an incomplete command at the end of ", path.c_str());
+        }
+        const auto elapsed = duration_cast<milliseconds>(steady_clock::now() - start);
+        LOG_INFO("replayed ", stats.value().commands, " commands from ", path.c_str(), " in ", elapsed.count(), "ms");
+        return true;
+    }
+
+    void Server::listen_(Services* services, const int vcpu)
+    {
+        const auto& config = this->server_config_;
+        // created on the vCPU of the listener, which polls it
+        std::unique_ptr<photon::net::ISocketServer> server(photon::net::new_tcp_socket_server());
+        DEFER(services->stopped.signal(1));
+        // the next listener starts once this one listens, or failed to
+        bool started = false;
+        const auto start_next = [&]
+        {
+            if (!std::exchange(started, true))
+            {
+                services->listening.signal(1);
+            }
+        };
+        DEFER(start_next());
+        server->setsockopt<int>(SOL_SOCKET, SO_REUSEADDR, 1);
+        if (server->setsockopt<int>(SOL_SOCKET, SO_REUSEPORT, 1) != 0)
+        {
+            LOG_ERRNO_RETURN(0, , "failed to set SO_REUSEPORT");
+        }
+        if (config.reuseport_cpu_steering_)
+        {
+            // The program picks the listener of rank CPU % vCPUs for a connection received by a CPU, and vCPU i is
+            // pinned to CPU i: a connection is served by the CPU which received it, when there are as many vCPUs.
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(vcpu, &cpus);
+            if (::sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+            {
+                LOG_WARN("failed to pin vCPU ", vcpu, " to its CPU: ", strerror(errno));
+            }
+            sock_filter code[] = {
+                    {BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)},
+                    {BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>(services->keyspace->shard_count())},
+                    {BPF_RET | BPF_A, 0, 0, 0},
+            };
+            sock_fprog program{static_cast<unsigned short>(std::size(code)), code};
+            if (server->setsockopt(SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) != 0)
+            {
+                LOG_WARN("failed to steer the connections by CPU, they are spread by hash: ", strerror(errno));
+            }
+        }
+        if (server->bind(config.port_, config.host_) != 0)
+        {
+            LOG_ERRNO_RETURN(0, , "failed to bind tcp socket");
+        }
+        if (server->listen() < 0)
+        {
+            LOG_ERRNO_RETURN(0, , "failed to listen on tcp socket");
+        }
+        start_next();
+        while (true)
+        {
+            std::unique_ptr<photon::net::ISocketStream> stream(server->accept());
+            if (stream == nullptr)
+            {
+                LOG_ERRNO_RETURN(0, , "failed to accept tcp socket");
+            }
+            if (!this->admit_(*stream))
+            {
+                continue;
+            }
+            // the session stays on this vCPU, the one the kernel chose
+            auto* handler = new Handler(std::move(stream), config.network_read_chunk_, config.output_flush_threshold_,
+                                        services->keyspace, services->persistence, services->aof,
+                                        config.client_limits_, config.reference_threshold_);
+            photon::thread_create11(&Server::serve_, this, handler);
+        }
+    }
+
+    void Server::serve_metrics_(Keyspace* keyspace)
+    {
+        const auto& config = this->server_config_;
+        std::unique_ptr<photon::net::ISocketServer> server(photon::net::new_tcp_socket_server());
+        server->setsockopt<int>(SOL_SOCKET, SO_REUSEADDR, 1);
+        if (server->bind(config.metrics_port_, config.host_) != 0 || server->listen() < 0)
+        {
+            LOG_ERRNO_RETURN(0, , "failed to listen on the metrics port");
+        }
+        LOG_INFO("serving metrics on port ", config.metrics_port_);
+        while (true)
+        {
+            auto* stream = server->accept();
+            if (stream == nullptr)
+            {
+                LOG_ERRNO_RETURN(0, , "failed to accept a metrics connection");
+            }
+            // a slow scraper only holds up its own thread
+            photon::thread_create11(&Server::scrape_, this, stream, keyspace);
+        }
+    }
+
+    void Server::scrape_(photon::net::ISocketStream* connection, Keyspace* keyspace)
+    {
+        // Photon streams wait without limit, a peer which does not send its request is dropped after a while.
+        constexpr uint64_t REQUEST_TIMEOUT_US = 5'000'000;
+        const std::unique_ptr<photon::net::ISocketStream> stream(connection);
+        const auto fd = stream->get_underlay_fd();
+        if (fd >= 0 && photon::wait_for_fd_readable(fd, REQUEST_TIMEOUT_US) != 0)
+        {
+            return;
+        }
+        // Whatever the request, the reply is the metrics. It is read first so that closing does not reset it.
+        char request[1024];
+        if (stream->recv(request, sizeof(request)) <= 0)
+        {
+            return;
+        }
+        const auto body = prometheus_text(collect_metrics(*keyspace));
+        const auto reply = std::format("HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                       "Content-Length: {}\r\nConnection: close\r\n\r\n{}",
+                                       body.size(), body);
+        stream->write(reply.data(), reply.size());
+    }
+
+    bool Server::admit_(photon::net::ISocketStream& stream)
+    {
+        if (clients_.fetch_add(1) < this->server_config_.max_concurrent_connections_)
+        {
+            return true;
+        }
+        --clients_;
+        count_rejected_connection();
+        constexpr std::string_view error = "-ERR max number of clients reached\r\n";
+        stream.write(error.data(), error.size());
+        return false;
+    }
+
+    void Server::serve_(Handler* handler)
+    {
+        {
+            const std::unique_ptr<Handler> owned(handler);
+            owned->start_session();
         }
+        // the connection is closed with the handler
+        --clients_;
     }
 }  // namespace redis
@@ -0,0 +1,128 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "storage/eviction.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace redis
+{
+    namespace
+    {
+        constexpr std::pair<EvictionPolicy, std::string_view> POLICY_NAMES[] = {
+                {EvictionPolicy::NoEviction, "noeviction"},       {EvictionPolicy::AllKeysLru, "allkeys-lru"},
+                {EvictionPolicy::AllKeysLfu, "allkeys-lfu"},      {EvictionPolicy::AllKeysRandom, "allkeys-random"},
+                {EvictionPolicy::VolatileLru, "volatile-lru"},    {EvictionPolicy::VolatileTtl, "volatile-ttl"},
+        };
+
+        uint32_t lfu_minutes(const int64_t now_ms) noexcept { return static_cast<uint32_t>(now_ms / 60'000) & 0xFFFF; }
+    }  // namespace
+
+    std::optional<EvictionPolicy> parse_eviction_policy(const std::string_view name) noexcept
+    {
+        for (const auto& [policy, policy_name]: POLICY_NAMES)
+        {
+            if (policy_name == name)
+            {
+                return policy;
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::string_view to_string(const EvictionPolicy policy) noexcept
+    {
+        for (const auto& [known, name]: POLICY_NAMES)
+        {
+            if (known == policy)
+            {
+                return name;
+            }
+        }
+        return "unknown";
+    }
+
+    namespace eviction
+    {
+        uint8_t lfu_counter(const uint32_t meta, const int64_t now_ms) noexcept
+        {
+            const auto last = meta >> 8;
+            const auto now = lfu_minutes(now_ms);
+            const auto elapsed = now >= last ? now - last : now + (0xFFFF - last);
+            const auto counter = meta & 0xFF;
+            const auto decay = elapsed / LFU_DECAY_TIME;
+            return static_cast<uint8_t>(decay >= counter ? 0 : counter - decay);
+        }
+
+        uint32_t lfu_touch(const uint32_t meta, const int64_t now_ms, const uint64_t random) noexcept
+        {
+            uint32_t counter = lfu_counter(meta, now_ms);
+            if (counter < 255)
+            {
+                // the probability to increment shrinks as the counter grows, 255 takes about a million accesses
+                const auto base = counter > LFU_INIT_VAL ? counter - LFU_INIT_VAL : 0;
+                const auto p = 1.0 / (base * LFU_LOG_FACTOR + 1);
+                if (static_cast<double>(random >> 11) * 0x1.0p-53 < p)
+                {
+                    ++counter;
+                }
+            }
+            return lfu_minutes(now_ms) << 8 | counter;
+        }
+
+        uint32_t lfu_new(const int64_t now_ms) noexcept { return lfu_minutes(now_ms) << 8 | LFU_INIT_VAL; }
+    }  // namespace eviction
+
+    void EvictionPool::offer(const std::string_view key, const uint64_t score)
+    {
+        // the position of the first candidate with a higher score
+        const auto end = candidates_.begin() + static_cast<ptrdiff_t>(size_);
+        auto position = std::find_if(candidates_.begin(), end, [&](const Candidate& c) { return c.score > score; });
+        if (std::any_of(candidates_.begin(), end, [&](const Candidate& c) { return c.key == key; }))
+        {
+            return;
+        }
+        if (size_ < SIZE)
+        {
+            // shift the better candidates up
+            std::move_backward(position, end, end + 1);
+            ++size_;
+        }
+        else
+        {
+            if (position == candidates_.begin())
+            {
+                // worse than every candidate
+                return;
+            }
+            // drop the worst candidate, shift the worse ones down
+            --position;
+            std::move(candidates_.begin() + 1, position + 1, candidates_.begin());
+        }
+        position->key.assign(key);
+        position->score = score;
+    }
+
+    bool EvictionPool::pop(SlabString& key)
+    {
+        if (size_ == 0)
+        {
+            return false;
+        }
+        auto& best = candidates_[--size_];
+        key.swap(best.key);
+        best.key.clear();
+        return true;
+    }
+
+    void EvictionPool::clear() noexcept
+    {
+        for (size_t i = 0; i < size_; ++i)
+        {
+            candidates_[i].key.clear();
+        }
+        size_ = 0;
+    }
+}  // namespace redis
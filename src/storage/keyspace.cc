@@ -0,0 +1,117 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "storage/keyspace.h"
+
+#include <cassert>
+#include <chrono>
+#include <photon/thread/thread11.h>
+
+namespace redis
+{
+    Keyspace::Keyspace(const size_t shard_count)
+    {
+        assert(shard_count > 0);
+        shards_.reserve(shard_count);
+        for (size_t i = 0; i < shard_count; ++i)
+        {
+            shards_.push_back(std::make_unique<Shard>());
+        }
+    }
+
+    Keyspace::Keyspace(photon::WorkPool& pool) : Keyspace(pool.get_vcpu_num())
+    {
+        vcpus_.reserve(shards_.size());
+        for (size_t i = 0; i < shards_.size(); ++i)
+        {
+            vcpus_.push_back(pool.get_vcpu_in_pool(i));
+        }
+    }
+
+    Keyspace::~Keyspace()
+    {
+        stopping_ = true;
+        for (size_t i = 0; i < expire_threads_.size(); ++i)
+        {
+            // a thread can only be interrupted and joined from its own vCPU
+            this->run_on(i,
+                         [&](Shard&)
+                         {
+                             photon::thread_interrupt(expire_threads_[i]);
+                             photon::thread_join(expire_joins_[i]);
+                         });
+        }
+    }
+
+    void Keyspace::start_expire_cycle(const uint64_t hz)
+    {
+        assert(hz > 0 && expire_threads_.empty());
+        const auto period_us = 1'000'000 / hz;
+        for (size_t i = 0; i < shards_.size(); ++i)
+        {
+            // the thread is created on the vCPU run_on migrated to
+            auto* thread = this->run_on(
+                    i, [&](Shard&) { return photon::thread_create11(&Keyspace::expire_cycle_, this, i, period_us); });
+            expire_threads_.push_back(thread);
+            expire_joins_.push_back(photon::thread_enable_join(thread));
+        }
+    }
+
+    void Keyspace::expire_cycle_(const size_t index, const uint64_t period_us)
+    {
+        using namespace std::chrono;
+        auto& shard = *shards_[index];
+        const auto budget = microseconds(period_us / 4);
+        while (!stopping_)
+        {
+            photon::thread_usleep(period_us);
+            const auto start = steady_clock::now();
+            while (!stopping_ && !shard.active_expire(unix_time_ms(), EXPIRE_SLICE_US))
+            {
+                if (steady_clock::now() - start >= budget)
+                {
+                    break;
+                }
+                photon::thread_yield();
+            }
+        }
+    }
+
+    void Keyspace::set_maxmemory(const size_t maxmemory, const EvictionPolicy policy)
+    {
+        maxmemory_ = maxmemory;
+        policy_ = policy;
+        // rounded up, so that a limit is never turned into no limit
+        const auto limit = maxmemory == 0 ? 0 : (maxmemory + shards_.size() - 1) / shards_.size();
+        for (size_t i = 0; i < shards_.size(); ++i)
+        {
+            this->run_on(i, [&](Shard& shard) { shard.set_maxmemory(limit, policy); });
+        }
+    }
+
+    void Keyspace::set_eviction_listener(const EvictionListener& listener)
+    {
+        for (size_t i = 0; i < shards_.size(); ++i)
+        {
+            this->run_on(i, [&](Shard& shard) { shard.set_eviction_listener(listener); });
+        }
+    }
+
+    Shard::Stats Keyspace::stats()
+    {
+        Shard::Stats total;
+        for (size_t i = 0; i < shards_.size(); ++i)
+        {
+            total += this->run_on(i, [](const Shard& shard) { return shard.stats(); });
+        }
+        return total;
+    }
+
+    size_t Keyspace::shard_of(const std::string_view key) const noexcept
+    {
+        // The dictionaries of the shards index their tables with the low bits of the hash, the high ones pick the shard
+        // so that all the keys of a shard do not share the same low bits.
+        return ((hash_key(key) >> 32) * shards_.size()) >> 32;
+    }
+}  // namespace redis
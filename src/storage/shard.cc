@@ -0,0 +1,381 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "storage/shard.h"
+
+#include <chrono>
+
+namespace redis
+{
+    int64_t unix_time_ms() noexcept
+    {
+        const auto now = std::chrono::system_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+    }
+
+    Shard::Entry* Shard::find_(const std::string_view key)
+    {
+        auto* entry = entries_.find(key);
+        if (entry != nullptr && entry->expire_at != NO_EXPIRY && entry->expire_at <= unix_time_ms())
+        {
+            this->erase_(key, *entry);
+            ++expired_keys_;
+            return nullptr;
+        }
+        return entry;
+    }
+
+    void Shard::erase_(const std::string_view key, const Entry& entry)
+    {
+        this->preserve_(key, &entry);
+        volatile_keys_ -= entry.expire_at != NO_EXPIRY;
+        entries_.erase(key);
+    }
+
+    void Shard::set_expiry_(const std::string_view key, Entry& entry, const int64_t at_ms)
+    {
+        this->preserve_(key, &entry);
+        volatile_keys_ += (at_ms != NO_EXPIRY) - (entry.expire_at != NO_EXPIRY);
+        entry.expire_at = at_ms;
+        // a timer firing before the new deadline is pushed back when it fires, only an earlier deadline needs one
+        if (at_ms != NO_EXPIRY && (entry.timer_at == NO_EXPIRY || at_ms < entry.timer_at))
+        {
+            timers_.add(key, at_ms);
+            entry.timer_at = at_ms;
+        }
+    }
+
+    const Value* Shard::get(const std::string_view key)
+    {
+        const SlabAllocator::Scope scope(slab_);
+        auto* entry = this->find_(key);
+        if (entry == nullptr)
+        {
+            ++misses_;
+            return nullptr;
+        }
+        ++hits_;
+        this->touch_(*entry);
+        return &entry->value;
+    }
+
+    void Shard::set(const std::string_view key, const std::span<const char> value, const int64_t expire_at)
+    {
+        const SlabAllocator::Scope scope(slab_);
+        this->store_(key, Value(value), expire_at);
+    }
+
+    void Shard::set(const std::string_view key, Value::Buffer&& value, const int64_t expire_at)
+    {
+        const SlabAllocator::Scope scope(slab_);
+        this->store_(key, Value::adopt(std::move(value)), expire_at);
+    }
+
+    void Shard::store_(const std::string_view key, Value&& value, const int64_t expire_at)
+    {
+        if (snapshot_.active)
+        {
+            this->preserve_(key, entries_.find(key));
+        }
+        // An existing key keeps its slot, and its access metadata like with Redis: a key written often is not
+        // considered new by LFU.
+        auto [entry, inserted] = entries_.try_emplace(key);
+        const auto meta = inserted ? 0 : entry->value.meta();
+        entry->value = std::move(value);
+        entry->value.set_meta(meta);
+        this->touch_(*entry);
+        this->set_expiry_(key, *entry, expire_at);
+    }
+
+    Result<int64_t> Shard::incr_by(const std::string_view key, const int64_t delta)
+    {
+        const SlabAllocator::Scope scope(slab_);
+        auto* entry = this->find_(key);
+        int64_t current = 0;
+        if (entry != nullptr)
+        {
+            // values are integer encoded whenever they can, anything else is not a number
+            const auto integer = entry->value.integer();
+            if (!integer.has_value())
+            {
+                return {RedisError::not_integer};
+            }
+            current = integer.value();
+        }
+        int64_t result;
+        if (__builtin_add_overflow(current, delta, &result))
+        {
+            return {RedisError::integer_overflow};
+        }
+        this->preserve_(key, entry);
+        const auto meta = entry == nullptr ? 0 : entry->value.meta();
+        if (entry == nullptr)
+        {
+            entry = entries_.try_emplace(key).first;
+        }
+        entry->value = Value::from_int(result);
+        entry->value.set_meta(meta);
+        this->touch_(*entry);
+        return {result};
+    }
+
+    bool Shard::del(const std::string_view key)
+    {
+        const SlabAllocator::Scope scope(slab_);
+        const auto* entry = this->find_(key);
+        if (entry == nullptr)
+        {
+            return false;
+        }
+        this->erase_(key, *entry);
+        return true;
+    }
+
+    bool Shard::expire(const std::string_view key, const int64_t at_ms)
+    {
+        const SlabAllocator::Scope scope(slab_);
+        auto* entry = this->find_(key);
+        if (entry == nullptr)
+        {
+            return false;
+        }
+        if (at_ms <= unix_time_ms())
+        {
+            this->erase_(key, *entry);
+            return true;
+        }
+        this->set_expiry_(key, *entry, at_ms);
+        return true;
+    }
+
+    bool Shard::persist(const std::string_view key)
+    {
+        const SlabAllocator::Scope scope(slab_);
+        auto* entry = this->find_(key);
+        if (entry == nullptr || entry->expire_at == NO_EXPIRY)
+        {
+            return false;
+        }
+        this->set_expiry_(key, *entry, NO_EXPIRY);
+        return true;
+    }
+
+    std::optional<int64_t> Shard::expire_time(const std::string_view key)
+    {
+        const SlabAllocator::Scope scope(slab_);
+        const auto* entry = this->find_(key);
+        if (entry == nullptr)
+        {
+            return std::nullopt;
+        }
+        return entry->expire_at;
+    }
+
+    void Shard::on_timer_(const TimingWheel::Timer& timer, const int64_t now_ms)
+    {
+        auto* entry = entries_.find(timer.key);
+        if (entry == nullptr || entry->timer_at != timer.at)
+        {
+            // the key is gone or a timer for an earlier deadline replaced this one
+            return;
+        }
+        if (entry->expire_at == NO_EXPIRY)
+        {
+            entry->timer_at = NO_EXPIRY;
+            return;
+        }
+        if (entry->expire_at <= now_ms)
+        {
+            this->erase_(timer.key, *entry);
+            ++expired_keys_;
+            return;
+        }
+        // the time to live was extended after this timer was filed
+        timers_.add(timer.key, entry->expire_at);
+        entry->timer_at = entry->expire_at;
+    }
+
+    bool Shard::active_expire(const int64_t now_ms, const int64_t budget_us)
+    {
+        const SlabAllocator::Scope scope(slab_);
+        using namespace std::chrono;
+        const auto deadline = steady_clock::now() + microseconds(budget_us);
+        size_t popped = 0;
+        return timers_.advance(
+                now_ms, [&](const TimingWheel::Timer& timer) { this->on_timer_(timer, now_ms); },
+                [&]
+                {
+                    // reading the clock is not free, only check it every few keys
+                    return (++popped % 16) == 0 && steady_clock::now() >= deadline;
+                });
+    }
+
+    void Shard::begin_snapshot(const int64_t now_ms)
+    {
+        const SlabAllocator::Scope scope(slab_);
+        this->end_snapshot();
+        snapshot_.active = true;
+        snapshot_.at = now_ms;
+    }
+
+    void Shard::end_snapshot()
+    {
+        const SlabAllocator::Scope scope(slab_);
+        snapshot_.preimages.clear();
+        snapshot_.active = false;
+        snapshot_.draining = false;
+        snapshot_.cursor = 0;
+    }
+
+    void Shard::preserve_(const std::string_view key, const Entry* entry)
+    {
+        // the keys behind the cursor were written already, the other ones keep their first preimage
+        if (!snapshot_.active || snapshot_.draining || decltype(entries_)::scanned(key, snapshot_.cursor))
+        {
+            return;
+        }
+        auto [preimage, inserted] = snapshot_.preimages.try_emplace(key);
+        if (!inserted || entry == nullptr)
+        {
+            return;
+        }
+        Value::IntText scratch;
+        preimage->value = Value(entry->value.str(scratch));
+        preimage->expire_at = entry->expire_at;
+        preimage->existed = true;
+    }
+
+    uint64_t Shard::random_() noexcept
+    {
+        random_state_ ^= random_state_ << 13;
+        random_state_ ^= random_state_ >> 7;
+        random_state_ ^= random_state_ << 17;
+        return random_state_;
+    }
+
+    void Shard::touch_(Entry& entry)
+    {
+        switch (policy_)
+        {
+            case EvictionPolicy::AllKeysLru:
+            case EvictionPolicy::VolatileLru:
+                entry.value.set_meta(eviction::lru_clock(unix_time_ms()));
+                break;
+            case EvictionPolicy::AllKeysLfu:
+            {
+                const auto now = unix_time_ms();
+                // a value just written has no metadata yet
+                const auto meta = entry.value.meta();
+                entry.value.set_meta(meta == 0 ? eviction::lfu_new(now) : eviction::lfu_touch(meta, now, this->random_()));
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    void Shard::set_maxmemory(const size_t limit, const EvictionPolicy policy)
+    {
+        const SlabAllocator::Scope scope(slab_);
+        maxmemory_ = limit;
+        if (policy != policy_)
+        {
+            // the scores of the candidates mean something else now
+            pool_.clear();
+            policy_ = policy;
+        }
+    }
+
+    void Shard::fill_pool_(const int64_t now_ms)
+    {
+        const auto volatile_only = policy_ == EvictionPolicy::VolatileLru || policy_ == EvictionPolicy::VolatileTtl;
+        entries_.sample(this->random_(), EVICTION_SAMPLES,
+                        [&](const auto& key, const Entry& entry)
+                        {
+                            if (volatile_only && entry.expire_at == NO_EXPIRY)
+                            {
+                                return;
+                            }
+                            uint64_t score;
+                            switch (policy_)
+                            {
+                                case EvictionPolicy::AllKeysLfu:
+                                    score = 255 - eviction::lfu_counter(entry.value.meta(), now_ms);
+                                    break;
+                                case EvictionPolicy::VolatileTtl:
+                                    // the sooner the key expires, the better
+                                    score = UINT64_MAX - static_cast<uint64_t>(entry.expire_at);
+                                    break;
+                                default:
+                                    score = eviction::lru_idle(entry.value.meta(), now_ms);
+                                    break;
+                            }
+                            pool_.offer(key, score);
+                        });
+    }
+
+    bool Shard::evict_one_()
+    {
+        if (policy_ == EvictionPolicy::AllKeysRandom)
+        {
+            SlabString victim;
+            // a sample can miss on a sparse table, try a few random slots
+            for (size_t round = 0; round < EvictionPool::SIZE; ++round)
+            {
+                if (entries_.sample(this->random_(), 1, [&](const auto& key, const Entry&) { victim.assign(key); }) != 0)
+                {
+                    if (on_evict_)
+                    {
+                        on_evict_(victim);
+                    }
+                    this->erase_(victim, *entries_.find(victim));
+                    ++evicted_keys_;
+                    return true;
+                }
+            }
+            return false;
+        }
+        const auto now = unix_time_ms();
+        SlabString victim;
+        // a few rounds, the candidates of the pool may be gone already
+        for (size_t round = 0; round < EvictionPool::SIZE; ++round)
+        {
+            this->fill_pool_(now);
+            while (pool_.pop(victim))
+            {
+                if (const auto* entry = entries_.find(victim); entry != nullptr)
+                {
+                    if (on_evict_)
+                    {
+                        on_evict_(victim);
+                    }
+                    this->erase_(victim, *entry);
+                    ++evicted_keys_;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool Shard::make_room()
+    {
+        if (maxmemory_ == 0 || slab_.stats().used <= maxmemory_)
+        {
+            return true;
+        }
+        if (policy_ == EvictionPolicy::NoEviction)
+        {
+            return false;
+        }
+        const SlabAllocator::Scope scope(slab_);
+        size_t evicted = 0;
+        while (slab_.stats().used > maxmemory_ && evicted < EVICTION_BATCH && this->evict_one_())
+        {
+            ++evicted;
+        }
+        // some progress is enough, the next writes evict more
+        return evicted > 0 || slab_.stats().used <= maxmemory_;
+    }
+}  // namespace redis
@@ -0,0 +1,275 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "storage/slab.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+
+namespace redis
+{
+    thread_local SlabAllocator* SlabAllocator::current_ = nullptr;
+
+    SlabAllocator::Stats& SlabAllocator::Stats::operator+=(const Stats& other) noexcept
+    {
+        used += other.used;
+        allocated += other.allocated;
+        resident += other.resident;
+        for (size_t i = 0; i < CLASS_COUNT; ++i)
+        {
+            classes[i].objects += other.classes[i].objects;
+            classes[i].slots += other.classes[i].slots;
+        }
+        return *this;
+    }
+
+    void SlabAllocator::PageList::push(Page* page) noexcept
+    {
+        page->prev = nullptr;
+        page->next = head;
+        if (head != nullptr)
+        {
+            head->prev = page;
+        }
+        head = page;
+        page->listed = true;
+    }
+
+    void SlabAllocator::PageList::remove(Page* page) noexcept
+    {
+        if (page->prev != nullptr)
+        {
+            page->prev->next = page->next;
+        }
+        else
+        {
+            head = page->next;
+        }
+        if (page->next != nullptr)
+        {
+            page->next->prev = page->prev;
+        }
+        page->prev = page->next = nullptr;
+        page->listed = false;
+    }
+
+    SlabAllocator::~SlabAllocator()
+    {
+        for (auto* arena: arenas_)
+        {
+            munmap(arena, ARENA_SIZE);
+        }
+    }
+
+    void SlabAllocator::map_arena_()
+    {
+        // Map twice the size and trim, for the arena to be aligned on its size.
+        auto* mapped = static_cast<char*>(
+                mmap(nullptr, 2 * ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (mapped == MAP_FAILED)
+        {
+            throw std::bad_alloc();
+        }
+        const auto address = reinterpret_cast<uintptr_t>(mapped);
+        auto* base = reinterpret_cast<char*>((address + ARENA_SIZE - 1) & ~(ARENA_SIZE - 1));
+        if (base != mapped)
+        {
+            munmap(mapped, base - mapped);
+        }
+        munmap(base + ARENA_SIZE, mapped + ARENA_SIZE - base);
+#ifdef MADV_HUGEPAGE
+        // a hint, the arena works the same with regular pages
+        madvise(base, ARENA_SIZE, MADV_HUGEPAGE);
+#endif
+        auto* arena = new (base) Arena{this, 0, {}};
+        for (size_t i = 0; i < PAGES_PER_ARENA; ++i)
+        {
+            unused_.push(&arena->pages[i]);
+        }
+        arenas_.push_back(arena);
+        stats_.resident += ARENA_SIZE;
+    }
+
+    void SlabAllocator::unmap_arena_(Arena* arena) noexcept
+    {
+        for (auto& page: arena->pages)
+        {
+            unused_.remove(&page);
+        }
+        std::erase(arenas_, arena);
+        munmap(arena, ARENA_SIZE);
+        stats_.resident -= ARENA_SIZE;
+    }
+
+    SlabAllocator::Page* SlabAllocator::take_page_(const size_t size_class)
+    {
+        if (unused_.head == nullptr)
+        {
+            this->map_arena_();
+        }
+        auto* page = unused_.head;
+        unused_.remove(page);
+        auto* arena = arena_of(page);
+        ++arena->used_pages;
+
+        const auto index = static_cast<size_t>(page - arena->pages);
+        auto* begin = reinterpret_cast<char*>(arena) + index * PAGE_SIZE;
+        if (index == 0)
+        {
+            begin += ARENA_HEADER_SIZE;
+        }
+        const auto size = CLASS_SIZES[size_class];
+        const auto slots = (reinterpret_cast<char*>(arena) + (index + 1) * PAGE_SIZE - begin) / size;
+        page->free = nullptr;
+        page->bump = begin;
+        page->end = begin + slots * size;
+        page->live = 0;
+        page->slots = static_cast<uint32_t>(slots);
+        page->size_class = static_cast<uint8_t>(size_class);
+        stats_.classes[size_class].slots += slots;
+        partial_[size_class].push(page);
+        return page;
+    }
+
+    void SlabAllocator::release_page_(Arena* arena, Page* page) noexcept
+    {
+        const auto size_class = page->size_class;
+        if (page->listed)
+        {
+            partial_[size_class].remove(page);
+        }
+        stats_.classes[size_class].slots -= page->slots;
+        unused_.push(page);
+        // keep an arena around, a shard going back and forth around a multiple of the arena size would map and unmap
+        if (--arena->used_pages == 0 && arenas_.size() > 1)
+        {
+            this->unmap_arena_(arena);
+        }
+    }
+
+    void* SlabAllocator::allocate_small_(const size_t size_class)
+    {
+        auto* page = partial_[size_class].head;
+        if (page == nullptr)
+        {
+            page = this->take_page_(size_class);
+        }
+        void* block;
+        if (page->free != nullptr)
+        {
+            block = page->free;
+            page->free = *static_cast<void**>(block);
+        }
+        else
+        {
+            block = page->bump;
+            page->bump += CLASS_SIZES[size_class];
+        }
+        ++page->live;
+        if (page->free == nullptr && page->bump == page->end)
+        {
+            partial_[size_class].remove(page);
+        }
+        return block;
+    }
+
+    void* SlabAllocator::allocate(const size_t size)
+    {
+        if (size <= MAX_SMALL)
+        {
+            const auto size_class = class_of(size);
+            auto* block = this->allocate_small_(size_class);
+            stats_.used += size;
+            stats_.allocated += CLASS_SIZES[size_class];
+            ++stats_.classes[size_class].objects;
+            return block;
+        }
+        auto* block = allocate_detached(size);
+        this->attach(block);
+        return block;
+    }
+
+    void* SlabAllocator::allocate_detached(const size_t size)
+    {
+        assert(size > MAX_SMALL);
+        auto* header = static_cast<LargeHeader*>(std::malloc(sizeof(LargeHeader) + size));
+        if (header == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        new (header) LargeHeader{nullptr, size, 1};
+        return header + 1;
+    }
+
+    void SlabAllocator::attach(void* block) noexcept
+    {
+        auto* header = static_cast<LargeHeader*>(block) - 1;
+        assert(header->owner == nullptr);
+        header->owner = this;
+        stats_.used += header->size;
+        stats_.allocated += sizeof(LargeHeader) + header->size;
+        stats_.resident += sizeof(LargeHeader) + header->size;
+    }
+
+    void SlabAllocator::deallocate_small_(Arena* arena, void* block, const size_t size) noexcept
+    {
+        auto* page = &arena->pages[(static_cast<char*>(block) - reinterpret_cast<char*>(arena)) / PAGE_SIZE];
+        const auto size_class = page->size_class;
+        stats_.used -= size;
+        stats_.allocated -= CLASS_SIZES[size_class];
+        --stats_.classes[size_class].objects;
+
+        *static_cast<void**>(block) = page->free;
+        page->free = block;
+        if (--page->live == 0)
+        {
+            this->release_page_(arena, page);
+            return;
+        }
+        if (!page->listed)
+        {
+            partial_[size_class].push(page);
+        }
+    }
+
+    void SlabAllocator::deallocate(void* block, const size_t size) noexcept
+    {
+        if (block == nullptr)
+        {
+            return;
+        }
+        if (size <= MAX_SMALL)
+        {
+            auto* arena = arena_of(block);
+            arena->owner->deallocate_small_(arena, block, size);
+            return;
+        }
+        if (const auto* header = static_cast<LargeHeader*>(block) - 1; header->owner != nullptr)
+        {
+            auto& stats = header->owner->stats_;
+            stats.used -= size;
+            stats.allocated -= sizeof(LargeHeader) + size;
+            stats.resident -= sizeof(LargeHeader) + size;
+        }
+        SlabAllocator::unpin(block);
+    }
+
+    void SlabAllocator::pin(const void* block) noexcept
+    {
+        const auto* header = static_cast<const LargeHeader*>(block) - 1;
+        const_cast<LargeHeader*>(header)->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void SlabAllocator::unpin(const void* block) noexcept
+    {
+        auto* header = const_cast<LargeHeader*>(static_cast<const LargeHeader*>(block) - 1);
+        if (header->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            header->~LargeHeader();
+            std::free(header);
+        }
+    }
+}  // namespace redis
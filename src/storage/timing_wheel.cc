@@ -0,0 +1,66 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "storage/timing_wheel.h"
+
+#include <bit>
+
+namespace redis
+{
+    namespace
+    {
+        // slots bigger than that are freed once emptied, instead of keeping the capacity of a burst around
+        constexpr size_t RELEASE_CAPACITY = 1024;
+    }  // namespace
+
+    void TimingWheel::add(const std::string_view key, const int64_t at_ms)
+    {
+        this->file_(Timer{SlabString(key), at_ms});
+        ++size_;
+    }
+
+    void TimingWheel::file_(Timer&& timer)
+    {
+        // an elapsed deadline fires with the next tick
+        const auto at = timer.at < current_ ? current_ : timer.at;
+        const auto diff = static_cast<uint64_t>(at ^ current_);
+        // the level is the highest digit where the deadline and the current tick differ
+        const auto level = diff == 0 ? 0 : (63 - std::countl_zero(diff)) / BITS;
+        const auto slot = (static_cast<uint64_t>(at) >> (level * BITS)) & (SLOTS - 1);
+        levels_[level][slot].push_back(std::move(timer));
+    }
+
+    void TimingWheel::cascade_()
+    {
+        cascaded_ = true;
+        // From the top: a cascaded timer can land in the slot of a lower level which starts at the same tick.
+        for (auto level = LEVELS - 1; level > 0; --level)
+        {
+            const auto low_bits = (uint64_t{1} << (level * BITS)) - 1;
+            if ((static_cast<uint64_t>(current_) & low_bits) != 0)
+            {
+                continue;
+            }
+            auto& slot = levels_[level][(static_cast<uint64_t>(current_) >> (level * BITS)) & (SLOTS - 1)];
+            if (slot.empty())
+            {
+                continue;
+            }
+            auto timers = std::move(slot);
+            slot = {};
+            for (auto& timer: timers)
+            {
+                this->file_(std::move(timer));
+            }
+        }
+    }
+
+    void TimingWheel::release_(Slot& slot)
+    {
+        if (slot.capacity() > RELEASE_CAPACITY)
+        {
+            slot = {};
+        }
+    }
+}  // namespace redis
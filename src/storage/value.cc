@@ -0,0 +1,196 @@
+//
+// Created by ynachi on 10/16/26.
+//
+
+#include "storage/value.h"
+
+#include "storage/slab.h"
+
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+namespace redis
+{
+    std::optional<int64_t> parse_canonical_int(const std::string_view text) noexcept
+    {
+        // "-0", "+1", "007" or " 1" are valid strings but not integers, they would not be given back as they came
+        if (text.empty() || text.size() > 20 || (text[0] == '0' && text.size() > 1) ||
+            (text[0] == '-' && (text.size() == 1 || text[1] == '0')))
+        {
+            return std::nullopt;
+        }
+        int64_t value;
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (ec != std::errc() || ptr != text.data() + text.size())
+        {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+    namespace
+    {
+        // checked_size rejects the sizes a raw value cannot hold, before anything is allocated
+        size_t checked_size(const size_t size)
+        {
+            if (size > Value::MAX_SIZE)
+            {
+                throw std::length_error("value larger than Value::MAX_SIZE");
+            }
+            return size;
+        }
+    }  // namespace
+
+    Value::Value(const std::span<const char> data)
+    {
+        if (const auto integer = parse_canonical_int(std::string_view(data.data(), data.size())); integer.has_value())
+        {
+            std::memcpy(payload_, &integer.value(), sizeof(int64_t));
+            this->set_header_(Encoding::Int, 0);
+            return;
+        }
+        if (data.size() <= EMBEDDED_CAPACITY)
+        {
+            std::memcpy(payload_, data.data(), data.size());
+            this->set_header_(Encoding::Embedded, data.size());
+            return;
+        }
+        auto* heap = static_cast<char*>(SlabAllocator::current().allocate(checked_size(data.size())));
+        std::memcpy(heap, data.data(), data.size());
+        const auto size = static_cast<uint32_t>(data.size());
+        std::memcpy(payload_, &heap, sizeof(char*));
+        std::memcpy(payload_ + sizeof(char*), &size, sizeof(uint32_t));
+        this->set_header_(Encoding::Raw, 0);
+    }
+
+    Value Value::from_int(const int64_t value) noexcept
+    {
+        Value result;
+        std::memcpy(result.payload_, &value, sizeof(int64_t));
+        result.set_header_(Encoding::Int, 0);
+        return result;
+    }
+
+    Value::Buffer::Buffer(const size_t size) :
+        data_(static_cast<char*>(SlabAllocator::allocate_detached(checked_size(size)))), size_(size)
+    {
+    }
+
+    Value::Buffer::~Buffer() { SlabAllocator::deallocate(data_, size_); }
+
+    Value Value::adopt(Buffer&& buffer) noexcept
+    {
+        SlabAllocator::current().attach(buffer.data_);
+        const auto size = static_cast<uint32_t>(std::exchange(buffer.size_, 0));
+        auto* heap = std::exchange(buffer.data_, nullptr);
+        Value result;
+        std::memcpy(result.payload_, &heap, sizeof(char*));
+        std::memcpy(result.payload_ + sizeof(char*), &size, sizeof(uint32_t));
+        result.set_header_(Encoding::Raw, 0);
+        return result;
+    }
+
+    Value::Value(Value&& other) noexcept : header_(other.header_)
+    {
+        std::memcpy(payload_, other.payload_, sizeof(payload_));
+        // the heap buffer, if any, changed hands
+        other.header_ = 0;
+    }
+
+    Value& Value::operator=(Value&& other) noexcept
+    {
+        if (this != &other)
+        {
+            this->release_();
+            std::memcpy(payload_, other.payload_, sizeof(payload_));
+            header_ = other.header_;
+            other.header_ = 0;
+        }
+        return *this;
+    }
+
+    char* Value::raw_data_() const noexcept
+    {
+        char* heap;
+        std::memcpy(&heap, payload_, sizeof(char*));
+        return heap;
+    }
+
+    uint32_t Value::raw_size_() const noexcept
+    {
+        uint32_t size;
+        std::memcpy(&size, payload_ + sizeof(char*), sizeof(uint32_t));
+        return size;
+    }
+
+    void Value::release_() noexcept
+    {
+        if (this->encoding() == Encoding::Raw)
+        {
+            SlabAllocator::deallocate(this->raw_data_(), this->raw_size_());
+        }
+    }
+
+    size_t Value::size() const noexcept
+    {
+        switch (this->encoding())
+        {
+            case Encoding::Int:
+            {
+                IntText scratch;
+                return this->str(scratch).size();
+            }
+            case Encoding::Raw:
+                return this->raw_size_();
+            default:
+                return this->embedded_size_();
+        }
+    }
+
+    std::string_view Value::str(IntText& scratch) const noexcept
+    {
+        switch (this->encoding())
+        {
+            case Encoding::Int:
+            {
+                const auto end = std::to_chars(scratch.data(), scratch.data() + scratch.size(), *this->integer()).ptr;
+                return {scratch.data(), static_cast<size_t>(end - scratch.data())};
+            }
+            case Encoding::Raw:
+                return {this->raw_data_(), this->raw_size_()};
+            default:
+                return {payload_, this->embedded_size_()};
+        }
+    }
+
+    Value::Pin::Pin(const std::string_view bytes) noexcept : bytes_(bytes) { SlabAllocator::pin(bytes_.data()); }
+
+    void Value::Pin::reset() noexcept
+    {
+        if (!this->empty())
+        {
+            SlabAllocator::unpin(std::exchange(bytes_, {}).data());
+        }
+    }
+
+    Value::Pin Value::pin() const noexcept
+    {
+        if (this->encoding() != Encoding::Raw || this->raw_size_() <= SlabAllocator::MAX_SMALL)
+        {
+            return {};
+        }
+        return Pin(std::string_view(this->raw_data_(), this->raw_size_()));
+    }
+
+    std::optional<int64_t> Value::integer() const noexcept
+    {
+        if (this->encoding() != Encoding::Int)
+        {
+            return std::nullopt;
+        }
+        int64_t value;
+        std::memcpy(&value, payload_, sizeof(int64_t));
+        return value;
+    }
+}  // namespace redis
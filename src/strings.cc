@@ -3,8 +3,9 @@
 //
 #include <algorithm>
 #include <cctype>
+#include <charconv>
 #include <string>
-#include <strings.h>
+#include <strings.hh>
 
 namespace utils
 {
@@ -14,4 +15,114 @@ namespace utils
         std::ranges::transform(result, result.begin(), ::toupper);
         return result;
     }
+
+    bool parse_int(const std::string_view text, int64_t& out) noexcept
+    {
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+        return ec == std::errc() && ptr == text.data() + text.size();
+    }
+
+    bool equals_ignore_case(const std::string_view text, const std::string_view name) noexcept
+    {
+        return std::ranges::equal(text, name, [](const char a, const char b)
+                                  { return std::toupper(static_cast<unsigned char>(a)) == b; });
+    }
+
+    namespace
+    {
+        // match_class matches c against the class starting right after '[' and moves p past the closing ']'
+        bool match_class(const std::string_view pattern, size_t& p, const char c) noexcept
+        {
+            const bool negate = p < pattern.size() && pattern[p] == '^';
+            if (negate)
+            {
+                ++p;
+            }
+            bool found = false;
+            for (; p < pattern.size() && pattern[p] != ']'; ++p)
+            {
+                if (pattern[p] == '\\' && p + 1 < pattern.size())
+                {
+                    found |= pattern[++p] == c;
+                }
+                else if (p + 2 < pattern.size() && pattern[p + 1] == '-' && pattern[p + 2] != ']')
+                {
+                    const auto [low, high] = std::minmax(pattern[p], pattern[p + 2]);
+                    found |= c >= low && c <= high;
+                    p += 2;
+                }
+                else
+                {
+                    found |= pattern[p] == c;
+                }
+            }
+            // skip the closing bracket
+            ++p;
+            return found != negate;
+        }
+    }  // namespace
+
+    bool glob_match(const std::string_view pattern, const std::string_view text) noexcept
+    {
+        // Iterative matching with backtracking to the last star only, linear for patterns with a single star and
+        // never exponential.
+        size_t p = 0, t = 0;
+        size_t star = std::string_view::npos, star_text = 0;
+        while (t < text.size())
+        {
+            if (p < pattern.size())
+            {
+                switch (pattern[p])
+                {
+                    case '*':
+                        star = ++p;
+                        star_text = t;
+                        continue;
+                    case '?':
+                        ++p;
+                        ++t;
+                        continue;
+                    case '[':
+                    {
+                        auto next = p + 1;
+                        if (match_class(pattern, next, text[t]))
+                        {
+                            p = next;
+                            ++t;
+                            continue;
+                        }
+                        break;
+                    }
+                    case '\\':
+                        if (p + 1 < pattern.size() && pattern[p + 1] == text[t])
+                        {
+                            p += 2;
+                            ++t;
+                            continue;
+                        }
+                        break;
+                    default:
+                        if (pattern[p] == text[t])
+                        {
+                            ++p;
+                            ++t;
+                            continue;
+                        }
+                        break;
+                }
+            }
+            if (star == std::string_view::npos)
+            {
+                return false;
+            }
+            // let the last star swallow one more character
+            p = star;
+            t = ++star_text;
+        }
+        while (p < pattern.size() && pattern[p] == '*')
+        {
+            ++p;
+        }
+        return p == pattern.size();
+    }
 }  // namespace utils
@@ -0,0 +1,112 @@
+#include "commands.hh"
+
+#include <gtest/gtest.h>
+#include <string>
+
+#include "framer/decoder.h"
+
+using namespace redis;
+
+class CommandTest : public ::testing::Test
+{
+protected:
+    Decoder decoder;
+    std::string input;
+
+    FrameView decode(std::string data)
+    {
+        input = std::move(data);
+        size_t consumed = 0;
+        return decoder.decode_view(std::span(input.data(), input.size()), consumed).value();
+    }
+};
+
+TEST_F(CommandTest, Ping)
+{
+    const auto command = Command::command_from_frame(decode("*1\r\n$4\r\npInG\r\n"));
+    EXPECT_EQ(command.type, CommandType::PING) << "command names are case insensitive";
+    EXPECT_EQ(command.argc(), 1);
+}
+
+TEST_F(CommandTest, PingWithMessage)
+{
+    const auto command = Command::command_from_frame(decode("*2\r\n$4\r\nPING\r\n$5\r\nhello\r\n"));
+    ASSERT_EQ(command.type, CommandType::PING);
+    EXPECT_EQ(command.arg(1), "hello");
+    EXPECT_EQ(command.arg(1).data(), input.data() + 18) << "arguments are borrowed from the decoded input";
+}
+
+TEST_F(CommandTest, PingTooManyArgs)
+{
+    const auto command = Command::command_from_frame(decode("*3\r\n$4\r\nPING\r\n$1\r\na\r\n$1\r\nb\r\n"));
+    EXPECT_EQ(command.type, CommandType::ERROR);
+}
+
+TEST_F(CommandTest, NotAnArray)
+{
+    const auto command = Command::command_from_frame(decode("+PING\r\n"));
+    EXPECT_EQ(command.type, CommandType::ERROR);
+    EXPECT_EQ(command.error, "only array can represent a redis command");
+}
+
+TEST_F(CommandTest, NotBulkStrings)
+{
+    const auto command = Command::command_from_frame(decode("*2\r\n$4\r\nPING\r\n:1\r\n"));
+    EXPECT_EQ(command.type, CommandType::ERROR);
+}
+
+TEST_F(CommandTest, Unknown)
+{
+    const auto command = Command::command_from_frame(decode("*1\r\n$5\r\nHELLO\r\n"));
+    EXPECT_EQ(command.type, CommandType::ERROR);
+    EXPECT_EQ(command.error, "unknown command 'HELLO'");
+}
+
+TEST_F(CommandTest, KeyCommands)
+{
+    EXPECT_EQ(Command::command_from_frame(decode("*2\r\n$3\r\nget\r\n$1\r\nk\r\n")).type, CommandType::GET);
+    EXPECT_EQ(Command::command_from_frame(decode("*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$1\r\nv\r\n")).type, CommandType::SET);
+    EXPECT_EQ(Command::command_from_frame(decode("*3\r\n$3\r\nDEL\r\n$1\r\na\r\n$1\r\nb\r\n")).type, CommandType::DEL);
+    EXPECT_EQ(Command::command_from_frame(decode("*3\r\n$6\r\nEXPIRE\r\n$1\r\nk\r\n$2\r\n10\r\n")).type,
+              CommandType::EXPIRE);
+}
+
+TEST_F(CommandTest, WrongArity)
+{
+    auto command = Command::command_from_frame(decode("*1\r\n$3\r\nGET\r\n"));
+    EXPECT_EQ(command.type, CommandType::ERROR);
+    EXPECT_EQ(command.error, "wrong number of arguments for 'get' command");
+
+    command = Command::command_from_frame(decode("*1\r\n$3\r\nDEL\r\n"));
+    EXPECT_EQ(command.error, "wrong number of arguments for 'del' command");
+}
+
+TEST(CommandTableTest, FindsEveryCommand)
+{
+    for (const auto& spec: COMMAND_TABLE)
+    {
+        EXPECT_EQ(find_command(spec.name), &spec) << spec.name;
+    }
+    ASSERT_NE(find_command("PeXpIrE"), nullptr);
+    EXPECT_EQ(find_command("PeXpIrE")->type, CommandType::PEXPIRE);
+    EXPECT_EQ(find_command("pexpir"), nullptr);
+    EXPECT_EQ(find_command("pexpiree"), nullptr);
+    EXPECT_EQ(find_command(""), nullptr);
+    EXPECT_EQ(find_command("a-very-long-name-which-is-no-command"), nullptr);
+}
+
+TEST_F(CommandTest, KeyPositions)
+{
+    const auto command = Command::command_from_frame(decode("*4\r\n$3\r\nDEL\r\n$1\r\na\r\n$1\r\nb\r\n$1\r\nc\r\n"));
+    ASSERT_EQ(command.type, CommandType::DEL);
+    ASSERT_NE(command.spec, nullptr);
+    EXPECT_TRUE(command.spec->flags & CMD_WRITE);
+    std::string keys;
+    command.for_each_key([&](const size_t i) { keys += command.arg(i); });
+    EXPECT_EQ(keys, "abc");
+
+    const auto ping = Command::command_from_frame(decode("*1\r\n$4\r\nPING\r\n"));
+    size_t count = 0;
+    ping.for_each_key([&](size_t) { ++count; });
+    EXPECT_EQ(count, 0);
+}
@@ -0,0 +1,91 @@
+#include "framer/arena.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+using namespace redis;
+
+TEST(ArenaTest, AllocationsAreAligned)
+{
+    Arena arena(128);
+    for (const size_t alignment: {1, 2, 8, 16, 64})
+    {
+        EXPECT_NE(arena.allocate(3, 1), nullptr);
+        const auto* p = arena.allocate(8, alignment);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % alignment, 0) << alignment;
+    }
+    EXPECT_EQ(arena.blocks(), 1);
+}
+
+TEST(ArenaTest, CopyAndGrow)
+{
+    Arena arena(64);
+    EXPECT_EQ(arena.capacity(), 0) << "nothing is allocated up front";
+    const auto a = arena.copy("hello");
+    const std::string large(1000, 'x');
+    const auto b = arena.copy(large);
+    EXPECT_EQ(a, "hello") << "growing does not move previous allocations";
+    EXPECT_EQ(b, large);
+    EXPECT_GE(arena.blocks(), 2);
+    EXPECT_GE(arena.used(), 1005);
+}
+
+TEST(ArenaTest, ResetCoalescesBlocks)
+{
+    Arena arena(64);
+    for (int i = 0; i < 100; ++i)
+    {
+        arena.copy("some scratch bytes");
+    }
+    const auto capacity = arena.capacity();
+    ASSERT_GT(arena.blocks(), 1);
+
+    arena.reset();
+    EXPECT_EQ(arena.blocks(), 1);
+    EXPECT_EQ(arena.capacity(), capacity);
+    EXPECT_EQ(arena.used(), 0);
+
+    // the same batch now fits in the single block
+    for (int i = 0; i < 100; ++i)
+    {
+        arena.copy("some scratch bytes");
+    }
+    EXPECT_EQ(arena.blocks(), 1);
+}
+
+TEST(ArenaTest, LargeBlocksAreNotRetained)
+{
+    Arena arena(64);
+    EXPECT_NE(arena.allocate(Arena::MAX_RETAINED + 1, 1), nullptr);
+    arena.reset();
+    EXPECT_LE(arena.capacity(), Arena::MAX_RETAINED);
+}
+
+TEST(ArenaTest, PmrContainers)
+{
+    Arena arena;
+    std::pmr::vector<int> numbers(&arena);
+    for (int i = 0; i < 1000; ++i)
+    {
+        numbers.push_back(i);
+    }
+    EXPECT_EQ(numbers[999], 999);
+    std::pmr::string text(&arena);
+    text.append(500, 'z');
+    EXPECT_EQ(text.size(), 500);
+}
+
+TEST(ArenaTest, ReleaseFreesBlocks)
+{
+    Arena arena(64);
+    for (int i = 0; i < 100; ++i)
+    {
+        arena.copy("some scratch bytes");
+    }
+    arena.release();
+    EXPECT_EQ(arena.blocks(), 0);
+    EXPECT_EQ(arena.capacity(), 0);
+    EXPECT_EQ(arena.used(), 0);
+    EXPECT_EQ(arena.copy("again"), "again") << "a released arena allocates on demand";
+    EXPECT_EQ(arena.blocks(), 1);
+}
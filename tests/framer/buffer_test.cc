@@ -0,0 +1,136 @@
+#include "framer/buffer.h"
+
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string_view>
+
+using namespace redis;
+
+std::string_view as_view(const IOBuffer& buffer) { return {buffer.data(), buffer.size()}; }
+
+TEST(IOBufferTest, AppendConsume)
+{
+    IOBuffer buffer(16);
+    ASSERT_TRUE(buffer.empty());
+    buffer.append(std::string_view("hello world"));
+    EXPECT_EQ(as_view(buffer), "hello world");
+    buffer.consume(6);
+    EXPECT_EQ(as_view(buffer), "world") << "consume only drops bytes from the front";
+    buffer.consume(5);
+    EXPECT_TRUE(buffer.empty());
+}
+
+TEST(IOBufferTest, PrepareCommit)
+{
+    IOBuffer buffer(8);
+    auto space = buffer.prepare(4);
+    ASSERT_GE(space.size(), 4);
+    std::memcpy(space.data(), "ping", 4);
+    EXPECT_TRUE(buffer.empty()) << "prepared bytes are not readable before commit";
+    buffer.commit(4);
+    EXPECT_EQ(as_view(buffer), "ping");
+}
+
+TEST(IOBufferTest, ConsumeDoesNotMoveData)
+{
+    IOBuffer buffer(32);
+    buffer.append(std::string_view("abcdefgh"));
+    const auto* before = buffer.data();
+    buffer.consume(3);
+    EXPECT_EQ(buffer.data(), before + 3) << "consuming must only advance the read cursor";
+}
+
+TEST(IOBufferTest, CompactsWhenConsumedPrefixIsLarge)
+{
+    IOBuffer buffer(16);
+    buffer.append(std::string_view("0123456789abcd"));
+    buffer.consume(12);
+    auto space = buffer.prepare(10);
+    EXPECT_EQ(buffer.capacity(), 16) << "reclaiming the consumed prefix is enough, no need to grow";
+    EXPECT_GE(space.size(), 10);
+    EXPECT_EQ(as_view(buffer), "cd");
+}
+
+TEST(IOBufferTest, GrowsWhenFull)
+{
+    IOBuffer buffer(4);
+    buffer.append(std::string_view("abcd"));
+    buffer.append(std::string_view("efghij"));
+    EXPECT_GE(buffer.capacity(), 10);
+    EXPECT_EQ(as_view(buffer), "abcdefghij");
+}
+
+TEST(IOBufferTest, DrainRewinds)
+{
+    IOBuffer buffer(8);
+    buffer.append(std::string_view("abcdef"));
+    buffer.consume(6);
+    auto space = buffer.prepare(8);
+    EXPECT_EQ(space.size(), 8) << "a drained buffer gives back its whole capacity";
+}
+
+TEST(IOBufferTest, StorageIsTakenOnFirstWrite)
+{
+    IOBuffer buffer(1024);
+    EXPECT_EQ(buffer.capacity(), 0) << "an unused buffer costs no memory";
+    buffer.append(std::string_view("ping"));
+    EXPECT_EQ(buffer.capacity(), 1024);
+}
+
+TEST(IOBufferTest, ReleaseReturnsStorageToPool)
+{
+    auto& pool = BufferPool::local();
+    IOBuffer buffer(2048);
+    buffer.append(std::string_view("hello"));
+    const auto free = pool.free_count(2048);
+    buffer.release();
+    EXPECT_EQ(buffer.capacity(), 2048) << "a buffer holding bytes keeps its storage";
+
+    buffer.consume(5);
+    const auto* storage = buffer.data();
+    buffer.release();
+    EXPECT_EQ(buffer.capacity(), 0);
+    EXPECT_EQ(pool.free_count(2048), free + 1);
+
+    auto space = buffer.prepare(8);
+    EXPECT_EQ(space.data(), storage) << "the released storage is reused";
+    EXPECT_EQ(space.size(), 2048);
+    EXPECT_EQ(pool.free_count(2048), free);
+}
+
+TEST(BufferPoolTest, OnlyPowersOfTwoArePooled)
+{
+    auto& pool = BufferPool::local();
+    pool.release(std::vector<char>(1000));
+    EXPECT_EQ(pool.free_count(1000), 0);
+    pool.release(std::vector<char>(BufferPool::MAX_SIZE * 2));
+    EXPECT_EQ(pool.free_count(BufferPool::MAX_SIZE * 2), 0);
+
+    const auto free = pool.free_count(4096);
+    pool.release(std::vector<char>(4096));
+    EXPECT_EQ(pool.free_count(4096), free + 1);
+    EXPECT_EQ(pool.acquire(4096).size(), 4096);
+    EXPECT_EQ(pool.free_count(4096), free);
+}
+
+TEST(BufferPoolTest, FreeBytesAreBounded)
+{
+    auto& pool = BufferPool::local();
+    constexpr auto size = BufferPool::MAX_SIZE;
+    for (size_t i = 0; i < BufferPool::MAX_FREE_BYTES / size + 4; ++i)
+    {
+        pool.release(std::vector<char>(size));
+    }
+    EXPECT_EQ(pool.free_count(size), BufferPool::MAX_FREE_BYTES / size);
+}
+
+TEST(IOBufferTest, Erase)
+{
+    IOBuffer buffer(16);
+    buffer.append(std::string_view("xxheaderpayload\r"));
+    buffer.consume(2);
+    buffer.erase(6, 7);
+    EXPECT_EQ(as_view(buffer), "header\r");
+    buffer.erase(0, buffer.size());
+    EXPECT_TRUE(buffer.empty());
+}
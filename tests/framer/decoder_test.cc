@@ -0,0 +1,236 @@
+#include "framer/decoder.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+using namespace redis;
+
+bytes to_bytes(const std::string& input) { return {input.begin(), input.end()}; }
+
+// feed_bytewise hands the input to the decoder one byte at a time, like a very slow network would.
+Result<Frame> feed_bytewise(Decoder& decoder, const std::string& input, size_t& calls)
+{
+    std::string pending;
+    calls = 0;
+    for (const char c: input)
+    {
+        pending.push_back(c);
+        size_t consumed = 0;
+        auto result = decoder.decode(std::span(pending.data(), pending.size()), consumed);
+        ++calls;
+        pending.erase(0, consumed);
+        if (!result.is_error() || (result.error() != RedisError::incomplete_frame &&
+                                   result.error() != RedisError::not_enough_data))
+        {
+            return result;
+        }
+    }
+    return {RedisError::incomplete_frame};
+}
+
+TEST(DecoderTest, NeedMoreOnPartialLine)
+{
+    Decoder decoder;
+    const std::string data = "+hel";
+    size_t consumed = 0;
+    auto result = decoder.decode(std::span(data.data(), data.size()), consumed);
+    ASSERT_TRUE(result.is_error());
+    EXPECT_EQ(result.error(), RedisError::incomplete_frame);
+    EXPECT_EQ(consumed, 0) << "an incomplete line is left in the input";
+    EXPECT_TRUE(decoder.idle());
+}
+
+TEST(DecoderTest, ResumesMidBulk)
+{
+    Decoder decoder;
+    std::string data = "$10\r\nhello";
+    size_t consumed = 0;
+    auto result = decoder.decode(std::span(data.data(), data.size()), consumed);
+    ASSERT_TRUE(result.is_error());
+    EXPECT_EQ(result.error(), RedisError::not_enough_data);
+    EXPECT_EQ(consumed, 0) << "nothing is consumed before the frame is complete";
+    EXPECT_FALSE(decoder.idle()) << "the bulk header is remembered";
+
+    data += "world\r\n";
+    result = decoder.decode(std::span(data.data(), data.size()), consumed);
+    ASSERT_FALSE(result.is_error());
+    EXPECT_EQ(result.value(), (Frame{FrameID::BulkString, to_bytes("helloworld")}));
+    EXPECT_EQ(consumed, data.size());
+    EXPECT_TRUE(decoder.idle());
+}
+
+TEST(DecoderTest, ResumesMidArrayBytewise)
+{
+    Decoder decoder;
+    const std::string data = "*2\r\n*2\r\n:1\r\n$3\r\nfoo\r\n#t\r\n";
+    size_t calls = 0;
+    auto result = feed_bytewise(decoder, data, calls);
+    ASSERT_FALSE(result.is_error());
+    auto inner = std::vector{Frame{FrameID::Integer, 1}, Frame{FrameID::BulkString, to_bytes("foo")}};
+    auto outer = std::vector{Frame{FrameID::Array, std::move(inner)}, Frame{FrameID::Boolean, true}};
+    EXPECT_EQ(result.value(), (Frame{FrameID::Array, std::move(outer)}));
+    EXPECT_EQ(calls, data.size());
+}
+
+TEST(DecoderTest, DecodesManyFramesFromOneInput)
+{
+    Decoder decoder;
+    const std::string data = ":1\r\n:2\r\n:3\r\n";
+    std::span input(data.data(), data.size());
+    for (int64_t i = 1; i <= 3; ++i)
+    {
+        size_t consumed = 0;
+        auto result = decoder.decode(input, consumed);
+        ASSERT_FALSE(result.is_error());
+        EXPECT_EQ(result.value(), (Frame{FrameID::Integer, i}));
+        input = input.subspan(consumed);
+    }
+    EXPECT_TRUE(input.empty());
+}
+
+TEST(DecoderTest, ErrorResetsState)
+{
+    Decoder decoder;
+    const std::string data = "*2\r\n:1\r\n:x\r\n:7\r\n";
+    size_t consumed = 0;
+    auto result = decoder.decode(std::span(data.data(), data.size()), consumed);
+    ASSERT_TRUE(result.is_error());
+    EXPECT_EQ(result.error(), RedisError::atoi);
+    EXPECT_TRUE(decoder.idle()) << "a decoding error drops the partially decoded array";
+
+    const auto rest = std::span(data.data(), data.size()).subspan(consumed);
+    result = decoder.decode(rest, consumed);
+    ASSERT_FALSE(result.is_error());
+    EXPECT_EQ(result.value(), (Frame{FrameID::Integer, 7}));
+}
+
+TEST(DecoderTest, UnknownIdentifierConsumesLine)
+{
+    Decoder decoder;
+    const std::string data = "PING\r\n:1\r\n";
+    size_t consumed = 0;
+    auto result = decoder.decode(std::span(data.data(), data.size()), consumed);
+    ASSERT_TRUE(result.is_error());
+    EXPECT_EQ(result.error(), RedisError::invalid_frame);
+    EXPECT_EQ(consumed, 6);
+}
+
+TEST(DecoderTest, ViewBorrowsInput)
+{
+    Decoder decoder;
+    const std::string data = "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$5\r\nvalue\r\n";
+    size_t consumed = 0;
+    auto result = decoder.decode_view(std::span(data.data(), data.size()), consumed);
+    ASSERT_FALSE(result.is_error());
+    EXPECT_EQ(consumed, data.size());
+    const auto view = result.value();
+    ASSERT_EQ(view.frame_id(), FrameID::Array);
+    ASSERT_EQ(view.size(), 3);
+    EXPECT_EQ(view[0].str(), "SET");
+    EXPECT_EQ(view[2].str(), "value");
+    EXPECT_EQ(view[1].str().data(), data.data() + 17) << "payloads point into the input, they are not copied";
+}
+
+TEST(DecoderTest, EmptyBulkString)
+{
+    Decoder decoder;
+    const std::string data = "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$0\r\n\r\n";
+    size_t consumed = 0;
+    auto result = decoder.decode_view(std::span(data.data(), data.size()), consumed);
+    ASSERT_FALSE(result.is_error()) << result.error();
+    EXPECT_EQ(consumed, data.size());
+    EXPECT_EQ(result.value()[2].frame_id(), FrameID::BulkString);
+    EXPECT_TRUE(result.value()[2].str().empty());
+
+    const std::string negative = "$-2\r\n";
+    auto rejected = decoder.decode(std::span(negative.data(), negative.size()), consumed);
+    ASSERT_TRUE(rejected.is_error());
+    EXPECT_EQ(rejected.error(), RedisError::invalid_frame);
+}
+
+TEST(DecoderTest, ViewNestedSiblings)
+{
+    Decoder decoder;
+    const std::string data = "*3\r\n*2\r\n:1\r\n*1\r\n+a\r\n$1\r\nb\r\n#f\r\n";
+    size_t consumed = 0;
+    auto result = decoder.decode_view(std::span(data.data(), data.size()), consumed);
+    ASSERT_FALSE(result.is_error());
+    const auto view = result.value();
+    ASSERT_EQ(view.size(), 3);
+    EXPECT_EQ(view[0].size(), 2);
+    EXPECT_EQ(view[0][1][0].str(), "a");
+    EXPECT_EQ(view[1].str(), "b") << "siblings skip over nested children";
+    EXPECT_FALSE(view[2].boolean());
+
+    size_t count = 0;
+    for (const auto child: view)
+    {
+        (void) child;
+        ++count;
+    }
+    EXPECT_EQ(count, 3);
+}
+
+TEST(DecoderTest, ViewResumesAfterInputMoved)
+{
+    Decoder decoder;
+    std::string data = "*2\r\n$3\r\nGET\r\n$3\r\nk";
+    size_t consumed = 0;
+    auto result = decoder.decode_view(std::span(data.data(), data.size()), consumed);
+    ASSERT_TRUE(result.is_error());
+
+    // the input is moved to a different location before being completed, like a compacted buffer
+    std::string moved = data + "ey\r\n";
+    result = decoder.decode_view(std::span(moved.data(), moved.size()), consumed);
+    ASSERT_FALSE(result.is_error());
+    EXPECT_EQ(result.value()[1].str(), "key");
+}
+
+TEST(DecoderTest, MaxDepth)
+{
+    Decoder decoder;
+    const std::string data = "*1\r\n*1\r\n*1\r\n:1\r\n";
+    size_t consumed = 0;
+    auto result = decoder.decode(std::span(data.data(), data.size()), consumed, 2);
+    ASSERT_TRUE(result.is_error());
+    EXPECT_EQ(result.error(), RedisError::max_recursion_depth);
+}
+
+TEST(DecoderTest, MaxBulkLength)
+{
+    Decoder decoder(8);
+    const std::string data = "*2\r\n$3\r\nGET\r\n$9\r\n";
+    size_t consumed = 0;
+    auto result = decoder.decode_view(std::span(data.data(), data.size()), consumed);
+    ASSERT_TRUE(result.is_error());
+    EXPECT_EQ(result.error(), RedisError::invalid_bulk_length);
+    EXPECT_EQ(consumed, data.size());
+    EXPECT_TRUE(decoder.idle());
+}
+
+TEST(DecoderTest, BulkPayloadReadElsewhere)
+{
+    Decoder decoder;
+    std::string data = "*2\r\n$3\r\nSET\r\n$5\r\nhe";
+    size_t consumed = 0;
+    auto result = decoder.decode_view(std::span(data.data(), data.size()), consumed);
+    ASSERT_TRUE(result.is_error());
+    EXPECT_EQ(result.error(), RedisError::not_enough_data);
+    const auto bulk = decoder.pending_bulk();
+    ASSERT_TRUE(bulk.has_value());
+    EXPECT_EQ(bulk->offset, 17);
+    EXPECT_EQ(bulk->size, 5);
+
+    // the caller reads the payload on its own and drops it from the input
+    const std::string payload = "hello";
+    decoder.set_bulk_payload(payload.data());
+    EXPECT_FALSE(decoder.pending_bulk().has_value());
+    data.resize(bulk->offset);
+    data += "\r\n";
+    result = decoder.decode_view(std::span(data.data(), data.size()), consumed);
+    ASSERT_FALSE(result.is_error());
+    EXPECT_EQ(consumed, data.size());
+    EXPECT_EQ(result.value()[1].str().data(), payload.data()) << "the payload is not copied";
+    EXPECT_EQ(result.value()[0].str(), "SET");
+    EXPECT_EQ(result.value()[1].str(), "hello");
+}
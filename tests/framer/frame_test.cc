@@ -3,6 +3,9 @@
 #include "framer/frame.h"
 
 #include <gtest/gtest.h>
+#include <string>
+
+#include "framer/buffer.h"
 
 // Assume the function and enum are part of a namespace or defined earlier
 
@@ -30,3 +33,74 @@ TEST(FrameIDTest, Undefined)
 {
     EXPECT_EQ(frame_id_from_char('x'), FrameID::Undefined);  // Assuming 'x' is not mapped
 }
+
+TEST(FrameIDTest, UndefinedIsDistinct)
+{
+    EXPECT_NE(frame_id_from_char('x'), FrameID::SimpleString) << "Undefined must not alias a real identifier";
+}
+
+//
+// Encoding
+//
+
+bytes to_bytes(const std::string& input) { return {input.begin(), input.end()}; }
+
+std::string encode(const Frame& frame)
+{
+    std::string out(frame.encoded_size(), '\0');
+    const auto end = frame.encode_to(out.data());
+    EXPECT_EQ(end, out.data() + out.size()) << "encoded_size must be exact";
+    return out;
+}
+
+TEST(FrameEncodeTest, Scalars)
+{
+    EXPECT_EQ(encode(Frame{FrameID::Integer, int64_t{0}}), ":0\r\n");
+    EXPECT_EQ(encode(Frame{FrameID::Integer, int64_t{-1234}}), ":-1234\r\n");
+    EXPECT_EQ(encode(Frame{FrameID::Integer, INT64_MIN}), ":-9223372036854775808\r\n");
+    EXPECT_EQ(encode(Frame{FrameID::SimpleString, to_bytes("OK")}), "+OK\r\n");
+    EXPECT_EQ(encode(Frame{FrameID::SimpleError, to_bytes("ERR x")}), "-ERR x\r\n");
+    EXPECT_EQ(encode(Frame{FrameID::BulkString, to_bytes("hello")}), "$5\r\nhello\r\n");
+    EXPECT_EQ(encode(Frame{FrameID::Boolean, true}), "#t\r\n");
+    EXPECT_EQ(encode(Frame{FrameID::Null, std::monostate{}}), "_\r\n");
+}
+
+TEST(FrameEncodeTest, ArrayHasCount)
+{
+    auto inner = std::vector{Frame{FrameID::Integer, int64_t{1}}};
+    auto items = std::vector{Frame{FrameID::BulkString, to_bytes("GET")}, Frame{FrameID::Array, std::move(inner)}};
+    const Frame frame{FrameID::Array, std::move(items)};
+    EXPECT_EQ(encode(frame), "*2\r\n$3\r\nGET\r\n*1\r\n:1\r\n");
+    const auto as_bytes = frame.as_bytes();
+    EXPECT_EQ(std::string(as_bytes.begin(), as_bytes.end()), encode(frame));
+}
+
+TEST(FrameEncodeTest, IntoBuffer)
+{
+    IOBuffer buffer(4);
+    Frame{FrameID::SimpleString, to_bytes("PONG")}.encode_to(buffer);
+    Frame{FrameID::Integer, int64_t{42}}.encode_to(buffer);
+    EXPECT_EQ(std::string(buffer.data(), buffer.size()), "+PONG\r\n:42\r\n");
+}
+
+TEST(FrameEncodeTest, IovReferencesLargePayloads)
+{
+    const std::string large(64, 'x');
+    auto items = std::vector{Frame{FrameID::BulkString, to_bytes("small")}, Frame{FrameID::BulkString, to_bytes(large)}};
+    const Frame frame{FrameID::Array, std::move(items)};
+
+    IOBuffer scratch(8);
+    std::vector<iovec> iov;
+    frame.encode_to_iov(scratch, iov, 32);
+    ASSERT_EQ(iov.size(), 3);
+    const auto& payload = std::get<bytes>(std::get<std::vector<Frame>>(frame.data)[1].data);
+    EXPECT_EQ(iov[1].iov_base, payload.data()) << "the large payload is referenced in place";
+    EXPECT_EQ(scratch.size(), frame.encoded_size() - large.size()) << "only the small parts are copied";
+
+    std::string joined;
+    for (const auto& vec: iov)
+    {
+        joined.append(static_cast<const char*>(vec.iov_base), vec.iov_len);
+    }
+    EXPECT_EQ(joined, encode(frame));
+}
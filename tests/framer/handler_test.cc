@@ -1,12 +1,21 @@
 #include "framer/handler.h"
 
+#include <chrono>
+#include <filesystem>
 #include <gtest/gtest.h>
+#include <limits>
+#include <set>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #include <photon/common/alog.h>
 #include <photon/common/memory-stream/memory-stream.h>
 #include <photon/common/utility.h>
 #include <photon/photon.h>
 
 #include "memory_stream/mstream.h"
+#include "metrics/metrics.h"
 
 using namespace redis;
 class HandlerTest : public ::testing::Test
@@ -33,13 +42,17 @@ bytes string_to_bytes(const std::string& input) { return std::vector(input.begin
 //
 // Read Exact
 //
-TEST_F(HandlerTest, ReadExact)
+TEST_F(HandlerTest, ReadExactEmpty)
 {
     // empty buffer handler, nothing in yet
     auto read = h->read_exact(3);
     EXPECT_TRUE(read.is_error());
     EXPECT_EQ(read.error(), RedisError::eof) << "an empty buffer and eof bit set means we are truly EOF";
+    ASSERT_TRUE(h->seen_eof()) << "read_exact: a read of 0 bytes sets the EOF bit";
+}
 
+TEST_F(HandlerTest, ReadExact)
+{
     auto data = "hello";
     client->send(data, 5);
     auto read1 = h->read_exact(3);
@@ -48,7 +61,7 @@ TEST_F(HandlerTest, ReadExact)
 
     auto read2 = h->read_exact(2);
     EXPECT_EQ(read2.value(), string_to_bytes("lo")) << "read_exact can read part the rest of a buffer";
-    ASSERT_TRUE(h->seen_eof()) << "read_exact: the buffer is empty and eof seen in upstream";
+    ASSERT_FALSE(h->seen_eof()) << "read_exact: a short read is not EOF";
 }
 
 TEST_F(HandlerTest, ReadExactNotEnoughData)
@@ -71,8 +84,8 @@ TEST_F(HandlerTest, ReadUntilBasic)
     client->send(data, 8);
     auto read = h->read_until('\n');
     EXPECT_EQ(read.value(), string_to_bytes("hello\n")) << "read_until can read part of a buffer";
-    ASSERT_TRUE(h->seen_eof()) << "read_until: data read is lower than chunk size, so EOF should be set";
-    ASSERT_EQ(h->get_buffer(), string_to_bytes("ha"));
+    ASSERT_FALSE(h->seen_eof()) << "read_until: a short read is not EOF";
+    ASSERT_EQ(std::string_view(h->get_buffer().begin(), h->get_buffer().end()), "ha");
 }
 
 TEST_F(HandlerTest, ReadUntilMultipleReads)
@@ -81,7 +94,7 @@ TEST_F(HandlerTest, ReadUntilMultipleReads)
     client->send(data, 15);
     auto read = h->read_until('\n');
     EXPECT_EQ(read.value(), string_to_bytes("hello\n")) << "read_until can read part of a buffer";
-    ASSERT_TRUE(h->seen_eof()) << "read_until: data read is lower than chunk size, so EOF should be set";
+    ASSERT_FALSE(h->seen_eof()) << "read_until: a short read is not EOF";
     ASSERT_EQ(std::string_view(h->get_buffer().begin(), h->get_buffer().end()), "world\nouu");
     auto read2 = h->read_until('\n');
     EXPECT_EQ(read2.value(), string_to_bytes("world\n"))
@@ -95,7 +108,7 @@ TEST_F(HandlerTest, ReadUntilDelimiterAtBoundary)
     client->send(data, 6);
     auto read = h->read_until('\n');
     EXPECT_EQ(read.value(), string_to_bytes("hello\n")) << "read_until can read part of a buffer";
-    ASSERT_TRUE(h->seen_eof()) << "read_until: data read is lower than chunk size, so EOF should be set";
+    ASSERT_FALSE(h->seen_eof()) << "read_until: a short read is not EOF";
     ASSERT_TRUE(h->empty());
 }
 
@@ -148,7 +161,7 @@ TEST_F(HandlerTest, DecodeIntAtBoundary)
 {
     const std::string data = ":25\r\n";
     client->send(data.data(), data.size());
-    auto read = h->decode(0, MAX_RECURSION_DEPTH);
+    auto read = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_FALSE(read.is_error());
     auto frame = Frame{FrameID::Integer, 25};
     ASSERT_EQ(read.value(), frame);
@@ -158,7 +171,7 @@ TEST_F(HandlerTest, DecodeIntInTheMiddle)
 {
     const std::string data = ":0\r\nheloe";
     client->send(data.data(), data.size());
-    auto read = h->decode(0, MAX_RECURSION_DEPTH);
+    auto read = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_FALSE(read.is_error());
     auto frame = Frame{FrameID::Integer, 0};
     ASSERT_EQ(read.value(), frame);
@@ -168,7 +181,7 @@ TEST_F(HandlerTest, DecodeIntNagative)
 {
     const std::string data = ":-25\r\n";
     client->send(data.data(), data.size());
-    auto read = h->decode(0, MAX_RECURSION_DEPTH);
+    auto read = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_FALSE(read.is_error());
     auto frame = Frame{FrameID::Integer, -25};
     ASSERT_EQ(read.value(), frame);
@@ -178,7 +191,7 @@ TEST_F(HandlerTest, DecodeIntAtoi)
 {
     const std::string data = ":-aeQ\r\n";
     client->send(data.data(), data.size());
-    auto read = h->decode(0, MAX_RECURSION_DEPTH);
+    auto read = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_TRUE(read.is_error());
     ASSERT_EQ(read.error(), RedisError::atoi);
 }
@@ -187,7 +200,7 @@ TEST_F(HandlerTest, DecodeSimpleIncomplete)
 {
     const std::string data = ":\r";
     client->send(data.data(), data.size());
-    auto read = h->decode(0, MAX_RECURSION_DEPTH);
+    auto read = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_TRUE(read.is_error());
     ASSERT_EQ(read.error(), RedisError::incomplete_frame);
 }
@@ -196,7 +209,7 @@ TEST_F(HandlerTest, DecodeSimpleInvalid)
 {
     const std::string data = ":T\n";
     client->send(data.data(), data.size());
-    auto read = h->decode(0, MAX_RECURSION_DEPTH);
+    auto read = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_TRUE(read.is_error());
     ASSERT_EQ(read.error(), RedisError::invalid_frame);
 }
@@ -205,7 +218,7 @@ TEST_F(HandlerTest, DecodeSimpleInvalid2)
 {
     const std::string data = "+hel\rlo\r\n";
     client->send(data.data(), data.size());
-    auto read = h->decode(0, MAX_RECURSION_DEPTH);
+    auto read = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_TRUE(read.is_error());
     ASSERT_EQ(read.error(), RedisError::invalid_frame);
 }
@@ -214,14 +227,14 @@ TEST_F(HandlerTest, DecodeSimpleInvalid3)
 {
     const std::string data = "+hel\nlo\r\n";
     client->send(data.data(), data.size());
-    auto read = h->decode(0, MAX_RECURSION_DEPTH);
+    auto read = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_TRUE(read.is_error());
     ASSERT_EQ(read.error(), RedisError::invalid_frame);
 }
 
 TEST_F(HandlerTest, DecodeSimpleEoF)
 {
-    auto read = h->decode(0, MAX_RECURSION_DEPTH);
+    auto read = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_TRUE(read.is_error());
     ASSERT_EQ(read.error(), RedisError::eof);
 }
@@ -231,22 +244,22 @@ TEST_F(HandlerTest, DecodeBulk)
     const std::string data = "$5\r\nhello\r\n$6\r\nhel\rlo\r\n$6\r\nhel\nlo\r\n$6\r\nhellojj\r";
     client->send(data.data(), data.size());
 
-    auto b_string1 = h->decode(0, MAX_RECURSION_DEPTH);
+    auto b_string1 = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_FALSE(b_string1.is_error());
     auto frame = Frame{FrameID::BulkString, string_to_bytes("hello")};
     ASSERT_EQ(b_string1.value(), frame);
 
-    auto b_string2 = h->decode(0, MAX_RECURSION_DEPTH);
+    auto b_string2 = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_FALSE(b_string2.is_error());
     auto frame2 = Frame{FrameID::BulkString, string_to_bytes("hel\rlo")};
     ASSERT_EQ(b_string2.value(), frame2);
 
-    auto b_string3 = h->decode(0, MAX_RECURSION_DEPTH);
+    auto b_string3 = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_FALSE(b_string3.is_error());
     auto frame3 = Frame{FrameID::BulkString, string_to_bytes("hel\nlo")};
     ASSERT_EQ(b_string3.value(), frame3);
 
-    auto b_string4 = h->decode(0, MAX_RECURSION_DEPTH);
+    auto b_string4 = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_TRUE(b_string4.is_error());
     ASSERT_EQ(b_string4.error(), RedisError::invalid_frame);
 }
@@ -256,17 +269,17 @@ TEST_F(HandlerTest, DecodeBool)
     const std::string data = "#t\r\n#f\r\n#u\r\n";
     client->send(data.data(), data.size());
 
-    auto bool1 = h->decode(0, MAX_RECURSION_DEPTH);
+    auto bool1 = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_FALSE(bool1.is_error());
     auto frame = Frame{FrameID::Boolean, true};
     ASSERT_EQ(bool1.value(), frame);
 
-    auto bool2 = h->decode(0, MAX_RECURSION_DEPTH);
+    auto bool2 = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_FALSE(bool2.is_error());
     auto frame2 = Frame{FrameID::Boolean, false};
     ASSERT_EQ(bool2.value(), frame2);
 
-    auto bool3 = h->decode(0, MAX_RECURSION_DEPTH);
+    auto bool3 = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_TRUE(bool3.is_error());
     ASSERT_EQ(bool3.error(), RedisError::invalid_frame);
 }
@@ -276,17 +289,17 @@ TEST_F(HandlerTest, DecodeSimple)
     const std::string data = "+hello\r\n+-25\r\n-hello\r\n";
     client->send(data.data(), data.size());
 
-    auto read = h->decode(0, MAX_RECURSION_DEPTH);
+    auto read = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_FALSE(read.is_error());
     auto frame = Frame{FrameID::SimpleString, string_to_bytes("hello")};
     ASSERT_EQ(read.value(), frame);
 
-    auto read2 = h->decode(0, MAX_RECURSION_DEPTH);
+    auto read2 = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_FALSE(read2.is_error());
     auto frame2 = Frame{FrameID::SimpleString, string_to_bytes("-25")};
     ASSERT_EQ(read2.value(), frame2);
 
-    auto read3 = h->decode(0, MAX_RECURSION_DEPTH);
+    auto read3 = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_FALSE(read3.is_error());
     auto frame3 = Frame{FrameID::SimpleError, string_to_bytes("hello")};
     ASSERT_EQ(read3.value(), frame3);
@@ -297,12 +310,12 @@ TEST_F(HandlerTest, DecodeNull)
     const std::string data = "_\r\n_f\r\n$u\r\n";
     client->send(data.data(), data.size());
 
-    auto read = h->decode(0, MAX_RECURSION_DEPTH);
+    auto read = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_FALSE(read.is_error());
     auto frame = Frame{FrameID::Null, std::monostate{}};
     ASSERT_EQ(read.value(), frame);
 
-    auto read2 = h->decode(0, MAX_RECURSION_DEPTH);
+    auto read2 = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_TRUE(read2.is_error());
     ASSERT_EQ(read2.error(), RedisError::invalid_frame);
 }
@@ -313,13 +326,13 @@ TEST_F(HandlerTest, DecodeArray)
     const std::string data = "*3\r\n:1\r\n+Two\r\n$5\r\nThree\r\n*2\r\n:1\r\n*1\r\n+Three\r\n*1\r\n$4\r\nPING\r\n";
     client->send(data.data(), data.size());
 
-    const auto result = h->decode(0, MAX_RECURSION_DEPTH);
+    const auto result = h->decode(MAX_RECURSION_DEPTH);
     auto vect = std::vector{Frame{FrameID::Integer, 1}, Frame{FrameID::SimpleString, string_to_bytes("Two")},
                             Frame{FrameID::BulkString, string_to_bytes("Three")}};
     const auto ans = Frame{FrameID::Array, std::move(vect)};
     EXPECT_EQ(result.value(), ans) << "can decode a simple string with start a stream";
 
-    const auto result2 = h->decode(0, MAX_RECURSION_DEPTH);
+    const auto result2 = h->decode(MAX_RECURSION_DEPTH);
     auto inner_vect = std::vector{Frame{FrameID::SimpleString, string_to_bytes("Three")}};
     auto vect2 = std::vector{Frame{FrameID::Integer, 1}, Frame{FrameID::Array, inner_vect}};
     const auto ans2 = Frame{FrameID::Array, std::move(vect2)};
@@ -331,7 +344,7 @@ TEST_F(HandlerTest, DecodeArrayOverflow)
     const std::string data = "*2\r\n:1\r\n*1\r\n+Three\r\n*1\r\n$4\r\nPING\r\n";
     client->send(data.data(), data.size());
 
-    const auto result = h->decode(0, 1);
+    const auto result = h->decode(1);
     ASSERT_TRUE(result.is_error());
     EXPECT_EQ(result.error(), RedisError::max_recursion_depth) << "can spot an array overflow";
 }
@@ -341,23 +354,789 @@ TEST_F(HandlerTest, DecodeArrayIncomplet)
     const std::string data = "*3\r\n:1\r\n+Two\r\n$5\r\nThree";
     client->send(data.data(), data.size());
 
-    const auto result = h->decode(0, MAX_RECURSION_DEPTH);
+    const auto result = h->decode(MAX_RECURSION_DEPTH);
     ASSERT_TRUE(result.is_error());
     EXPECT_EQ(result.error(), RedisError::not_enough_data) << "can spot an incomplete array";
 }
 
+TEST_F(HandlerTest, DecodePipelinedDoesNotReadUpstream)
+{
+    const std::string data = "*1\r\n$4\r\nPING\r\n*2\r\n$4\r\nECHO\r\n$2\r\nhi\r\n";
+    client->send(data.data(), data.size());
+
+    const auto first = h->decode(MAX_RECURSION_DEPTH);
+    ASSERT_FALSE(first.is_error());
+    const auto second = h->decode(MAX_RECURSION_DEPTH);
+    ASSERT_FALSE(second.is_error());
+    auto vect = std::vector{Frame{FrameID::BulkString, string_to_bytes("ECHO")},
+                            Frame{FrameID::BulkString, string_to_bytes("hi")}};
+    EXPECT_EQ(second.value(), (Frame{FrameID::Array, std::move(vect)}));
+    ASSERT_FALSE(h->seen_eof()) << "buffered frames are decoded without reading from upstream";
+    ASSERT_TRUE(h->empty());
+}
+
+TEST_F(HandlerTest, DecodeResumesAcrossReads)
+{
+    // the chunk size is 25, so this command takes several reads to be decoded
+    const std::string data = "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$20\r\nabcdefghijklmnopqrst\r\n";
+    client->send(data.data(), data.size());
+
+    const auto result = h->decode(MAX_RECURSION_DEPTH);
+    ASSERT_FALSE(result.is_error());
+    auto vect = std::vector{Frame{FrameID::BulkString, string_to_bytes("SET")},
+                            Frame{FrameID::BulkString, string_to_bytes("key")},
+                            Frame{FrameID::BulkString, string_to_bytes("abcdefghijklmnopqrst")}};
+    EXPECT_EQ(result.value(), (Frame{FrameID::Array, std::move(vect)}));
+}
+
 TEST_F(HandlerTest, DecodeCommand)
 {
     // try decoding a resp command, i.e array of bulk
     const std::string data = "*1\r\n$4\r\nPING\r\n";
     client->send(data.data(), data.size());
 
-    const auto result = h->decode(0, MAX_RECURSION_DEPTH);
+    const auto result = h->decode(MAX_RECURSION_DEPTH);
     auto vect = std::vector{Frame{FrameID::BulkString, string_to_bytes("PING")}};
     const auto ans = Frame{FrameID::Array, std::move(vect)};
     EXPECT_EQ(result.value(), ans) << "can decode a simple string with start a stream";
 }
 
+TEST_F(HandlerTest, DecodeViewHoldsBufferUntilNextDecode)
+{
+    const std::string data = "*2\r\n$3\r\nGET\r\n$3\r\nkey\r\n:5\r\n";
+    client->send(data.data(), data.size());
+
+    const auto view = h->decode_view(MAX_RECURSION_DEPTH);
+    ASSERT_FALSE(view.is_error());
+    EXPECT_EQ(view.value()[1].str(), "key");
+    EXPECT_GE(h->buffer_size(), 22) << "the frame stays in the buffer while it is borrowed";
+    EXPECT_EQ(view.value()[1].str().data(), h->data() + 17);
+
+    const auto next = h->decode(MAX_RECURSION_DEPTH);
+    ASSERT_FALSE(next.is_error());
+    EXPECT_EQ(next.value(), (Frame{FrameID::Integer, 5}));
+    EXPECT_TRUE(h->empty());
+}
+
+TEST_F(HandlerTest, HandleCommandPing)
+{
+    const std::string data = "*1\r\n$4\r\nping\r\n*2\r\n$4\r\nPING\r\n$2\r\nhi\r\n*1\r\n$3\r\nFOO\r\n";
+    client->send(data.data(), data.size());
+    for (int i = 0; i < 3; ++i)
+    {
+        const auto view = h->decode_view(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(view.is_error());
+        h->handle_command(Command::command_from_frame(view.value()));
+    }
+    h->flush();
+    std::vector<char> received(128);
+    const auto rd = client->recv(received.data(), received.size(), 0);
+    EXPECT_EQ(std::string_view(received.data(), rd), "+PONG\r\n$2\r\nhi\r\n-ERR unknown command 'FOO'\r\n");
+}
+
+TEST_F(HandlerTest, HandleKeyCommands)
+{
+    auto dup = MemoryStream::duplex(1024);
+    auto peer = std::move(dup.first);
+    Keyspace keyspace(4);
+    Handler handler(std::move(dup.second), 25, DEFAULT_FLUSH_THRESHOLD, &keyspace);
+    const std::string data = "*3\r\n$3\r\nSET\r\n$1\r\na\r\n$5\r\nhello\r\n"
+                             "*2\r\n$3\r\nGET\r\n$1\r\na\r\n"
+                             "*3\r\n$3\r\nSET\r\n$1\r\nb\r\n$1\r\n1\r\n"
+                             "*3\r\n$6\r\nEXPIRE\r\n$1\r\nb\r\n$3\r\n100\r\n"
+                             "*3\r\n$6\r\nEXPIRE\r\n$1\r\nb\r\n$1\r\nx\r\n"
+                             "*4\r\n$3\r\nDEL\r\n$1\r\na\r\n$1\r\nb\r\n$1\r\nc\r\n"
+                             "*2\r\n$3\r\nGET\r\n$1\r\na\r\n";
+    peer->send(data.data(), data.size());
+    for (int i = 0; i < 7; ++i)
+    {
+        const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(view.is_error());
+        handler.handle_command(Command::command_from_frame(view.value()));
+    }
+    handler.flush();
+    std::vector<char> received(256);
+    const auto rd = peer->recv(received.data(), received.size(), 0);
+    EXPECT_EQ(std::string_view(received.data(), rd),
+              "+OK\r\n$5\r\nhello\r\n+OK\r\n:1\r\n-ERR value is not an integer or out of range\r\n:2\r\n$-1\r\n");
+}
+
+TEST_F(HandlerTest, HandleExpiry)
+{
+    auto dup = MemoryStream::duplex(1024);
+    auto peer = std::move(dup.first);
+    Keyspace keyspace(2);
+    Handler handler(std::move(dup.second), 64, DEFAULT_FLUSH_THRESHOLD, &keyspace);
+    const std::string data = "*5\r\n$3\r\nSET\r\n$1\r\na\r\n$1\r\nv\r\n$2\r\nex\r\n$3\r\n100\r\n"
+                             "*2\r\n$3\r\nTTL\r\n$1\r\na\r\n"
+                             "*3\r\n$7\r\nPEXPIRE\r\n$1\r\na\r\n$5\r\n50000\r\n"
+                             "*2\r\n$3\r\nTTL\r\n$1\r\na\r\n"
+                             "*2\r\n$7\r\nPERSIST\r\n$1\r\na\r\n"
+                             "*2\r\n$4\r\nPTTL\r\n$1\r\na\r\n"
+                             "*2\r\n$4\r\nPTTL\r\n$7\r\nmissing\r\n"
+                             "*5\r\n$3\r\nSET\r\n$1\r\nb\r\n$1\r\nv\r\n$2\r\nPX\r\n$1\r\n0\r\n"
+                             "*4\r\n$3\r\nSET\r\n$1\r\nb\r\n$1\r\nv\r\n$2\r\nNX\r\n"
+                             "*1\r\n$4\r\nINFO\r\n";
+    peer->send(data.data(), data.size());
+    for (int i = 0; i < 10; ++i)
+    {
+        const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(view.is_error());
+        handler.handle_command(Command::command_from_frame(view.value()));
+    }
+    handler.flush();
+    std::vector<char> received(1024);
+    const auto rd = peer->recv(received.data(), received.size(), 0);
+    const std::string_view reply(received.data(), rd);
+    const std::string_view expected = "+OK\r\n:100\r\n:1\r\n:50\r\n:1\r\n:-1\r\n:-2\r\n"
+                                      "-ERR invalid expire time in 'set' command\r\n-ERR syntax error\r\n";
+    ASSERT_TRUE(reply.starts_with(expected)) << reply;
+    const auto info = reply.substr(expected.size());
+    EXPECT_NE(info.find("expired_keys:0\r\n"), std::string_view::npos) << info;
+    EXPECT_NE(info.find("db0:keys=1,expires=0\r\n"), std::string_view::npos) << info;
+    EXPECT_NE(info.find("# Memory\r\nused_memory:"), std::string_view::npos) << info;
+    EXPECT_NE(info.find("mem_fragmentation_ratio:"), std::string_view::npos) << info;
+    EXPECT_NE(info.find("slab_class_"), std::string_view::npos) << info;
+}
+
+TEST_F(HandlerTest, HandleCounters)
+{
+    auto dup = MemoryStream::duplex(1024);
+    auto peer = std::move(dup.first);
+    Keyspace keyspace(2);
+    Handler handler(std::move(dup.second), 64, DEFAULT_FLUSH_THRESHOLD, &keyspace);
+    const std::string data = "*2\r\n$4\r\nINCR\r\n$1\r\nc\r\n"
+                             "*3\r\n$6\r\nINCRBY\r\n$1\r\nc\r\n$2\r\n10\r\n"
+                             "*2\r\n$4\r\nDECR\r\n$1\r\nc\r\n"
+                             "*3\r\n$6\r\nDECRBY\r\n$1\r\nc\r\n$2\r\n20\r\n"
+                             "*2\r\n$3\r\nGET\r\n$1\r\nc\r\n"
+                             "*3\r\n$6\r\nINCRBY\r\n$1\r\nc\r\n$3\r\none\r\n"
+                             "*3\r\n$3\r\nSET\r\n$1\r\ns\r\n$3\r\nabc\r\n"
+                             "*2\r\n$4\r\nINCR\r\n$1\r\ns\r\n"
+                             "*3\r\n$3\r\nSET\r\n$1\r\nm\r\n$19\r\n9223372036854775807\r\n"
+                             "*2\r\n$4\r\nINCR\r\n$1\r\nm\r\n"
+                             "*2\r\n$3\r\nGET\r\n$1\r\nm\r\n";
+    peer->send(data.data(), data.size());
+    for (int i = 0; i < 11; ++i)
+    {
+        const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(view.is_error());
+        handler.handle_command(Command::command_from_frame(view.value()));
+    }
+    handler.flush();
+    std::vector<char> received(1024);
+    const auto rd = peer->recv(received.data(), received.size(), 0);
+    EXPECT_EQ(std::string_view(received.data(), rd),
+              ":1\r\n:11\r\n:10\r\n:-10\r\n$3\r\n-10\r\n-ERR value is not an integer or out of range\r\n+OK\r\n"
+              "-ERR value is not an integer or out of range\r\n+OK\r\n-ERR increment or decrement would overflow\r\n"
+              "$19\r\n9223372036854775807\r\n");
+}
+
+TEST_F(HandlerTest, HandleInfoMetrics)
+{
+    auto dup = MemoryStream::duplex(8192);
+    auto peer = std::move(dup.first);
+    Keyspace keyspace(2);
+    Handler handler(std::move(dup.second), 64, DEFAULT_FLUSH_THRESHOLD, &keyspace);
+    // the counters of the vCPU are shared by every test of the process
+    const auto before = Metrics::local();
+    const std::string data = "*3\r\n$3\r\nSET\r\n$1\r\ns\r\n$3\r\nabc\r\n"
+                             "*2\r\n$3\r\nGET\r\n$1\r\ns\r\n"
+                             "*2\r\n$4\r\nINCR\r\n$1\r\ns\r\n"
+                             "*4\r\n$4\r\nINFO\r\n$5\r\nstats\r\n$12\r\ncommandstats\r\n$12\r\nlatencystats\r\n";
+    peer->send(data.data(), data.size());
+    for (int i = 0; i < 4; ++i)
+    {
+        const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(view.is_error());
+        handler.handle_command(Command::command_from_frame(view.value()));
+    }
+    handler.flush();
+    std::vector<char> received(8192);
+    const auto rd = peer->recv(received.data(), received.size(), 0);
+    const std::string_view reply(received.data(), rd);
+    const std::string_view expected = "+OK\r\n$3\r\nabc\r\n-ERR value is not an integer or out of range\r\n";
+    ASSERT_TRUE(reply.starts_with(expected)) << reply;
+    const auto info = reply.substr(expected.size());
+    EXPECT_NE(info.find("# Stats\r\ntotal_connections_received:"), std::string_view::npos) << info;
+    EXPECT_NE(info.find("total_error_replies:"), std::string_view::npos) << info;
+    EXPECT_NE(info.find("rejected_connections:"), std::string_view::npos) << info;
+    EXPECT_NE(info.find("# Commandstats\r\n"), std::string_view::npos) << info;
+    EXPECT_NE(info.find("cmdstat_set:calls="), std::string_view::npos) << info;
+    EXPECT_NE(info.find("cmdstat_incr:calls="), std::string_view::npos) << info;
+    EXPECT_NE(info.find("latency_percentiles_usec_get:p50="), std::string_view::npos) << info;
+    EXPECT_EQ(info.find("# Keyspace"), std::string_view::npos) << "only the sections asked for are reported";
+
+    const auto& after = Metrics::local();
+    EXPECT_EQ(after.total_commands_processed - before.total_commands_processed, 4);
+    EXPECT_EQ(after.total_error_replies - before.total_error_replies, 1);
+    const auto incr = static_cast<size_t>(CommandType::INCR);
+    EXPECT_EQ(after.commands[incr].calls - before.commands[incr].calls, 1);
+    EXPECT_EQ(after.commands[incr].failed_calls - before.commands[incr].failed_calls, 1);
+    EXPECT_GT(after.net_input_bytes, before.net_input_bytes);
+    EXPECT_GT(after.net_output_bytes, before.net_output_bytes);
+
+    // the default sections do not include the per command ones
+    const std::string info_default = "*1\r\n$4\r\nINFO\r\n";
+    peer->send(info_default.data(), info_default.size());
+    const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+    ASSERT_FALSE(view.is_error());
+    handler.handle_command(Command::command_from_frame(view.value()));
+    handler.flush();
+    const auto rd_default = peer->recv(received.data(), received.size(), 0);
+    const std::string_view reply_default(received.data(), rd_default);
+    EXPECT_NE(reply_default.find("# Clients\r\nconnected_clients:"), std::string_view::npos) << reply_default;
+    EXPECT_EQ(reply_default.find("# Commandstats"), std::string_view::npos) << reply_default;
+}
+
+TEST_F(HandlerTest, HandleMaxmemory)
+{
+    auto dup = MemoryStream::duplex(8192);
+    auto peer = std::move(dup.first);
+    Keyspace keyspace(1);
+    Handler handler(std::move(dup.second), 64, DEFAULT_FLUSH_THRESHOLD, &keyspace);
+    keyspace.with_key("big", [](Shard& shard) { shard.set("big", std::string(1000, 'x')); });
+    keyspace.set_maxmemory(100, EvictionPolicy::NoEviction);
+    const auto before = Metrics::local();
+    const std::string data = "*3\r\n$3\r\nSET\r\n$1\r\na\r\n$1\r\nv\r\n"
+                             "*2\r\n$4\r\nINCR\r\n$1\r\nc\r\n"
+                             "*2\r\n$3\r\nGET\r\n$3\r\nbig\r\n"
+                             "*2\r\n$3\r\nGET\r\n$1\r\na\r\n"
+                             "*1\r\n$4\r\nINFO\r\n";
+    peer->send(data.data(), data.size());
+    for (int i = 0; i < 5; ++i)
+    {
+        const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(view.is_error());
+        handler.handle_command(Command::command_from_frame(view.value()));
+    }
+    handler.flush();
+    std::vector<char> received(8192);
+    const auto rd = peer->recv(received.data(), received.size(), 0);
+    const std::string_view reply(received.data(), rd);
+    const std::string expected = "-OOM command not allowed when used memory > 'maxmemory'.\r\n"
+                                 "-OOM command not allowed when used memory > 'maxmemory'.\r\n"
+                                 "$1000\r\n" + std::string(1000, 'x') + "\r\n$-1\r\n";
+    ASSERT_TRUE(reply.starts_with(expected)) << reply;
+    const auto info = reply.substr(expected.size());
+    EXPECT_NE(info.find("keyspace_hits:1\r\nkeyspace_misses:1\r\n"), std::string_view::npos) << info;
+    EXPECT_NE(info.find("maxmemory:100\r\nmaxmemory_human:100B\r\nmaxmemory_policy:noeviction\r\n"),
+              std::string_view::npos)
+            << info;
+
+    // the refused writes are rejected calls, not failed ones
+    const auto& after = Metrics::local();
+    const auto set = static_cast<size_t>(CommandType::SET);
+    EXPECT_EQ(after.commands[set].rejected_calls - before.commands[set].rejected_calls, 1);
+    EXPECT_EQ(after.commands[set].calls, before.commands[set].calls);
+    EXPECT_EQ(after.commands[set].failed_calls, before.commands[set].failed_calls);
+    const auto incr = static_cast<size_t>(CommandType::INCR);
+    EXPECT_EQ(after.commands[incr].rejected_calls - before.commands[incr].rejected_calls, 1);
+}
+
+TEST_F(HandlerTest, HandleSave)
+{
+    auto dup = MemoryStream::duplex(8192);
+    auto peer = std::move(dup.first);
+    Keyspace keyspace(2);
+    const auto path = (std::filesystem::temp_directory_path() / "handler_test_save.rdb").string();
+    Persistence persistence(keyspace, path);
+    Handler handler(std::move(dup.second), 64, DEFAULT_FLUSH_THRESHOLD, &keyspace, &persistence);
+    const std::string data = "*3\r\n$3\r\nSET\r\n$1\r\na\r\n$1\r\nv\r\n"
+                             "*1\r\n$4\r\nSAVE\r\n"
+                             "*1\r\n$6\r\nBGSAVE\r\n"
+                             "*2\r\n$6\r\nBGSAVE\r\n$3\r\nNOW\r\n"
+                             "*2\r\n$4\r\nINFO\r\n$11\r\npersistence\r\n";
+    peer->send(data.data(), data.size());
+    for (int i = 0; i < 5; ++i)
+    {
+        const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(view.is_error());
+        handler.handle_command(Command::command_from_frame(view.value()));
+    }
+    handler.flush();
+    std::vector<char> received(8192);
+    const auto rd = peer->recv(received.data(), received.size(), 0);
+    const std::string_view reply(received.data(), rd);
+    const std::string expected = "+OK\r\n+OK\r\n+Background saving started\r\n-ERR syntax error\r\n";
+    ASSERT_TRUE(reply.starts_with(expected)) << reply;
+    const auto info = reply.substr(expected.size());
+    EXPECT_NE(info.find("# Persistence\r\nrdb_bgsave_in_progress:0\r\nrdb_saves:2\r\n"), std::string_view::npos)
+            << info;
+    EXPECT_NE(info.find("rdb_last_bgsave_status:ok\r\nrdb_last_bgsave_time_sec:0\r\n"), std::string_view::npos)
+            << info;
+    EXPECT_EQ(info.find("# Keyspace"), std::string_view::npos) << "only the asked section is written";
+    EXPECT_TRUE(std::filesystem::exists(path));
+    std::filesystem::remove(path);
+}
+
+TEST_F(HandlerTest, HandleAof)
+{
+    auto dup = MemoryStream::duplex(8192);
+    auto peer = std::move(dup.first);
+    Keyspace keyspace(2);
+    const auto path = (std::filesystem::temp_directory_path() / "handler_test.aof").string();
+    std::filesystem::remove(path);
+    Aof aof(keyspace, path, FsyncPolicy::EverySec);
+    ASSERT_FALSE(aof.open().is_error());
+    Persistence persistence(keyspace, path + ".rdb", &aof);
+    Handler handler(std::move(dup.second), 64, DEFAULT_FLUSH_THRESHOLD, &keyspace, &persistence, &aof);
+    const std::string data = "*5\r\n$3\r\nSET\r\n$1\r\na\r\n$1\r\nv\r\n$2\r\nEX\r\n$3\r\n100\r\n"
+                             "*3\r\n$3\r\nSET\r\n$1\r\nb\r\n$1\r\nv\r\n"
+                             "*3\r\n$3\r\nDEL\r\n$1\r\nb\r\n$7\r\nmissing\r\n"
+                             "*3\r\n$6\r\nDECRBY\r\n$1\r\nc\r\n$1\r\n5\r\n"
+                             "*2\r\n$4\r\nINCR\r\n$1\r\nb\r\n"
+                             "*1\r\n$12\r\nBGREWRITEAOF\r\n"
+                             "*2\r\n$4\r\nINFO\r\n$11\r\npersistence\r\n";
+    peer->send(data.data(), data.size());
+    for (int i = 0; i < 7; ++i)
+    {
+        const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(view.is_error());
+        handler.handle_command(Command::command_from_frame(view.value()));
+    }
+    ASSERT_TRUE(aof.flush());
+    handler.flush();
+    std::vector<char> received(8192);
+    const auto rd = peer->recv(received.data(), received.size(), 0);
+    const std::string_view reply(received.data(), rd);
+    const std::string expected =
+            "+OK\r\n+OK\r\n:1\r\n:-5\r\n:1\r\n+Background append only file rewriting started\r\n";
+    ASSERT_TRUE(reply.starts_with(expected)) << reply;
+    EXPECT_NE(reply.find("aof_enabled:1\r\naof_rewrite_in_progress:0\r\n"), std::string_view::npos) << reply;
+    EXPECT_NE(reply.find("aof_last_bgrewrite_status:ok\r\naof_rewrites:1\r\naof_last_write_status:ok\r\n"),
+              std::string_view::npos)
+            << reply;
+
+    Keyspace loaded(3);
+    const auto stats = load_aof(path, loaded);
+    ASSERT_FALSE(stats.is_error()) << stats.error();
+    EXPECT_EQ(stats.value().commands, 3) << "the rewritten file holds the keys left";
+    const auto at = keyspace.with_key("a", [](Shard& shard) { return shard.expire_time("a"); });
+    EXPECT_EQ(loaded.with_key("a", [](Shard& shard) { return shard.expire_time("a"); }), at);
+    EXPECT_EQ(loaded.with_key("c", [](Shard& shard) { return shard.get("c")->integer(); }), -5);
+    EXPECT_EQ(loaded.with_key("b", [](Shard& shard) { return shard.get("b")->integer(); }), 1);
+    std::filesystem::remove(path);
+}
+
+TEST_F(HandlerTest, OutputBufferLimit)
+{
+    auto dup = MemoryStream::duplex(8192);
+    auto peer = std::move(dup.first);
+    Keyspace keyspace(1);
+    keyspace.with_key("big", [](Shard& shard) { shard.set("big", std::string(1000, 'x')); });
+    ClientLimits limits;
+    limits.normal.hard_bytes = 4096;
+    limits.normal.soft_bytes = 512;
+    limits.normal.soft_seconds = 60;
+    // the pipeline is read at once, its replies are only written at the end
+    Handler handler(std::move(dup.second), 1024, DEFAULT_FLUSH_THRESHOLD, &keyspace, nullptr, nullptr, limits);
+    const std::string get = "*2\r\n$3\r\nGET\r\n$3\r\nbig\r\n";
+    std::string data;
+    for (int i = 0; i < 5; ++i)
+    {
+        data += get;
+    }
+    peer->send(data.data(), data.size());
+    for (int i = 0; i < 4; ++i)
+    {
+        const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(view.is_error());
+        handler.handle_command(Command::command_from_frame(view.value()));
+        EXPECT_FALSE(handler.closed()) << "past the soft limit for less than its duration";
+    }
+    const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+    ASSERT_FALSE(view.is_error());
+    handler.handle_command(Command::command_from_frame(view.value()));
+    EXPECT_TRUE(handler.closed()) << "the hard limit is reached";
+    EXPECT_EQ(handler.pending_output(), 0) << "the replies are dropped";
+    EXPECT_LT(handler.flush(), 0);
+}
+
+// SocketStream is one end of a socketpair, the handler sees it as a plain socket and writes to its fd
+class SocketStream final : public photon::net::ISocketStream
+{
+public:
+    explicit SocketStream(const int fd) : fd_(fd) {}
+    ~SocketStream() override { ::close(fd_); }
+
+    ssize_t read(void* buf, size_t count) override { return ::read(fd_, buf, count); }
+    ssize_t write(const void* buf, size_t count) override { return ::write(fd_, buf, count); }
+    ssize_t readv(const struct iovec* iov, int iovcnt) override { return ::readv(fd_, iov, iovcnt); }
+    ssize_t writev(const struct iovec* iov, int iovcnt) override { return ::writev(fd_, iov, iovcnt); }
+    ssize_t recv(void* buf, size_t count, int flags) override { return ::recv(fd_, buf, count, flags); }
+    ssize_t recv(const struct iovec* iov, int iovcnt, int flags) override { return ::readv(fd_, iov, iovcnt); }
+    ssize_t send(const void* buf, size_t count, int flags) override { return ::send(fd_, buf, count, flags); }
+    ssize_t send(const struct iovec* iov, int iovcnt, int flags) override { return ::writev(fd_, iov, iovcnt); }
+    ssize_t sendfile(int in_fd, off_t offset, size_t count) override { return -1; }
+    int close() override { return 0; }
+    int setsockopt(int level, int option_name, const void* option_value, socklen_t option_len) override
+    {
+        return ::setsockopt(fd_, level, option_name, option_value, option_len);
+    }
+    int getsockopt(int level, int option_name, void* option_value, socklen_t* option_len) override
+    {
+        return ::getsockopt(fd_, level, option_name, option_value, option_len);
+    }
+    Object* get_underlay_object(uint64_t recursion) override
+    {
+        return reinterpret_cast<Object*>(static_cast<uintptr_t>(fd_));
+    }
+    int getsockname(photon::net::EndPoint& addr) override { return 0; }
+    int getsockname(char* path, size_t count) override { return 0; }
+    int getpeername(photon::net::EndPoint& addr) override { return 0; }
+    int getpeername(char* path, size_t count) override { return 0; }
+
+private:
+    int fd_;
+};
+
+TEST_F(HandlerTest, SoftOutputLimitDropsStalledPeer)
+{
+    Keyspace keyspace(1);
+    keyspace.with_key("big", [](Shard& shard) { shard.set("big", std::string(1 << 20, 'x')); });
+    ClientLimits limits;
+    limits.normal.soft_bytes = 64 << 10;
+    limits.normal.soft_seconds = 1;
+    // the reply is copied to the output buffer, or referenced and written with writev
+    for (const auto reference_threshold: {std::numeric_limits<size_t>::max(), DEFAULT_REFERENCE_THRESHOLD})
+    {
+        int fds[2];
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        // the peer never reads
+        SocketStream peer(fds[0]);
+        Handler handler(std::make_unique<SocketStream>(fds[1]), 1024, DEFAULT_FLUSH_THRESHOLD, &keyspace, nullptr,
+                        nullptr, limits, reference_threshold);
+        const std::string get = "*2\r\n$3\r\nGET\r\n$3\r\nbig\r\n";
+        handler.add_more_data(std::span(get.data(), get.size()));
+        const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(view.is_error());
+        const auto start = std::chrono::steady_clock::now();
+        handler.handle_command(Command::command_from_frame(view.value()));
+        handler.flush();
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        EXPECT_TRUE(handler.closed()) << "the replies stayed past the soft limit for soft_seconds";
+        EXPECT_GE(elapsed, std::chrono::milliseconds(900));
+        EXPECT_LT(elapsed, std::chrono::seconds(5)) << "the write does not wait for the peer forever";
+        EXPECT_EQ(handler.pending_output(), 0);
+    }
+}
+
+TEST_F(HandlerTest, IdleConnectionReleasesMemory)
+{
+    Keyspace keyspace(1);
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    SocketStream peer(fds[0]);
+    Handler handler(std::make_unique<SocketStream>(fds[1]), 1024, DEFAULT_FLUSH_THRESHOLD, &keyspace);
+    const std::string info = "*1\r\n$4\r\nINFO\r\n";
+    ASSERT_EQ(peer.write(info.data(), info.size()), info.size());
+    const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+    ASSERT_FALSE(view.is_error());
+    handler.handle_command(Command::command_from_frame(view.value()));
+    ASSERT_GT(handler.scratch().capacity(), 0) << "INFO formats its reply in the arena";
+
+    // the next request comes once the connection is idle, waiting for it
+    const auto pooled = []
+    {
+        size_t count = 0;
+        for (auto size = BufferPool::MIN_SIZE; size <= BufferPool::MAX_SIZE; size *= 2)
+        {
+            count += BufferPool::local().free_count(size);
+        }
+        return count;
+    };
+    const auto free = pooled();
+    std::thread client(
+            [&]
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                const std::string ping = "*1\r\n$4\r\nPING\r\n";
+                peer.write(ping.data(), ping.size());
+            });
+    const auto next = handler.decode_view(MAX_RECURSION_DEPTH);
+    client.join();
+    ASSERT_FALSE(next.is_error());
+    EXPECT_EQ(Command::command_from_frame(next.value()).type, CommandType::PING);
+    EXPECT_EQ(handler.scratch().capacity(), 0) << "the scratch memory is freed while idle";
+    EXPECT_EQ(pooled(), free + 1) << "the output buffer went back to the pool, the input one was taken again";
+}
+
+TEST_F(HandlerTest, QueryBufferLimit)
+{
+    auto dup = MemoryStream::duplex(1024);
+    auto peer = std::move(dup.first);
+    ClientLimits limits;
+    limits.query_buffer_bytes = 100;
+    Handler handler(std::move(dup.second), 64, DEFAULT_FLUSH_THRESHOLD, nullptr, nullptr, nullptr, limits);
+    // the bulk string is never complete, its bytes pile up
+    const std::string data = "*2\r\n$3\r\nGET\r\n$500\r\n" + std::string(200, 'k');
+    peer->send(data.data(), data.size());
+    EXPECT_EQ(handler.decode_view(MAX_RECURSION_DEPTH).error(), RedisError::query_buffer_limit);
+}
+
+TEST_F(HandlerTest, StreamedBulkCountsTowardQueryBufferLimit)
+{
+    auto dup = MemoryStream::duplex(1 << 20);
+    auto peer = std::move(dup.first);
+    ClientLimits limits;
+    limits.query_buffer_bytes = 100'000;
+    Handler handler(std::move(dup.second), 1024, DEFAULT_FLUSH_THRESHOLD, nullptr, nullptr, nullptr, limits);
+    // each bulk string is under the limit, both of them are not
+    const std::string bulk(60'000, 'v');
+    const std::string data = "*3\r\n$3\r\nSET\r\n$60000\r\n" + bulk + "\r\n$60000\r\n" + bulk.substr(0, 100);
+    peer->send(data.data(), data.size());
+    EXPECT_EQ(handler.decode_view(MAX_RECURSION_DEPTH).error(), RedisError::query_buffer_limit);
+}
+
+TEST_F(HandlerTest, LargeValuesAreReferenced)
+{
+    auto dup = MemoryStream::duplex(1 << 20);
+    auto peer = std::move(dup.first);
+    Keyspace keyspace(2);
+    const std::string large(100'000, 'v');
+    keyspace.with_key("blob", [&](Shard& shard) { shard.set("blob", std::string_view(large)); });
+    Handler handler(std::move(dup.second), 1024, 1 << 20, &keyspace, nullptr, nullptr, {}, 32 * 1024);
+
+    const std::string data = "*2\r\n$3\r\nGET\r\n$4\r\nblob\r\n"
+                             "*3\r\n$3\r\nSET\r\n$4\r\nblob\r\n$5\r\nsmall\r\n"
+                             "*2\r\n$3\r\nGET\r\n$4\r\nblob\r\n";
+    peer->send(data.data(), data.size());
+    for (int i = 0; i < 3; ++i)
+    {
+        const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(view.is_error());
+        handler.handle_command(Command::command_from_frame(view.value()));
+    }
+    const auto expected = "$100000\r\n" + large + "\r\n+OK\r\n$5\r\nsmall\r\n";
+    EXPECT_EQ(handler.pending_output(), expected.size()) << "the referenced value counts as pending";
+    EXPECT_EQ(handler.flush(), expected.size());
+    EXPECT_EQ(handler.pending_output(), 0);
+
+    std::vector<char> received(expected.size() + 1);
+    const auto rd = peer->recv(received.data(), received.size(), 0);
+    EXPECT_EQ(std::string_view(received.data(), rd), expected) << "the value overwritten meanwhile was kept";
+}
+
+TEST_F(HandlerTest, LargeBulkIsStreamed)
+{
+    auto dup = MemoryStream::duplex(1 << 20);
+    auto peer = std::move(dup.first);
+    Keyspace keyspace(2);
+    Handler handler(std::move(dup.second), 64, DEFAULT_FLUSH_THRESHOLD, &keyspace);
+    const std::string large(200'000, 'v');
+    const auto data = "*3\r\n$3\r\nSET\r\n$4\r\nblob\r\n$200000\r\n" + large + "\r\n*1\r\n$4\r\nPING\r\n";
+    peer->send(data.data(), data.size());
+    for (int i = 0; i < 2; ++i)
+    {
+        const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(view.is_error()) << view.error();
+        EXPECT_LT(handler.buffer_size(), 1024) << "the payload is not buffered";
+        handler.handle_command(Command::command_from_frame(view.value()));
+    }
+    handler.flush();
+    std::vector<char> received(64);
+    const auto rd = peer->recv(received.data(), received.size(), 0);
+    EXPECT_EQ(std::string_view(received.data(), rd), "+OK\r\n+PONG\r\n");
+    EXPECT_EQ(keyspace.with_key("blob",
+                                [](Shard& shard)
+                                {
+                                    Value::IntText scratch;
+                                    return std::string(shard.get("blob")->str(scratch));
+                                }),
+              large);
+    EXPECT_GE(keyspace.stats().memory.used, large.size()) << "the streamed value is accounted to its shard";
+}
+
+TEST_F(HandlerTest, ProtoMaxBulkLen)
+{
+    auto dup = MemoryStream::duplex(1024);
+    auto peer = std::move(dup.first);
+    ClientLimits limits;
+    limits.proto_max_bulk_len = 100;
+    Handler handler(std::move(dup.second), 64, DEFAULT_FLUSH_THRESHOLD, nullptr, nullptr, nullptr, limits);
+    const std::string data = "*2\r\n$4\r\nECHO\r\n$101\r\n";
+    peer->send(data.data(), data.size());
+    EXPECT_EQ(handler.decode_view(MAX_RECURSION_DEPTH).error(), RedisError::invalid_bulk_length);
+}
+
+TEST_F(HandlerTest, ProtoMaxBulkLenIsClampedToValueSize)
+{
+    auto dup = MemoryStream::duplex(1024);
+    auto peer = std::move(dup.first);
+    ClientLimits limits;
+    limits.proto_max_bulk_len = std::numeric_limits<size_t>::max();
+    Handler handler(std::move(dup.second), 64, DEFAULT_FLUSH_THRESHOLD, nullptr, nullptr, nullptr, limits);
+    const std::string data = "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$4294967296\r\n";
+    peer->send(data.data(), data.size());
+    EXPECT_EQ(handler.decode_view(MAX_RECURSION_DEPTH).error(), RedisError::invalid_bulk_length);
+}
+
+TEST_F(HandlerTest, ScratchIsResetAfterBatch)
+{
+    auto dup = MemoryStream::duplex(1024);
+    auto peer = std::move(dup.first);
+    Keyspace keyspace(2);
+    Handler handler(std::move(dup.second), 64, DEFAULT_FLUSH_THRESHOLD, &keyspace);
+    const std::string data = "*1\r\n$4\r\nINFO\r\n*2\r\n$4\r\nSCAN\r\n$1\r\n0\r\n";
+    peer->send(data.data(), data.size());
+    for (int i = 0; i < 2; ++i)
+    {
+        const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(view.is_error());
+        handler.handle_command(Command::command_from_frame(view.value()));
+    }
+    EXPECT_GT(handler.scratch().used(), 0) << "INFO formats its reply in the arena";
+    EXPECT_EQ(handler.decode_view(MAX_RECURSION_DEPTH).error(), RedisError::eof);
+    EXPECT_EQ(handler.scratch().used(), 0) << "the arena is reset before waiting for the next batch";
+}
+
+TEST_F(HandlerTest, HandleScan)
+{
+    auto dup = MemoryStream::duplex(1 << 16);
+    auto peer = std::move(dup.first);
+    Keyspace keyspace(4);
+    for (int i = 0; i < 100; ++i)
+    {
+        const auto key = (i % 2 == 0 ? "even:" : "odd:") + std::to_string(i);
+        keyspace.with_key(key, [&](Shard& shard) { shard.set(key, std::string_view("v")); });
+    }
+    Handler handler(std::move(dup.second), 64, DEFAULT_FLUSH_THRESHOLD, &keyspace);
+
+    std::set<std::string> seen;
+    std::string cursor = "0";
+    std::vector<char> received(1 << 16);
+    do
+    {
+        const auto request = "*6\r\n$4\r\nSCAN\r\n$" + std::to_string(cursor.size()) + "\r\n" + cursor +
+                             "\r\n$5\r\nmatch\r\n$6\r\neven:*\r\n$5\r\nCOUNT\r\n$1\r\n7\r\n";
+        peer->send(request.data(), request.size());
+        const auto view = handler.decode_view(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(view.is_error());
+        handler.handle_command(Command::command_from_frame(view.value()));
+        handler.flush();
+
+        const auto rd = peer->recv(received.data(), received.size(), 0);
+        Decoder decoder;
+        size_t consumed = 0;
+        const auto reply = decoder.decode(std::span(received.data(), rd), consumed);
+        ASSERT_FALSE(reply.is_error());
+        const auto& parts = std::get<std::vector<Frame>>(reply.value().data);
+        ASSERT_EQ(parts.size(), 2);
+        const auto& next = std::get<bytes>(parts[0].data);
+        cursor.assign(next.begin(), next.end());
+        for (const auto& key: std::get<std::vector<Frame>>(parts[1].data))
+        {
+            const auto& name = std::get<bytes>(key.data);
+            seen.emplace(name.begin(), name.end());
+        }
+    }
+    while (cursor != "0");
+    EXPECT_EQ(seen.size(), 50) << "every key of every shard matching the pattern is returned";
+    for (const auto& key: seen)
+    {
+        EXPECT_TRUE(key.starts_with("even:"));
+    }
+}
+
+TEST_F(HandlerTest, HandleCommandInfo)
+{
+    const std::string data = "*2\r\n$7\r\nCOMMAND\r\n$5\r\ncount\r\n"
+                             "*4\r\n$7\r\nCOMMAND\r\n$4\r\nINFO\r\n$3\r\nGET\r\n$4\r\nnope\r\n";
+    client->send(data.data(), data.size());
+    for (int i = 0; i < 2; ++i)
+    {
+        const auto view = h->decode_view(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(view.is_error());
+        h->handle_command(Command::command_from_frame(view.value()));
+    }
+    h->flush();
+    std::vector<char> received(256);
+    const auto rd = client->recv(received.data(), received.size(), 0);
+    EXPECT_EQ(std::string_view(received.data(), rd),
+              ":" + std::to_string(COMMAND_TABLE.size()) +
+                      "\r\n*2\r\n*6\r\n$3\r\nget\r\n:2\r\n*2\r\n+readonly\r\n+fast\r\n:1\r\n:1\r\n:1\r\n$-1\r\n");
+}
+
+TEST_F(HandlerTest, KeyCommandsWithoutKeyspace)
+{
+    const std::string data = "*2\r\n$3\r\nGET\r\n$1\r\na\r\n";
+    client->send(data.data(), data.size());
+    const auto view = h->decode_view(MAX_RECURSION_DEPTH);
+    ASSERT_FALSE(view.is_error());
+    h->handle_command(Command::command_from_frame(view.value()));
+    h->flush();
+    std::vector<char> received(64);
+    const auto rd = client->recv(received.data(), received.size(), 0);
+    EXPECT_EQ(std::string_view(received.data(), rd), "-ERR command not supported\r\n");
+}
+
+//
+// Output batching
+//
+
+TEST_F(HandlerTest, WriteFrameIsBuffered)
+{
+    h->write_frame(Frame{FrameID::SimpleString, string_to_bytes("OK")});
+    h->write_frame(Frame{FrameID::Integer, 7});
+    EXPECT_EQ(h->pending_output(), 9);
+
+    std::vector<char> received(64);
+    EXPECT_EQ(client->recv(received.data(), received.size(), 0), 0) << "nothing is written before a flush";
+
+    EXPECT_EQ(h->flush(), 9);
+    EXPECT_EQ(h->pending_output(), 0);
+    const auto rd = client->recv(received.data(), received.size(), 0);
+    EXPECT_EQ(std::string_view(received.data(), rd), "+OK\r\n:7\r\n");
+}
+
+TEST_F(HandlerTest, WriteFrameFlushesPastThreshold)
+{
+    auto dup = MemoryStream::duplex(1024);
+    auto peer = std::move(dup.first);
+    Handler handler(std::move(dup.second), 25, 8);
+    handler.write_frame(Frame{FrameID::SimpleString, string_to_bytes("OK")});
+    EXPECT_EQ(handler.pending_output(), 5);
+    handler.write_frame(Frame{FrameID::SimpleString, string_to_bytes("OK")});
+    EXPECT_EQ(handler.pending_output(), 0) << "crossing the threshold writes the batch right away";
+}
+
+TEST_F(HandlerTest, ReadingUpstreamFlushesReplies)
+{
+    const std::string data = ":1\r\n:2\r\n";
+    client->send(data.data(), data.size());
+    for (int i = 0; i < 2; ++i)
+    {
+        auto frame = h->decode(MAX_RECURSION_DEPTH);
+        ASSERT_FALSE(frame.is_error());
+        h->write_frame(frame.value());
+    }
+    EXPECT_EQ(h->pending_output(), 8) << "replies wait while buffered input is being processed";
+
+    auto read = h->decode(MAX_RECURSION_DEPTH);
+    ASSERT_TRUE(read.is_error());
+    EXPECT_EQ(h->pending_output(), 0) << "the batch is flushed before reading more input";
+    std::vector<char> received(64);
+    const auto rd = client->recv(received.data(), received.size(), 0);
+    EXPECT_EQ(std::string_view(received.data(), rd), data);
+}
+
+TEST_F(HandlerTest, SendFrameWritesBufferedRepliesFirst)
+{
+    auto dup = MemoryStream::duplex(1024);
+    auto peer = std::move(dup.first);
+    Handler handler(std::move(dup.second), 25, 16);
+    handler.write_frame(Frame{FrameID::Integer, 1});
+    const std::string large(40, 'v');
+    const auto wr = handler.send_frame(Frame{FrameID::BulkString, string_to_bytes(large)});
+    EXPECT_EQ(wr, 5 + 40 + 2);
+    EXPECT_EQ(handler.pending_output(), 0);
+
+    std::vector<char> received(128);
+    const auto rd = peer->recv(received.data(), received.size(), 0);
+    EXPECT_EQ(std::string_view(received.data(), rd), ":1\r\n$40\r\n" + large + "\r\n");
+}
+
 int main(int argc, char** argv)
 {
     log_output_level = ALOG_INFO;
@@ -0,0 +1,74 @@
+#include "framer/scan.h"
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace redis;
+
+LineScan scan(const std::string& input) { return scan_line(std::span(input.data(), input.size())); }
+
+TEST(ScanLineTest, FindsLf)
+{
+    EXPECT_EQ(scan("+OK\r\n").lf, 4);
+    EXPECT_FALSE(scan("+OK\r\n").stray_cr);
+    EXPECT_EQ(scan("+OK").lf, NO_LF);
+    EXPECT_EQ(scan("").lf, NO_LF);
+}
+
+TEST(ScanLineTest, StrayCr)
+{
+    EXPECT_TRUE(scan("+hel\rlo\r\n").stray_cr);
+    EXPECT_TRUE(scan("+hello\r\r\n").stray_cr);
+    EXPECT_FALSE(scan("+hello\n").stray_cr) << "a missing CR is not a stray CR";
+    EXPECT_FALSE(scan("+hello\r\n\r\r\r").stray_cr) << "bytes after the LF are not looked at";
+}
+
+TEST(ScanLineTest, BlockBoundaries)
+{
+    // put the terminating CR at the end of a block and the LF at the start of the next one
+    for (const size_t width: {16, 32})
+    {
+        std::string line(width - 1, 'a');
+        line += "\r\n";
+        const auto result = scan(line);
+        EXPECT_EQ(result.lf, width);
+        EXPECT_FALSE(result.stray_cr);
+
+        std::string stray(width - 1, 'a');
+        stray += "\rb\r\n";
+        EXPECT_TRUE(scan(stray).stray_cr) << "a CR at the end of a block followed by a regular byte is stray";
+    }
+}
+
+TEST(ScanLineTest, ImplementationsAgree)
+{
+    std::mt19937 rng(42);
+    // a small alphabet makes CR and LF frequent
+    const std::string alphabet = "ab\r\n";
+    for (int round = 0; round < 20000; ++round)
+    {
+        std::string input(rng() % 100, ' ');
+        for (auto& c: input)
+        {
+            c = alphabet[rng() % (round % 2 == 0 ? alphabet.size() : alphabet.size() - 1)];
+        }
+        const auto span = std::span(input.data(), input.size());
+        const auto expected = scan_line_scalar(span);
+        const std::vector<LineScan> results = {scan_line(span),
+#if defined(__x86_64__)
+                                               scan_line_sse2(span),
+                                               __builtin_cpu_supports("avx2") ? scan_line_avx2(span) : expected
+#endif
+        };
+        for (const auto& result: results)
+        {
+            ASSERT_EQ(result.lf, expected.lf) << "input: " << input;
+            if (expected.lf != NO_LF)
+            {
+                ASSERT_EQ(result.stray_cr, expected.stray_cr) << "input: " << input;
+            }
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#include "metrics/metrics.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+#include "storage/keyspace.h"
+
+using namespace redis;
+
+TEST(LatencyHistogramTest, Buckets)
+{
+    for (uint64_t usec = 0; usec < LatencyHistogram::SUB_BUCKETS; ++usec)
+    {
+        EXPECT_EQ(LatencyHistogram::bucket_of(usec), usec) << "small latencies are exact";
+    }
+    // every bucket begins right after the previous one ends
+    for (size_t i = 1; i < LatencyHistogram::BUCKETS; ++i)
+    {
+        const auto lower = LatencyHistogram::upper_bound(i - 1) + 1;
+        EXPECT_EQ(LatencyHistogram::bucket_of(lower), i) << lower;
+        EXPECT_EQ(LatencyHistogram::bucket_of(LatencyHistogram::upper_bound(i)), i);
+    }
+    EXPECT_EQ(LatencyHistogram::upper_bound(LatencyHistogram::BUCKETS - 1), LatencyHistogram::MAX_VALUE);
+    EXPECT_EQ(LatencyHistogram::bucket_of(UINT64_MAX), LatencyHistogram::BUCKETS - 1);
+    // the width of a bucket is under 1 / SUB_BUCKETS of its values
+    const auto bucket = LatencyHistogram::bucket_of(1'000'000);
+    const auto width = LatencyHistogram::upper_bound(bucket) - LatencyHistogram::upper_bound(bucket - 1);
+    EXPECT_LE(width * LatencyHistogram::SUB_BUCKETS, 1'000'000);
+}
+
+TEST(LatencyHistogramTest, Percentiles)
+{
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.percentile(50), 0);
+    for (uint64_t usec = 1; usec <= 1'000; ++usec)
+    {
+        histogram.record(usec);
+    }
+    EXPECT_EQ(histogram.count(), 1'000);
+    EXPECT_EQ(histogram.sum(), 500'500);
+    EXPECT_EQ(histogram.max(), 1'000);
+    const auto near = [](const uint64_t value, const uint64_t expected)
+    { return value >= expected && value <= expected + expected / LatencyHistogram::SUB_BUCKETS; };
+    EXPECT_PRED2(near, histogram.percentile(50), 500);
+    EXPECT_PRED2(near, histogram.percentile(99), 990);
+    EXPECT_EQ(histogram.percentile(99.9), 1'000) << "a percentile is never above the largest latency";
+    EXPECT_EQ(histogram.percentile(100), 1'000);
+
+    LatencyHistogram slow;
+    slow.record(1'000'000);
+    histogram += slow;
+    EXPECT_EQ(histogram.count(), 1'001);
+    EXPECT_EQ(histogram.max(), 1'000'000);
+    EXPECT_PRED2(near, histogram.percentile(50), 500);
+    EXPECT_EQ(histogram.percentile(100), 1'000'000);
+}
+
+TEST(MetricsTest, RecordCommand)
+{
+    Metrics metrics;
+    metrics.record_command(CommandType::GET, 10, false);
+    metrics.record_command(CommandType::GET, 30, false);
+    metrics.record_command(CommandType::INCR, 5, true);
+    EXPECT_EQ(metrics.total_commands_processed, 3);
+    const auto& get = metrics.commands[static_cast<size_t>(CommandType::GET)];
+    EXPECT_EQ(get.calls, 2);
+    EXPECT_EQ(get.failed_calls, 0);
+    EXPECT_EQ(get.latency.sum(), 40);
+    EXPECT_EQ(metrics.commands[static_cast<size_t>(CommandType::INCR)].failed_calls, 1);
+    metrics.record_rejected(CommandType::SET);
+    EXPECT_EQ(metrics.commands[static_cast<size_t>(CommandType::SET)].rejected_calls, 1);
+    EXPECT_EQ(metrics.commands[static_cast<size_t>(CommandType::SET)].calls, 0);
+
+    Metrics total;
+    total.net_input_bytes = 7;
+    total += metrics;
+    total += metrics;
+    EXPECT_EQ(total.total_commands_processed, 6);
+    EXPECT_EQ(total.net_input_bytes, 7);
+    EXPECT_EQ(total.commands[static_cast<size_t>(CommandType::GET)].latency.count(), 4);
+    EXPECT_EQ(total.commands[static_cast<size_t>(CommandType::SET)].rejected_calls, 2);
+}
+
+TEST(MetricsTest, CollectCountsEveryVcpuOnce)
+{
+    auto& local = Metrics::local();
+    const auto before = local.total_commands_processed;
+    local.record_command(CommandType::PING, 1, false);
+    // the shards of this keyspace all run inline, on the vCPU of the test
+    Keyspace keyspace(4);
+    const auto rejected = collect_metrics(keyspace).rejected_connections;
+    count_rejected_connection();
+    const auto collected = collect_metrics(keyspace);
+    EXPECT_EQ(collected.total_commands_processed, before + 1);
+    EXPECT_EQ(collected.rejected_connections, rejected + 1) << "the counter is shared by the vCPUs";
+    EXPECT_EQ(collected.commands[static_cast<size_t>(CommandType::PING)].calls,
+              local.commands[static_cast<size_t>(CommandType::PING)].calls);
+}
+
+TEST(MetricsTest, PrometheusText)
+{
+    Metrics metrics;
+    metrics.connected_clients = 3;
+    metrics.net_output_bytes = 1'024;
+    metrics.record_command(CommandType::SET, 12, false);
+    metrics.record_command(CommandType::SET, 20, true);
+    const auto text = prometheus_text(metrics);
+    EXPECT_NE(text.find("# TYPE redis_connected_clients gauge\nredis_connected_clients 3\n"), std::string::npos)
+            << text;
+    EXPECT_NE(text.find("redis_net_output_bytes_total 1024\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("redis_commands_total{cmd=\"set\"} 2\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("redis_commands_total{cmd=\"get\"} 0\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("redis_commands_failed_total{cmd=\"set\"} 1\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("redis_command_latency_usec{cmd=\"set\",quantile=\"0.999\"} 20\n"), std::string::npos)
+            << text;
+    EXPECT_NE(text.find("redis_command_latency_usec_sum{cmd=\"set\"} 32\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("redis_command_latency_usec_count{cmd=\"set\"} 2\n"), std::string::npos) << text;
+    EXPECT_EQ(text.find("redis_command_latency_usec{cmd=\"get\""), std::string::npos) << "no latency without calls";
+}
@@ -0,0 +1,247 @@
+#include "persistence/aof.h"
+
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+
+#include "storage/keyspace.h"
+
+using namespace redis;
+
+// temp_path returns a path in the temporary directory where no file exists
+std::string temp_path(const std::string& name)
+{
+    const auto path = (std::filesystem::temp_directory_path() / name).string();
+    std::filesystem::remove(path);
+    return path;
+}
+
+std::string read_file(const std::string& path)
+{
+    std::ostringstream content;
+    content << std::ifstream(path, std::ios::binary).rdbuf();
+    return content.str();
+}
+
+std::string value_of(Keyspace& keyspace, const std::string_view key)
+{
+    return keyspace.with_key(key,
+                             [&](Shard& shard)
+                             {
+                                 const auto* value = shard.get(key);
+                                 Value::IntText scratch;
+                                 return value == nullptr ? std::string("(nil)") : std::string(value->str(scratch));
+                             });
+}
+
+TEST(AofTest, FsyncPolicy)
+{
+    EXPECT_EQ(parse_fsync_policy("always"), FsyncPolicy::Always);
+    EXPECT_EQ(parse_fsync_policy("everysec"), FsyncPolicy::EverySec);
+    EXPECT_EQ(parse_fsync_policy("no"), FsyncPolicy::No);
+    EXPECT_FALSE(parse_fsync_policy("sometimes").has_value());
+    EXPECT_EQ(to_string(FsyncPolicy::EverySec), "everysec");
+}
+
+TEST(AofTest, AppendAndReplay)
+{
+    const auto path = temp_path("aof_test_replay.aof");
+    const auto later = unix_time_ms() + 60'000;
+    {
+        Keyspace keyspace(4);
+        Aof aof(keyspace, path, FsyncPolicy::Always);
+        ASSERT_EQ(aof.open().value(), 0) << "the base of an empty keyspace is empty";
+        const auto log = [&](const std::string_view key, const std::initializer_list<std::string_view> args)
+        { return keyspace.with_key(key, [&](Shard&) { return aof.append(key, args); }); };
+        for (int i = 0; i < 1'000; ++i)
+        {
+            const auto key = "key:" + std::to_string(i);
+            log(key, {"SET", key, "value:" + std::to_string(i)});
+        }
+        const auto at = std::to_string(later);
+        log("volatile", {"SET", "volatile", "v", "PXAT", at});
+        log("key:1", {"PEXPIREAT", "key:1", at});
+        log("key:1", {"PERSIST", "key:1"});
+        log("key:2", {"DEL", "key:2"});
+        log("counter", {"INCRBY", "counter", "40"});
+        const auto epoch = log("counter", {"INCRBY", "counter", "2"});
+        EXPECT_EQ(epoch, 1);
+
+        ASSERT_TRUE(aof.flush());
+        aof.wait_durable(epoch);
+        EXPECT_TRUE(aof.info().last_write_ok);
+        EXPECT_EQ(aof.info().size, std::filesystem::file_size(path));
+        EXPECT_EQ(log("key:3", {"DEL", "key:3"}), 2) << "a flush begins a new epoch";
+    }
+    EXPECT_NE(read_file(path).find("*3\r\n$3\r\nSET\r\n$5\r\nkey:0\r\n$7\r\nvalue:0\r\n"), std::string::npos);
+
+    Keyspace loaded(3);
+    const auto stats = load_aof(path, loaded);
+    ASSERT_FALSE(stats.is_error()) << stats.error();
+    EXPECT_EQ(stats.value().commands, 1'007) << "the commands logged before the destruction are flushed";
+    EXPECT_EQ(stats.value().bytes, std::filesystem::file_size(path));
+    EXPECT_EQ(stats.value().truncated, 0);
+    EXPECT_EQ(loaded.stats().keys, 1'000);
+    EXPECT_EQ(value_of(loaded, "key:0"), "value:0");
+    EXPECT_EQ(value_of(loaded, "key:2"), "(nil)");
+    EXPECT_EQ(value_of(loaded, "key:3"), "(nil)");
+    EXPECT_EQ(value_of(loaded, "counter"), "42");
+    EXPECT_EQ(loaded.with_key("volatile", [](Shard& shard) { return shard.expire_time("volatile"); }), later);
+    EXPECT_EQ(loaded.with_key("key:1", [](Shard& shard) { return shard.expire_time("key:1"); }), NO_EXPIRY);
+    std::filesystem::remove(path);
+}
+
+TEST(AofTest, EvictionsAreLogged)
+{
+    const auto path = temp_path("aof_test_evictions.aof");
+    Keyspace keyspace(2);
+    keyspace.set_maxmemory(512 * 1024, EvictionPolicy::AllKeysLru);
+    {
+        Aof aof(keyspace, path, FsyncPolicy::No);
+        ASSERT_FALSE(aof.open().is_error());
+        const std::string value(100, 'x');
+        for (int i = 0; i < 10'000; ++i)
+        {
+            const auto key = "key:" + std::to_string(i);
+            keyspace.with_key(key,
+                              [&](Shard& shard)
+                              {
+                                  ASSERT_TRUE(shard.make_room());
+                                  shard.set(key, std::string_view(value));
+                                  aof.append(key, {"SET", key, value});
+                              });
+        }
+    }
+    const auto stats = keyspace.stats();
+    ASSERT_GT(stats.evicted_keys, 0);
+
+    Keyspace loaded(2);
+    ASSERT_FALSE(load_aof(path, loaded).is_error());
+    EXPECT_EQ(loaded.stats().keys, stats.keys) << "the evicted keys are not brought back";
+    std::filesystem::remove(path);
+}
+
+TEST(AofTest, TruncatedTail)
+{
+    const auto path = temp_path("aof_test_truncated.aof");
+    const std::string complete = "*3\r\n$3\r\nSET\r\n$4\r\nkept\r\n$1\r\nv\r\n";
+    std::ofstream(path, std::ios::binary) << complete << "*3\r\n$3\r\nSET\r\n$4\r\nlost\r\n$5\r\nval";
+
+    Keyspace keyspace(2);
+    const auto stats = load_aof(path, keyspace);
+    ASSERT_FALSE(stats.is_error()) << stats.error();
+    EXPECT_EQ(stats.value().commands, 1);
+    EXPECT_EQ(stats.value().truncated, 30);
+    EXPECT_EQ(value_of(keyspace, "kept"), "v");
+    EXPECT_EQ(value_of(keyspace, "lost"), "(nil)");
+    EXPECT_EQ(read_file(path), complete) << "the incomplete command is cut off";
+    std::filesystem::remove(path);
+}
+
+TEST(AofTest, Failures)
+{
+    Keyspace keyspace(2);
+    EXPECT_EQ(load_aof("/nonexistent/appendonly.aof", keyspace).error(), RedisError::eof);
+    EXPECT_EQ(errno, ENOENT);
+
+    const auto path = temp_path("aof_test_corrupted.aof");
+    std::ofstream(path, std::ios::binary) << "*2\r\n$4\r\nLPOP\r\n$4\r\nlist\r\n";
+    EXPECT_EQ(load_aof(path, keyspace).error(), RedisError::aof_corrupted) << "unknown command";
+    std::ofstream(path, std::ios::binary) << "*2\r\n$3\r\nDEL\r\n$4\r\nkeyXX\r\n";
+    EXPECT_EQ(load_aof(path, keyspace).error(), RedisError::aof_corrupted) << "wrong bulk length";
+    std::ofstream(path, std::ios::binary) << "*3\r\n$9\r\nPEXPIREAT\r\n$3\r\nkey\r\n$3\r\nabc\r\n";
+    EXPECT_EQ(load_aof(path, keyspace).error(), RedisError::aof_corrupted) << "not a time";
+    std::ofstream(path, std::ios::binary) << "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$4294967296\r\n";
+    EXPECT_EQ(load_aof(path, keyspace).error(), RedisError::aof_corrupted) << "a string larger than a value";
+    std::filesystem::remove(path);
+
+    Aof aof(keyspace, "/nonexistent/appendonly.aof", FsyncPolicy::No);
+    EXPECT_EQ(aof.open().error(), RedisError::io_error);
+}
+
+TEST(AofTest, OpenWritesBase)
+{
+    Keyspace keyspace(4);
+    const auto later = unix_time_ms() + 60'000;
+    for (int i = 0; i < 5'000; ++i)
+    {
+        const auto key = "key:" + std::to_string(i);
+        keyspace.with_key(key,
+                          [&](Shard& shard)
+                          { shard.set(key, std::string_view("value:" + std::to_string(i)), i % 5 == 0 ? later : -1); });
+    }
+    keyspace.with_key("counter", [](Shard& shard) { return shard.incr_by("counter", 7); });
+
+    const auto path = temp_path("aof_test_base.aof");
+    size_t size;
+    {
+        Aof aof(keyspace, path, FsyncPolicy::EverySec);
+        const auto opened = aof.open();
+        ASSERT_FALSE(opened.is_error()) << opened.error();
+        size = opened.value();
+        EXPECT_EQ(size, std::filesystem::file_size(path));
+        EXPECT_FALSE(std::filesystem::exists(path + ".tmp"));
+    }
+    {
+        Aof aof(keyspace, path, FsyncPolicy::EverySec);
+        EXPECT_EQ(aof.open().value(), size) << "an existing file is appended to";
+    }
+
+    Keyspace loaded(3);
+    const auto stats = load_aof(path, loaded);
+    ASSERT_FALSE(stats.is_error()) << stats.error();
+    EXPECT_EQ(stats.value().commands, 5'001);
+    EXPECT_EQ(value_of(loaded, "key:4999"), "value:4999");
+    EXPECT_EQ(value_of(loaded, "counter"), "7");
+    EXPECT_EQ(loaded.with_key("key:5", [](Shard& shard) { return shard.expire_time("key:5"); }), later);
+    EXPECT_EQ(loaded.stats().volatile_keys, keyspace.stats().volatile_keys);
+    std::filesystem::remove(path);
+}
+
+TEST(AofTest, Rewrite)
+{
+    Keyspace keyspace(4);
+    const auto path = temp_path("aof_test_rewrite.aof");
+    Aof aof(keyspace, path, FsyncPolicy::Always);
+    ASSERT_EQ(aof.open().value(), 0);
+    // a counter incremented many times is a single SET once rewritten
+    for (int i = 0; i < 1'000; ++i)
+    {
+        const auto key = "counter:" + std::to_string(i % 10);
+        keyspace.with_key(key,
+                          [&](Shard& shard)
+                          {
+                              static_cast<void>(shard.incr_by(key, 1));
+                              aof.append(key, {"INCRBY", key, "1"});
+                          });
+    }
+    ASSERT_TRUE(aof.flush());
+    const auto logged = aof.info().size;
+    keyspace.with_key("pending",
+                      [&](Shard& shard)
+                      {
+                          shard.set("pending", std::string_view("v"));
+                          aof.append("pending", {"SET", "pending", "v"});
+                      });
+
+    const auto rewritten = aof.rewrite();
+    ASSERT_FALSE(rewritten.is_error()) << rewritten.error();
+    EXPECT_LT(rewritten.value(), logged / 10);
+    EXPECT_EQ(aof.info().size, rewritten.value());
+    EXPECT_EQ(std::filesystem::file_size(path), rewritten.value());
+    EXPECT_FALSE(std::filesystem::exists(path + ".rewrite.tmp"));
+
+    // the rewritten file is appended to
+    keyspace.with_key("after", [&](Shard&) { aof.append("after", {"SET", "after", "v"}); });
+    ASSERT_TRUE(aof.flush());
+    Keyspace loaded(2);
+    const auto stats = load_aof(path, loaded);
+    ASSERT_FALSE(stats.is_error()) << stats.error();
+    EXPECT_EQ(stats.value().commands, 12) << "the command logged before the rewrite is in the snapshot only";
+    EXPECT_EQ(value_of(loaded, "counter:3"), "100");
+    EXPECT_EQ(value_of(loaded, "pending"), "v");
+    EXPECT_EQ(value_of(loaded, "after"), "v");
+    std::filesystem::remove(path);
+}
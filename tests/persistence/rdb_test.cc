@@ -0,0 +1,377 @@
+#include "persistence/rdb.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <limits>
+#include <string>
+
+#include "persistence/crc64.h"
+#include "storage/keyspace.h"
+
+using namespace redis;
+using namespace std::literals;
+
+// the dump.rdb of the repository, written by Redis 7.4 with an empty dataset
+const std::string EMPTY_DUMP("REDIS0012\xfa\x09redis-ver\x05"
+                             "7.4.0\xfa\x0aredis-bits\xc0\x40\xfa\x05"
+                             "ctime\xc2\x17\xb1\xe5\x66\xfa\x08used-mem\xc2\x68\x31\x0f\x00\xfa\x08"
+                             "aof-base\xc0\x00\xff\x62\xdc\x3a\x7f\x0f\xab\xb7\x28",
+                             88);
+
+// RdbBuilder writes the RDB encoding of values, to build test files
+struct RdbBuilder
+{
+    std::string out = "REDIS0012";
+
+    RdbBuilder& byte(const uint8_t value)
+    {
+        out.push_back(static_cast<char>(value));
+        return *this;
+    }
+
+    RdbBuilder& length(const uint64_t value)
+    {
+        if (value < 64)
+        {
+            return this->byte(value);
+        }
+        if (value < 16384)
+        {
+            return this->byte(0x40 | value >> 8).byte(value & 0xFF);
+        }
+        const auto wide = value > std::numeric_limits<uint32_t>::max();
+        this->byte(wide ? rdb::LEN_64BIT : rdb::LEN_32BIT);
+        for (int shift = wide ? 56 : 24; shift >= 0; shift -= 8)
+        {
+            this->byte(value >> shift & 0xFF);
+        }
+        return *this;
+    }
+
+    RdbBuilder& string(const std::string_view value)
+    {
+        this->length(value.size());
+        out.append(value);
+        return *this;
+    }
+
+    template<typename T>
+    RdbBuilder& le(const T value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        return *this;
+    }
+
+    RdbBuilder& set(const std::string_view key, const std::string_view value)
+    {
+        return this->byte(rdb::TYPE_STRING).string(key).string(value);
+    }
+
+    // end writes the end of file opcode and the checksum of the file
+    RdbBuilder& end()
+    {
+        this->byte(rdb::OPCODE_EOF);
+        return this->le(crc64(0, out));
+    }
+};
+
+std::string write_file(const std::string& name, const std::string& content)
+{
+    const auto path = (std::filesystem::temp_directory_path() / name).string();
+    std::ofstream(path, std::ios::binary) << content;
+    return path;
+}
+
+std::string value_of(Keyspace& keyspace, const std::string_view key)
+{
+    return keyspace.with_key(key,
+                             [&](Shard& shard)
+                             {
+                                 const auto* value = shard.get(key);
+                                 Value::IntText scratch;
+                                 return value == nullptr ? std::string("(nil)") : std::string(value->str(scratch));
+                             });
+}
+
+TEST(RdbReaderTest, EmptyDump)
+{
+    RdbReader reader(EMPTY_DUMP);
+    const auto version = reader.read_header();
+    ASSERT_FALSE(version.is_error());
+    EXPECT_EQ(version.value(), 12);
+    RdbEntry entry;
+    const auto event = reader.next(entry);
+    ASSERT_FALSE(event.is_error()) << event.error();
+    EXPECT_EQ(event.value(), RdbEvent::End) << "auxiliary fields are skipped";
+    EXPECT_EQ(reader.offset(), EMPTY_DUMP.size()) << "the checksum written by Redis is verified";
+}
+
+TEST(RdbReaderTest, Header)
+{
+    EXPECT_EQ(RdbReader("REDIS"sv).read_header().error(), RedisError::rdb_corrupted);
+    EXPECT_EQ(RdbReader("RADIS0012"sv).read_header().error(), RedisError::rdb_corrupted);
+    EXPECT_EQ(RdbReader("REDIS00x2"sv).read_header().error(), RedisError::rdb_corrupted);
+    EXPECT_EQ(RdbReader("REDIS0099"sv).read_header().error(), RedisError::rdb_unsupported);
+    EXPECT_EQ(RdbReader("REDIS0006"sv).read_header().value(), 6);
+}
+
+TEST(RdbReaderTest, StringEncodings)
+{
+    RdbBuilder rdb;
+    rdb.byte(rdb::OPCODE_SELECTDB).length(0).byte(rdb::OPCODE_RESIZEDB).length(6).length(2);
+    rdb.set("raw", std::string(20000, 'r'));
+    rdb.byte(rdb::TYPE_STRING).string("int8").byte(0xC0).byte(0xF6);
+    rdb.byte(rdb::TYPE_STRING).string("int16").byte(0xC1).le<int16_t>(-30000);
+    rdb.byte(rdb::OPCODE_EXPIRETIME_MS).le<int64_t>(1'700'000'000'123);
+    rdb.byte(rdb::TYPE_STRING).string("int32").byte(0xC2).le<int32_t>(2'000'000'000);
+    // "abc" as literals, then a back reference of 9 bytes, 3 bytes behind
+    rdb.byte(rdb::OPCODE_EXPIRETIME).le<int32_t>(1'700'000'000);
+    rdb.byte(rdb::TYPE_STRING).string("lzf").byte(0xC3).length(7).length(12);
+    rdb.out.append("\x02" "abc" "\xe0\x00\x02", 7);
+    rdb.byte(rdb::OPCODE_FREQ).byte(3).byte(rdb::OPCODE_IDLE).length(100);
+    rdb.byte(rdb::TYPE_STRING).byte(0xC0).byte(42).string("integer key");
+    rdb.end();
+
+    RdbReader reader(rdb.out);
+    ASSERT_FALSE(reader.read_header().is_error());
+    RdbEntry entry;
+    ASSERT_EQ(reader.next(entry).value(), RdbEvent::ResizeDb);
+    EXPECT_EQ(entry.db_size, 6);
+
+    const std::tuple<std::string, std::string, int64_t> expected[] = {
+            {"raw", std::string(20000, 'r'), NO_EXPIRY},
+            {"int8", "-10", NO_EXPIRY},
+            {"int16", "-30000", NO_EXPIRY},
+            {"int32", "2000000000", 1'700'000'000'123},
+            {"lzf", "abcabcabcabc", 1'700'000'000'000},
+            {"42", "integer key", NO_EXPIRY},
+    };
+    for (const auto& [key, value, expire_at]: expected)
+    {
+        const auto event = reader.next(entry);
+        ASSERT_FALSE(event.is_error()) << key << ": " << event.error();
+        ASSERT_EQ(event.value(), RdbEvent::Key);
+        EXPECT_EQ(entry.type, rdb::TYPE_STRING);
+        EXPECT_EQ(entry.key, key);
+        EXPECT_EQ(entry.value, value) << key;
+        EXPECT_EQ(entry.expire_at, expire_at) << key;
+    }
+    EXPECT_EQ(reader.next(entry).value(), RdbEvent::End);
+}
+
+TEST(RdbReaderTest, Collections)
+{
+    RdbBuilder rdb;
+    rdb.byte(rdb::TYPE_LIST).string("list").length(2).string("a").byte(0xC0).byte(1);
+    rdb.byte(rdb::TYPE_SET).string("set").length(1).string("member");
+    rdb.byte(rdb::TYPE_ZSET).string("zset").length(2).string("a").string("1.5").string("b").byte(254);
+    rdb.byte(rdb::TYPE_ZSET_2).string("zset2").length(1).string("a").le<double>(2.5);
+    rdb.byte(rdb::TYPE_HASH).string("hash").length(1).string("field").string("value");
+    rdb.byte(rdb::TYPE_HASH_LISTPACK).string("listpack").string("opaque listpack bytes");
+    rdb.byte(rdb::TYPE_SET_INTSET).string("intset").byte(0xC3).length(2).length(3).out.append("zz");
+    rdb.byte(rdb::TYPE_LIST_QUICKLIST_2).string("quicklist").length(2).length(2).string("node").length(1).string("n");
+    rdb.set("string", "value").end();
+
+    RdbReader reader(rdb.out);
+    ASSERT_FALSE(reader.read_header().is_error());
+    RdbEntry entry;
+    for (const std::string key: {"list", "set", "zset", "zset2", "hash", "listpack", "intset", "quicklist"})
+    {
+        const auto event = reader.next(entry);
+        ASSERT_FALSE(event.is_error()) << key << ": " << event.error();
+        EXPECT_EQ(entry.key, key);
+        EXPECT_NE(entry.type, rdb::TYPE_STRING);
+        EXPECT_TRUE(entry.value.empty());
+    }
+    ASSERT_EQ(reader.next(entry).value(), RdbEvent::Key);
+    EXPECT_EQ(entry.value, "value") << "the collections were skipped exactly";
+    EXPECT_EQ(reader.next(entry).value(), RdbEvent::End);
+}
+
+TEST(RdbReaderTest, Errors)
+{
+    RdbBuilder rdb;
+    rdb.set("key", "value");
+    for (size_t size = rdb.out.size() - 1; size > 9; --size)
+    {
+        RdbReader reader(std::string_view(rdb.out).substr(0, size));
+        ASSERT_FALSE(reader.read_header().is_error());
+        RdbEntry entry;
+        EXPECT_EQ(reader.next(entry).error(), RedisError::rdb_corrupted) << "truncated at " << size;
+    }
+
+    RdbBuilder stream;
+    stream.byte(15).string("stream").string("whatever");
+    RdbReader reader(stream.out);
+    ASSERT_FALSE(reader.read_header().is_error());
+    RdbEntry entry;
+    EXPECT_EQ(reader.next(entry).error(), RedisError::rdb_unsupported);
+
+    RdbBuilder lzf;
+    lzf.byte(rdb::TYPE_STRING).string("k").byte(0xC3).length(4).length(12).out.append("\x02" "abc", 4);
+    RdbReader bad(lzf.out);
+    ASSERT_FALSE(bad.read_header().is_error());
+    EXPECT_EQ(bad.next(entry).error(), RedisError::rdb_corrupted) << "the decompressed size does not match";
+
+    RdbBuilder huge;
+    huge.byte(rdb::TYPE_STRING).string("k").length(Value::MAX_SIZE + 1).out.append("value");
+    RdbReader oversized(huge.out);
+    ASSERT_FALSE(oversized.read_header().is_error());
+    EXPECT_EQ(oversized.next(entry).error(), RedisError::rdb_corrupted) << "a string larger than a value";
+}
+
+TEST(RdbReaderTest, Checksum)
+{
+    EXPECT_EQ(crc64(0, "123456789"sv), 0xe9c6d914c4b8d9caULL);
+    EXPECT_EQ(crc64(crc64(0, "1234"sv), "56789"sv), crc64(0, "123456789"sv)) << "the checksum can be extended";
+
+    RdbEntry entry;
+    auto corrupted = EMPTY_DUMP;
+    corrupted[20] ^= 1;
+    RdbReader reader(corrupted);
+    ASSERT_FALSE(reader.read_header().is_error());
+    EXPECT_EQ(reader.next(entry).error(), RedisError::rdb_corrupted) << "a flipped bit is detected";
+
+    RdbBuilder disabled;
+    disabled.set("key", "value").byte(rdb::OPCODE_EOF).out.append(8, '\0');
+    RdbReader unchecked(disabled.out);
+    ASSERT_FALSE(unchecked.read_header().is_error());
+    EXPECT_EQ(unchecked.next(entry).value(), RdbEvent::Key);
+    EXPECT_EQ(unchecked.next(entry).value(), RdbEvent::End) << "a checksum of 0 is not verified";
+
+    RdbBuilder old;
+    old.out = "REDIS0004";
+    old.set("key", "value").byte(rdb::OPCODE_EOF);
+    RdbReader legacy(old.out);
+    ASSERT_FALSE(legacy.read_header().is_error());
+    EXPECT_EQ(legacy.next(entry).value(), RdbEvent::Key);
+    EXPECT_EQ(legacy.next(entry).value(), RdbEvent::End) << "version 4 files have no checksum";
+}
+
+TEST(RdbLoadTest, LoadIntoShards)
+{
+    RdbBuilder rdb;
+    rdb.byte(rdb::OPCODE_AUX).string("redis-ver").string("7.4.0");
+    rdb.byte(rdb::OPCODE_SELECTDB).length(0).byte(rdb::OPCODE_RESIZEDB).length(10003).length(1);
+    for (int i = 0; i < 10'000; ++i)
+    {
+        rdb.set("key:" + std::to_string(i), "value:" + std::to_string(i));
+    }
+    const auto future = unix_time_ms() + 60'000;
+    rdb.byte(rdb::OPCODE_EXPIRETIME_MS).le<int64_t>(future).set("volatile", "v");
+    rdb.byte(rdb::OPCODE_EXPIRETIME_MS).le<int64_t>(unix_time_ms() - 1).set("expired", "v");
+    rdb.byte(rdb::TYPE_SET).string("set").length(1).string("member");
+    rdb.byte(rdb::OPCODE_SELECTDB).length(1).set("other db", "v");
+    rdb.end();
+    const auto path = write_file("rdb_test_load.rdb", rdb.out);
+
+    Keyspace keyspace(4);
+    const auto stats = load_rdb(path, keyspace);
+    ASSERT_FALSE(stats.is_error()) << stats.error();
+    EXPECT_EQ(stats.value().keys, 10'001);
+    EXPECT_EQ(stats.value().expired, 1);
+    EXPECT_EQ(stats.value().skipped, 2);
+    EXPECT_EQ(stats.value().bytes, rdb.out.size());
+    EXPECT_EQ(keyspace.stats().keys, 10'001);
+    EXPECT_EQ(value_of(keyspace, "key:0"), "value:0");
+    EXPECT_EQ(value_of(keyspace, "key:9999"), "value:9999");
+    EXPECT_EQ(value_of(keyspace, "expired"), "(nil)");
+    EXPECT_EQ(keyspace.with_key("volatile", [](Shard& shard) { return shard.expire_time("volatile"); }), future);
+    std::filesystem::remove(path);
+}
+
+TEST(RdbLoadTest, Failures)
+{
+    Keyspace keyspace(2);
+    EXPECT_EQ(load_rdb("/nonexistent/dump.rdb", keyspace).error(), RedisError::eof);
+    EXPECT_EQ(errno, ENOENT);
+
+    const auto empty = write_file("rdb_test_empty.rdb", EMPTY_DUMP);
+    const auto stats = load_rdb(empty, keyspace);
+    ASSERT_FALSE(stats.is_error());
+    EXPECT_EQ(stats.value().keys, 0);
+    std::filesystem::remove(empty);
+
+    RdbBuilder rdb;
+    rdb.set("kept", "v").set("truncated", "value");
+    rdb.out.resize(rdb.out.size() - 2);
+    const auto truncated = write_file("rdb_test_truncated.rdb", rdb.out);
+    EXPECT_EQ(load_rdb(truncated, keyspace).error(), RedisError::rdb_corrupted);
+    EXPECT_EQ(value_of(keyspace, "kept"), "v") << "the keys read before the error are loaded";
+    std::filesystem::remove(truncated);
+}
+
+TEST(RdbWriterTest, RoundTrip)
+{
+    std::string out;
+    RdbWriter writer(out);
+    writer.write_header(unix_time_ms(), 1024);
+    writer.select_db(0, 5, 1);
+    const auto long_value = std::string(20'000, 'x');
+    writer.write_string("small", "value", NO_EXPIRY);
+    writer.write_string("int8", "-12", NO_EXPIRY);
+    writer.write_string("int32", "2147483647", 1'700'000'000'000);
+    writer.write_string("not canonical", "007", NO_EXPIRY);
+    writer.write_string("long", long_value, NO_EXPIRY);
+    writer.write_end();
+    writer.write_checksum(crc64(0, out));
+    EXPECT_NE(out.find("\xfe\x00\xfb\x05\x01"sv), std::string::npos) << "database 0 of 5 keys, 1 volatile";
+    EXPECT_NE(out.find("\x04int8\xc0\xf4"sv), std::string::npos) << "integers are encoded";
+
+    RdbReader reader(out);
+    ASSERT_EQ(reader.read_header().value(), rdb::VERSION);
+    RdbEntry entry;
+    ASSERT_EQ(reader.next(entry).value(), RdbEvent::ResizeDb);
+    EXPECT_EQ(entry.db_size, 5);
+    const std::pair<std::string_view, std::string_view> expected[] = {
+            {"small", "value"}, {"int8", "-12"}, {"int32", "2147483647"}, {"not canonical", "007"}, {"long", long_value}};
+    for (const auto& [key, value]: expected)
+    {
+        ASSERT_EQ(reader.next(entry).value(), RdbEvent::Key);
+        EXPECT_EQ(entry.key, key);
+        EXPECT_EQ(entry.value, value);
+        EXPECT_EQ(entry.expire_at, key == "int32" ? 1'700'000'000'000 : NO_EXPIRY);
+    }
+    EXPECT_EQ(reader.next(entry).value(), RdbEvent::End) << "the checksum matches";
+    EXPECT_EQ(reader.offset(), out.size());
+}
+
+TEST(RdbSaveTest, SaveAndLoad)
+{
+    Keyspace keyspace(4);
+    const auto later = unix_time_ms() + 60'000;
+    for (int i = 0; i < 10'000; ++i)
+    {
+        const auto key = "key:" + std::to_string(i);
+        keyspace.with_key(key,
+                          [&](Shard& shard)
+                          { shard.set(key, std::string_view("value:" + std::to_string(i)), i % 7 == 0 ? later : -1); });
+    }
+    keyspace.with_key("counter", [](Shard& shard) { return shard.incr_by("counter", 42); });
+    const auto path = (std::filesystem::temp_directory_path() / "rdb_test_save.rdb").string();
+
+    SaveProgress progress;
+    const auto saved = save_rdb(path, keyspace, &progress);
+    ASSERT_FALSE(saved.is_error()) << saved.error();
+    EXPECT_EQ(saved.value().keys, 10'001);
+    EXPECT_EQ(saved.value().bytes, std::filesystem::file_size(path));
+    EXPECT_EQ(progress.keys_processed, 10'001);
+    EXPECT_EQ(progress.keys_total, 10'001);
+    EXPECT_FALSE(std::filesystem::exists(path + ".tmp"));
+
+    Keyspace loaded(3);
+    const auto stats = load_rdb(path, loaded);
+    ASSERT_FALSE(stats.is_error()) << stats.error();
+    EXPECT_EQ(stats.value().keys, 10'001);
+    EXPECT_EQ(value_of(loaded, "key:1"), "value:1");
+    EXPECT_EQ(value_of(loaded, "key:9999"), "value:9999");
+    EXPECT_EQ(value_of(loaded, "counter"), "42");
+    EXPECT_EQ(loaded.with_key("key:7", [](Shard& shard) { return shard.expire_time("key:7"); }), later);
+    EXPECT_EQ(loaded.stats().volatile_keys, keyspace.stats().volatile_keys);
+    std::filesystem::remove(path);
+
+    EXPECT_EQ(save_rdb("/nonexistent/dump.rdb", keyspace).error(), RedisError::io_error);
+    EXPECT_EQ(errno, ENOENT);
+}
@@ -0,0 +1,156 @@
+#include "storage/dict.h"
+
+#include <gtest/gtest.h>
+#include <set>
+#include <string>
+
+using namespace redis;
+
+std::string key_of(const int i) { return "key:" + std::to_string(i); }
+
+TEST(DictTest, InsertFindErase)
+{
+    Dict<int> dict;
+    EXPECT_EQ(dict.find("a"), nullptr);
+    auto [value, inserted] = dict.try_emplace("a");
+    ASSERT_TRUE(inserted);
+    *value = 1;
+    auto [again, inserted_again] = dict.try_emplace("a");
+    EXPECT_FALSE(inserted_again);
+    EXPECT_EQ(*again, 1);
+    EXPECT_EQ(dict.size(), 1);
+
+    EXPECT_TRUE(dict.erase("a"));
+    EXPECT_FALSE(dict.erase("a"));
+    EXPECT_EQ(dict.find("a"), nullptr);
+    EXPECT_TRUE(dict.empty());
+}
+
+TEST(DictTest, GrowsIncrementally)
+{
+    Dict<int> dict;
+    bool seen_rehash = false;
+    for (int i = 0; i < 10'000; ++i)
+    {
+        *dict.try_emplace(key_of(i)).first = i;
+        seen_rehash |= dict.rehashing();
+        // keys must stay reachable while they are moved between the tables
+        ASSERT_NE(dict.find(key_of(i / 2)), nullptr) << i;
+    }
+    EXPECT_TRUE(seen_rehash) << "growing moves entries over several operations";
+    EXPECT_EQ(dict.size(), 10'000);
+    for (int i = 0; i < 10'000; ++i)
+    {
+        const auto* value = dict.find(key_of(i));
+        ASSERT_NE(value, nullptr);
+        EXPECT_EQ(*value, i);
+    }
+}
+
+TEST(DictTest, Reserve)
+{
+    Dict<int> dict;
+    dict.reserve(10'000);
+    const auto capacity = dict.capacity();
+    EXPECT_GE(capacity, 10'000);
+    for (int i = 0; i < 10'000; ++i)
+    {
+        *dict.try_emplace(key_of(i)).first = i;
+    }
+    EXPECT_EQ(dict.capacity(), capacity) << "no resize while inserting what was reserved";
+    EXPECT_FALSE(dict.rehashing());
+
+    dict.reserve(100'000);
+    EXPECT_TRUE(dict.rehashing()) << "a table in use is grown incrementally";
+    for (int i = 0; i < 10'000; ++i)
+    {
+        ASSERT_NE(dict.find(key_of(i)), nullptr);
+    }
+}
+
+TEST(DictTest, ShrinksAndReusesTombstones)
+{
+    Dict<int> dict;
+    for (int round = 0; round < 20; ++round)
+    {
+        for (int i = 0; i < 1000; ++i)
+        {
+            dict.try_emplace(key_of(round * 1000 + i));
+        }
+        for (int i = 0; i < 1000; ++i)
+        {
+            ASSERT_TRUE(dict.erase(key_of(round * 1000 + i)));
+        }
+    }
+    EXPECT_TRUE(dict.empty());
+    dict.rehash(SIZE_MAX);
+    EXPECT_LE(dict.capacity(), 64) << "an empty dictionary gives its memory back";
+}
+
+TEST(DictTest, ScanVisitsEverything)
+{
+    Dict<int> dict;
+    for (int i = 0; i < 5000; ++i)
+    {
+        dict.try_emplace(key_of(i));
+    }
+    std::set<std::string> seen;
+    uint64_t cursor = 0;
+    do
+    {
+        cursor = dict.scan(cursor, [&](const std::string& key, int&) { seen.insert(key); });
+    }
+    while (cursor != 0);
+    EXPECT_EQ(seen.size(), 5000);
+}
+
+TEST(DictTest, ScanSurvivesResizes)
+{
+    Dict<int> dict;
+    for (int i = 0; i < 1000; ++i)
+    {
+        dict.try_emplace(key_of(i));
+    }
+    std::set<std::string> seen;
+    uint64_t cursor = 0;
+    int next = 1000;
+    do
+    {
+        cursor = dict.scan(cursor, [&](const std::string& key, int&) { seen.insert(key); });
+        // grow the table between the calls, the original keys must still all be returned
+        for (int i = 0; i < 50; ++i)
+        {
+            dict.try_emplace(key_of(next++));
+        }
+    }
+    while (cursor != 0);
+    for (int i = 0; i < 1000; ++i)
+    {
+        EXPECT_TRUE(seen.contains(key_of(i))) << key_of(i);
+    }
+}
+
+TEST(DictTest, Scanned)
+{
+    Dict<int> dict;
+    for (int i = 0; i < 1000; ++i)
+    {
+        dict.try_emplace(key_of(i));
+    }
+    EXPECT_FALSE(Dict<int>::scanned(key_of(0), 0)) << "nothing is scanned before the iteration starts";
+    std::set<std::string> seen;
+    uint64_t cursor = 0;
+    int next = 1000;
+    while ((cursor = dict.scan(cursor, [&](const std::string& key, int&) { seen.insert(key); })) != 0)
+    {
+        // the keys returned so far are exactly the scanned ones, across resizes
+        for (int i = 0; i < 1000; ++i)
+        {
+            ASSERT_EQ(Dict<int>::scanned(key_of(i), cursor), seen.contains(key_of(i))) << key_of(i);
+        }
+        for (int i = 0; i < 50; ++i)
+        {
+            dict.try_emplace(key_of(next++));
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#include "storage/eviction.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+using namespace redis;
+
+TEST(EvictionTest, PolicyNames)
+{
+    for (const auto name: {"noeviction", "allkeys-lru", "allkeys-lfu", "allkeys-random", "volatile-lru",
+                           "volatile-ttl"})
+    {
+        const auto policy = parse_eviction_policy(name);
+        ASSERT_TRUE(policy.has_value()) << name;
+        EXPECT_EQ(to_string(*policy), name);
+    }
+    EXPECT_FALSE(parse_eviction_policy("allkeys").has_value());
+    EXPECT_FALSE(parse_eviction_policy("").has_value());
+}
+
+TEST(EvictionTest, LruIdle)
+{
+    const int64_t now = 1'000'000'000'000;
+    EXPECT_EQ(eviction::lru_idle(eviction::lru_clock(now), now), 0);
+    EXPECT_EQ(eviction::lru_idle(eviction::lru_clock(now - 30'000), now), 30);
+
+    // the clock wraps, an access just before must still look recent
+    const int64_t wrap = (static_cast<int64_t>(eviction::LRU_CLOCK_MAX) + 1) * 1000;
+    EXPECT_EQ(eviction::lru_clock(wrap), 0);
+    EXPECT_LT(eviction::lru_idle(eviction::lru_clock(wrap - 2'000), wrap + 1'000), 5);
+}
+
+TEST(EvictionTest, LfuCounter)
+{
+    const int64_t now = 1'000'000'000'000;
+    auto meta = eviction::lfu_new(now);
+    EXPECT_EQ(eviction::lfu_counter(meta, now), eviction::LFU_INIT_VAL);
+
+    // a random number of 0 always increments
+    meta = eviction::lfu_touch(meta, now, 0);
+    EXPECT_EQ(eviction::lfu_counter(meta, now), eviction::LFU_INIT_VAL + 1);
+    // and one of UINT64_MAX never does past the initial value
+    EXPECT_EQ(eviction::lfu_counter(eviction::lfu_touch(meta, now, UINT64_MAX), now), eviction::LFU_INIT_VAL + 1);
+
+    // decremented once per minute of idleness
+    EXPECT_EQ(eviction::lfu_counter(meta, now + 3 * 60'000), eviction::LFU_INIT_VAL - 2);
+    EXPECT_EQ(eviction::lfu_counter(meta, now + 60 * 60'000), 0);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        meta = eviction::lfu_touch(meta, now, 0);
+    }
+    EXPECT_EQ(eviction::lfu_counter(meta, now), 255) << "the counter saturates";
+}
+
+TEST(EvictionTest, PoolKeepsBestCandidates)
+{
+    SlabAllocator slab;
+    const SlabAllocator::Scope scope(slab);
+    EvictionPool pool;
+    SlabString key;
+    EXPECT_FALSE(pool.pop(key));
+
+    for (uint64_t score = 0; score < 2 * EvictionPool::SIZE; ++score)
+    {
+        pool.offer("key:" + std::to_string(score), score);
+    }
+    pool.offer("key:31", 31);
+    pool.offer("worse", 0);
+
+    for (uint64_t score = 2 * EvictionPool::SIZE; score-- > EvictionPool::SIZE;)
+    {
+        ASSERT_TRUE(pool.pop(key));
+        EXPECT_EQ(std::string_view(key), "key:" + std::to_string(score)) << "the best candidate comes first, once";
+    }
+    EXPECT_TRUE(pool.empty());
+
+    pool.offer("a", 1);
+    pool.clear();
+    EXPECT_FALSE(pool.pop(key));
+}
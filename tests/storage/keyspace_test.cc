@@ -0,0 +1,345 @@
+#include "storage/keyspace.h"
+
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+
+using namespace redis;
+
+std::string value_of(const Value* value)
+{
+    Value::IntText scratch;
+    return std::string(value->str(scratch));
+}
+
+TEST(ShardTest, SetGetDel)
+{
+    Shard shard;
+    EXPECT_EQ(shard.get("k"), nullptr);
+    shard.set("k", std::string_view("v1"));
+    ASSERT_NE(shard.get("k"), nullptr);
+    EXPECT_EQ(value_of(shard.get("k")), "v1");
+
+    shard.set("k", std::string_view("value2"));
+    EXPECT_EQ(value_of(shard.get("k")), "value2") << "set overwrites";
+    EXPECT_EQ(shard.size(), 1);
+
+    EXPECT_TRUE(shard.del("k"));
+    EXPECT_FALSE(shard.del("k"));
+    EXPECT_EQ(shard.get("k"), nullptr);
+}
+
+TEST(ShardTest, Expire)
+{
+    Shard shard;
+    EXPECT_FALSE(shard.expire("k", unix_time_ms() + 10'000)) << "a missing key has no ttl";
+
+    shard.set("k", std::string_view("v"));
+    EXPECT_TRUE(shard.expire("k", unix_time_ms() + 10'000));
+    EXPECT_NE(shard.get("k"), nullptr);
+
+    EXPECT_TRUE(shard.expire("k", unix_time_ms() - 1));
+    EXPECT_EQ(shard.get("k"), nullptr) << "an expiry time in the past deletes the key";
+    EXPECT_EQ(shard.size(), 0);
+}
+
+TEST(ShardTest, TimeToLive)
+{
+    Shard shard;
+    EXPECT_EQ(shard.expire_time("k"), std::nullopt);
+    const auto at = unix_time_ms() + 10'000;
+    shard.set("k", std::string_view("v"), at);
+    EXPECT_EQ(shard.expire_time("k"), at);
+    EXPECT_EQ(shard.stats().volatile_keys, 1);
+
+    EXPECT_TRUE(shard.persist("k"));
+    EXPECT_FALSE(shard.persist("k"));
+    EXPECT_EQ(shard.expire_time("k"), NO_EXPIRY);
+    EXPECT_EQ(shard.stats().volatile_keys, 0);
+
+    shard.expire("k", at);
+    shard.set("k", std::string_view("w"));
+    EXPECT_EQ(shard.expire_time("k"), NO_EXPIRY) << "set discards the time to live";
+    EXPECT_EQ(shard.stats().volatile_keys, 0);
+}
+
+TEST(ShardTest, IncrBy)
+{
+    Shard shard;
+    EXPECT_EQ(shard.incr_by("counter", 1).value(), 1) << "a missing key counts as 0";
+    EXPECT_EQ(shard.incr_by("counter", 41).value(), 42);
+    EXPECT_EQ(shard.incr_by("counter", -50).value(), -8);
+    EXPECT_EQ(value_of(shard.get("counter")), "-8");
+
+    shard.set("k", std::string_view("10"), unix_time_ms() + 10'000);
+    EXPECT_EQ(shard.incr_by("k", 5).value(), 15);
+    EXPECT_NE(shard.expire_time("k"), NO_EXPIRY) << "incr keeps the time to live";
+
+    shard.set("k", std::string_view("ten"));
+    EXPECT_EQ(shard.incr_by("k", 1).error(), RedisError::not_integer);
+    shard.set("k", std::string_view("010"));
+    EXPECT_EQ(shard.incr_by("k", 1).error(), RedisError::not_integer) << "only canonical integers are numbers";
+
+    shard.set("k", std::string_view("9223372036854775807"));
+    EXPECT_EQ(shard.incr_by("k", 1).error(), RedisError::integer_overflow);
+    EXPECT_EQ(value_of(shard.get("k")), "9223372036854775807") << "a failed incr leaves the value alone";
+}
+
+TEST(ShardTest, MemoryAccounting)
+{
+    Shard shard;
+    EXPECT_EQ(shard.stats().memory.used, 0);
+    shard.set("small", std::string_view("v"));
+    const auto table = shard.stats().memory.used;
+    EXPECT_GT(table, 0) << "the table is allocated from the slab";
+
+    const std::string value(3000, 'x');
+    shard.set("a key longer than the small string buffer", value, unix_time_ms() + 10'000);
+    const auto memory = shard.stats().memory;
+    EXPECT_GE(memory.used, table + value.size() + 40) << "keys, values and timers are accounted";
+    EXPECT_GE(memory.resident, memory.allocated);
+    EXPECT_EQ(memory.classes[SlabAllocator::class_of(value.size())].objects, 1);
+
+    shard.del("a key longer than the small string buffer");
+    EXPECT_LT(shard.stats().memory.used, table + value.size());
+}
+
+TEST(ShardTest, ActiveExpire)
+{
+    Shard shard;
+    const auto now = unix_time_ms();
+    for (int i = 0; i < 100; ++i)
+    {
+        shard.set("short:" + std::to_string(i), std::string_view("v"), now + 50);
+        shard.set("long:" + std::to_string(i), std::string_view("v"), now + 60'000);
+    }
+    // extended after its timer was filed, it must survive the first deadline
+    shard.expire("short:0", now + 60'000);
+    shard.set("plain", std::string_view("v"));
+
+    EXPECT_TRUE(shard.active_expire(now + 10, 1'000'000));
+    EXPECT_EQ(shard.size(), 201);
+
+    EXPECT_TRUE(shard.active_expire(now + 100, 1'000'000));
+    EXPECT_EQ(shard.size(), 102) << "the keys are removed without being accessed";
+    EXPECT_EQ(shard.stats().expired_keys, 99);
+    EXPECT_EQ(shard.stats().volatile_keys, 101);
+    EXPECT_NE(shard.get("short:0"), nullptr);
+
+    EXPECT_TRUE(shard.active_expire(now + 60'000, 1'000'000));
+    EXPECT_EQ(shard.size(), 1);
+    EXPECT_EQ(shard.stats().volatile_keys, 0);
+}
+
+TEST(ShardTest, NoEviction)
+{
+    Shard shard;
+    EXPECT_TRUE(shard.make_room()) << "no limit by default";
+    shard.set("k", std::string(1000, 'x'));
+    shard.set_maxmemory(100, EvictionPolicy::NoEviction);
+    EXPECT_FALSE(shard.make_room()) << "over the limit, writes are refused";
+    EXPECT_EQ(shard.size(), 1);
+    EXPECT_EQ(shard.stats().evicted_keys, 0);
+}
+
+TEST(ShardTest, EvictionKeepsMemoryBounded)
+{
+    for (const auto policy: {EvictionPolicy::AllKeysLru, EvictionPolicy::AllKeysLfu, EvictionPolicy::AllKeysRandom})
+    {
+        Shard shard;
+        constexpr size_t limit = 256 * 1024;
+        shard.set_maxmemory(limit, policy);
+        for (int i = 0; i < 5000; ++i)
+        {
+            ASSERT_TRUE(shard.make_room()) << to_string(policy);
+            shard.set("key:" + std::to_string(i), std::string(100, 'x'));
+        }
+        EXPECT_LT(shard.stats().memory.used, limit + limit / 4) << to_string(policy);
+        EXPECT_GT(shard.stats().evicted_keys, 0) << to_string(policy);
+        EXPECT_EQ(shard.stats().evicted_keys + shard.size(), 5000) << to_string(policy);
+    }
+}
+
+TEST(ShardTest, EvictionFollowsPolicy)
+{
+    const auto now = unix_time_ms();
+    Shard shard;
+    shard.set_maxmemory(1, EvictionPolicy::VolatileTtl);
+    shard.set("persistent", std::string_view("v"));
+    for (int i = 0; i < 100; ++i)
+    {
+        shard.set("volatile:" + std::to_string(i), std::string_view("v"), now + 60'000 + i * 1000);
+    }
+    EXPECT_TRUE(shard.make_room());
+    EXPECT_EQ(shard.stats().evicted_keys, Shard::EVICTION_BATCH);
+    EXPECT_NE(shard.get("persistent"), nullptr) << "only keys with a time to live are evicted";
+    EXPECT_NE(shard.get("volatile:99"), nullptr) << "the keys expiring the soonest go first";
+    EXPECT_TRUE(shard.make_room());
+    EXPECT_FALSE(shard.make_room()) << "no volatile key is left";
+    EXPECT_EQ(shard.size(), 1);
+
+    Shard lfu;
+    lfu.set_maxmemory(0, EvictionPolicy::AllKeysLfu);
+    for (int i = 0; i < 200; ++i)
+    {
+        lfu.set("cold:" + std::to_string(i), std::string_view("v"));
+    }
+    lfu.set("hot", std::string_view("v"));
+    for (int i = 0; i < 100; ++i)
+    {
+        ASSERT_NE(lfu.get("hot"), nullptr);
+    }
+    lfu.set_maxmemory(1, EvictionPolicy::AllKeysLfu);
+    EXPECT_TRUE(lfu.make_room());
+    EXPECT_TRUE(lfu.make_room());
+    EXPECT_EQ(lfu.stats().evicted_keys, 2 * Shard::EVICTION_BATCH);
+    EXPECT_NE(lfu.get("hot"), nullptr) << "frequently used keys are kept";
+}
+
+TEST(ShardTest, LfuKeepsCounterOfOverwrittenKeys)
+{
+    Shard shard;
+    shard.set_maxmemory(0, EvictionPolicy::AllKeysLfu);
+    for (int i = 0; i < 200; ++i)
+    {
+        shard.set("cold:" + std::to_string(i), std::string_view("v"));
+    }
+    shard.set("hot", std::string_view("v"));
+    ASSERT_FALSE(shard.incr_by("counter", 1).is_error());
+    for (int i = 0; i < 100; ++i)
+    {
+        ASSERT_NE(shard.get("hot"), nullptr);
+        ASSERT_NE(shard.get("counter"), nullptr);
+    }
+    // like Redis, a write to an existing key is one more access, not a new key
+    shard.set("hot", std::string_view("overwritten"));
+    ASSERT_FALSE(shard.incr_by("counter", 1).is_error());
+    shard.set_maxmemory(1, EvictionPolicy::AllKeysLfu);
+    while (shard.size() > 10)
+    {
+        ASSERT_TRUE(shard.make_room());
+    }
+    EXPECT_NE(shard.get("hot"), nullptr) << "a hot key survives its overwrite";
+    EXPECT_NE(shard.get("counter"), nullptr) << "a hot counter survives its increment";
+}
+
+TEST(ShardTest, KeyspaceHits)
+{
+    Shard shard;
+    shard.set("k", std::string_view("v"));
+    EXPECT_NE(shard.get("k"), nullptr);
+    EXPECT_EQ(shard.get("missing"), nullptr);
+    EXPECT_EQ(shard.stats().keyspace_hits, 1);
+    EXPECT_EQ(shard.stats().keyspace_misses, 1);
+}
+
+// snapshot reads the whole snapshot of shard in steps of count keys, calling between(step) after each of them
+template<typename F>
+std::map<std::string, std::pair<std::string, int64_t>> snapshot(Shard& shard, const size_t count, F&& between)
+{
+    std::map<std::string, std::pair<std::string, int64_t>> keys;
+    shard.begin_snapshot(unix_time_ms());
+    for (int step = 0;; ++step)
+    {
+        const auto more = shard.snapshot_step(count,
+                                              [&](const std::string_view key, const Value& value, const int64_t at)
+                                              {
+                                                  const auto [it, inserted] =
+                                                          keys.emplace(key, std::pair(value_of(&value), at));
+                                                  EXPECT_TRUE(inserted) << "returned twice: " << key;
+                                              });
+        if (!more)
+        {
+            return keys;
+        }
+        between(step);
+    }
+}
+
+TEST(ShardTest, SnapshotIsPointInTime)
+{
+    Shard shard;
+    std::map<std::string, std::pair<std::string, int64_t>> expected;
+    const auto later = unix_time_ms() + 60'000;
+    for (int i = 0; i < 5000; ++i)
+    {
+        const auto key = "key:" + std::to_string(i);
+        const auto at = i % 10 == 0 ? later : NO_EXPIRY;
+        shard.set(key, std::string_view("value:" + std::to_string(i)), at);
+        expected[key] = {"value:" + std::to_string(i), at};
+    }
+    shard.set("counter", std::string_view("10"));
+    expected["counter"] = {"10", NO_EXPIRY};
+    shard.set("gone", std::string_view("v"), unix_time_ms() - 1);
+
+    const auto keys = snapshot(shard, 100,
+                               [&](const int step)
+                               {
+                                   // overwrite, delete, expire and create keys while the snapshot runs, the inserts
+                                   // and the deletes resize the table
+                                   for (int i = step * 50; i < step * 50 + 50 && i < 5000; ++i)
+                                   {
+                                       const auto key = "key:" + std::to_string(i);
+                                       if (i % 3 == 0)
+                                       {
+                                           shard.del(key);
+                                       }
+                                       else if (i % 3 == 1)
+                                       {
+                                           shard.set(key, std::string_view("changed"));
+                                       }
+                                       else
+                                       {
+                                           shard.expire(key, unix_time_ms() - 1);
+                                       }
+                                       shard.set("new:" + std::to_string(i), std::string_view("new"));
+                                   }
+                                   ASSERT_FALSE(shard.incr_by("counter", 1).is_error());
+                               });
+    EXPECT_EQ(keys, expected) << "the snapshot holds the keys as they were when it began";
+    EXPECT_FALSE(shard.snapshotting());
+    EXPECT_EQ(value_of(shard.get("key:1")), "changed");
+}
+
+TEST(ShardTest, SnapshotCopiesOnlyChangedKeys)
+{
+    Shard shard;
+    for (int i = 0; i < 1000; ++i)
+    {
+        shard.set("key:" + std::to_string(i), std::string(100, 'x'));
+    }
+    const auto before = shard.stats().memory.used;
+    shard.begin_snapshot(unix_time_ms());
+    EXPECT_TRUE(shard.snapshotting());
+    EXPECT_EQ(shard.stats().memory.used, before) << "nothing is copied upfront";
+    shard.set("key:0", std::string_view("changed"));
+    EXPECT_GT(shard.stats().memory.used, before) << "the previous value is kept aside";
+    shard.end_snapshot();
+    EXPECT_FALSE(shard.snapshotting());
+    EXPECT_FALSE(shard.snapshot_step(10, [](std::string_view, const Value&, int64_t) {}));
+
+    const auto keys = snapshot(shard, 7, [](int) {});
+    EXPECT_EQ(keys.size(), 1000);
+    EXPECT_EQ(keys.at("key:0").first, "changed");
+}
+
+TEST(KeyspaceTest, KeysAreSpreadOverShards)
+{
+    Keyspace keyspace(4);
+    ASSERT_EQ(keyspace.shard_count(), 4);
+    std::vector<size_t> counts(4);
+    for (int i = 0; i < 1000; ++i)
+    {
+        const auto key = "key:" + std::to_string(i);
+        const auto index = keyspace.shard_of(key);
+        ASSERT_LT(index, 4);
+        EXPECT_EQ(index, keyspace.shard_of(key)) << "a key always maps to the same shard";
+        keyspace.with_key(key, [&](Shard& shard) { shard.set(key, std::string_view("v")); });
+        ++counts[index];
+    }
+    for (size_t i = 0; i < 4; ++i)
+    {
+        EXPECT_GT(counts[i], 100);
+        EXPECT_EQ(keyspace.run_on(i, [](Shard& shard) { return shard.size(); }), counts[i]);
+    }
+}
@@ -0,0 +1,108 @@
+#include "storage/slab.h"
+
+#include <cstring>
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace redis;
+
+TEST(SlabAllocatorTest, SizeClasses)
+{
+    EXPECT_EQ(SlabAllocator::CLASS_SIZES[SlabAllocator::class_of(1)], 16);
+    EXPECT_EQ(SlabAllocator::CLASS_SIZES[SlabAllocator::class_of(16)], 16);
+    EXPECT_EQ(SlabAllocator::CLASS_SIZES[SlabAllocator::class_of(17)], 32);
+    EXPECT_EQ(SlabAllocator::CLASS_SIZES[SlabAllocator::class_of(129)], 160);
+    EXPECT_EQ(SlabAllocator::CLASS_SIZES[SlabAllocator::class_of(1000)], 1024);
+    EXPECT_EQ(SlabAllocator::class_of(SlabAllocator::MAX_SMALL), SlabAllocator::CLASS_COUNT - 1);
+    for (size_t size = 1; size <= SlabAllocator::MAX_SMALL; ++size)
+    {
+        const auto size_class = SlabAllocator::class_of(size);
+        ASSERT_GE(SlabAllocator::CLASS_SIZES[size_class], size);
+        ASSERT_TRUE(size_class == 0 || SlabAllocator::CLASS_SIZES[size_class - 1] < size) << size;
+    }
+}
+
+TEST(SlabAllocatorTest, ExactAccounting)
+{
+    SlabAllocator slab;
+    std::vector<std::pair<void*, size_t>> blocks;
+    size_t used = 0;
+    for (size_t size: {1, 7, 16, 100, 1000, 5000, 16384, 20000, 1 << 20})
+    {
+        auto* block = slab.allocate(size);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(block) % SlabAllocator::ALIGNMENT, 0) << size;
+        // blocks must not overlap
+        std::memset(block, static_cast<int>(size & 0xFF), size);
+        blocks.emplace_back(block, size);
+        used += size;
+    }
+    EXPECT_EQ(slab.stats().used, used);
+    EXPECT_GE(slab.stats().allocated, used);
+    EXPECT_GE(slab.stats().resident, slab.stats().allocated);
+    EXPECT_EQ(slab.stats().classes[SlabAllocator::class_of(100)].objects, 1);
+    for (const auto& [block, size]: blocks)
+    {
+        EXPECT_EQ(*static_cast<unsigned char*>(block), size & 0xFF) << size;
+        SlabAllocator::deallocate(block, size);
+    }
+    EXPECT_EQ(slab.stats().used, 0);
+    EXPECT_EQ(slab.stats().allocated, 0);
+    EXPECT_EQ(slab.stats().resident, SlabAllocator::ARENA_SIZE) << "the last arena is kept";
+}
+
+TEST(SlabAllocatorTest, PagesAndArenasAreReleased)
+{
+    SlabAllocator slab;
+    std::vector<void*> blocks;
+    // about 4 arenas worth of 1 KiB blocks
+    for (size_t i = 0; i < 8000; ++i)
+    {
+        blocks.push_back(slab.allocate(1024));
+    }
+    const auto& stats = slab.stats();
+    EXPECT_GE(stats.resident, 4 * SlabAllocator::ARENA_SIZE);
+    const auto& klass = stats.classes[SlabAllocator::class_of(1024)];
+    EXPECT_EQ(klass.objects, 8000);
+    EXPECT_GE(klass.slots, 8000);
+
+    // freed blocks are reused before any new page
+    SlabAllocator::deallocate(blocks[10], 1024);
+    EXPECT_EQ(slab.allocate(1024), blocks[10]);
+
+    for (auto* block: blocks)
+    {
+        SlabAllocator::deallocate(block, 1024);
+    }
+    EXPECT_EQ(klass.objects, 0);
+    EXPECT_EQ(klass.slots, 0) << "empty pages go back to the allocator";
+    EXPECT_EQ(stats.resident, SlabAllocator::ARENA_SIZE) << "empty arenas are unmapped";
+
+    // the pages of a class can be reused by another one
+    auto* block = slab.allocate(48);
+    EXPECT_EQ(stats.resident, SlabAllocator::ARENA_SIZE);
+    SlabAllocator::deallocate(block, 48);
+}
+
+TEST(SlabAllocatorTest, StdAllocator)
+{
+    SlabAllocator slab;
+    SlabAllocator other;
+    {
+        const SlabAllocator::Scope scope(slab);
+        std::vector<int, SlabStdAllocator<int>> numbers;
+        for (int i = 0; i < 10'000; ++i)
+        {
+            numbers.push_back(i);
+        }
+        SlabString text(100, 'x');
+        EXPECT_EQ(slab.stats().used, numbers.capacity() * sizeof(int) + text.capacity() + 1);
+        {
+            // blocks go back to their own allocator, whatever the current one
+            const SlabAllocator::Scope nested(other);
+            decltype(numbers)().swap(numbers);
+            SlabString().swap(text);
+        }
+        EXPECT_EQ(slab.stats().used, 0);
+        EXPECT_EQ(other.stats().used, 0);
+    }
+}
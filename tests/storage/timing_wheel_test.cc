@@ -0,0 +1,95 @@
+#include "storage/timing_wheel.h"
+
+#include <gtest/gtest.h>
+#include <map>
+
+using namespace redis;
+
+// timers are allocated from the current slab allocator, like in a shard
+class TimingWheelTest : public testing::Test
+{
+protected:
+    SlabAllocator slab_;
+    SlabAllocator::Scope scope_{slab_};
+};
+
+std::vector<TimingWheel::Timer> advance(TimingWheel& wheel, const int64_t now)
+{
+    std::vector<TimingWheel::Timer> fired;
+    EXPECT_TRUE(wheel.advance(now, [&](TimingWheel::Timer& timer) { fired.push_back(std::move(timer)); },
+                              [] { return false; }));
+    return fired;
+}
+
+TEST_F(TimingWheelTest, FiresAtDeadline)
+{
+    TimingWheel wheel(1000);
+    wheel.add("a", 1005);
+    wheel.add("b", 1003);
+    EXPECT_EQ(wheel.size(), 2);
+    EXPECT_TRUE(advance(wheel, 1002).empty());
+    auto fired = advance(wheel, 1004);
+    ASSERT_EQ(fired.size(), 1);
+    EXPECT_EQ(fired[0].key, "b");
+    fired = advance(wheel, 1005);
+    ASSERT_EQ(fired.size(), 1);
+    EXPECT_EQ(fired[0].key, "a");
+    EXPECT_EQ(wheel.size(), 0);
+}
+
+TEST_F(TimingWheelTest, ElapsedDeadlineFiresNext)
+{
+    TimingWheel wheel(1000);
+    advance(wheel, 2000);
+    wheel.add("late", 1500);
+    const auto fired = advance(wheel, 2001);
+    ASSERT_EQ(fired.size(), 1);
+    EXPECT_EQ(fired[0].at, 1500) << "the original deadline is kept";
+}
+
+TEST_F(TimingWheelTest, CascadesFarDeadlines)
+{
+    // deadlines spread over several levels must all fire on time, in one advance or in small steps
+    const int64_t start = 1'700'000'000'123;
+    TimingWheel wheel(start);
+    std::multimap<int64_t, std::string> expected;
+    int64_t delta = 1;
+    for (int i = 0; i < 40; ++i)
+    {
+        delta = delta * 3 / 2 + 7;
+        expected.emplace(start + delta, std::to_string(i));
+        wheel.add(std::to_string(i), start + delta);
+    }
+    int64_t now = start;
+    for (const auto& [at, key]: expected)
+    {
+        if (at - now > 100'000)
+        {
+            // jump close to the deadline, like an idle server would
+            EXPECT_TRUE(advance(wheel, at - 2).empty()) << key;
+        }
+        now = at;
+        const auto fired = advance(wheel, at);
+        ASSERT_FALSE(fired.empty()) << key;
+        for (const auto& timer: fired)
+        {
+            EXPECT_EQ(timer.at, at);
+        }
+    }
+    EXPECT_EQ(wheel.size(), 0);
+}
+
+TEST_F(TimingWheelTest, StopsWhenOutOfBudget)
+{
+    TimingWheel wheel(0);
+    for (int i = 0; i < 10; ++i)
+    {
+        wheel.add(std::to_string(i), 5);
+    }
+    int calls = 0;
+    int fired = 0;
+    EXPECT_FALSE(wheel.advance(10, [&](TimingWheel::Timer&) { ++fired; }, [&] { return ++calls > 4; }));
+    EXPECT_EQ(fired, 4);
+    EXPECT_TRUE(wheel.advance(10, [&](TimingWheel::Timer&) { ++fired; }, [] { return false; }));
+    EXPECT_EQ(fired, 10) << "the next advance resumes where the previous stopped";
+}
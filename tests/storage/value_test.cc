@@ -0,0 +1,132 @@
+#include "storage/value.h"
+
+#include <cstring>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+
+#include "storage/slab.h"
+
+using namespace redis;
+
+// raw values are allocated from the current slab allocator, like in a shard
+class ValueTest : public testing::Test
+{
+protected:
+    SlabAllocator slab_;
+    SlabAllocator::Scope scope_{slab_};
+};
+
+std::string value_of(const Value& value)
+{
+    Value::IntText scratch;
+    return std::string(value.str(scratch));
+}
+
+TEST_F(ValueTest, Encodings)
+{
+    const std::string embedded = "hello";
+    const Value small(embedded);
+    EXPECT_EQ(small.encoding(), Value::Encoding::Embedded);
+    EXPECT_EQ(value_of(small), embedded);
+    EXPECT_EQ(small.size(), embedded.size());
+    EXPECT_EQ(small.heap_size(), 0);
+
+    const std::string full(Value::EMBEDDED_CAPACITY, 'x');
+    EXPECT_EQ(Value(full).encoding(), Value::Encoding::Embedded);
+
+    const std::string raw(Value::EMBEDDED_CAPACITY + 1, 'y');
+    const Value large(raw);
+    EXPECT_EQ(large.encoding(), Value::Encoding::Raw);
+    EXPECT_EQ(value_of(large), raw);
+    EXPECT_EQ(large.heap_size(), raw.size());
+
+    const Value empty(std::string_view(""));
+    EXPECT_EQ(empty.encoding(), Value::Encoding::Embedded);
+    EXPECT_EQ(value_of(empty), "");
+}
+
+TEST_F(ValueTest, Integers)
+{
+    for (const std::string text: {"0", "-1", "42", "9223372036854775807", "-9223372036854775808"})
+    {
+        const Value value(text);
+        EXPECT_EQ(value.encoding(), Value::Encoding::Int) << text;
+        EXPECT_EQ(value_of(value), text);
+        EXPECT_EQ(value.size(), text.size());
+    }
+    // strings which would not come back as they were given are kept as strings
+    for (const std::string text: {"-0", "007", "+1", " 1", "1 ", "1.5", "9223372036854775808", "-"})
+    {
+        const Value value(text);
+        EXPECT_NE(value.encoding(), Value::Encoding::Int) << text;
+        EXPECT_EQ(value_of(value), text);
+    }
+    EXPECT_EQ(Value::from_int(-12).integer(), -12);
+    EXPECT_EQ(Value(std::string_view("abc")).integer(), std::nullopt);
+}
+
+TEST_F(ValueTest, MoveAndMeta)
+{
+    const std::string raw(100, 'z');
+    Value a(raw);
+    a.set_meta(0xABCDEF);
+    Value b(std::move(a));
+    EXPECT_EQ(value_of(b), raw);
+    EXPECT_EQ(b.meta(), 0xABCDEF);
+    EXPECT_EQ(b.encoding(), Value::Encoding::Raw) << "meta does not touch the encoding";
+
+    Value c(std::string_view("short"));
+    c = std::move(b);
+    EXPECT_EQ(value_of(c), raw);
+    c = Value::from_int(7);
+    EXPECT_EQ(value_of(c), "7");
+    EXPECT_EQ(slab_.stats().used, 0) << "the raw buffer was freed";
+}
+
+TEST_F(ValueTest, Pin)
+{
+    EXPECT_TRUE(Value(std::string(SlabAllocator::MAX_SMALL, 'x')).pin().empty()) << "small blocks are not pinned";
+
+    const std::string raw(SlabAllocator::MAX_SMALL + 1, 'z');
+    Value::Pin pin;
+    {
+        const Value large(raw);
+        pin = large.pin();
+        ASSERT_FALSE(pin.empty());
+        Value::IntText scratch;
+        EXPECT_EQ(pin.bytes().data(), large.str(scratch).data()) << "the bytes are referenced, not copied";
+    }
+    EXPECT_EQ(slab_.stats().used, 0) << "the value is accounted as freed";
+    EXPECT_EQ(pin.bytes(), raw) << "the pinned bytes outlive the value";
+    pin.reset();
+    EXPECT_TRUE(pin.empty());
+}
+
+TEST_F(ValueTest, Adopt)
+{
+    Value::Buffer buffer(SlabAllocator::MAX_SMALL * 2);
+    std::memset(buffer.data(), 'a', buffer.size());
+    const auto* data = buffer.data();
+    EXPECT_EQ(slab_.stats().used, 0) << "a buffer belongs to no allocator";
+
+    const auto value = Value::adopt(std::move(buffer));
+    EXPECT_TRUE(buffer.empty());
+    EXPECT_EQ(value.encoding(), Value::Encoding::Raw);
+    EXPECT_EQ(value_of(value), std::string(SlabAllocator::MAX_SMALL * 2, 'a'));
+    Value::IntText scratch;
+    EXPECT_EQ(value.str(scratch).data(), data) << "the bytes are not copied";
+    EXPECT_EQ(slab_.stats().used, SlabAllocator::MAX_SMALL * 2);
+
+    // a buffer never adopted is freed on its own
+    const Value::Buffer unused(SlabAllocator::MAX_SMALL + 1);
+}
+
+TEST_F(ValueTest, RejectsValuesOverMaxSize)
+{
+    // the size is checked before anything is read or allocated
+    const char byte = 'a';
+    EXPECT_THROW(Value(std::span(&byte, Value::MAX_SIZE + 1)), std::length_error);
+    EXPECT_THROW(Value::Buffer(Value::MAX_SIZE + 1), std::length_error);
+    EXPECT_EQ(slab_.stats().used, 0);
+}
@@ -0,0 +1,56 @@
+#include "strings.hh"
+
+#include <gtest/gtest.h>
+
+using utils::glob_match;
+
+TEST(GlobTest, Literals)
+{
+    EXPECT_TRUE(glob_match("key", "key"));
+    EXPECT_FALSE(glob_match("key", "keys"));
+    EXPECT_TRUE(glob_match("", ""));
+}
+
+TEST(GlobTest, Wildcards)
+{
+    EXPECT_TRUE(glob_match("*", "anything"));
+    EXPECT_TRUE(glob_match("user:*", "user:42"));
+    EXPECT_FALSE(glob_match("user:*", "session:42"));
+    EXPECT_TRUE(glob_match("*:42", "user:42"));
+    EXPECT_TRUE(glob_match("h?llo", "hello"));
+    EXPECT_FALSE(glob_match("h?llo", "hllo"));
+    EXPECT_TRUE(glob_match("a*b*c", "aXXbYYbc"));
+}
+
+TEST(GlobTest, Classes)
+{
+    EXPECT_TRUE(glob_match("h[ae]llo", "hallo"));
+    EXPECT_FALSE(glob_match("h[ae]llo", "hillo"));
+    EXPECT_TRUE(glob_match("h[^e]llo", "hallo"));
+    EXPECT_FALSE(glob_match("h[^e]llo", "hello"));
+    EXPECT_TRUE(glob_match("id:[0-9]", "id:7"));
+    EXPECT_FALSE(glob_match("id:[0-9]", "id:x"));
+}
+
+TEST(GlobTest, Escape)
+{
+    EXPECT_TRUE(glob_match("a\\*", "a*"));
+    EXPECT_FALSE(glob_match("a\\*", "ab"));
+}
+
+TEST(StringsTest, ParseInt)
+{
+    int64_t value = 0;
+    EXPECT_TRUE(utils::parse_int("-42", value));
+    EXPECT_EQ(value, -42);
+    EXPECT_FALSE(utils::parse_int("42x", value));
+    EXPECT_FALSE(utils::parse_int("", value));
+    EXPECT_FALSE(utils::parse_int("99999999999999999999", value));
+}
+
+TEST(StringsTest, EqualsIgnoreCase)
+{
+    EXPECT_TRUE(utils::equals_ignore_case("pxAt", "PXAT"));
+    EXPECT_FALSE(utils::equals_ignore_case("pxa", "PXAT"));
+    EXPECT_FALSE(utils::equals_ignore_case("PXAT", "pxat")) << "the name is upper case";
+}